@@ -0,0 +1,30 @@
+#!/bin/sh
+# Times map insertion, lookup and iteration at 1K, 1M and 10M entries: bench/maps.sh [path/to/clox]
+# Bytes per entry are the growth of the peak resident set reported by --stats over a 1K-entry run, so they include
+# allocator overhead but are only meaningful for the large maps.
+LOX=${1:-./clox}
+DIR=$(dirname "$0")
+SCRIPT=$(mktemp)
+trap 'rm -f "$SCRIPT"' EXIT
+
+configure() {
+    sed -e "s/^var n = .*/var n = $1;/" -e "s/^var phases = .*/var phases = $2;/" "$DIR/maps.lox" > "$SCRIPT"
+}
+
+peak() {
+    configure "$1" 1
+    "$LOX" --stats "$SCRIPT" 2>&1 >/dev/null | awk '/peak resident set/ { print $4 }'
+}
+
+baseline=$(peak 1000)
+printf "%-10s %10s %10s %10s %12s\n" entries "insert ns" "lookup ns" "iterate ns" "bytes/entry"
+for n in 1000 1000000 10000000; do
+    configure "$n" 3
+    times=$("$LOX" "$SCRIPT" | tr '\n' ' ')
+    memory=$(peak "$n")
+    awk -v n="$n" -v times="$times" -v memory="$memory" -v baseline="$baseline" 'BEGIN {
+        split(times, t, " ")
+        bytes = n >= 1000000 ? sprintf("%.1f", (memory - baseline) * 1024 / n) : "-"
+        printf "%-10d %10.1f %10.1f %10.1f %12s\n", n, t[1], t[2], t[3], bytes
+    }'
+done
@@ -0,0 +1,15 @@
+#!/bin/sh
+# Times every benchmark under each engine: bench/run.sh [path/to/clox]
+LOX=${1:-./clox}
+ENGINES=${ENGINES:-visitor closure bytecode}
+DIR=$(dirname "$0")
+
+for script in "$DIR"/*.lox; do
+    for engine in $ENGINES; do
+        start=$(date +%s.%N)
+        "$LOX" --engine "$engine" "$script" > /dev/null || echo "$script failed under $engine"
+        end=$(date +%s.%N)
+        awk -v name="$(basename "$script")" -v engine="$engine" -v start="$start" -v end="$end" \
+            'BEGIN { printf "%-16s %-8s %6.3fs\n", name, engine, end - start }'
+    done
+done
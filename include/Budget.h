@@ -0,0 +1,36 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// What one run of a script may spend, set by --fuel and --deadline: a number of safepoints, each a loop iteration or
+// a call, and wall-clock time. The interpreter and the parallel workers draw on it a batch of safepoints at a time,
+// checking the deadline as they do, so counting costs a decrement and a branch per safepoint.
+class Budget {
+ public:
+    using Clock = std::chrono::steady_clock;
+
+    // Both limits default to 0, meaning none.
+    void setFuel(std::uint64_t fuel);
+    void setTimeLimit(std::chrono::milliseconds limit);
+    bool limited() const;
+    // Refills the budget for a new run.
+    void start();
+
+    // The safepoints the caller may pass before drawing again. Once the fuel or the time is used up it returns 0 and
+    // sets error to the message to report.
+    std::int64_t draw(const char *&error);
+    // Milliseconds a wait of wait milliseconds, or of any length if negative, may last before the deadline.
+    int clampWait(int wait) const;
+    bool pastDeadline() const;
+
+ private:
+    // Between deadline checks, and so the fuel a worker may hold but not use when it finishes.
+    static constexpr std::int64_t BATCH = 1024;
+
+    std::uint64_t fuel = 0;
+    std::chrono::milliseconds timeLimit{0};
+    std::atomic<std::int64_t> fuelLeft{0};
+    Clock::time_point deadline = Clock::time_point::max();
+};
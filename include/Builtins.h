@@ -0,0 +1,37 @@
+#pragma once
+
+#include <any>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "Ref.h"
+#include "Token.h"
+
+class Interpreter;
+
+// A function implemented in C++. Its body gets the evaluated arguments in place and reports a misuse by throwing a
+// RuntimeError at the call's closing parenthesis. The last optional ones of its arity may be left out of a call, and
+// then arrive as nil.
+class LoxNative : public RefCounted {
+ public:
+    using Body = std::any (*)(Interpreter &interpreter, const Token &paren, std::any *arguments);
+
+    LoxNative(std::string name, std::size_t arity, Body body, std::size_t optional = 0);
+
+    std::string toString() const;
+
+    const std::string name;
+    const std::size_t arity;
+    const Body body;
+    const std::size_t optional;
+};
+
+// The tree-walker's global functions: clock; len and push for arrays; has, remove, keys and values for maps; the
+// numeric kernels sum, dot, scale, axpy, min, max and sort, which work on the unboxed elements of arrays holding only
+// numbers; parallelMap and parallelReduce, see Parallel.h; next and done for the fibers generators return;
+// setTimeout, sleep, readFile and readLines, see EventLoop.h; and openFile, readLine, readAll and split, see
+// LoxFile.h.
+std::vector<Ref<LoxNative>> builtins();
+// Whether name is one of the above, which the other engines leave to the tree-walker.
+bool isBuiltin(const std::string &name);
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Stmt.h"
+#include "Value.h"
+
+// Three-address instructions over the registers of the running frame: R[a] is a register, K[b] a constant,
+// G[b] a global, U[b] an upvalue of the running closure.
+enum class OpCode : std::uint8_t {
+    MOVE,           // R[a] = R[b]
+    LOAD_CONSTANT,  // R[a] = K[b]
+    GET_GLOBAL,     // R[a] = G[b]
+    DEFINE_GLOBAL,  // G[b] = R[a]
+    SET_GLOBAL,     // G[b] = R[a], which must already be defined
+    BOX,            // R[a] = a new cell holding R[a]
+    GET_CELL,       // R[a] = the value in cell R[b]
+    SET_CELL,       // the value in cell R[a] = R[b]
+    GET_UPVALUE,    // R[a] = U[b]
+    SET_UPVALUE,    // U[b] = R[a]
+
+    // R[a] = R[b] op R[c], or op K[c] with the CONSTANT flag. After their first execution these rewrite themselves
+    // into one of the quickened variants below, or stay generic for good with the GENERIC flag.
+    ADD,
+    SUBTRACT,
+    MULTIPLY,
+    DIVIDE,
+    GREATER,
+    GREATER_EQUAL,
+    LESS,
+    LESS_EQUAL,
+    EQUAL,
+    NOT_EQUAL,
+
+    ADD_NUMBER,
+    SUBTRACT_NUMBER,
+    MULTIPLY_NUMBER,
+    DIVIDE_NUMBER,
+    GREATER_NUMBER,
+    GREATER_EQUAL_NUMBER,
+    LESS_NUMBER,
+    LESS_EQUAL_NUMBER,
+    EQUAL_NUMBER,
+    NOT_EQUAL_NUMBER,
+
+    ADD_NUMBER_CONSTANT,
+    SUBTRACT_NUMBER_CONSTANT,
+    MULTIPLY_NUMBER_CONSTANT,
+    DIVIDE_NUMBER_CONSTANT,
+    GREATER_NUMBER_CONSTANT,
+    GREATER_EQUAL_NUMBER_CONSTANT,
+    LESS_NUMBER_CONSTANT,
+    LESS_EQUAL_NUMBER_CONSTANT,
+    EQUAL_NUMBER_CONSTANT,
+    NOT_EQUAL_NUMBER_CONSTANT,
+
+    ADD_STRING,
+
+    NEGATE,         // R[a] = -R[b]
+    NOT,            // R[a] = !R[b]
+    JUMP,           // go to target
+    JUMP_IF_FALSE,  // go to target if R[a] is falsey
+    JUMP_IF_TRUE,   // go to target if R[a] is truthy
+    CALL,           // R[a] = R[b](R[b + 1], ..., R[b + c])
+    TAIL_CALL,      // return R[b](R[b + 1], ..., R[b + c]) in place of the running frame
+    RETURN,         // return R[a]
+    RETURN_NIL,
+    CLOSURE,        // R[a] = a closure over the b-th nested prototype
+    PRINT,          // print R[a]
+};
+
+// Distance from a generic binary opcode to its quickened variants.
+constexpr int NUMBER_VARIANT = static_cast<int>(OpCode::ADD_NUMBER) - static_cast<int>(OpCode::ADD);
+constexpr int NUMBER_CONSTANT_VARIANT = static_cast<int>(OpCode::ADD_NUMBER_CONSTANT) - static_cast<int>(OpCode::ADD);
+
+struct Instruction {
+    static constexpr std::uint8_t CONSTANT = 1;
+    static constexpr std::uint8_t GENERIC = 2;
+
+    OpCode op;
+    std::uint8_t flags;
+    std::uint16_t a;
+    std::uint16_t b;
+    std::uint16_t c;
+
+    // Jumps keep their target in b and c.
+    std::uint32_t target() const {
+        return b | static_cast<std::uint32_t>(c) << 16;
+    }
+
+    void setTarget(std::uint32_t target) {
+        b = target & 0xFFFF;
+        c = target >> 16;
+    }
+};
+
+// The compiled form of one function body, or of a chunk of top-level code.
+struct Proto {
+    std::string name;
+    std::size_t arity = 0;
+    // Locals first, then the temporaries of expressions and call arguments.
+    std::size_t registers = 0;
+    std::vector<Instruction> code;
+    std::vector<int> lines;
+    std::vector<Value> constants;
+    std::vector<std::shared_ptr<Proto>> prototypes;
+    std::vector<FunctionStmt::UpvalueSource> upvalues;
+    std::vector<std::uint16_t> boxedParameters;
+};
+
+struct CellObj : Obj {
+    Value value;
+
+    explicit CellObj(Value value) : value{std::move(value)} {}
+};
+
+struct ClosureObj : Obj {
+    std::shared_ptr<Proto> proto;
+    std::vector<Ref<CellObj>> upvalues;
+
+    explicit ClosureObj(std::shared_ptr<Proto> proto) : proto{std::move(proto)} {}
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "Bytecode.h"
+#include "Expr.h"
+#include "Stmt.h"
+
+class VM;
+
+// Translates the resolved AST into register bytecode. Locals use the frame slots the Resolver picked as their
+// registers, so instructions read and write them in place; temporaries are allocated above them like a stack.
+class BytecodeCompiler : public ExprVisitor, public StmtVisitor {
+ public:
+    BytecodeCompiler(VM &vm, std::shared_ptr<Proto> proto, std::size_t frameSize);
+    void compile(const std::vector<std::shared_ptr<Stmt>> &statements);
+
+    std::any visitArrayExpr(ArrayExpr &expr) override;
+    std::any visitAssignExpr(AssignExpr &expr) override;
+    std::any visitBinaryExpr(BinaryExpr &expr) override;
+    std::any visitCallExpr(CallExpr &expr) override;
+    std::any visitGetExpr(GetExpr &expr) override;
+    std::any visitGroupingExpr(GroupingExpr &expr) override;
+    std::any visitIndexExpr(IndexExpr &expr) override;
+    std::any visitLiteralExpr(LiteralExpr &expr) override;
+    std::any visitLogicalExpr(LogicalExpr &expr) override;
+    std::any visitMapExpr(MapExpr &expr) override;
+    std::any visitSetExpr(SetExpr &expr) override;
+    std::any visitSetIndexExpr(SetIndexExpr &expr) override;
+    std::any visitSuperExpr(SuperExpr &expr) override;
+    std::any visitThisExpr(ThisExpr &expr) override;
+    std::any visitUnaryExpr(UnaryExpr &expr) override;
+    std::any visitVariableExpr(VariableExpr &expr) override;
+    void visitBlockStmt(BlockStmt &stmt) override;
+    void visitClassStmt(ClassStmt &stmt) override;
+    void visitExpressionStmt(ExpressionStmt &stmt) override;
+    void visitFunctionStmt(FunctionStmt &stmt) override;
+    void visitIfStmt(IfStmt &stmt) override;
+    void visitPrintStmt(PrintStmt &stmt) override;
+    void visitReturnStmt(ReturnStmt &stmt) override;
+    void visitWhileStmt(WhileStmt &stmt) override;
+    void visitVarStmt(VarStmt &stmt) override;
+    void visitYieldStmt(YieldStmt &stmt) override;
+
+ private:
+    // Target register of an assignment whose value nobody reads.
+    static constexpr int DISCARD = -1;
+
+    VM &vm;
+    std::shared_ptr<Proto> proto;
+    const std::size_t frameSize;
+    std::size_t top;
+    int target = DISCARD;
+    int line = 0;
+
+    std::size_t emit(OpCode op, int a, int b = 0, int c = 0, std::uint8_t flags = 0);
+    std::size_t emitJump(OpCode op, int a = 0);
+    void patchJump(std::size_t jump);
+    void emitLoop(std::size_t start);
+    int addConstant(Value value);
+    int allocate(std::size_t count = 1);
+
+    void compile(const std::shared_ptr<Stmt> &stmt);
+    void compileInto(const std::shared_ptr<Expr> &expr, int dest);
+    int compileOperand(const std::shared_ptr<Expr> &expr);
+    int compileCall(const CallExpr &call);
+    int localRegister(const std::shared_ptr<Expr> &expr);
+    bool constantOperand(const std::shared_ptr<Expr> &expr, int &index);
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <any>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Ref.h"
+#include "Stmt.h"
+#include "Token.h"
+#include "Upvalue.h"
+
+// Runs programs by lowering the resolved AST once into a tree of pre-bound closures. Slots, operators and constant
+// operands are fixed while lowering, so executing a node is one indirect call instead of a visitor dispatch.
+class ClosureEngine {
+ public:
+    // Thrown while lowering a program the engine cannot run; the caller falls back to another engine.
+    struct Unsupported {
+        const char *reason;
+    };
+
+    ClosureEngine();
+    // frameSize is the slot count the Resolver reported for top-level blocks. Returns false, without running
+    // anything, when the program cannot be lowered.
+    bool interpret(const std::vector<std::shared_ptr<Stmt>> &statements, std::size_t frameSize);
+    void setMaxCallDepth(std::size_t depth);
+
+ private:
+    class Compiler;
+    class CallGuard;
+
+    using Evaluate = std::function<std::any()>;
+    // Returns true once a return statement has run, which stops the enclosing statements.
+    using Execute = std::function<bool()>;
+
+    struct GlobalCell {
+        bool defined = false;
+        std::any value;
+    };
+
+    struct CompiledFunction {
+        std::string name;
+        std::size_t arity;
+        // Slots the body touches: its locals, then the arguments of the calls it makes.
+        std::size_t frameExtent;
+        std::vector<std::size_t> boxedParameters;
+        Execute body;
+    };
+
+    // The runtime value of a function declaration, the counterpart of LoxFunction.
+    struct Function : RefCounted {
+        std::shared_ptr<CompiledFunction> code;
+        std::vector<Ref<Upvalue>> upvalues;
+    };
+
+    std::vector<std::any> stack;
+    std::size_t base = 0;
+    Function *function = nullptr;
+    std::size_t depth = 0;
+    std::size_t maxCallDepth;
+    std::uintptr_t nativeStackLimit = 0;
+    std::any returnValue;
+    // Set by a return statement that hands its frame over to a call in tail position.
+    Ref<Function> tailCall;
+    // Looked up only while compiling; compiled code holds on to the cells.
+    std::unordered_map<std::string, std::shared_ptr<GlobalCell>> globals;
+
+    std::shared_ptr<GlobalCell> globalCell(const std::string &name);
+    void reserveStack(std::size_t size);
+    Function *checkCallee(std::any &callee, const Token &paren, std::size_t argumentBase, std::size_t argumentCount);
+    std::any call(Function *callee, std::size_t callBase, const Token &paren);
+    std::string stringify(const std::any &object);
+};
@@ -2,28 +2,60 @@
 
 #include <any>
 #include <map>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "RuntimeError.h"
 #include "Token.h"
 
-class Environment : public std::enable_shared_from_this<Environment> {
+class Environment {
     friend class Interpreter;
+    friend class Jit;
 
  public:
     Environment();
     Environment(std::shared_ptr<Environment> enclosing);
+    // Returns the index of name's slot, adding one that is not defined yet the first time. The resolver gives every
+    // global reference its slot this way, so running the program only indexes values.
+    std::size_t slot(const std::string &name);
     void define(const std::string &name, std::any value);
     void assign(const Token &name, std::any value);
-    void assignAt(int distance, const Token &name, std::any value);
     std::any get(const Token &name);
-    std::any getAt(int distance, const std::string &name);
-    std::shared_ptr<Environment> ancestor(int distance);
+
+    void define(std::size_t slot, std::any value) {
+        values[slot] = std::move(value);
+    }
+
+    void assign(const Token &name, std::size_t slot, std::any value) {
+        std::any &current = values[slot];
+        if (!current.has_value()) {
+            undefined(name);
+        }
+        current = std::move(value);
+    }
+
+    // The value in slot, or nullptr while it is not defined.
+    const std::any *find(std::size_t slot) const {
+        const std::any &value = values[slot];
+        return value.has_value() ? &value : nullptr;
+    }
+
+    const std::any &get(const Token &name, std::size_t slot) const {
+        const std::any &value = values[slot];
+        if (!value.has_value()) {
+            undefined(name);
+        }
+        return value;
+    }
 
     std::shared_ptr<Environment> enclosing;
 
  private:
     void print_values();
+    [[noreturn]] static void undefined(const Token &name);
 
-    std::map<std::string, std::any> values;
-};
\ No newline at end of file
+    std::map<std::string, std::size_t> slots;
+    // Lox's nil is a nullptr, so an empty std::any can mark a slot that is not defined yet.
+    std::vector<std::any> values;
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <any>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "Token.h"
+
+class Interpreter;
+
+// setTimeout(fn, ms) calls fn after ms milliseconds; sleep(ms) waits that long. readFile(path, fn) reads the whole
+// text of a file or pipe, and readLines(path, fn) reads it line by line. Given fn, those two return at once and the
+// event loop calls fn with the text later, readLines once per line and then once with nil. Without fn, they and sleep
+// return the result themselves: in a fiber, they suspend it meanwhile so the loop can run other work; outside one,
+// they block, and readLines returns an array of the lines.
+std::any setTimeout(Interpreter &interpreter, const Token &paren, std::any *arguments);
+std::any sleepFor(Interpreter &interpreter, const Token &paren, std::any *arguments);
+std::any readFile(Interpreter &interpreter, const Token &paren, std::any *arguments);
+std::any readLines(Interpreter &interpreter, const Token &paren, std::any *arguments);
+
+// The timers and reads the builtins above wait on, which the interpreter runs once the top-level code has finished.
+// Pipes and the other descriptors epoll supports are waited on with it; regular files, which it does not support and
+// which never block for long, are read a chunk at a time in between the other work.
+class EventLoop {
+ public:
+    EventLoop();
+    ~EventLoop();
+    EventLoop(const EventLoop &) = delete;
+    EventLoop &operator=(const EventLoop &) = delete;
+
+    // target is the function to call with the result, or the fiber to wake with it.
+    void addTimer(double milliseconds, std::any target, const Token &paren);
+    void addRead(const std::string &path, bool lines, std::any target, const Token &paren);
+    // Calls back and wakes fibers as timers expire and input arrives, until nothing is left to wait on.
+    void run(Interpreter &interpreter);
+    void clear();
+
+ private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Timer {
+        Clock::time_point deadline;
+        // Timers due at the same time run in the order they were set.
+        std::uint64_t sequence;
+        std::any target;
+        Token paren;
+    };
+
+    struct Later {
+        bool operator()(const Timer &a, const Timer &b) const;
+    };
+
+    struct Read;
+
+    std::priority_queue<Timer, std::vector<Timer>, Later> timers;
+    std::uint64_t timersSet = 0;
+    // By the order they were started in, which is also the order the unpolled ones are read in.
+    std::map<std::uint64_t, std::unique_ptr<Read>> reads;
+    std::uint64_t readsStarted = 0;
+    std::vector<char> buffer;
+    int poller = -1;
+
+    void readChunk(Interpreter &interpreter, std::uint64_t id);
+    void deliverLines(Interpreter &interpreter, Read &read);
+    void finish(Interpreter &interpreter, std::unique_ptr<Read> read);
+    int timeout(bool unpolled) const;
+};
@@ -1,46 +1,154 @@
 #pragma once
 
 #include <any>
+#include <cstdint>
 #include <memory>
+#include <typeinfo>
 #include <utility>  // std::move
 #include <vector>
 
+#include "LoxClass.h"
 #include "Token.h"
 
+struct ArrayExpr;
 struct AssignExpr;
 struct BinaryExpr;
 struct CallExpr;
+struct GetExpr;
 struct GroupingExpr;
+struct IndexExpr;
 struct LiteralExpr;
 struct LogicalExpr;
+struct MapExpr;
+struct SetExpr;
+struct SetIndexExpr;
+struct SuperExpr;
+struct ThisExpr;
 struct UnaryExpr;
 struct VariableExpr;
+struct FunctionStmt;
+
+// Where a variable lives at runtime, filled in by the Resolver. Locals index the current call frame; a BOXED local
+// holds a shared Upvalue because some closure captures it; UPVALUE indexes the running closure's captured cells.
+// A NUMBER local is one the TypeInference pass proved only ever holds numbers, kept as a raw double.
+struct VariableBinding {
+    enum class Kind {
+        GLOBAL,
+        LOCAL,
+        BOXED,
+        UPVALUE,
+        NUMBER,
+    };
+
+    Kind kind = Kind::GLOBAL;
+    int index = 0;
+};
+
+// Runtime type feedback: a node rewrites itself into the variant matching the operand types it has seen, and
+// falls back to the generic form for good once one of that variant's guards fails.
+enum class BinarySpecialization {
+    UNINITIALIZED,
+    NUMBER_ADD,
+    NUMBER_SUBTRACT,
+    NUMBER_MULTIPLY,
+    NUMBER_DIVIDE,
+    NUMBER_GREATER,
+    NUMBER_GREATER_EQUAL,
+    NUMBER_LESS,
+    NUMBER_LESS_EQUAL,
+    NUMBER_EQUAL,
+    NUMBER_NOT_EQUAL,
+    STRING_CONCAT,
+    GENERIC,
+};
+
+// Evaluations that took the specialized path, and those that needed the generic one.
+struct SpecializationStats {
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+};
+
+// A monomorphic inline cache for one property access: the last shape seen there and what that shape resolves the
+// property to. A hit is a pointer compare and an indexed load; anything else looks the property up and refills it.
+struct PropertyCache {
+    Ref<Shape> shape;
+    // The field's slot, or -1 when the property is the method below.
+    int slot = -1;
+    Ref<LoxFunction> method;
+    // For assignments that add the field: the shape the instance moves to.
+    Ref<Shape> transition;
+    SpecializationStats stats;
+};
 
 struct ExprVisitor {
-    virtual std::any visitAssignExpr(std::shared_ptr<AssignExpr> expr) = 0;
-    virtual std::any visitBinaryExpr(std::shared_ptr<BinaryExpr> expr) = 0;
-    virtual std::any visitCallExpr(std::shared_ptr<CallExpr> expr) = 0;
-    virtual std::any visitGroupingExpr(std::shared_ptr<GroupingExpr> expr) = 0;
-    virtual std::any visitLiteralExpr(std::shared_ptr<LiteralExpr> expr) = 0;
-    virtual std::any visitLogicalExpr(std::shared_ptr<LogicalExpr> expr) = 0;
-    virtual std::any visitUnaryExpr(std::shared_ptr<UnaryExpr> expr) = 0;
-    virtual std::any visitVariableExpr(std::shared_ptr<VariableExpr> expr) = 0;
+    virtual std::any visitArrayExpr(ArrayExpr& expr) = 0;
+    virtual std::any visitAssignExpr(AssignExpr& expr) = 0;
+    virtual std::any visitBinaryExpr(BinaryExpr& expr) = 0;
+    virtual std::any visitCallExpr(CallExpr& expr) = 0;
+    virtual std::any visitGetExpr(GetExpr& expr) = 0;
+    virtual std::any visitGroupingExpr(GroupingExpr& expr) = 0;
+    virtual std::any visitIndexExpr(IndexExpr& expr) = 0;
+    virtual std::any visitLiteralExpr(LiteralExpr& expr) = 0;
+    virtual std::any visitLogicalExpr(LogicalExpr& expr) = 0;
+    virtual std::any visitMapExpr(MapExpr& expr) = 0;
+    virtual std::any visitSetExpr(SetExpr& expr) = 0;
+    virtual std::any visitSetIndexExpr(SetIndexExpr& expr) = 0;
+    virtual std::any visitSuperExpr(SuperExpr& expr) = 0;
+    virtual std::any visitThisExpr(ThisExpr& expr) = 0;
+    virtual std::any visitUnaryExpr(UnaryExpr& expr) = 0;
+    virtual std::any visitVariableExpr(VariableExpr& expr) = 0;
     ~ExprVisitor() = default;
 };
 
+// Evaluates an expression TypeInference proved to be a number straight to a double, see Expr::isNumber.
+struct NumberVisitor {
+    virtual double visitAssignNumber(AssignExpr& expr) = 0;
+    virtual double visitBinaryNumber(BinaryExpr& expr) = 0;
+    virtual double visitGroupingNumber(GroupingExpr& expr) = 0;
+    virtual double visitLiteralNumber(LiteralExpr& expr) = 0;
+    virtual double visitUnaryNumber(UnaryExpr& expr) = 0;
+    virtual double visitVariableNumber(VariableExpr& expr) = 0;
+    ~NumberVisitor() = default;
+};
+
 struct Expr {
     virtual std::any accept(ExprVisitor& visitor) = 0;
+
+    // Only called when isNumber is set, which TypeInference never does for calls or logical operators.
+    virtual double acceptNumber(NumberVisitor& visitor) {
+        return 0;
+    }
+
+    // Set by TypeInference when every evaluation that completes yields a number.
+    bool isNumber = false;
+};
+
+struct ArrayExpr final : Expr, public std::enable_shared_from_this<ArrayExpr> {
+    ArrayExpr(Token bracket, std::vector<std::shared_ptr<Expr>> elements)
+        : bracket{std::move(bracket)}, elements{std::move(elements)} {}
+
+    std::any accept(ExprVisitor& visitor) override {
+        return visitor.visitArrayExpr(*this);
+    }
+
+    const Token bracket;
+    const std::vector<std::shared_ptr<Expr>> elements;
 };
 
 struct AssignExpr final : Expr, public std::enable_shared_from_this<AssignExpr> {
     AssignExpr(Token name, std::shared_ptr<Expr> value) : name{std::move(name)}, value{std::move(value)} {}
 
     std::any accept(ExprVisitor& visitor) override {
-        return visitor.visitAssignExpr(shared_from_this());
+        return visitor.visitAssignExpr(*this);
+    }
+
+    double acceptNumber(NumberVisitor& visitor) override {
+        return visitor.visitAssignNumber(*this);
     }
 
     const Token name;
     const std::shared_ptr<Expr> value;
+    VariableBinding binding;
 };
 
 struct BinaryExpr final : Expr, public std::enable_shared_from_this<BinaryExpr> {
@@ -48,12 +156,28 @@ struct BinaryExpr final : Expr, public std::enable_shared_from_this<BinaryExpr>
         : left{std::move(left)}, op{std::move(op)}, right{std::move(right)} {}
 
     std::any accept(ExprVisitor& visitor) override {
-        return visitor.visitBinaryExpr(shared_from_this());
+        return visitor.visitBinaryExpr(*this);
+    }
+
+    double acceptNumber(NumberVisitor& visitor) override {
+        return visitor.visitBinaryNumber(*this);
     }
 
     const std::shared_ptr<Expr> left;
     const Token op;
     const std::shared_ptr<Expr> right;
+    BinarySpecialization specialization = BinarySpecialization::UNINITIALIZED;
+    SpecializationStats stats;
+    // Set by TypeInference when both operands are proven numbers, so no type feedback is needed.
+    bool numberOperands = false;
+};
+
+// A call the Inliner replaced with a copy of the callee's returned expression, whose parameters live in extra slots
+// of the caller's frame. It only stands in for the call while the global still holds the function it came from.
+struct InlinedCall {
+    const FunctionStmt* declaration;
+    std::vector<VariableBinding> parameters;
+    std::shared_ptr<Expr> body;
 };
 
 struct CallExpr final : Expr, public std::enable_shared_from_this<CallExpr> {
@@ -61,32 +185,72 @@ struct CallExpr final : Expr, public std::enable_shared_from_this<CallExpr> {
         : callee{std::move(callee)}, paren{std::move(paren)}, arguments{std::move(arguments)} {}
 
     std::any accept(ExprVisitor& visitor) override {
-        return visitor.visitCallExpr(shared_from_this());
+        return visitor.visitCallExpr(*this);
     }
 
     const std::shared_ptr<Expr> callee;
     const Token paren;
     const std::vector<std::shared_ptr<Expr>> arguments;
+    std::unique_ptr<InlinedCall> inlined;
+    // Set by the Resolver when the callee is a property access, so a method is called without binding it first.
+    GetExpr* property = nullptr;
+};
+
+struct GetExpr final : Expr, public std::enable_shared_from_this<GetExpr> {
+    GetExpr(std::shared_ptr<Expr> object, Token name) : object{std::move(object)}, name{std::move(name)} {}
+
+    std::any accept(ExprVisitor& visitor) override {
+        return visitor.visitGetExpr(*this);
+    }
+
+    const std::shared_ptr<Expr> object;
+    const Token name;
+    PropertyCache cache;
 };
 
 struct GroupingExpr final : Expr, public std::enable_shared_from_this<GroupingExpr> {
     GroupingExpr(std::shared_ptr<Expr> expression) : expression{std::move(expression)} {}
 
     std::any accept(ExprVisitor& visitor) override {
-        return visitor.visitGroupingExpr(shared_from_this());
+        return visitor.visitGroupingExpr(*this);
+    }
+
+    double acceptNumber(NumberVisitor& visitor) override {
+        return visitor.visitGroupingNumber(*this);
     }
 
     const std::shared_ptr<Expr> expression;
 };
 
+struct IndexExpr final : Expr, public std::enable_shared_from_this<IndexExpr> {
+    IndexExpr(std::shared_ptr<Expr> object, Token bracket, std::shared_ptr<Expr> index)
+        : object{std::move(object)}, bracket{std::move(bracket)}, index{std::move(index)} {}
+
+    std::any accept(ExprVisitor& visitor) override {
+        return visitor.visitIndexExpr(*this);
+    }
+
+    const std::shared_ptr<Expr> object;
+    const Token bracket;
+    const std::shared_ptr<Expr> index;
+};
+
 struct LiteralExpr final : Expr, public std::enable_shared_from_this<LiteralExpr> {
-    LiteralExpr(std::any value) : value{std::move(value)} {}
+    LiteralExpr(std::any value)
+        : value{std::move(value)},
+          number{this->value.type() == typeid(double) ? std::any_cast<double>(this->value) : 0} {}
 
     std::any accept(ExprVisitor& visitor) override {
-        return visitor.visitLiteralExpr(shared_from_this());
+        return visitor.visitLiteralExpr(*this);
+    }
+
+    double acceptNumber(NumberVisitor& visitor) override {
+        return visitor.visitLiteralNumber(*this);
     }
 
     const std::any value;
+    // The value unwrapped once, for literals that are numbers.
+    const double number;
 };
 
 struct LogicalExpr final : Expr, public std::enable_shared_from_this<LogicalExpr> {
@@ -94,7 +258,7 @@ struct LogicalExpr final : Expr, public std::enable_shared_from_this<LogicalExpr
         : left{std::move(left)}, op{std::move(op)}, right{std::move(right)} {}
 
     std::any accept(ExprVisitor& visitor) override {
-        return visitor.visitLogicalExpr(shared_from_this());
+        return visitor.visitLogicalExpr(*this);
     }
 
     const std::shared_ptr<Expr> left;
@@ -102,11 +266,81 @@ struct LogicalExpr final : Expr, public std::enable_shared_from_this<LogicalExpr
     const std::shared_ptr<Expr> right;
 };
 
+struct MapExpr final : Expr, public std::enable_shared_from_this<MapExpr> {
+    MapExpr(Token brace, std::vector<std::shared_ptr<Expr>> keys, std::vector<std::shared_ptr<Expr>> values)
+        : brace{std::move(brace)}, keys{std::move(keys)}, values{std::move(values)} {}
+
+    std::any accept(ExprVisitor& visitor) override {
+        return visitor.visitMapExpr(*this);
+    }
+
+    const Token brace;
+    const std::vector<std::shared_ptr<Expr>> keys;
+    const std::vector<std::shared_ptr<Expr>> values;
+};
+
+struct SetExpr final : Expr, public std::enable_shared_from_this<SetExpr> {
+    SetExpr(std::shared_ptr<Expr> object, Token name, std::shared_ptr<Expr> value)
+        : object{std::move(object)}, name{std::move(name)}, value{std::move(value)} {}
+
+    std::any accept(ExprVisitor& visitor) override {
+        return visitor.visitSetExpr(*this);
+    }
+
+    const std::shared_ptr<Expr> object;
+    const Token name;
+    const std::shared_ptr<Expr> value;
+    PropertyCache cache;
+};
+
+struct SetIndexExpr final : Expr, public std::enable_shared_from_this<SetIndexExpr> {
+    SetIndexExpr(std::shared_ptr<Expr> object, Token bracket, std::shared_ptr<Expr> index, std::shared_ptr<Expr> value)
+        : object{std::move(object)}, bracket{std::move(bracket)}, index{std::move(index)}, value{std::move(value)} {}
+
+    std::any accept(ExprVisitor& visitor) override {
+        return visitor.visitSetIndexExpr(*this);
+    }
+
+    const std::shared_ptr<Expr> object;
+    const Token bracket;
+    const std::shared_ptr<Expr> index;
+    const std::shared_ptr<Expr> value;
+};
+
+// Reads a method of the superclass, which the Resolver binds as the local 'super' around the class's methods.
+struct SuperExpr final : Expr, public std::enable_shared_from_this<SuperExpr> {
+    SuperExpr(Token keyword, Token method) : keyword{std::move(keyword)}, method{std::move(method)} {}
+
+    std::any accept(ExprVisitor& visitor) override {
+        return visitor.visitSuperExpr(*this);
+    }
+
+    const Token keyword;
+    const Token method;
+    VariableBinding binding;
+    VariableBinding thisBinding;
+};
+
+struct ThisExpr final : Expr, public std::enable_shared_from_this<ThisExpr> {
+    ThisExpr(Token keyword) : keyword{std::move(keyword)} {}
+
+    std::any accept(ExprVisitor& visitor) override {
+        return visitor.visitThisExpr(*this);
+    }
+
+    const Token keyword;
+    VariableBinding binding;
+};
+
 struct UnaryExpr final : Expr, public std::enable_shared_from_this<UnaryExpr> {
     UnaryExpr(Token op, std::shared_ptr<Expr> right) : op{std::move(op)}, right{std::move(right)} {}
 
     std::any accept(ExprVisitor& visitor) override {
-        return visitor.visitUnaryExpr(shared_from_this());
+        return visitor.visitUnaryExpr(*this);
+    }
+
+    double acceptNumber(NumberVisitor& visitor) override {
+        return visitor.visitUnaryNumber(*this);
     }
 
     const Token op;
@@ -117,8 +351,13 @@ struct VariableExpr final : Expr, public std::enable_shared_from_this<VariableEx
     VariableExpr(Token name) : name{std::move(name)} {}
 
     std::any accept(ExprVisitor& visitor) override {
-        return visitor.visitVariableExpr(shared_from_this());
+        return visitor.visitVariableExpr(*this);
+    }
+
+    double acceptNumber(NumberVisitor& visitor) override {
+        return visitor.visitVariableNumber(*this);
     }
 
     const Token name;
+    VariableBinding binding;
 };
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "Expr.h"
+#include "Stmt.h"
+
+// Replaces calls to small global functions with a copy of the expression they return. A function qualifies when it
+// is declared once at top level, never assigned, its body is a single return of at most BUDGET nodes, and that
+// expression does not call the function itself. Each call site gets its own slots in the caller's frame for the
+// parameters, so the copy is re-resolved against those instead of a frame of its own.
+class Inliner : public ExprVisitor, public StmtVisitor {
+ public:
+    static constexpr int BUDGET = 24;
+
+    // Returns the size the top-level frame needs, given the size it had.
+    int inlineCalls(const std::vector<std::shared_ptr<Stmt>> &statements, int frameSize);
+    std::size_t inlinedCalls() const;
+
+    std::any visitArrayExpr(ArrayExpr &expr) override;
+    std::any visitAssignExpr(AssignExpr &expr) override;
+    std::any visitBinaryExpr(BinaryExpr &expr) override;
+    std::any visitCallExpr(CallExpr &expr) override;
+    std::any visitGetExpr(GetExpr &expr) override;
+    std::any visitGroupingExpr(GroupingExpr &expr) override;
+    std::any visitIndexExpr(IndexExpr &expr) override;
+    std::any visitLiteralExpr(LiteralExpr &expr) override;
+    std::any visitLogicalExpr(LogicalExpr &expr) override;
+    std::any visitMapExpr(MapExpr &expr) override;
+    std::any visitSetExpr(SetExpr &expr) override;
+    std::any visitSetIndexExpr(SetIndexExpr &expr) override;
+    std::any visitSuperExpr(SuperExpr &expr) override;
+    std::any visitThisExpr(ThisExpr &expr) override;
+    std::any visitUnaryExpr(UnaryExpr &expr) override;
+    std::any visitVariableExpr(VariableExpr &expr) override;
+    void visitBlockStmt(BlockStmt &stmt) override;
+    void visitClassStmt(ClassStmt &stmt) override;
+    void visitExpressionStmt(ExpressionStmt &stmt) override;
+    void visitFunctionStmt(FunctionStmt &stmt) override;
+    void visitIfStmt(IfStmt &stmt) override;
+    void visitPrintStmt(PrintStmt &stmt) override;
+    void visitReturnStmt(ReturnStmt &stmt) override;
+    void visitWhileStmt(WhileStmt &stmt) override;
+    void visitVarStmt(VarStmt &stmt) override;
+    void visitYieldStmt(YieldStmt &stmt) override;
+
+ private:
+    bool collecting = true;
+    std::map<std::string, std::vector<FunctionStmt *>> globalFunctions;
+    std::set<std::string> assignedGlobals;
+    // Eligible functions by name, with the expression each one returns.
+    std::map<std::string, std::pair<FunctionStmt *, std::shared_ptr<Expr>>> candidates;
+
+    int scriptFrameSize = 0;
+    // Frame size of the function whose body is being walked.
+    int *frameSize = nullptr;
+    std::size_t inlined = 0;
+
+    void walk(const std::vector<std::shared_ptr<Stmt>> &statements);
+    void walk(const std::shared_ptr<Expr> &expr);
+    void walkBody(FunctionStmt &function);
+    void inlineCall(CallExpr &call, FunctionStmt &declaration, const std::shared_ptr<Expr> &body);
+};
@@ -2,63 +2,217 @@
 
 #include <any>
 #include <chrono>
+#include <cstdint>
 #include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
 
+#include "Budget.h"
+#include "Builtins.h"
 #include "Environment.h"
+#include "EventLoop.h"
 #include "Expr.h"
+#include "Jit.h"
+#include "LoxArray.h"
+#include "LoxClass.h"
 #include "LoxCallable.h"
+#include "LoxFunction.h"
+#include "LoxMap.h"
 #include "Stmt.h"
+#include "TypeInference.h"
 
-class Clock : public LoxCallable {
- public:
-    int arity() override {
-        return 0;
-    }
-
-    std::any call(Interpreter &interpreter, std::vector<std::any> arguments) override {
-        auto now = std::chrono::system_clock::now().time_since_epoch();
-        return std::chrono::duration<double>{now}.count() / 1000.0;
-    }
+class LoxFiber;
 
-    std::string toString() override {
-        return "<native fn>";
-    }
-};
-
-class Interpreter : public ExprVisitor, public StmtVisitor {
+class Interpreter : public ExprVisitor, public NumberVisitor, public StmtVisitor {
  public:
     std::shared_ptr<Environment> globals{new Environment};
     Interpreter();
     void interpret(const std::vector<std::shared_ptr<Stmt>> &statements);
-    std::any visitAssignExpr(std::shared_ptr<AssignExpr> expr) override;
-    std::any visitBinaryExpr(std::shared_ptr<BinaryExpr> expr) override;
-    std::any visitCallExpr(std::shared_ptr<CallExpr> expr) override;
-    std::any visitLiteralExpr(std::shared_ptr<LiteralExpr> expr) override;
-    std::any visitLogicalExpr(std::shared_ptr<LogicalExpr> expr) override;
-    std::any visitGroupingExpr(std::shared_ptr<GroupingExpr> expr) override;
-    std::any visitUnaryExpr(std::shared_ptr<UnaryExpr> expr) override;
-    std::any visitVariableExpr(std::shared_ptr<VariableExpr> expr) override;
-    void visitBlockStmt(std::shared_ptr<BlockStmt> stmt) override;
-    void visitExpressionStmt(std::shared_ptr<ExpressionStmt> stmt) override;
-    void visitFunctionStmt(std::shared_ptr<FunctionStmt> stmt) override;
-    void visitIfStmt(std::shared_ptr<IfStmt> stmt) override;
-    void visitPrintStmt(std::shared_ptr<PrintStmt> stmt) override;
-    void visitReturnStmt(std::shared_ptr<ReturnStmt> stmt) override;
-    void visitWhileStmt(std::shared_ptr<WhileStmt> stmt) override;
-    void visitVarStmt(std::shared_ptr<VarStmt> stmt) override;
-    void executeBlock(const std::vector<std::shared_ptr<Stmt>> &statements, std::shared_ptr<Environment> environment);
-    void resolve(std::shared_ptr<Expr> expr, int depth);
+    std::any visitArrayExpr(ArrayExpr &expr) override;
+    std::any visitAssignExpr(AssignExpr &expr) override;
+    std::any visitBinaryExpr(BinaryExpr &expr) override;
+    std::any visitCallExpr(CallExpr &expr) override;
+    std::any visitGetExpr(GetExpr &expr) override;
+    std::any visitLiteralExpr(LiteralExpr &expr) override;
+    std::any visitLogicalExpr(LogicalExpr &expr) override;
+    std::any visitMapExpr(MapExpr &expr) override;
+    std::any visitGroupingExpr(GroupingExpr &expr) override;
+    std::any visitIndexExpr(IndexExpr &expr) override;
+    std::any visitSetExpr(SetExpr &expr) override;
+    std::any visitSetIndexExpr(SetIndexExpr &expr) override;
+    std::any visitSuperExpr(SuperExpr &expr) override;
+    std::any visitThisExpr(ThisExpr &expr) override;
+    std::any visitUnaryExpr(UnaryExpr &expr) override;
+    std::any visitVariableExpr(VariableExpr &expr) override;
+    double visitAssignNumber(AssignExpr &expr) override;
+    double visitBinaryNumber(BinaryExpr &expr) override;
+    double visitGroupingNumber(GroupingExpr &expr) override;
+    double visitLiteralNumber(LiteralExpr &expr) override;
+    double visitUnaryNumber(UnaryExpr &expr) override;
+    double visitVariableNumber(VariableExpr &expr) override;
+    void visitBlockStmt(BlockStmt &stmt) override;
+    void visitClassStmt(ClassStmt &stmt) override;
+    void visitExpressionStmt(ExpressionStmt &stmt) override;
+    void visitFunctionStmt(FunctionStmt &stmt) override;
+    void visitIfStmt(IfStmt &stmt) override;
+    void visitPrintStmt(PrintStmt &stmt) override;
+    void visitReturnStmt(ReturnStmt &stmt) override;
+    void visitWhileStmt(WhileStmt &stmt) override;
+    void visitVarStmt(VarStmt &stmt) override;
+    void visitYieldStmt(YieldStmt &stmt) override;
+    std::any executeFunction(LoxFunction &function, std::vector<std::any> &arguments);
+    // Runs fiber to its next yield, or to the end of its body, and returns the value yielded or returned; nil once
+    // it is done.
+    std::any resume(LoxFiber &fiber, const Token &paren);
+    // The fiber running now, or null in top-level code.
+    LoxFiber *currentFiber() const;
+    EventLoop &eventLoop();
+    std::any waitForEvent();
+    // Resumes a fiber waiting for an event, which waitForEvent then returns value from.
+    void wake(LoxFiber &fiber, std::any value, const Token &paren);
+    void reserveScriptFrame(int size);
+    void setMaxCallDepth(std::size_t depth);
+    std::size_t callDepthLimit() const;
+    // Compiles declaration to machine code now if the JIT is on and can, for callers about to run it many times
+    // without going through the interpreter.
+    void compileNow(FunctionStmt &declaration);
+    void setCollectStats(bool collect);
+    void setJitEnabled(bool enabled);
+    // Limit each run of interpret, see Budget. Machine code passes no safepoints, so the JIT is off while limited.
+    void setFuel(std::uint64_t fuel);
+    void setTimeLimit(std::chrono::milliseconds limit);
+    Budget &budget();
+    void setMemoizePure(bool enabled);
+    void printStats(std::ostream &out);
+    static bool isTruthy(const std::any &object);
+    static bool isEqual(const std::any &a, const std::any &b);
+    static std::string stringify(const std::any &object);
+    // What the operators and calls do with values of any type, errors included, touching nothing but their operands.
+    // The parallel workers evaluate with these too.
+    static std::any binaryOperation(const Token &op, const std::any &left, const std::any &right);
+    static std::any unaryOperation(const Token &op, const std::any &right);
+    [[noreturn]] static void throwArityError(const Token &paren, std::size_t expected, std::size_t got);
+
+    static constexpr std::size_t DEFAULT_MAX_CALL_DEPTH = 100000;
 
  private:
-    std::shared_ptr<Environment> environment = globals;
-    std::map<std::shared_ptr<Expr>, int> locals;
-    std::any evaluate(std::shared_ptr<Expr> expr);
-    void execute(std::shared_ptr<Stmt> stmt);
-    bool isTruthy(const std::any &object);
-    bool isEqual(const std::any &a, const std::any &b);
-    std::any lookUpVariable(const Token &name, std::shared_ptr<Expr> expr);
-    void checkNumberOperand(const Token &op, const std::any &operand);
-    void checkNumberOperands(const Token &op, const std::any &left, const std::any &right);
-
-    std::string stringify(const std::any &object);
+    friend class LoxFiber;
+
+    // The locals of one running function (or of top-level code) occupy stack[base, base + size).
+    struct CallFrame {
+        LoxFunction *function;
+        std::size_t base;
+        std::size_t size;
+    };
+
+    // Pops a call frame however the call ends, including by a RuntimeError unwinding through it.
+    class FrameGuard {
+     public:
+        FrameGuard(Interpreter &interpreter, CallFrame callee);
+        ~FrameGuard();
+
+     private:
+        Interpreter &interpreter;
+    };
+
+    std::vector<std::any> stack;
+    // NUMBER locals live here as raw doubles, at the same indices their slots would have in stack.
+    std::vector<double> numbers;
+    CallFrame frame{nullptr, 0, 0};
+    std::vector<CallFrame> frames;
+    std::size_t maxCallDepth = DEFAULT_MAX_CALL_DEPTH;
+    // Lowest native stack address a Lox call may start below; 0 when the thread's stack bounds are unknown.
+    std::uintptr_t nativeStackLimit = 0;
+    static constexpr std::size_t NATIVE_STACK_MARGIN = 256 * 1024;
+
+    // Every fiber not yet destroyed, linked through the fibers themselves, and the one running, if any.
+    LoxFiber *fibers = nullptr;
+    LoxFiber *runningFiber = nullptr;
+    EventLoop events;
+
+    Budget limits;
+    // Safepoints left before drawing on limits again.
+    std::int64_t safepointsLeft = 0;
+
+    bool jitRequested = LOX_JIT_SUPPORTED;
+    bool jitEnabled = LOX_JIT_SUPPORTED;
+    Jit jit{globals, DEFAULT_MAX_CALL_DEPTH};
+
+    bool returning = false;
+    std::any returnValue;
+    // Set with returning when a return statement hands its frame over to a call in tail position.
+    Ref<LoxFunction> tailCall;
+
+    // Nodes that have received type feedback, kept only while collecting statistics.
+    bool collectingStats = false;
+    std::vector<std::shared_ptr<BinaryExpr>> binaryFeedback;
+    std::vector<std::shared_ptr<IfStmt>> ifFeedback;
+    std::vector<std::shared_ptr<WhileStmt>> whileFeedback;
+    std::vector<std::shared_ptr<GetExpr>> getFeedback;
+    std::vector<std::shared_ptr<SetExpr>> setFeedback;
+    TypeInferenceStats typeStats;
+    std::uint64_t inlinedCalls = 0;
+    std::uint64_t inlineGuardFailures = 0;
+
+    bool memoizePure = false;
+    std::vector<std::shared_ptr<FunctionStmt>> memoized;
+    // Keys of memoized functions tail-called by running frames, for the results those frames return.
+    struct PendingMemo {
+        MemoTable *memo;
+        std::string key;
+    };
+    std::vector<PendingMemo> tailMemoKeys;
+
+    std::any evaluate(const std::shared_ptr<Expr> &expr);
+    double evaluateNumber(const std::shared_ptr<Expr> &expr);
+    std::any evaluateNumberOperands(BinaryExpr &expr);
+    bool compareNumbers(BinaryExpr &expr);
+    bool runCountedLoop(WhileStmt &stmt);
+    void execute(const std::shared_ptr<Stmt> &stmt);
+    void executeStatements(const std::vector<std::shared_ptr<Stmt>> &statements);
+    void checkCallDepth(const Token &paren);
+    void safepoint(const Token &token);
+    void drawBudget(const Token &token);
+    void reserveStack(std::size_t size);
+    std::size_t evaluateArguments(const std::vector<std::shared_ptr<Expr>> &arguments);
+    LoxFunction *checkCallee(std::any &callee, const Token &paren, std::size_t argumentCount);
+    void checkArity(std::size_t arity, const Token &paren, std::size_t argumentCount);
+    std::size_t fillOptionalArguments(LoxNative &native, const Token &paren, std::size_t argumentCount);
+    void discardArguments(std::size_t argumentCount);
+    std::any callValue(std::any &callee, CallExpr &expr);
+    std::any callNative(LoxNative &native, const Token &paren, std::size_t argumentCount);
+    std::any construct(const Ref<LoxClass> &klass, const Token &paren, std::size_t argumentCount);
+    std::any invoke(CallExpr &call, GetExpr &property);
+    std::any callMethod(LoxFunction *method, std::any receiver, const Token &paren, std::size_t argumentCount);
+    LoxFunction *findProperty(GetExpr &expr, LoxInstance &instance, std::any *&field);
+    void refillCache(GetExpr &expr, LoxInstance &instance);
+    void refillCache(SetExpr &expr, LoxInstance &instance);
+    std::any evaluateKey(const std::shared_ptr<Expr> &key, const Token &token);
+    double evaluateIndex(const std::shared_ptr<Expr> &index, const Token &bracket);
+    Ref<LoxFunction> makeClosure(FunctionStmt &declaration);
+    void bindParameters(LoxFunction &function, std::size_t base);
+    void invalidateTypeProofs(FunctionStmt &declaration, std::size_t enteringBase);
+    std::any executeCall(LoxFunction *function);
+    std::any callMemoized(LoxFunction *function);
+    bool lookUpTailMemo(LoxFunction *function);
+    void storeTailMemo(std::size_t first);
+    static void storeMemo(MemoTable &memo, std::string key, const std::any &result);
+    bool holdsDependencies(MemoTable &memo);
+    bool holdsFunction(const FunctionStmt &declaration);
+    std::any evaluateInlined(CallExpr &call);
+    bool runCompiled(FunctionStmt &declaration, std::any &result);
+    void executeTailCall(CallExpr &call);
+    std::any startGenerator(LoxFunction *function, const Token &paren, std::size_t argumentCount);
+    void runFiber(LoxFiber &fiber);
+    void switchFrames(LoxFiber &fiber);
+    void updateNativeStackLimit();
+    void specialize(BinaryExpr &expr, const std::any &left, const std::any &right);
+    bool testCondition(const std::shared_ptr<Expr> &condition, ConditionSpecialization &specialization,
+                       SpecializationStats &stats);
+    void define(const Token &name, const VariableBinding &binding, std::any value);
+    std::any lookUpVariable(const Token &name, const VariableBinding &binding);
+    void assignVariable(const Token &name, const VariableBinding &binding, std::any value);
+    static void checkNumberOperand(const Token &op, const std::any &operand);
+    static void checkNumberOperands(const Token &op, const std::any &left, const std::any &right);
 };
\ No newline at end of file
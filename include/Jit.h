@@ -0,0 +1,79 @@
+#pragma once
+
+#include <any>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Environment.h"
+#include "Stmt.h"
+
+#if defined(__linux__) && defined(__x86_64__)
+#define LOX_JIT_SUPPORTED 1
+#else
+#define LOX_JIT_SUPPORTED 0
+#endif
+
+struct JitSite;
+
+// Machine code for one function declaration. Values inside it are always plain doubles; anything else makes the
+// code bail out, and the interpreter then runs the call from the start.
+struct JitFunction {
+    using Entry = int (*)(const double *arguments, double *result, void *jit);
+
+    std::string name;
+    int line = 0;
+    Entry entry = nullptr;
+    void *memory = nullptr;
+    std::size_t size = 0;
+    // Address-stable data the generated code refers to.
+    std::vector<std::unique_ptr<JitSite>> sites;
+
+    std::uint64_t entries = 0;
+    std::uint64_t nativeCalls = 0;
+    std::uint64_t guardFailures = 0;
+    std::uint64_t bailouts = 0;
+
+    ~JitFunction();
+};
+
+// Baseline template JIT for Linux x86-64. Hot functions that only compute with numbers are translated one node at a
+// time into machine code; on other platforms compile() always declines and everything stays interpreted.
+class Jit {
+ public:
+    static constexpr std::uint32_t HOT_THRESHOLD = 50;
+
+    // A readOnly Jit only runs code compiled already, so threads besides the interpreter's can use one: it compiles
+    // nothing, records no statistics, and leaves a function whose code bailed out compiled.
+    Jit(std::shared_ptr<Environment> globals, std::size_t maxCallDepth, bool readOnly = false);
+    bool compile(FunctionStmt &declaration);
+    // Runs declaration's machine code on the call's arguments. Returns false when an argument is not a number or the
+    // code bailed out; nothing observable has happened then, so the caller interprets the call instead.
+    bool run(FunctionStmt &declaration, const std::any *arguments, std::size_t depth, std::uintptr_t stackLimit,
+             std::any &result);
+    void setMaxCallDepth(std::size_t depth);
+    void printStats(std::ostream &out);
+
+    // Called from generated code; a non-zero status bails the running machine code out.
+    static int callGlobal(Jit *jit, JitSite *site, const double *arguments, double *result);
+    static int loadGlobal(Jit *jit, JitSite *site, double *result);
+
+ private:
+    struct Rejection {
+        std::string name;
+        int line;
+        std::string reason;
+    };
+
+    std::shared_ptr<Environment> globals;
+    std::size_t maxCallDepth;
+    const bool readOnly;
+    std::size_t depth = 0;
+    std::uintptr_t stackLimit = 0;
+    std::vector<double> arguments;
+    std::vector<std::shared_ptr<JitFunction>> compiled;
+    std::vector<Rejection> rejected;
+};
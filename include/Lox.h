@@ -1,22 +1,55 @@
 #pragma once
 
+#include <memory>
 #include <string>
+#include <vector>
 
+#include "ClosureEngine.h"
+#include "Environment.h"
 #include "Interpreter.h"
 #include "RuntimeError.h"
+#include "Stmt.h"
 #include "Token.h"
+#include "VM.h"
+
+// A script scanned, parsed and resolved, ready to run.
+struct Program {
+    std::vector<std::shared_ptr<Stmt>> statements;
+    int frameSize = 0;
+};
 
 class Lox {
  public:
+    enum class Engine {
+        VISITOR,
+        CLOSURE,
+        BYTECODE,
+    };
+
     static bool hadError;
     static bool hadRuntimeError;
+    static bool showStats;
+    static Engine engine;
 
     static void runFile(const std::string& path);
     static void runPrompt();
     static void run(const std::string& source);
+    // Reports the errors in source and returns false if there are any.
+    static bool compile(const std::string& source, Program& program);
+    static void execute(const Program& program);
+    // The globals scripts are resolved against and run with: the natives, and a slot for every global name resolved
+    // since they were last replaced.
+    static Environment& globals();
 
     static void error(int line, const std::string& message);
     static void report(int line, const std::string& where, const std::string& message);
     static void error(Token token, const std::string& message);
     static void runtimeError(RuntimeError error);
+
+ private:
+    // Which engines have run a program, declined ones excepted, so --stats shows what actually ran.
+    static bool visitorRan;
+    static bool bytecodeRan;
+
+    static void printStats();
 };
\ No newline at end of file
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <any>
+#include <cstddef>
+#include <vector>
+
+#include "Ref.h"
+
+// An array value. While every element is a number they are kept unboxed in numbers, which the numeric builtins work
+// on directly; storing anything else moves them all to values, and only unbox moves them back.
+class LoxArray : public RefCounted {
+ public:
+    std::size_t size() const;
+    std::any get(std::size_t index) const;
+    void set(std::size_t index, std::any value);
+    void push(std::any value);
+    // Returns whether every element is a number, first moving them back to numbers if they are boxed.
+    bool unbox();
+
+    // Set once the elements are in values rather than numbers.
+    bool generic = false;
+    std::vector<double> numbers;
+    std::vector<std::any> values;
+
+ private:
+    void promote();
+};
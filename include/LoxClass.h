@@ -0,0 +1,51 @@
+#pragma once
+
+#include <any>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "LoxFunction.h"
+#include "Ref.h"
+
+// The hidden class of an instance: the fields it has and the slot of each. Every class has its own empty root, and
+// adding a field follows a transition to the next shape, so instances of one class that gained the same fields in
+// the same order share a shape. A shape therefore decides both where a field is and which class a method comes from.
+struct Shape : RefCounted {
+    std::unordered_map<std::string, std::uint32_t> slots;
+    // Shapes with one more field, made the first time an instance of this shape gains it.
+    std::unordered_map<std::string, Ref<Shape>> transitions;
+
+    // Returns the field's slot, or -1 if instances of this shape do not have it.
+    int find(const std::string &name) const;
+    const Ref<Shape> &transition(const std::string &name);
+};
+
+class LoxClass : public RefCounted {
+ public:
+    LoxClass(std::string name, Ref<LoxClass> superclass, std::unordered_map<std::string, Ref<LoxFunction>> methods);
+
+    // Includes the inherited methods that are not overridden, since a class cannot change once declared.
+    LoxFunction *findMethod(const std::string &name) const;
+    int arity() const;
+    std::string toString() const;
+
+    const std::string name;
+    const Ref<LoxClass> superclass;
+    const std::unordered_map<std::string, Ref<LoxFunction>> methods;
+    LoxFunction *const initializer;
+    const Ref<Shape> root;
+};
+
+class LoxInstance : public RefCounted {
+ public:
+    explicit LoxInstance(Ref<LoxClass> klass);
+
+    std::string toString() const;
+
+    const Ref<LoxClass> klass;
+    Ref<Shape> shape;
+    // Indexed by the slots of shape.
+    std::vector<std::any> fields;
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <any>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Interpreter.h"
+#include "LoxFunction.h"
+#include "Ref.h"
+
+// A call of a generator function. Its body runs on a native stack of its own, so a yield can stop it anywhere inside
+// the interpreter's visitors and a later resume carry on from there, on the same thread. While the fiber is
+// suspended, its interpreter frame stack is parked here; while it runs, the resumer's is.
+class LoxFiber : public RefCounted {
+ public:
+    enum class State {
+        // Not started yet, or stopped at a yield.
+        SUSPENDED,
+        RUNNING,
+        // Suspended in a builtin until the event loop wakes it.
+        WAITING,
+        DONE,
+    };
+
+    LoxFiber(Interpreter &interpreter, Ref<LoxFunction> function);
+    ~LoxFiber();
+
+    // Switches to the fiber's stack until it suspends or its body ends. The first switch starts Interpreter::runFiber
+    // there.
+    void resume();
+    // Switches back to the resume that is running the fiber.
+    void suspend();
+    // Lowest usable address of the fiber's native stack.
+    std::uintptr_t stackBottom() const;
+    std::string toString() const;
+
+    Interpreter &interpreter;
+    const Ref<LoxFunction> function;
+    State state = State::SUSPENDED;
+
+    std::vector<std::any> stack;
+    std::vector<double> numbers;
+    Interpreter::CallFrame frame{nullptr, 0, 0};
+    std::vector<Interpreter::CallFrame> frames;
+    std::uintptr_t nativeStackLimit = 0;
+
+    // The value of the last yield, or the body's return value once done, until resume hands it over.
+    std::any value;
+    // An error the body ended with, which resume rethrows in the resumer.
+    std::exception_ptr error;
+
+    // The interpreter's list of live fibers.
+    LoxFiber *previous = nullptr;
+    LoxFiber *next = nullptr;
+
+ private:
+    struct Context;
+
+    static void start(LoxFiber *fiber);
+
+    std::unique_ptr<Context> context;
+    void *nativeStack;
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <any>
+#include <cstddef>
+#include <string>
+
+#include "LoxString.h"
+#include "Ref.h"
+#include "Token.h"
+
+class Interpreter;
+
+// The whole text of a file, mapped into memory. Input that cannot be mapped, such as a pipe, is read into a copy.
+class MappedFile : public RefCounted {
+ public:
+    // Null if the file cannot be opened or read.
+    static Ref<MappedFile> open(const std::string &path);
+    ~MappedFile();
+
+    // Lets the system drop the pages before offset from memory; reading them again faults them back in.
+    void release(std::size_t offset);
+
+    const char *data = nullptr;
+    std::size_t size = 0;
+
+ private:
+    MappedFile() = default;
+
+    bool mapped = false;
+    std::string copy;
+};
+
+// A file being read line by line.
+class LoxFile : public RefCounted {
+ public:
+    LoxFile(std::string path, Ref<MappedFile> mapping);
+
+    // The next line containing text, without its newline; null once there are no more.
+    Ref<LoxString> readLine(std::string_view text);
+    // The rest of the text.
+    Ref<LoxString> readAll();
+    std::string toString() const;
+
+    const std::string path;
+
+ private:
+    Ref<MappedFile> mapping;
+    std::size_t position = 0;
+    std::size_t released = 0;
+};
+
+// openFile(path) maps a file and returns it for reading; readLine(file) returns its next line, nil at the end, and
+// readAll(file) the rest of its text. Both return slices of the mapping. readLine(file, text) skips to the next line
+// containing text, searching the mapping without making the lines in between. split(string, separator) returns an
+// array of the fields between the separators, slices too when the string is one.
+std::any openFile(Interpreter &interpreter, const Token &paren, std::any *arguments);
+std::any readLine(Interpreter &interpreter, const Token &paren, std::any *arguments);
+std::any readAll(Interpreter &interpreter, const Token &paren, std::any *arguments);
+std::any split(Interpreter &interpreter, const Token &paren, std::any *arguments);
@@ -1,20 +1,28 @@
 #pragma once
 
 #include <any>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "LoxCallable.h"
+#include "Ref.h"
+#include "Upvalue.h"
 
-class Environment;
 struct FunctionStmt;
+class LoxInstance;
 
-class LoxFunction : public LoxCallable {
+class LoxFunction : public LoxCallable, public RefCounted {
  public:
     std::shared_ptr<FunctionStmt> declaration;
-    std::shared_ptr<Environment> closure;
+    // Only the variables the body captures, in the order given by FunctionStmt::upvalues.
+    std::vector<Ref<Upvalue>> upvalues;
+    // Set for a method read off an instance, which the call then finds as 'this'.
+    Ref<LoxInstance> receiver;
 
-    LoxFunction(std::shared_ptr<FunctionStmt> declaration, std::shared_ptr<Environment> closure);
+    LoxFunction(std::shared_ptr<FunctionStmt> declaration);
+    ~LoxFunction() override;
+    Ref<LoxFunction> bind(Ref<LoxInstance> instance) const;
     int arity() override;
     std::any call(Interpreter& interpreter, std::vector<std::any> arguments) override;
     std::string toString() override;
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <any>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Ref.h"
+
+// A map value, keyed by nil, booleans, numbers and strings. Numbers are the same key if they are equal, so 0 and -0
+// are one key, or if their bits are, so a NaN finds itself; strings are compared by their text.
+//
+// The entries are kept in insertion order, which is the order they are iterated in. Finding one goes through an
+// open-addressing table in the style of SwissTable: a control byte per slot holds 7 bits of the key's hash, and
+// probing tests a group of 8 of them at once before comparing any keys. A group keeps its slots' entry indices next to
+// its control bytes, so a lookup in a large map usually misses the cache once for the group and once for the entry.
+class LoxMap : public RefCounted {
+ public:
+    struct Entry {
+        // Empty once the entry is removed.
+        std::any key;
+        std::any value;
+        std::uint64_t hash;
+    };
+
+    static bool isKey(const std::any &key);
+
+    std::size_t size() const;
+    // nullptr if the map does not hold key.
+    std::any *get(const std::any &key);
+    void set(const std::any &key, std::any value);
+    bool remove(const std::any &key);
+    // Includes the removed entries, which are skipped by checking for an empty key.
+    const std::vector<Entry> &entries() const;
+    // The bytes allocated for the entries and the table, not counting what the keys and values refer to.
+    std::size_t memoryUsage() const;
+
+ private:
+    static constexpr std::size_t GROUP = 8;
+
+    struct Group {
+        // One per slot: EMPTY, DELETED, or the low 7 bits of the hash of the entry in the slot.
+        std::uint8_t control[GROUP];
+        // The index in items of the entry in each full slot.
+        std::uint32_t indices[GROUP];
+    };
+
+    // Where a key is in the table.
+    struct Slot {
+        Group *group;
+        std::size_t offset;
+    };
+
+    std::vector<Entry> items;
+    // A power of two of them, or none before the first insertion.
+    std::vector<Group> groups;
+    std::size_t live = 0;
+    // Slots that are full or DELETED, which both keep probes going.
+    std::size_t used = 0;
+
+    Slot find(const std::any &key, std::uint64_t hash);
+    void insert(std::uint32_t entry, std::uint64_t hash);
+    void rebuild();
+};
@@ -1,8 +0,0 @@
-#pragma once
-
-#include <any>
-
-class LoxReturn {
- public:
-    const std::any value;
-};
\ No newline at end of file
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "Ref.h"
+
+class MappedFile;
+
+// A string value of the tree-walking engines, shared by reference instead of copied. Concatenating strings whose
+// result is long makes a rope node that only refers to both operands; the text is built the first time something
+// reads it and then replaces the node's children. Short results are copied, and a left operand nothing else refers
+// to is appended to in place. A line read from a file is a slice of the file's mapped text, copied out only once
+// something needs it as a std::string.
+class LoxString : public RefCounted {
+ public:
+    static constexpr std::size_t SHORT = 64;
+
+    explicit LoxString(std::string chars);
+    LoxString(Ref<MappedFile> file, std::string_view text);
+    ~LoxString();
+
+    static Ref<LoxString> concatenate(Ref<LoxString> left, const Ref<LoxString> &right);
+    const std::string &str();
+    // The text without copying a slice out of its file.
+    std::string_view view();
+    // A slice of a slice shares its file; other strings are copied from.
+    Ref<LoxString> substring(std::size_t start, std::size_t length);
+    std::size_t length() const;
+    // Computed the first time a map looks the string up and kept until the string is appended to.
+    std::uint64_t hash();
+
+ private:
+    LoxString(Ref<LoxString> left, Ref<LoxString> right);
+
+    std::string chars;
+    // Both set while this is a rope node that has not been flattened yet.
+    Ref<LoxString> left;
+    Ref<LoxString> right;
+    // Set while this is a slice that has not been copied out yet.
+    Ref<MappedFile> file;
+    const char *slice = nullptr;
+    std::size_t size;
+    // 0 until computed.
+    std::uint64_t hashCode = 0;
+
+    void flatten();
+    void releaseChildren();
+};
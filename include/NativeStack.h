@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Lowest native stack address a Lox call may start below on the calling thread, keeping margin bytes free for the
+// frames that report the overflow; 0 when the thread's stack bounds are unknown.
+std::uintptr_t nativeStackLimit(std::size_t margin);
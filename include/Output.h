@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Longest text formatNumber writes: the integer digits of the largest double, a sign, a point and six decimals.
+constexpr std::size_t NUMBER_TEXT_SIZE = 320;
+
+// Writes number the way print shows it, with six decimals, to out and returns the end of the text.
+char *formatNumber(double number, char *out);
+
+// Where print writes. Text collects in a buffer that goes out in one write when full, on flush, and when the sink is
+// destroyed or redirected; on a terminal, or when asked to, after every line as well. The sink writes to a file descriptor, or appends
+// to a string for programs embedding the interpreter.
+class Output {
+ public:
+    explicit Output(int fd);
+    ~Output();
+    Output(const Output &) = delete;
+    Output &operator=(const Output &) = delete;
+
+    void writeTo(int fd);
+    // Until the next redirection, memory must outlive the sink.
+    void captureIn(std::string &memory);
+    // Sends every line out as it ends, until the next redirection.
+    void flushEachLine();
+
+    void append(std::string_view text) {
+        if (text.size() > CAPACITY - used) {
+            appendLong(text);
+            return;
+        }
+        text.copy(buffer + used, text.size());
+        used += text.size();
+    }
+
+    void appendNumber(double number);
+    // Ends a printed line.
+    void endLine();
+    void flush();
+
+ private:
+    static constexpr std::size_t CAPACITY = 64 * 1024;
+
+    char buffer[CAPACITY];
+    std::size_t used = 0;
+    int fd;
+    bool lineBuffered;
+    std::string *memory = nullptr;
+
+    void appendLong(std::string_view text);
+    void write(const char *data, std::size_t size);
+};
+
+// The process's standard output. Everything the interpreters print goes through it, and so does anything else meant
+// for standard output that must stay in order with printed text.
+Output &standardOutput();
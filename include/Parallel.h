@@ -0,0 +1,21 @@
+#pragma once
+
+#include <any>
+
+#include "Token.h"
+
+class Interpreter;
+
+// The parallelMap(fn, array) and parallelReduce(fn, array, init) builtins. They split the array into chunks that a
+// pool of threads, the calling one included, runs fn over. The interpreter writes type feedback and caches into the
+// AST and counts references without atomics, so the workers do not run it: each has a small evaluator of its own
+// that only reads the AST. fn must therefore be pure, and it and every function it calls must compute only with
+// nil, booleans and numbers. parallelReduce folds each run of 1024 elements from its first element and then folds
+// the run results in order from init. That gives the sequential result if fn is associative, and the same result
+// for any number of threads either way.
+std::any parallelMap(Interpreter &interpreter, const Token &paren, std::any *arguments);
+std::any parallelReduce(Interpreter &interpreter, const Token &paren, std::any *arguments);
+
+// Threads the builtins above spread work over, the calling one included; 0, the default, means one per CPU. Takes
+// effect only before their first call.
+void setParallelThreads(unsigned threads);
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdexcept>
 #include <vector>
 
 #include "Expr.h"
@@ -25,11 +26,13 @@ class Parser {
     std::shared_ptr<Expr> expression();
     std::shared_ptr<Stmt> statement();
     std::shared_ptr<Stmt> declaration();
+    std::shared_ptr<Stmt> classDeclaration();
     std::shared_ptr<Stmt> forStatement();
     std::shared_ptr<Stmt> ifStatement();
     std::shared_ptr<Stmt> whileStatement();
     std::shared_ptr<Stmt> printStatement();
     std::shared_ptr<Stmt> returnStatement();
+    std::shared_ptr<Stmt> yieldStatement();
     std::shared_ptr<Stmt> varDeclaration();
     std::shared_ptr<Stmt> expressionStatement();
     std::shared_ptr<FunctionStmt> function(std::string kind);
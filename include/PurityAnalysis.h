@@ -0,0 +1,67 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "Expr.h"
+#include "Stmt.h"
+
+// Proves which global functions are pure, so their results depend on nothing but their arguments. A function
+// qualifies when it is declared once at top level, never assigned, and its body prints nothing, declares no
+// functions, writes no global or captured variable, and reads no global but functions that qualify themselves,
+// which are also the only things it calls. This is a greatest fixed point: every candidate starts out pure and is
+// dropped until nothing changes.
+class PurityAnalysis : public ExprVisitor, public StmtVisitor {
+ public:
+    // Marks the pure functions and returns them. With memoize, each is also given an empty MemoTable listing the
+    // functions it depends on.
+    std::vector<std::shared_ptr<FunctionStmt>> analyze(const std::vector<std::shared_ptr<Stmt>> &statements,
+                                                       bool memoize);
+
+    std::any visitArrayExpr(ArrayExpr &expr) override;
+    std::any visitAssignExpr(AssignExpr &expr) override;
+    std::any visitBinaryExpr(BinaryExpr &expr) override;
+    std::any visitCallExpr(CallExpr &expr) override;
+    std::any visitGetExpr(GetExpr &expr) override;
+    std::any visitGroupingExpr(GroupingExpr &expr) override;
+    std::any visitIndexExpr(IndexExpr &expr) override;
+    std::any visitLiteralExpr(LiteralExpr &expr) override;
+    std::any visitLogicalExpr(LogicalExpr &expr) override;
+    std::any visitMapExpr(MapExpr &expr) override;
+    std::any visitSetExpr(SetExpr &expr) override;
+    std::any visitSetIndexExpr(SetIndexExpr &expr) override;
+    std::any visitSuperExpr(SuperExpr &expr) override;
+    std::any visitThisExpr(ThisExpr &expr) override;
+    std::any visitUnaryExpr(UnaryExpr &expr) override;
+    std::any visitVariableExpr(VariableExpr &expr) override;
+    void visitBlockStmt(BlockStmt &stmt) override;
+    void visitClassStmt(ClassStmt &stmt) override;
+    void visitExpressionStmt(ExpressionStmt &stmt) override;
+    void visitFunctionStmt(FunctionStmt &stmt) override;
+    void visitIfStmt(IfStmt &stmt) override;
+    void visitPrintStmt(PrintStmt &stmt) override;
+    void visitReturnStmt(ReturnStmt &stmt) override;
+    void visitWhileStmt(WhileStmt &stmt) override;
+    void visitVarStmt(VarStmt &stmt) override;
+    void visitYieldStmt(YieldStmt &stmt) override;
+
+ private:
+    bool collecting = true;
+    std::map<std::string, std::vector<std::shared_ptr<FunctionStmt>>> globalFunctions;
+    std::set<std::string> assignedGlobals;
+    // Functions still assumed pure by name, and the global functions each one's body names.
+    std::map<std::string, std::shared_ptr<FunctionStmt>> candidates;
+    std::map<std::string, std::set<std::string>> references;
+
+    // Whether the body being checked has done something impure, and the global functions it named so far.
+    bool impure = false;
+    std::set<std::string> *named = nullptr;
+
+    void walk(const std::vector<std::shared_ptr<Stmt>> &statements);
+    void walk(const std::shared_ptr<Expr> &expr);
+    bool isPure(const std::string &name, FunctionStmt &declaration);
+    void collectDependencies(const std::string &name, std::set<std::string> &dependencies);
+};
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+// Base of the runtime objects values share: functions, captured variables and the VM's heap objects. The count is
+// a plain integer rather than std::shared_ptr's atomic one, since an interpreter and its values stay on one thread.
+class RefCounted {
+ public:
+    RefCounted() = default;
+    RefCounted(const RefCounted &) = delete;
+    RefCounted &operator=(const RefCounted &) = delete;
+
+ private:
+    template <typename T>
+    friend class Ref;
+
+    std::uint32_t refCount = 0;
+};
+
+// Deletes object with destroy, which deletes it as its type. Deleting an object releases the handles it holds, which
+// can delete more objects, down a chain as long as any list a script builds. Only the outermost deletion on a thread
+// happens at once: the ones it sets off are queued and done one after another once it returns, so dropping a chain
+// takes the same native stack however long it is.
+void deleteRefCounted(void *object, void (*destroy)(void *));
+
+// An owning handle to a RefCounted object, which is deleted along with its last handle. Delete through a base only
+// if it has a virtual destructor.
+template <typename T>
+class Ref {
+ public:
+    Ref() = default;
+    Ref(std::nullptr_t) {}
+
+    explicit Ref(T *object) : object{object} {
+        retain();
+    }
+
+    Ref(const Ref &other) : object{other.object} {
+        retain();
+    }
+
+    Ref(Ref &&other) noexcept : object{other.object} {
+        other.object = nullptr;
+    }
+
+    template <typename U, typename = std::enable_if_t<std::is_convertible_v<U *, T *>>>
+    Ref(Ref<U> other) : object{other.object} {
+        other.object = nullptr;
+    }
+
+    ~Ref() {
+        release();
+    }
+
+    Ref &operator=(Ref other) noexcept {
+        std::swap(object, other.object);
+        return *this;
+    }
+
+    T *get() const {
+        return object;
+    }
+
+    T &operator*() const {
+        return *object;
+    }
+
+    T *operator->() const {
+        return object;
+    }
+
+    explicit operator bool() const {
+        return object != nullptr;
+    }
+
+    // Whether this is the only handle, so the object may be changed without anyone else seeing it.
+    bool unique() const {
+        return object != nullptr && object->refCount == 1;
+    }
+
+    bool operator==(std::nullptr_t) const {
+        return object == nullptr;
+    }
+
+    bool operator!=(std::nullptr_t) const {
+        return object != nullptr;
+    }
+
+ private:
+    template <typename U>
+    friend class Ref;
+
+    T *object = nullptr;
+
+    void retain() {
+        if (object != nullptr) {
+            ++object->refCount;
+        }
+    }
+
+    void release() {
+        if (object != nullptr && --object->refCount == 0) {
+            deleteRefCounted(object, [](void *object) { delete static_cast<T *>(object); });
+        }
+    }
+};
+
+template <typename T, typename... Args>
+Ref<T> makeRef(Args &&...args) {
+    return Ref<T>{new T(std::forward<Args>(args)...)};
+}
+
+// The counterpart of std::static_pointer_cast.
+template <typename T, typename U>
+Ref<T> staticRefCast(const Ref<U> &ref) {
+    return Ref<T>{static_cast<T *>(ref.get())};
+}
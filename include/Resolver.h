@@ -9,41 +9,83 @@ class Resolver : public ExprVisitor, public StmtVisitor {
  public:
     Resolver(Interpreter &interpreter);
     void resolve(const std::vector<std::shared_ptr<Stmt>> &statements);
+    // Slots the locals of top-level blocks need, once resolve() has run.
+    int scriptFrameSize() const;
 
-    void visitBlockStmt(std::shared_ptr<BlockStmt> stmt) override;
-    void visitExpressionStmt(std::shared_ptr<ExpressionStmt> stmt) override;
-    void visitFunctionStmt(std::shared_ptr<FunctionStmt> stmt) override;
-    void visitIfStmt(std::shared_ptr<IfStmt> stmt) override;
-    void visitPrintStmt(std::shared_ptr<PrintStmt> stmt) override;
-    void visitReturnStmt(std::shared_ptr<ReturnStmt> stmt) override;
-    void visitVarStmt(std::shared_ptr<VarStmt> stmt) override;
-    void visitWhileStmt(std::shared_ptr<WhileStmt> stmt) override;
-
-    std::any visitAssignExpr(std::shared_ptr<AssignExpr> expr) override;
-    std::any visitBinaryExpr(std::shared_ptr<BinaryExpr> expr) override;
-    std::any visitCallExpr(std::shared_ptr<CallExpr> expr) override;
-    std::any visitGroupingExpr(std::shared_ptr<GroupingExpr> expr) override;
-    std::any visitLiteralExpr(std::shared_ptr<LiteralExpr> expr) override;
-    std::any visitLogicalExpr(std::shared_ptr<LogicalExpr> expr) override;
-    std::any visitUnaryExpr(std::shared_ptr<UnaryExpr> expr) override;
-    std::any visitVariableExpr(std::shared_ptr<VariableExpr> expr) override;
+    void visitBlockStmt(BlockStmt &stmt) override;
+    void visitClassStmt(ClassStmt &stmt) override;
+    void visitExpressionStmt(ExpressionStmt &stmt) override;
+    void visitFunctionStmt(FunctionStmt &stmt) override;
+    void visitIfStmt(IfStmt &stmt) override;
+    void visitPrintStmt(PrintStmt &stmt) override;
+    void visitReturnStmt(ReturnStmt &stmt) override;
+    void visitVarStmt(VarStmt &stmt) override;
+    void visitYieldStmt(YieldStmt &stmt) override;
+    void visitWhileStmt(WhileStmt &stmt) override;
+
+    std::any visitArrayExpr(ArrayExpr &expr) override;
+    std::any visitAssignExpr(AssignExpr &expr) override;
+    std::any visitBinaryExpr(BinaryExpr &expr) override;
+    std::any visitCallExpr(CallExpr &expr) override;
+    std::any visitGetExpr(GetExpr &expr) override;
+    std::any visitGroupingExpr(GroupingExpr &expr) override;
+    std::any visitIndexExpr(IndexExpr &expr) override;
+    std::any visitLiteralExpr(LiteralExpr &expr) override;
+    std::any visitLogicalExpr(LogicalExpr &expr) override;
+    std::any visitMapExpr(MapExpr &expr) override;
+    std::any visitSetExpr(SetExpr &expr) override;
+    std::any visitSetIndexExpr(SetIndexExpr &expr) override;
+    std::any visitSuperExpr(SuperExpr &expr) override;
+    std::any visitThisExpr(ThisExpr &expr) override;
+    std::any visitUnaryExpr(UnaryExpr &expr) override;
+    std::any visitVariableExpr(VariableExpr &expr) override;
 
  private:
     enum class FunctionType {
         NONE,
         FUNCTION,
+        GENERATOR,
+        METHOD,
+        INITIALIZER,
+    };
+
+    enum class ClassType {
+        NONE,
+        CLASS,
+        SUBCLASS,
+    };
+
+    struct Local {
+        bool defined;
+        int slot;
+        bool captured;
+        // The declaration and every reference resolved to this local, switched to BOXED if a closure captures it.
+        std::vector<VariableBinding *> bindings;
+    };
+
+    // Block scopes of one function body, or of top-level code, whose locals share a single call frame.
+    struct FunctionScope {
+        FunctionStmt *declaration;
+        std::vector<std::map<std::string, Local>> scopes;
+        int slotCount = 0;
+        int frameSize = 0;
     };
 
     FunctionType currentFunction = FunctionType::NONE;
-    std::vector<std::map<std::string, bool>> scopes;
+    ClassType currentClass = ClassType::NONE;
+    std::vector<FunctionScope> functions;
     Interpreter &interpreter;
 
-    void resolve(std::shared_ptr<Stmt> stmt);
-    void resolve(std::shared_ptr<Expr> expr);
-    void resolveFunction(std::shared_ptr<FunctionStmt> function, FunctionType type);
-    void resolveLocal(std::shared_ptr<Expr> expr, const Token &name);
+    void resolve(const std::shared_ptr<Stmt> &stmt);
+    void resolve(const std::shared_ptr<Expr> &expr);
+    void resolveFunction(FunctionStmt &function, FunctionType type);
+    void resolveLocal(VariableBinding &binding, const Token &name);
+    int resolveUpvalue(std::size_t function, const Token &name);
+    int addUpvalue(FunctionScope &function, bool isLocal, int index);
+    Local *findLocal(FunctionScope &function, const Token &name);
     void beginScope();
     void endScope();
-    void declare(const Token &name);
+    void declare(const Token &name, VariableBinding &binding);
     void define(const Token &name);
+    VariableBinding globalBinding(const Token &name);
 };
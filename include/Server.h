@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+
+// clox --serve PATH listens on a Unix socket at PATH and runs the scripts clients send, each in a process forked from
+// the server, so it starts with fresh globals but without the cost of starting clox. A request is either
+// "FILE <absolute path>\n", which runs that file, or "SOURCE\n" followed by the source up to the end of the client's
+// writing. The server keeps the files it has been asked to run most recently parsed and resolved until they change.
+// The reply is everything the script prints, errors included, as it prints it, then a NUL byte and the exit status
+// clox would have had. At most workers scripts run at once; later requests wait.
+void serve(const std::string &path, unsigned workers);
+
+// clox --connect PATH [script] sends script, or else the source on standard input, to the server at PATH, copies its
+// output to standard output and returns its exit status.
+int runRemote(const std::string &path, const char *script);
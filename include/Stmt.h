@@ -2,10 +2,16 @@
 
 #include <algorithm>
 #include <any>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "Expr.h"
 
 struct BlockStmt;
+struct ClassStmt;
 struct ExpressionStmt;
 struct FunctionStmt;
 struct IfStmt;
@@ -13,18 +19,55 @@ struct PrintStmt;
 struct ReturnStmt;
 struct WhileStmt;
 struct VarStmt;
+struct YieldStmt;
+struct JitFunction;
+
+// Type feedback for the condition of an if or while, see BinarySpecialization.
+enum class ConditionSpecialization {
+    UNINITIALIZED,
+    BOOLEAN,
+    GENERIC,
+};
+
+// What TypeInference proved inside one function body, resting on the parameters listed here always being passed
+// numbers. The interpreter checks those on entry and undoes every proof if one ever is not.
+struct TypeProofs {
+    std::vector<std::size_t> parameters;
+    std::vector<VariableBinding *> bindings;
+    std::vector<bool *> flags;
+    // Frame slots whose variables became NUMBER locals.
+    std::vector<int> slots;
+};
+
+// Results of a function PurityAnalysis proved pure, by the encoded values of the arguments they were computed for.
+// They hold only while each global function the body can reach is still the one analyzed, itself included.
+struct MemoTable {
+    static constexpr std::size_t CAPACITY = 1 << 16;
+
+    std::vector<const FunctionStmt *> dependencies;
+    std::unordered_map<std::string, std::any> results;
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+    // Calls that ran unmemoized, because of an argument that is not a number, string or boolean, or a redefined
+    // dependency.
+    std::uint64_t bypassed = 0;
+    // Times the table filled up and was emptied.
+    std::uint64_t clears = 0;
+};
 
 struct StmtVisitor {
     virtual ~StmtVisitor() = default;
 
-    virtual void visitBlockStmt(std::shared_ptr<BlockStmt> stmt) = 0;
-    virtual void visitExpressionStmt(std::shared_ptr<ExpressionStmt> stmt) = 0;
-    virtual void visitFunctionStmt(std::shared_ptr<FunctionStmt> stmt) = 0;
-    virtual void visitIfStmt(std::shared_ptr<IfStmt> stmt) = 0;
-    virtual void visitPrintStmt(std::shared_ptr<PrintStmt> stmt) = 0;
-    virtual void visitReturnStmt(std::shared_ptr<ReturnStmt> stmt) = 0;
-    virtual void visitWhileStmt(std::shared_ptr<WhileStmt> stmt) = 0;
-    virtual void visitVarStmt(std::shared_ptr<VarStmt> stmt) = 0;
+    virtual void visitBlockStmt(BlockStmt& stmt) = 0;
+    virtual void visitClassStmt(ClassStmt& stmt) = 0;
+    virtual void visitExpressionStmt(ExpressionStmt& stmt) = 0;
+    virtual void visitFunctionStmt(FunctionStmt& stmt) = 0;
+    virtual void visitIfStmt(IfStmt& stmt) = 0;
+    virtual void visitPrintStmt(PrintStmt& stmt) = 0;
+    virtual void visitReturnStmt(ReturnStmt& stmt) = 0;
+    virtual void visitWhileStmt(WhileStmt& stmt) = 0;
+    virtual void visitVarStmt(VarStmt& stmt) = 0;
+    virtual void visitYieldStmt(YieldStmt& stmt) = 0;
 };
 
 struct Stmt {
@@ -32,93 +75,178 @@ struct Stmt {
     virtual void accept(StmtVisitor &visitor) = 0;
 };
 
-struct BlockStmt : public Stmt {
+struct BlockStmt : public Stmt, public std::enable_shared_from_this<BlockStmt> {
     std::vector<std::shared_ptr<Stmt>> statements;
 
     BlockStmt(std::vector<std::shared_ptr<Stmt>> statements) : statements(std::move(statements)) {}
 
     void accept(StmtVisitor &visitor) override {
-        visitor.visitBlockStmt(std::make_shared<BlockStmt>(*this));
+        visitor.visitBlockStmt(*this);
+    }
+};
+
+struct ClassStmt : public Stmt, public std::enable_shared_from_this<ClassStmt> {
+    Token name;
+    std::shared_ptr<VariableExpr> superclass;
+    std::vector<std::shared_ptr<FunctionStmt>> methods;
+    VariableBinding binding;
+    // The local the methods find the superclass in, when there is one.
+    VariableBinding superBinding;
+
+    ClassStmt(Token name, std::shared_ptr<VariableExpr> superclass, std::vector<std::shared_ptr<FunctionStmt>> methods)
+        : name(std::move(name)), superclass(std::move(superclass)), methods(std::move(methods)) {}
+
+    void accept(StmtVisitor &visitor) override {
+        visitor.visitClassStmt(*this);
     }
 };
 
-struct ExpressionStmt : public Stmt {
+struct ExpressionStmt : public Stmt, public std::enable_shared_from_this<ExpressionStmt> {
     std::shared_ptr<Expr> expression;
 
     ExpressionStmt(std::shared_ptr<Expr> expression) : expression(std::move(expression)) {}
 
     void accept(StmtVisitor &visitor) override {
-        visitor.visitExpressionStmt(std::make_shared<ExpressionStmt>(*this));
+        visitor.visitExpressionStmt(*this);
     }
 };
 
-struct FunctionStmt : public Stmt {
+struct FunctionStmt : public Stmt, public std::enable_shared_from_this<FunctionStmt> {
+    // How a new closure finds each variable it captures: a slot of the declaring frame, or one of the
+    // enclosing closure's own upvalues.
+    struct UpvalueSource {
+        bool isLocal;
+        int index;
+    };
+
     Token name;
     std::vector<Token> parameters;
     std::vector<std::shared_ptr<Stmt>> body;
+    VariableBinding binding;
+    // A method has one more binding than it has parameters: 'this', in the slot after them.
+    std::vector<VariableBinding> parameterBindings;
+    std::vector<UpvalueSource> upvalues;
+    int frameSize = 0;
+    // Calls counted towards the JIT's hot threshold, and the machine code once compiled.
+    std::uint32_t callCount = 0;
+    std::shared_ptr<JitFunction> jitCode;
+    bool jitRejected = false;
+    // Set by the Resolver for the methods of a class, and for the one named init.
+    bool isMethod = false;
+    bool isInitializer = false;
+    // Declared with fun*: a call returns a LoxFiber that runs the body.
+    bool isGenerator = false;
+    TypeProofs typeProofs;
+    // Set by PurityAnalysis.
+    bool isPure = false;
+    // Set for proven pure functions when memoization is on.
+    std::unique_ptr<MemoTable> memo;
 
     FunctionStmt(Token name, std::vector<Token> parameters, std::vector<std::shared_ptr<Stmt>> body)
-        : name(std::move(name)), parameters(std::move(parameters)), body(std::move(body)) {}
+        : name(std::move(name)),
+          parameters(std::move(parameters)),
+          body(std::move(body)),
+          parameterBindings(this->parameters.size()) {}
 
     void accept(StmtVisitor &visitor) override {
-        visitor.visitFunctionStmt(std::make_shared<FunctionStmt>(*this));
+        visitor.visitFunctionStmt(*this);
     }
 };
 
-struct IfStmt : public Stmt {
+struct IfStmt : public Stmt, public std::enable_shared_from_this<IfStmt> {
+    Token keyword;
     std::shared_ptr<Expr> condition;
     std::shared_ptr<Stmt> thenBranch;
     std::shared_ptr<Stmt> elseBranch;
-
-    IfStmt(std::shared_ptr<Expr> condition, std::shared_ptr<Stmt> thenBranch, std::shared_ptr<Stmt> elseBranch)
-        : condition(std::move(condition)), thenBranch(std::move(thenBranch)), elseBranch(std::move(elseBranch)) {}
+    ConditionSpecialization specialization = ConditionSpecialization::UNINITIALIZED;
+    SpecializationStats stats;
+    // Set by TypeInference when the condition compares two proven numbers.
+    bool numberCondition = false;
+
+    IfStmt(Token keyword, std::shared_ptr<Expr> condition, std::shared_ptr<Stmt> thenBranch,
+           std::shared_ptr<Stmt> elseBranch)
+        : keyword(std::move(keyword)),
+          condition(std::move(condition)),
+          thenBranch(std::move(thenBranch)),
+          elseBranch(std::move(elseBranch)) {}
 
     void accept(StmtVisitor &visitor) override {
-        visitor.visitIfStmt(std::make_shared<IfStmt>(*this));
+        visitor.visitIfStmt(*this);
     }
 };
 
-struct PrintStmt : public Stmt {
+struct PrintStmt : public Stmt, public std::enable_shared_from_this<PrintStmt> {
     std::shared_ptr<Expr> expression;
 
     PrintStmt(std::shared_ptr<Expr> expression) : expression(std::move(expression)) {}
 
     void accept(StmtVisitor &visitor) override {
-        visitor.visitPrintStmt(std::make_shared<PrintStmt>(*this));
+        visitor.visitPrintStmt(*this);
     }
 };
 
-struct ReturnStmt : public Stmt {
+struct ReturnStmt : public Stmt, public std::enable_shared_from_this<ReturnStmt> {
     Token keyword;
     std::shared_ptr<Expr> value;
+    // Set by the Resolver when value is a call whose result is returned directly.
+    bool isTailCall = false;
 
     ReturnStmt(Token keyword, std::shared_ptr<Expr> value) : keyword(std::move(keyword)), value(std::move(value)) {}
 
     void accept(StmtVisitor &visitor) override {
-        visitor.visitReturnStmt(std::make_shared<ReturnStmt>(*this));
+        visitor.visitReturnStmt(*this);
     }
 };
 
-struct WhileStmt : public Stmt {
+// A while loop, such as a desugared for, whose condition compares a NUMBER local and whose body ends by stepping that
+// local by a constant. Set by TypeInference; the interpreter then runs the rest of the body and steps the raw double
+// itself, re-reading the local and the bound every iteration since the body may assign either.
+struct CountedLoop {
+    int slot;
+    double step;
+    std::shared_ptr<Stmt> body;
+    std::shared_ptr<Stmt> increment;
+};
+
+struct WhileStmt : public Stmt, public std::enable_shared_from_this<WhileStmt> {
+    Token keyword;
     std::shared_ptr<Expr> condition;
     std::shared_ptr<Stmt> body;
+    ConditionSpecialization specialization = ConditionSpecialization::UNINITIALIZED;
+    SpecializationStats stats;
+    // Set by TypeInference when the condition compares two proven numbers.
+    bool numberCondition = false;
+    // Only used while numberCondition holds.
+    std::unique_ptr<CountedLoop> counted;
 
-    WhileStmt(std::shared_ptr<Expr> condition, std::shared_ptr<Stmt> body)
-        : condition(std::move(condition)), body(std::move(body)) {}
+    WhileStmt(Token keyword, std::shared_ptr<Expr> condition, std::shared_ptr<Stmt> body)
+        : keyword(std::move(keyword)), condition(std::move(condition)), body(std::move(body)) {}
 
     void accept(StmtVisitor &visitor) override {
-        visitor.visitWhileStmt(std::make_shared<WhileStmt>(*this));
+        visitor.visitWhileStmt(*this);
     }
 };
 
-struct VarStmt : public Stmt {
+struct VarStmt : public Stmt, public std::enable_shared_from_this<VarStmt> {
     Token name;
     std::shared_ptr<Expr> initializer;
+    VariableBinding binding;
 
     VarStmt(Token name, std::shared_ptr<Expr> initializer)
         : name(std::move(name)), initializer(std::move(initializer)) {}
 
     void accept(StmtVisitor &visitor) override {
-        visitor.visitVarStmt(std::make_shared<VarStmt>(*this));
+        visitor.visitVarStmt(*this);
+    }
+};
+
+struct YieldStmt : public Stmt, public std::enable_shared_from_this<YieldStmt> {
+    Token keyword;
+    std::shared_ptr<Expr> value;
+
+    YieldStmt(Token keyword, std::shared_ptr<Expr> value) : keyword(std::move(keyword)), value(std::move(value)) {}
+
+    void accept(StmtVisitor &visitor) override {
+        visitor.visitYieldStmt(*this);
     }
 };
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "Expr.h"
+#include "Stmt.h"
+
+struct TypeInferenceStats {
+    std::uint64_t numberVariables = 0;
+    std::uint64_t numberExpressions = 0;
+    std::uint64_t speculatedFunctions = 0;
+    std::uint64_t invalidations = 0;
+    std::uint64_t countedLoops = 0;
+};
+
+// Proves which locals and expressions of the resolved program only ever hold numbers, so the interpreter can keep
+// them as raw doubles. A local is a number if every value stored into its frame slot is; parameters of global
+// functions that are only ever called directly are assumed numbers when every call site passes one, which the
+// interpreter then checks on entry. Both are greatest fixed points: start from "number" and demote until nothing
+// changes.
+class TypeInference : public ExprVisitor, public StmtVisitor {
+ public:
+    void infer(const std::vector<std::shared_ptr<Stmt>> &statements);
+    const TypeInferenceStats &stats() const;
+
+    std::any visitArrayExpr(ArrayExpr &expr) override;
+    std::any visitAssignExpr(AssignExpr &expr) override;
+    std::any visitBinaryExpr(BinaryExpr &expr) override;
+    std::any visitCallExpr(CallExpr &expr) override;
+    std::any visitGetExpr(GetExpr &expr) override;
+    std::any visitGroupingExpr(GroupingExpr &expr) override;
+    std::any visitIndexExpr(IndexExpr &expr) override;
+    std::any visitLiteralExpr(LiteralExpr &expr) override;
+    std::any visitLogicalExpr(LogicalExpr &expr) override;
+    std::any visitMapExpr(MapExpr &expr) override;
+    std::any visitSetExpr(SetExpr &expr) override;
+    std::any visitSetIndexExpr(SetIndexExpr &expr) override;
+    std::any visitSuperExpr(SuperExpr &expr) override;
+    std::any visitThisExpr(ThisExpr &expr) override;
+    std::any visitUnaryExpr(UnaryExpr &expr) override;
+    std::any visitVariableExpr(VariableExpr &expr) override;
+    void visitBlockStmt(BlockStmt &stmt) override;
+    void visitClassStmt(ClassStmt &stmt) override;
+    void visitExpressionStmt(ExpressionStmt &stmt) override;
+    void visitFunctionStmt(FunctionStmt &stmt) override;
+    void visitIfStmt(IfStmt &stmt) override;
+    void visitPrintStmt(PrintStmt &stmt) override;
+    void visitReturnStmt(ReturnStmt &stmt) override;
+    void visitWhileStmt(WhileStmt &stmt) override;
+    void visitVarStmt(VarStmt &stmt) override;
+    void visitYieldStmt(YieldStmt &stmt) override;
+
+ private:
+    enum class Pass {
+        // Finds every function and how each global name is used.
+        COLLECT,
+        // Demotes frame slots and parameters that may hold something other than a number.
+        ANALYZE,
+        // Rewrites bindings and sets the flags the interpreter reads.
+        ANNOTATE,
+    };
+
+    Pass pass = Pass::COLLECT;
+    std::vector<std::shared_ptr<FunctionStmt>> functions;
+    std::map<std::string, std::vector<FunctionStmt *>> globalFunctions;
+    // Global names declared with var, assigned, or read other than as the callee of a call.
+    std::set<std::string> unknownGlobals;
+    // Global functions whose every call is known, and which of their parameters every call passes a number.
+    std::map<std::string, FunctionStmt *> knownFunctions;
+    std::map<FunctionStmt *, std::vector<bool>> numberParameters;
+
+    // Frame slots of the body being analyzed that were demoted so far.
+    std::vector<bool> demoted;
+    bool changed = false;
+    bool parametersDemoted = false;
+    // Where the body being annotated records its proofs, or nullptr for top-level code, which never undoes them.
+    TypeProofs *proofs = nullptr;
+    TypeInferenceStats inferenceStats;
+
+    void infer(const std::vector<std::shared_ptr<Stmt>> &statements, FunctionStmt *declaration, Pass last);
+    void walk(const std::vector<std::shared_ptr<Stmt>> &statements);
+    bool isNumber(const std::shared_ptr<Expr> &expr);
+    bool isNumberSlot(std::size_t slot) const;
+    bool isNumberLocal(const VariableBinding &binding) const;
+    void demote(std::size_t slot);
+    void store(VariableBinding &binding, bool number);
+    void declare(VariableBinding &binding);
+    void convert(VariableBinding &binding);
+    bool annotate(Expr &expr, bool number);
+    void annotate(bool &flag);
+    void findCountedLoop(WhileStmt &stmt);
+};
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <any>
+#include <cstddef>
+
+#include "Ref.h"
+
+// A local captured by at least one closure. The declaring frame and every closure that uses the variable share it.
+//
+// A captured variable declared in a loop body gets a new cell on every iteration, so cells are allocated from a
+// free list of the thread's rather than the heap.
+struct Upvalue : RefCounted {
+    std::any value;
+
+    explicit Upvalue(std::any value) : value{std::move(value)} {}
+
+    static void *operator new(std::size_t size);
+    static void operator delete(void *cell);
+};
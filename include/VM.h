@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Bytecode.h"
+#include "Stmt.h"
+#include "Value.h"
+
+// Runs register bytecode compiled from the resolved AST. Lox calls push frames onto an explicit stack instead of
+// recursing natively, so only the call depth limit bounds recursion.
+class VM {
+ public:
+    // Thrown by the BytecodeCompiler for a program the VM cannot run; the caller falls back to another engine.
+    struct Unsupported {
+        const char *reason;
+    };
+
+    VM();
+    // Returns false, without running anything, when the program cannot be compiled to bytecode.
+    bool interpret(const std::vector<std::shared_ptr<Stmt>> &statements, std::size_t frameSize);
+    void setMaxCallDepth(std::size_t depth);
+    void printStats(std::ostream &out);
+    std::uint16_t globalSlot(const std::string &name);
+
+ private:
+    struct CallFrame {
+        // Kept alive by the caller's callee register, or by hold after a tail call replaced that.
+        ClosureObj *closure;
+        Instruction *ip;
+        std::size_t base;
+        // Caller register the result goes to.
+        std::uint16_t dest;
+        Ref<ClosureObj> hold;
+    };
+
+    std::vector<Value> stack;
+    std::vector<CallFrame> frames;
+    std::size_t maxCallDepth;
+    std::vector<Value> globals;
+    std::vector<std::string> globalNames;
+    std::unordered_map<std::string, std::uint16_t> globalSlots;
+    // Every compiled prototype, for the quickening statistics.
+    std::vector<std::shared_ptr<Proto>> prototypes;
+
+    std::uint64_t dispatched = 0;
+    std::uint64_t calls = 0;
+
+    void run();
+    void reserveStack(std::size_t size);
+    void collectPrototypes(const std::shared_ptr<Proto> &proto);
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "LoxString.h"
+#include "Ref.h"
+
+// Heap objects a Value can refer to.
+struct Obj : RefCounted {
+    virtual ~Obj() = default;
+};
+
+struct StringObj : Obj {
+    Ref<LoxString> text;
+
+    explicit StringObj(Ref<LoxString> text) : text{std::move(text)} {}
+};
+
+// A tagged Lox value for the bytecode VM. Type checks are a compare of the tag instead of a std::any type lookup.
+struct Value {
+    enum class Type : std::uint8_t {
+        NIL,
+        BOOL,
+        NUMBER,
+        STRING,
+        FUNCTION,
+        CELL,
+        NATIVE,
+        // Only found in the global table, for names that have not been defined yet.
+        UNDEFINED,
+    };
+
+    Type type = Type::NIL;
+    union {
+        bool boolean;
+        double number;
+    };
+    Ref<Obj> object;
+
+    Value() : number{0} {}
+    Value(bool boolean) : type{Type::BOOL}, boolean{boolean} {}
+    Value(double number) : type{Type::NUMBER}, number{number} {}
+    Value(Type type, Ref<Obj> object) : type{type}, number{0}, object{std::move(object)} {}
+
+    static Value string(std::string chars) {
+        return string(makeRef<LoxString>(std::move(chars)));
+    }
+
+    static Value string(Ref<LoxString> text) {
+        return Value{Type::STRING, makeRef<StringObj>(std::move(text))};
+    }
+
+    bool isNumber() const {
+        return type == Type::NUMBER;
+    }
+
+    const std::string &asString() const {
+        return asText()->str();
+    }
+
+    const Ref<LoxString> &asText() const {
+        return static_cast<StringObj *>(object.get())->text;
+    }
+
+    bool isTruthy() const {
+        return type == Type::BOOL ? boolean : type != Type::NIL;
+    }
+
+    bool equals(const Value &other) const;
+    std::string toString() const;
+};
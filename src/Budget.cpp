@@ -0,0 +1,54 @@
+#include "../include/Budget.h"
+
+#include <algorithm>
+#include <limits>
+
+void Budget::setFuel(std::uint64_t fuel) {
+    this->fuel = std::min<std::uint64_t>(fuel, std::numeric_limits<std::int64_t>::max());
+}
+
+void Budget::setTimeLimit(std::chrono::milliseconds limit) {
+    timeLimit = limit;
+}
+
+bool Budget::limited() const {
+    return fuel != 0 || timeLimit.count() != 0;
+}
+
+void Budget::start() {
+    fuelLeft.store(static_cast<std::int64_t>(fuel), std::memory_order_relaxed);
+    deadline = timeLimit.count() != 0 ? Clock::now() + timeLimit : Clock::time_point::max();
+}
+
+std::int64_t Budget::draw(const char*& error) {
+    if (!limited()) {
+        return std::numeric_limits<std::int64_t>::max();
+    }
+    if (pastDeadline()) {
+        error = "Deadline exceeded.";
+        return 0;
+    }
+    if (fuel == 0) {
+        return BATCH;
+    }
+    // Workers racing for the last of it may take it below 0; whoever finds nothing left stops.
+    std::int64_t left = fuelLeft.fetch_sub(BATCH, std::memory_order_relaxed);
+    if (left <= 0) {
+        error = "Out of fuel.";
+        return 0;
+    }
+    return std::min(left, BATCH);
+}
+
+int Budget::clampWait(int wait) const {
+    if (deadline == Clock::time_point::max()) {
+        return wait;
+    }
+    auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - Clock::now()).count();
+    remaining = std::clamp<decltype(remaining)>(remaining, 0, std::numeric_limits<int>::max());
+    return wait < 0 || remaining < wait ? static_cast<int>(remaining) : wait;
+}
+
+bool Budget::pastDeadline() const {
+    return deadline != Clock::time_point::max() && Clock::now() >= deadline;
+}
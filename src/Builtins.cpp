@@ -0,0 +1,328 @@
+#include "../include/Builtins.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "../include/EventLoop.h"
+#include "../include/Interpreter.h"
+#include "../include/LoxArray.h"
+#include "../include/LoxFiber.h"
+#include "../include/LoxFile.h"
+#include "../include/LoxMap.h"
+#include "../include/LoxString.h"
+#include "../include/Parallel.h"
+#include "../include/RuntimeError.h"
+
+LoxNative::LoxNative(std::string name, std::size_t arity, Body body, std::size_t optional)
+    : name{std::move(name)}, arity{arity}, body{body}, optional{optional} {}
+
+std::string LoxNative::toString() const {
+    return "<native fn>";
+}
+
+namespace {
+
+// Two doubles at a time: the width of the SSE2 registers every x86-64 CPU has, and of NEON's on AArch64, so the
+// compiler lowers each operation on these to one SIMD instruction without needing flags for wider ones.
+typedef double Lanes __attribute__((vector_size(2 * sizeof(double))));
+constexpr std::size_t LANES = 2;
+// Loops handle two vectors per iteration, so the additions of the reductions do not each wait for the previous one.
+constexpr std::size_t STEP = 2 * LANES;
+
+Lanes load(const double* elements) {
+    Lanes lanes;
+    std::memcpy(&lanes, elements, sizeof lanes);
+    return lanes;
+}
+
+void store(double* elements, Lanes lanes) {
+    std::memcpy(elements, &lanes, sizeof lanes);
+}
+
+// The reductions keep separate partial sums per lane, so they may round differently from a left-to-right loop.
+double sumKernel(const double* x, std::size_t n) {
+    Lanes even{};
+    Lanes odd{};
+    std::size_t i = 0;
+    for (; i + STEP <= n; i += STEP) {
+        even += load(x + i);
+        odd += load(x + i + LANES);
+    }
+    Lanes partial = even + odd;
+    double sum = partial[0] + partial[1];
+    for (; i < n; ++i) {
+        sum += x[i];
+    }
+    return sum;
+}
+
+double dotKernel(const double* x, const double* y, std::size_t n) {
+    Lanes even{};
+    Lanes odd{};
+    std::size_t i = 0;
+    for (; i + STEP <= n; i += STEP) {
+        even += load(x + i) * load(y + i);
+        odd += load(x + i + LANES) * load(y + i + LANES);
+    }
+    Lanes partial = even + odd;
+    double sum = partial[0] + partial[1];
+    for (; i < n; ++i) {
+        sum += x[i] * y[i];
+    }
+    return sum;
+}
+
+void scaleKernel(double* x, double factor, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + STEP <= n; i += STEP) {
+        store(x + i, load(x + i) * factor);
+        store(x + i + LANES, load(x + i + LANES) * factor);
+    }
+    for (; i < n; ++i) {
+        x[i] *= factor;
+    }
+}
+
+void axpyKernel(double a, const double* x, double* y, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + STEP <= n; i += STEP) {
+        store(y + i, a * load(x + i) + load(y + i));
+        store(y + i + LANES, a * load(x + i + LANES) + load(y + i + LANES));
+    }
+    for (; i < n; ++i) {
+        y[i] += a * x[i];
+    }
+}
+
+// The least element for MIN and the greatest otherwise, or NaN if any element is, wherever it is: a NaN replaces any
+// candidate and, since every comparison with it is false, is never replaced. n must not be 0.
+template <bool MIN>
+double extremeKernel(const double* x, std::size_t n) {
+    Lanes extreme = Lanes{} + x[0];
+    std::size_t i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        Lanes lanes = load(x + i);
+        extreme = ((MIN ? lanes < extreme : lanes > extreme) | (lanes != lanes)) ? lanes : extreme;
+    }
+    double result = x[0];
+    for (std::size_t lane = 0; lane < LANES; ++lane) {
+        if ((MIN ? extreme[lane] < result : extreme[lane] > result) || extreme[lane] != extreme[lane]) {
+            result = extreme[lane];
+        }
+    }
+    for (; i < n; ++i) {
+        if ((MIN ? x[i] < result : x[i] > result) || x[i] != x[i]) {
+            result = x[i];
+        }
+    }
+    return result;
+}
+
+LoxArray& checkArray(const Token& paren, std::any& argument) {
+    auto* array = std::any_cast<Ref<LoxArray>>(&argument);
+    if (array == nullptr) {
+        throw RuntimeError{paren, "Argument must be an array."};
+    }
+    return **array;
+}
+
+std::vector<double>& checkNumbers(const Token& paren, std::any& argument) {
+    LoxArray& array = checkArray(paren, argument);
+    if (!array.unbox()) {
+        throw RuntimeError{paren, "Array elements must be numbers."};
+    }
+    return array.numbers;
+}
+
+double checkNumber(const Token& paren, const std::any& argument) {
+    const double* number = std::any_cast<double>(&argument);
+    if (number == nullptr) {
+        throw RuntimeError{paren, "Argument must be a number."};
+    }
+    return *number;
+}
+
+void checkSameLength(const Token& paren, const std::vector<double>& x, const std::vector<double>& y) {
+    if (x.size() != y.size()) {
+        throw RuntimeError{paren, "Arrays must have the same length."};
+    }
+}
+
+LoxMap& checkMap(const Token& paren, std::any& argument) {
+    auto* map = std::any_cast<Ref<LoxMap>>(&argument);
+    if (map == nullptr) {
+        throw RuntimeError{paren, "Argument must be a map."};
+    }
+    return **map;
+}
+
+const std::any& checkKey(const Token& paren, const std::any& argument) {
+    if (!LoxMap::isKey(argument)) {
+        throw RuntimeError{paren, "Map keys must be nil, booleans, numbers or strings."};
+    }
+    return argument;
+}
+
+std::any clockNow(Interpreter& interpreter, const Token& paren, std::any* arguments) {
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    return std::chrono::duration<double>{now}.count();
+}
+
+std::any len(Interpreter& interpreter, const Token& paren, std::any* arguments) {
+    if (auto* map = std::any_cast<Ref<LoxMap>>(&arguments[0])) {
+        return static_cast<double>((*map)->size());
+    }
+    if (auto* array = std::any_cast<Ref<LoxArray>>(&arguments[0])) {
+        return static_cast<double>((*array)->size());
+    }
+    throw RuntimeError{paren, "Argument must be an array or a map."};
+}
+
+std::any push(Interpreter& interpreter, const Token& paren, std::any* arguments) {
+    checkArray(paren, arguments[0]).push(std::move(arguments[1]));
+    return nullptr;
+}
+
+std::any has(Interpreter& interpreter, const Token& paren, std::any* arguments) {
+    return checkMap(paren, arguments[0]).get(checkKey(paren, arguments[1])) != nullptr;
+}
+
+std::any removeKey(Interpreter& interpreter, const Token& paren, std::any* arguments) {
+    return checkMap(paren, arguments[0]).remove(checkKey(paren, arguments[1]));
+}
+
+// keys and values list the entries in the order they were first added.
+std::any keys(Interpreter& interpreter, const Token& paren, std::any* arguments) {
+    LoxMap& map = checkMap(paren, arguments[0]);
+    auto keys = makeRef<LoxArray>();
+    for (const LoxMap::Entry& entry : map.entries()) {
+        if (entry.key.has_value()) {
+            keys->push(entry.key);
+        }
+    }
+    return keys;
+}
+
+std::any values(Interpreter& interpreter, const Token& paren, std::any* arguments) {
+    LoxMap& map = checkMap(paren, arguments[0]);
+    auto values = makeRef<LoxArray>();
+    for (const LoxMap::Entry& entry : map.entries()) {
+        if (entry.key.has_value()) {
+            values->push(entry.value);
+        }
+    }
+    return values;
+}
+
+std::any sum(Interpreter& interpreter, const Token& paren, std::any* arguments) {
+    std::vector<double>& x = checkNumbers(paren, arguments[0]);
+    return sumKernel(x.data(), x.size());
+}
+
+std::any dot(Interpreter& interpreter, const Token& paren, std::any* arguments) {
+    std::vector<double>& x = checkNumbers(paren, arguments[0]);
+    std::vector<double>& y = checkNumbers(paren, arguments[1]);
+    checkSameLength(paren, x, y);
+    return dotKernel(x.data(), y.data(), x.size());
+}
+
+std::any scale(Interpreter& interpreter, const Token& paren, std::any* arguments) {
+    std::vector<double>& x = checkNumbers(paren, arguments[0]);
+    scaleKernel(x.data(), checkNumber(paren, arguments[1]), x.size());
+    return nullptr;
+}
+
+// y = a * x + y, in place.
+std::any axpy(Interpreter& interpreter, const Token& paren, std::any* arguments) {
+    double a = checkNumber(paren, arguments[0]);
+    std::vector<double>& x = checkNumbers(paren, arguments[1]);
+    std::vector<double>& y = checkNumbers(paren, arguments[2]);
+    checkSameLength(paren, x, y);
+    axpyKernel(a, x.data(), y.data(), x.size());
+    return nullptr;
+}
+
+template <bool MIN>
+std::any extreme(Interpreter& interpreter, const Token& paren, std::any* arguments) {
+    std::vector<double>& x = checkNumbers(paren, arguments[0]);
+    if (x.empty()) {
+        return nullptr;
+    }
+    return extremeKernel<MIN>(x.data(), x.size());
+}
+
+// Numbers sort ascending with NaNs last; an array of strings sorts by their text.
+std::any sort(Interpreter& interpreter, const Token& paren, std::any* arguments) {
+    LoxArray& array = checkArray(paren, arguments[0]);
+    if (array.unbox()) {
+        auto end = std::partition(array.numbers.begin(), array.numbers.end(), [](double x) { return x == x; });
+        std::sort(array.numbers.begin(), end);
+        return nullptr;
+    }
+
+    for (const std::any& value : array.values) {
+        if (value.type() != typeid(Ref<LoxString>)) {
+            throw RuntimeError{paren, "Can only sort numbers or strings."};
+        }
+    }
+    std::sort(array.values.begin(), array.values.end(), [](const std::any& a, const std::any& b) {
+        return (*std::any_cast<Ref<LoxString>>(&a))->view() < (*std::any_cast<Ref<LoxString>>(&b))->view();
+    });
+    return nullptr;
+}
+
+LoxFiber& checkFiber(const Token& paren, std::any& argument) {
+    auto* fiber = std::any_cast<Ref<LoxFiber>>(&argument);
+    if (fiber == nullptr) {
+        throw RuntimeError{paren, "Argument must be a fiber."};
+    }
+    return **fiber;
+}
+
+std::any next(Interpreter& interpreter, const Token& paren, std::any* arguments) {
+    return interpreter.resume(checkFiber(paren, arguments[0]), paren);
+}
+
+std::any done(Interpreter& interpreter, const Token& paren, std::any* arguments) {
+    return checkFiber(paren, arguments[0]).state == LoxFiber::State::DONE;
+}
+
+}  // namespace
+
+std::vector<Ref<LoxNative>> builtins() {
+    return {
+        makeRef<LoxNative>("clock", 0, clockNow),
+        makeRef<LoxNative>("len", 1, len),
+        makeRef<LoxNative>("push", 2, push),
+        makeRef<LoxNative>("has", 2, has),
+        makeRef<LoxNative>("remove", 2, removeKey),
+        makeRef<LoxNative>("keys", 1, keys),
+        makeRef<LoxNative>("values", 1, values),
+        makeRef<LoxNative>("sum", 1, sum),
+        makeRef<LoxNative>("dot", 2, dot),
+        makeRef<LoxNative>("scale", 2, scale),
+        makeRef<LoxNative>("axpy", 3, axpy),
+        makeRef<LoxNative>("min", 1, extreme<true>),
+        makeRef<LoxNative>("max", 1, extreme<false>),
+        makeRef<LoxNative>("sort", 1, sort),
+        makeRef<LoxNative>("parallelMap", 2, parallelMap),
+        makeRef<LoxNative>("parallelReduce", 3, parallelReduce),
+        makeRef<LoxNative>("next", 1, next),
+        makeRef<LoxNative>("done", 1, done),
+        makeRef<LoxNative>("setTimeout", 2, setTimeout),
+        makeRef<LoxNative>("sleep", 1, sleepFor),
+        makeRef<LoxNative>("readFile", 2, readFile, 1),
+        makeRef<LoxNative>("readLines", 2, readLines, 1),
+        makeRef<LoxNative>("openFile", 1, openFile),
+        makeRef<LoxNative>("readLine", 2, readLine, 1),
+        makeRef<LoxNative>("readAll", 1, readAll),
+        makeRef<LoxNative>("split", 2, split),
+    };
+}
+
+bool isBuiltin(const std::string& name) {
+    static const std::vector<Ref<LoxNative>> natives = builtins();
+    return std::any_of(natives.begin(), natives.end(),
+                       [&](const Ref<LoxNative>& native) { return native->name == name; });
+}
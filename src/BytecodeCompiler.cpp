@@ -0,0 +1,493 @@
+#include "../include/BytecodeCompiler.h"
+
+#include <algorithm>
+
+#include "../include/Builtins.h"
+#include "../include/VM.h"
+
+BytecodeCompiler::BytecodeCompiler(VM& vm, std::shared_ptr<Proto> proto, std::size_t frameSize)
+    : vm{vm}, proto{std::move(proto)}, frameSize{frameSize}, top{frameSize} {
+    this->proto->registers = std::max(this->proto->registers, frameSize);
+}
+
+void BytecodeCompiler::compile(const std::vector<std::shared_ptr<Stmt>>& statements) {
+    for (const std::shared_ptr<Stmt>& statement : statements) {
+        compile(statement);
+    }
+    emit(OpCode::RETURN_NIL, 0);
+}
+
+std::size_t BytecodeCompiler::emit(OpCode op, int a, int b, int c, std::uint8_t flags) {
+    if (a > UINT16_MAX || b > UINT16_MAX || c > UINT16_MAX) {
+        throw VM::Unsupported{"function too large for bytecode"};
+    }
+    proto->code.push_back(Instruction{op, flags, static_cast<std::uint16_t>(a), static_cast<std::uint16_t>(b),
+                                      static_cast<std::uint16_t>(c)});
+    proto->lines.push_back(line);
+    return proto->code.size() - 1;
+}
+
+std::size_t BytecodeCompiler::emitJump(OpCode op, int a) {
+    return emit(op, a);
+}
+
+void BytecodeCompiler::patchJump(std::size_t jump) {
+    proto->code[jump].setTarget(proto->code.size());
+}
+
+void BytecodeCompiler::emitLoop(std::size_t start) {
+    proto->code[emit(OpCode::JUMP, 0)].setTarget(start);
+}
+
+int BytecodeCompiler::addConstant(Value value) {
+    proto->constants.push_back(std::move(value));
+    return proto->constants.size() - 1;
+}
+
+int BytecodeCompiler::allocate(std::size_t count) {
+    std::size_t first = top;
+    top += count;
+    proto->registers = std::max(proto->registers, top);
+    return first;
+}
+
+void BytecodeCompiler::compile(const std::shared_ptr<Stmt>& stmt) {
+    stmt->accept(*this);
+}
+
+void BytecodeCompiler::compileInto(const std::shared_ptr<Expr>& expr, int dest) {
+    int enclosing = target;
+    target = dest;
+    expr->accept(*this);
+    target = enclosing;
+}
+
+// Returns the register holding the value of expr: a local's own register, or a new temporary.
+int BytecodeCompiler::compileOperand(const std::shared_ptr<Expr>& expr) {
+    int local = localRegister(expr);
+    if (local >= 0) {
+        return local;
+    }
+
+    int dest = allocate();
+    compileInto(expr, dest);
+    return dest;
+}
+
+int BytecodeCompiler::localRegister(const std::shared_ptr<Expr>& expr) {
+    if (auto grouping = std::dynamic_pointer_cast<GroupingExpr>(expr)) {
+        return localRegister(grouping->expression);
+    }
+    if (auto variable = std::dynamic_pointer_cast<VariableExpr>(expr)) {
+        if (variable->binding.kind == VariableBinding::Kind::LOCAL) {
+            return variable->binding.index;
+        }
+    }
+    return -1;
+}
+
+bool BytecodeCompiler::constantOperand(const std::shared_ptr<Expr>& expr, int& index) {
+    auto literal = std::dynamic_pointer_cast<LiteralExpr>(expr);
+    if (literal == nullptr) {
+        return false;
+    }
+
+    if (literal->value.type() == typeid(double)) {
+        index = addConstant(Value{std::any_cast<double>(literal->value)});
+        return true;
+    }
+    if (literal->value.type() == typeid(Ref<LoxString>)) {
+        index = addConstant(Value::string(std::any_cast<Ref<LoxString>>(literal->value)));
+        return true;
+    }
+    return false;
+}
+
+// Whether evaluating expr may assign a variable, which would make reading a left operand in place unsafe.
+static bool assigns(const std::shared_ptr<Expr>& expr) {
+    if (std::dynamic_pointer_cast<AssignExpr>(expr) != nullptr) {
+        return true;
+    }
+    if (auto binary = std::dynamic_pointer_cast<BinaryExpr>(expr)) {
+        return assigns(binary->left) || assigns(binary->right);
+    }
+    if (auto logical = std::dynamic_pointer_cast<LogicalExpr>(expr)) {
+        return assigns(logical->left) || assigns(logical->right);
+    }
+    if (auto grouping = std::dynamic_pointer_cast<GroupingExpr>(expr)) {
+        return assigns(grouping->expression);
+    }
+    if (auto unary = std::dynamic_pointer_cast<UnaryExpr>(expr)) {
+        return assigns(unary->right);
+    }
+    if (auto call = std::dynamic_pointer_cast<CallExpr>(expr)) {
+        return assigns(call->callee) ||
+               std::any_of(call->arguments.begin(), call->arguments.end(),
+                           [](const std::shared_ptr<Expr>& argument) { return assigns(argument); });
+    }
+    return false;
+}
+
+int BytecodeCompiler::compileCall(const CallExpr& call) {
+    // The callee sits just below its arguments, which become the first registers of the called frame.
+    int callee = allocate(1 + call.arguments.size());
+    compileInto(call.callee, callee);
+    for (std::size_t i = 0; i < call.arguments.size(); ++i) {
+        compileInto(call.arguments[i], callee + 1 + i);
+    }
+    line = call.paren.line;
+    return callee;
+}
+
+std::any BytecodeCompiler::visitAssignExpr(AssignExpr& expr) {
+    int dest = target;
+    std::size_t mark = top;
+    int index = expr.binding.index;
+
+    if (expr.binding.kind == VariableBinding::Kind::LOCAL) {
+        compileInto(expr.value, index);
+        if (dest != DISCARD && dest != index) {
+            emit(OpCode::MOVE, dest, index);
+        }
+        top = mark;
+        return {};
+    }
+
+    int value = compileOperand(expr.value);
+    line = expr.name.line;
+    switch (expr.binding.kind) {
+        case VariableBinding::Kind::BOXED:
+            emit(OpCode::SET_CELL, index, value);
+            break;
+        case VariableBinding::Kind::UPVALUE:
+            emit(OpCode::SET_UPVALUE, value, index);
+            break;
+        case VariableBinding::Kind::GLOBAL:
+        default:
+            emit(OpCode::SET_GLOBAL, value, vm.globalSlot(expr.name.lexeme));
+            break;
+    }
+    if (dest != DISCARD && dest != value) {
+        emit(OpCode::MOVE, dest, value);
+    }
+    top = mark;
+    return {};
+}
+
+std::any BytecodeCompiler::visitBinaryExpr(BinaryExpr& expr) {
+    OpCode op;
+    switch (expr.op.type) {
+        case PLUS:
+            op = OpCode::ADD;
+            break;
+        case MINUS:
+            op = OpCode::SUBTRACT;
+            break;
+        case STAR:
+            op = OpCode::MULTIPLY;
+            break;
+        case SLASH:
+            op = OpCode::DIVIDE;
+            break;
+        case GREATER:
+            op = OpCode::GREATER;
+            break;
+        case GREATER_EQUAL:
+            op = OpCode::GREATER_EQUAL;
+            break;
+        case LESS:
+            op = OpCode::LESS;
+            break;
+        case LESS_EQUAL:
+            op = OpCode::LESS_EQUAL;
+            break;
+        case EQUAL_EQUAL:
+            op = OpCode::EQUAL;
+            break;
+        case BANG_EQUAL:
+        default:
+            op = OpCode::NOT_EQUAL;
+            break;
+    }
+
+    int dest = target;
+    std::size_t mark = top;
+    int left = localRegister(expr.left);
+    if (left < 0 || assigns(expr.right)) {
+        left = allocate();
+        compileInto(expr.left, left);
+    }
+
+    int right;
+    std::uint8_t flags = 0;
+    if (constantOperand(expr.right, right)) {
+        flags = Instruction::CONSTANT;
+    } else {
+        right = compileOperand(expr.right);
+    }
+
+    line = expr.op.line;
+    emit(op, dest, left, right, flags);
+    top = mark;
+    return {};
+}
+
+std::any BytecodeCompiler::visitCallExpr(CallExpr& expr) {
+    int dest = target;
+    std::size_t mark = top;
+    int callee = compileCall(expr);
+    emit(OpCode::CALL, dest, callee, expr.arguments.size());
+    top = mark;
+    return {};
+}
+
+// Like classes, arrays are left to the tree-walker.
+std::any BytecodeCompiler::visitArrayExpr(ArrayExpr& expr) {
+    throw VM::Unsupported{"uses arrays"};
+}
+
+// The VM has no objects besides strings and functions yet; programs with classes run on the tree-walker.
+std::any BytecodeCompiler::visitGetExpr(GetExpr& expr) {
+    throw VM::Unsupported{"uses classes"};
+}
+
+std::any BytecodeCompiler::visitGroupingExpr(GroupingExpr& expr) {
+    compileInto(expr.expression, target);
+    return {};
+}
+
+std::any BytecodeCompiler::visitIndexExpr(IndexExpr& expr) {
+    throw VM::Unsupported{"uses arrays"};
+}
+
+std::any BytecodeCompiler::visitLiteralExpr(LiteralExpr& expr) {
+    Value value;
+    if (expr.value.type() == typeid(double)) {
+        value = Value{std::any_cast<double>(expr.value)};
+    } else if (expr.value.type() == typeid(Ref<LoxString>)) {
+        value = Value::string(std::any_cast<Ref<LoxString>>(expr.value));
+    } else if (expr.value.type() == typeid(bool)) {
+        value = Value{std::any_cast<bool>(expr.value)};
+    }
+    emit(OpCode::LOAD_CONSTANT, target, addConstant(std::move(value)));
+    return {};
+}
+
+std::any BytecodeCompiler::visitLogicalExpr(LogicalExpr& expr) {
+    // The left operand is stored before the right one runs, so a local target must not see it early.
+    int dest = target;
+    std::size_t mark = top;
+    int result = dest < static_cast<int>(frameSize) ? allocate() : dest;
+
+    compileInto(expr.left, result);
+    std::size_t jump = emitJump(expr.op.type == OR ? OpCode::JUMP_IF_TRUE : OpCode::JUMP_IF_FALSE, result);
+    compileInto(expr.right, result);
+    patchJump(jump);
+
+    if (result != dest) {
+        emit(OpCode::MOVE, dest, result);
+    }
+    top = mark;
+    return {};
+}
+
+std::any BytecodeCompiler::visitMapExpr(MapExpr& expr) {
+    throw VM::Unsupported{"uses maps"};
+}
+
+std::any BytecodeCompiler::visitSetExpr(SetExpr& expr) {
+    throw VM::Unsupported{"uses classes"};
+}
+
+std::any BytecodeCompiler::visitSetIndexExpr(SetIndexExpr& expr) {
+    throw VM::Unsupported{"uses arrays"};
+}
+
+std::any BytecodeCompiler::visitSuperExpr(SuperExpr& expr) {
+    throw VM::Unsupported{"uses classes"};
+}
+
+std::any BytecodeCompiler::visitThisExpr(ThisExpr& expr) {
+    throw VM::Unsupported{"uses classes"};
+}
+
+std::any BytecodeCompiler::visitUnaryExpr(UnaryExpr& expr) {
+    int dest = target;
+    std::size_t mark = top;
+    int right = compileOperand(expr.right);
+    line = expr.op.line;
+    emit(expr.op.type == MINUS ? OpCode::NEGATE : OpCode::NOT, dest, right);
+    top = mark;
+    return {};
+}
+
+std::any BytecodeCompiler::visitVariableExpr(VariableExpr& expr) {
+    int index = expr.binding.index;
+    line = expr.name.line;
+    switch (expr.binding.kind) {
+        case VariableBinding::Kind::NUMBER:
+        case VariableBinding::Kind::LOCAL:
+            if (target != index) {
+                emit(OpCode::MOVE, target, index);
+            }
+            break;
+        case VariableBinding::Kind::BOXED:
+            emit(OpCode::GET_CELL, target, index);
+            break;
+        case VariableBinding::Kind::UPVALUE:
+            emit(OpCode::GET_UPVALUE, target, index);
+            break;
+        case VariableBinding::Kind::GLOBAL:
+            if (isBuiltin(expr.name.lexeme)) {
+                throw VM::Unsupported{"calls builtins"};
+            }
+            emit(OpCode::GET_GLOBAL, target, vm.globalSlot(expr.name.lexeme));
+            break;
+    }
+    return {};
+}
+
+void BytecodeCompiler::visitBlockStmt(BlockStmt& stmt) {
+    for (const std::shared_ptr<Stmt>& statement : stmt.statements) {
+        compile(statement);
+    }
+}
+
+void BytecodeCompiler::visitClassStmt(ClassStmt& stmt) {
+    throw VM::Unsupported{"uses classes"};
+}
+
+void BytecodeCompiler::visitExpressionStmt(ExpressionStmt& stmt) {
+    std::size_t mark = top;
+    bool assignment = std::dynamic_pointer_cast<AssignExpr>(stmt.expression) != nullptr;
+    compileInto(stmt.expression, assignment ? DISCARD : allocate());
+    top = mark;
+}
+
+void BytecodeCompiler::visitFunctionStmt(FunctionStmt& stmt) {
+    if (stmt.isGenerator) {
+        throw VM::Unsupported{"uses generators"};
+    }
+    auto function = std::make_shared<Proto>();
+    function->name = stmt.name.lexeme;
+    function->arity = stmt.parameters.size();
+    function->upvalues = stmt.upvalues;
+    for (std::size_t i = 0; i < stmt.parameters.size(); ++i) {
+        if (stmt.parameterBindings[i].kind == VariableBinding::Kind::BOXED) {
+            function->boxedParameters.push_back(i);
+        }
+    }
+    BytecodeCompiler{vm, function, static_cast<std::size_t>(stmt.frameSize)}.compile(stmt.body);
+
+    int prototype = proto->prototypes.size();
+    proto->prototypes.push_back(function);
+
+    std::size_t mark = top;
+    int index = stmt.binding.index;
+    line = stmt.name.line;
+    switch (stmt.binding.kind) {
+        case VariableBinding::Kind::NUMBER:
+        case VariableBinding::Kind::LOCAL:
+            emit(OpCode::CLOSURE, index, prototype);
+            break;
+        case VariableBinding::Kind::BOXED: {
+            // The cell exists before the closure captures its upvalues, so the function can refer to itself.
+            int closure = allocate();
+            emit(OpCode::LOAD_CONSTANT, index, addConstant(Value{}));
+            emit(OpCode::BOX, index);
+            emit(OpCode::CLOSURE, closure, prototype);
+            emit(OpCode::SET_CELL, index, closure);
+            break;
+        }
+        case VariableBinding::Kind::GLOBAL:
+        case VariableBinding::Kind::UPVALUE: {
+            int closure = allocate();
+            emit(OpCode::CLOSURE, closure, prototype);
+            emit(OpCode::DEFINE_GLOBAL, closure, vm.globalSlot(stmt.name.lexeme));
+            break;
+        }
+    }
+    top = mark;
+}
+
+void BytecodeCompiler::visitIfStmt(IfStmt& stmt) {
+    std::size_t mark = top;
+    int condition = compileOperand(stmt.condition);
+    top = mark;
+
+    std::size_t elseJump = emitJump(OpCode::JUMP_IF_FALSE, condition);
+    compile(stmt.thenBranch);
+    if (stmt.elseBranch == nullptr) {
+        patchJump(elseJump);
+        return;
+    }
+
+    std::size_t endJump = emitJump(OpCode::JUMP);
+    patchJump(elseJump);
+    compile(stmt.elseBranch);
+    patchJump(endJump);
+}
+
+void BytecodeCompiler::visitPrintStmt(PrintStmt& stmt) {
+    std::size_t mark = top;
+    emit(OpCode::PRINT, compileOperand(stmt.expression));
+    top = mark;
+}
+
+void BytecodeCompiler::visitReturnStmt(ReturnStmt& stmt) {
+    std::size_t mark = top;
+    if (stmt.isTailCall) {
+        const CallExpr& call = static_cast<const CallExpr&>(*stmt.value);
+        int callee = compileCall(call);
+        emit(OpCode::TAIL_CALL, 0, callee, call.arguments.size());
+    } else if (stmt.value != nullptr) {
+        emit(OpCode::RETURN, compileOperand(stmt.value));
+    } else {
+        emit(OpCode::RETURN_NIL, 0);
+    }
+    top = mark;
+}
+
+void BytecodeCompiler::visitWhileStmt(WhileStmt& stmt) {
+    std::size_t start = proto->code.size();
+    std::size_t mark = top;
+    int condition = compileOperand(stmt.condition);
+    top = mark;
+
+    std::size_t exitJump = emitJump(OpCode::JUMP_IF_FALSE, condition);
+    compile(stmt.body);
+    emitLoop(start);
+    patchJump(exitJump);
+}
+
+void BytecodeCompiler::visitVarStmt(VarStmt& stmt) {
+    std::size_t mark = top;
+    int index = stmt.binding.index;
+    line = stmt.name.line;
+
+    if (stmt.binding.kind == VariableBinding::Kind::GLOBAL) {
+        int value = allocate();
+        if (stmt.initializer != nullptr) {
+            compileInto(stmt.initializer, value);
+        } else {
+            emit(OpCode::LOAD_CONSTANT, value, addConstant(Value{}));
+        }
+        emit(OpCode::DEFINE_GLOBAL, value, vm.globalSlot(stmt.name.lexeme));
+        top = mark;
+        return;
+    }
+
+    if (stmt.initializer != nullptr) {
+        compileInto(stmt.initializer, index);
+    } else {
+        emit(OpCode::LOAD_CONSTANT, index, addConstant(Value{}));
+    }
+    if (stmt.binding.kind == VariableBinding::Kind::BOXED) {
+        emit(OpCode::BOX, index);
+    }
+    top = mark;
+}
+
+void BytecodeCompiler::visitYieldStmt(YieldStmt& stmt) {
+    throw VM::Unsupported{"uses generators"};
+}
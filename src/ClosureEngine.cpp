@@ -0,0 +1,702 @@
+#include "../include/ClosureEngine.h"
+
+#include <algorithm>
+
+#include "../include/Builtins.h"
+#include "../include/Interpreter.h"
+#include "../include/Lox.h"
+#include "../include/LoxString.h"
+#include "../include/NativeStack.h"
+#include "../include/Output.h"
+#include "../include/RuntimeError.h"
+
+[[noreturn]] __attribute__((noinline, cold)) static void throwError(const Token& token, const char* message) {
+    throw RuntimeError{token, message};
+}
+
+[[noreturn]] __attribute__((noinline, cold)) static void throwUndefined(const Token& name) {
+    throw RuntimeError{name, "Undefined variable '" + name.lexeme + "'."};
+}
+
+__attribute__((noinline)) static std::any concatenate(Ref<LoxString> left, const Ref<LoxString>& right) {
+    return LoxString::concatenate(std::move(left), right);
+}
+
+// Lowers one function body, or the top-level code, into closures over the engine's runtime state.
+class ClosureEngine::Compiler : public ExprVisitor, public StmtVisitor {
+ public:
+    Compiler(ClosureEngine& engine, std::size_t frameSize)
+        : engine{engine}, frameSize{frameSize}, frameExtent{frameSize} {}
+
+    Evaluate compile(const std::shared_ptr<Expr>& expr) {
+        return std::any_cast<Evaluate>(expr->accept(*this));
+    }
+
+    Execute compile(const std::shared_ptr<Stmt>& stmt) {
+        stmt->accept(*this);
+        return std::move(compiled);
+    }
+
+    Execute compileBlock(const std::vector<std::shared_ptr<Stmt>>& statements) {
+        std::vector<Execute> body;
+        for (const std::shared_ptr<Stmt>& statement : statements) {
+            body.push_back(compile(statement));
+        }
+        if (body.size() == 1) {
+            return std::move(body[0]);
+        }
+        return [body = std::move(body)]() {
+            for (const Execute& statement : body) {
+                if (statement()) {
+                    return true;
+                }
+            }
+            return false;
+        };
+    }
+
+    std::size_t extent() const {
+        return frameExtent;
+    }
+
+    std::any visitArrayExpr(ArrayExpr& expr) override;
+    std::any visitAssignExpr(AssignExpr& expr) override;
+    std::any visitBinaryExpr(BinaryExpr& expr) override;
+    std::any visitCallExpr(CallExpr& expr) override;
+    std::any visitGetExpr(GetExpr& expr) override;
+    std::any visitGroupingExpr(GroupingExpr& expr) override;
+    std::any visitIndexExpr(IndexExpr& expr) override;
+    std::any visitLiteralExpr(LiteralExpr& expr) override;
+    std::any visitLogicalExpr(LogicalExpr& expr) override;
+    std::any visitMapExpr(MapExpr& expr) override;
+    std::any visitSetExpr(SetExpr& expr) override;
+    std::any visitSetIndexExpr(SetIndexExpr& expr) override;
+    std::any visitSuperExpr(SuperExpr& expr) override;
+    std::any visitThisExpr(ThisExpr& expr) override;
+    std::any visitUnaryExpr(UnaryExpr& expr) override;
+    std::any visitVariableExpr(VariableExpr& expr) override;
+    void visitBlockStmt(BlockStmt& stmt) override;
+    void visitClassStmt(ClassStmt& stmt) override;
+    void visitExpressionStmt(ExpressionStmt& stmt) override;
+    void visitFunctionStmt(FunctionStmt& stmt) override;
+    void visitIfStmt(IfStmt& stmt) override;
+    void visitPrintStmt(PrintStmt& stmt) override;
+    void visitReturnStmt(ReturnStmt& stmt) override;
+    void visitWhileStmt(WhileStmt& stmt) override;
+    void visitVarStmt(VarStmt& stmt) override;
+    void visitYieldStmt(YieldStmt& stmt) override;
+
+ private:
+    // Compiled callee and arguments of a call, with the frame offset its arguments are evaluated into.
+    struct CallSite {
+        Evaluate callee;
+        std::vector<Evaluate> arguments;
+        std::size_t argumentBase;
+    };
+
+    CallSite compileCall(const CallExpr& call);
+
+    template <typename Operation>
+    Evaluate compileNumeric(const BinaryExpr& expr, const char* message, Operation operation);
+
+    ClosureEngine& engine;
+    const std::size_t frameSize;
+    // Arguments already evaluated by the calls enclosing the expression being compiled.
+    std::size_t temporaries = 0;
+    std::size_t frameExtent;
+    Execute compiled;
+};
+
+ClosureEngine::Compiler::CallSite ClosureEngine::Compiler::compileCall(const CallExpr& call) {
+    CallSite site{compile(call.callee), {}, frameSize + temporaries};
+
+    // Calls inside an argument place their own arguments above the ones evaluated before it.
+    std::size_t enclosing = temporaries;
+    for (std::size_t i = 0; i < call.arguments.size(); ++i) {
+        temporaries = site.argumentBase - frameSize + i;
+        site.arguments.push_back(compile(call.arguments[i]));
+    }
+    temporaries = enclosing;
+
+    frameExtent = std::max(frameExtent, site.argumentBase + call.arguments.size());
+    return site;
+}
+
+template <typename Operation>
+ClosureEngine::Evaluate ClosureEngine::Compiler::compileNumeric(const BinaryExpr& expr, const char* message,
+                                                                Operation operation) {
+    Evaluate left = compile(expr.left);
+    Token op = expr.op;
+
+    auto literal = std::dynamic_pointer_cast<LiteralExpr>(expr.right);
+    if (literal != nullptr && literal->value.type() == typeid(double)) {
+        double constant = std::any_cast<double>(literal->value);
+        return Evaluate{[left, constant, op, message, operation]() -> std::any {
+            std::any a = left();
+            if (const double* x = std::any_cast<double>(&a)) {
+                return operation(*x, constant);
+            }
+            throwError(op, message);
+        }};
+    }
+
+    Evaluate right = compile(expr.right);
+    return Evaluate{[left, right, op, message, operation]() -> std::any {
+        std::any a = left();
+        std::any b = right();
+        const double* x = std::any_cast<double>(&a);
+        const double* y = std::any_cast<double>(&b);
+        if (x != nullptr && y != nullptr) {
+            return operation(*x, *y);
+        }
+        throwError(op, message);
+    }};
+}
+
+std::any ClosureEngine::Compiler::visitAssignExpr(AssignExpr& expr) {
+    Evaluate value = compile(expr.value);
+    std::size_t index = expr.binding.index;
+    ClosureEngine* engine = &this->engine;
+
+    switch (expr.binding.kind) {
+        case VariableBinding::Kind::NUMBER:
+        case VariableBinding::Kind::LOCAL:
+            return Evaluate{[engine, value, index]() {
+                std::any result = value();
+                engine->stack[engine->base + index] = result;
+                return result;
+            }};
+        case VariableBinding::Kind::BOXED:
+            return Evaluate{[engine, value, index]() {
+                std::any result = value();
+                (*std::any_cast<Ref<Upvalue>>(&engine->stack[engine->base + index]))->value = result;
+                return result;
+            }};
+        case VariableBinding::Kind::UPVALUE:
+            return Evaluate{[engine, value, index]() {
+                std::any result = value();
+                engine->function->upvalues[index]->value = result;
+                return result;
+            }};
+        case VariableBinding::Kind::GLOBAL:
+        default:
+            if (isBuiltin(expr.name.lexeme)) {
+                throw Unsupported{"calls builtins"};
+            }
+            return Evaluate{[cell = engine->globalCell(expr.name.lexeme), value, name = expr.name]() {
+                std::any result = value();
+                if (!cell->defined) {
+                    throwUndefined(name);
+                }
+                cell->value = result;
+                return result;
+            }};
+    }
+}
+
+std::any ClosureEngine::Compiler::visitBinaryExpr(BinaryExpr& expr) {
+    static const char* const numbers = "Operands must be numbers.";
+
+    switch (expr.op.type) {
+        case MINUS:
+            return compileNumeric(expr, numbers, [](double a, double b) { return a - b; });
+        case SLASH:
+            return compileNumeric(expr, numbers, [](double a, double b) { return a / b; });
+        case STAR:
+            return compileNumeric(expr, numbers, [](double a, double b) { return a * b; });
+        case GREATER:
+            return compileNumeric(expr, numbers, [](double a, double b) { return a > b; });
+        case GREATER_EQUAL:
+            return compileNumeric(expr, numbers, [](double a, double b) { return a >= b; });
+        case LESS:
+            return compileNumeric(expr, numbers, [](double a, double b) { return a < b; });
+        case LESS_EQUAL:
+            return compileNumeric(expr, numbers, [](double a, double b) { return a <= b; });
+        default:
+            break;
+    }
+
+    if (expr.op.type == PLUS) {
+        auto literal = std::dynamic_pointer_cast<LiteralExpr>(expr.right);
+        if (literal != nullptr && literal->value.type() == typeid(double)) {
+            return compileNumeric(expr, "Operands must be two numbers or two strings.",
+                                  [](double a, double b) { return a + b; });
+        }
+    }
+
+    Evaluate left = compile(expr.left);
+    Evaluate right = compile(expr.right);
+    switch (expr.op.type) {
+        case PLUS:
+            return Evaluate{[left, right, op = expr.op]() -> std::any {
+                std::any a = left();
+                std::any b = right();
+                const double* x = std::any_cast<double>(&a);
+                const double* y = std::any_cast<double>(&b);
+                if (x != nullptr && y != nullptr) {
+                    return *x + *y;
+                }
+
+                Ref<LoxString>* s = std::any_cast<Ref<LoxString>>(&a);
+                const Ref<LoxString>* t = std::any_cast<Ref<LoxString>>(&b);
+                if (s != nullptr && t != nullptr) {
+                    return concatenate(std::move(*s), *t);
+                }
+                throwError(op, "Operands must be two numbers or two strings.");
+            }};
+        case EQUAL_EQUAL:
+            return Evaluate{[left, right]() -> std::any {
+                std::any a = left();
+                std::any b = right();
+                return Interpreter::isEqual(a, b);
+            }};
+        case BANG_EQUAL:
+        default:
+            return Evaluate{[left, right]() -> std::any {
+                std::any a = left();
+                std::any b = right();
+                return !Interpreter::isEqual(a, b);
+            }};
+    }
+}
+
+std::any ClosureEngine::Compiler::visitCallExpr(CallExpr& expr) {
+    CallSite site = compileCall(expr);
+    ClosureEngine* engine = &this->engine;
+
+    return Evaluate{[engine, site = std::move(site), paren = expr.paren]() {
+        // value keeps the function alive for the duration of the call.
+        std::any value = site.callee();
+        std::size_t argumentCount = site.arguments.size();
+        for (std::size_t i = 0; i < argumentCount; ++i) {
+            std::any argument = site.arguments[i]();
+            engine->stack[engine->base + site.argumentBase + i] = std::move(argument);
+        }
+
+        std::size_t callBase = engine->base + site.argumentBase;
+        Function* callee = engine->checkCallee(value, paren, callBase, argumentCount);
+        return engine->call(callee, callBase, paren);
+    }};
+}
+
+// Like classes, arrays are left to the tree-walker.
+std::any ClosureEngine::Compiler::visitArrayExpr(ArrayExpr& expr) {
+    throw Unsupported{"uses arrays"};
+}
+
+// Classes are only implemented by the tree-walker, which runs programs this engine declines.
+std::any ClosureEngine::Compiler::visitGetExpr(GetExpr& expr) {
+    throw Unsupported{"uses classes"};
+}
+
+std::any ClosureEngine::Compiler::visitGroupingExpr(GroupingExpr& expr) {
+    return compile(expr.expression);
+}
+
+std::any ClosureEngine::Compiler::visitIndexExpr(IndexExpr& expr) {
+    throw Unsupported{"uses arrays"};
+}
+
+std::any ClosureEngine::Compiler::visitLiteralExpr(LiteralExpr& expr) {
+    return Evaluate{[value = expr.value]() { return value; }};
+}
+
+std::any ClosureEngine::Compiler::visitLogicalExpr(LogicalExpr& expr) {
+    Evaluate left = compile(expr.left);
+    Evaluate right = compile(expr.right);
+
+    if (expr.op.type == OR) {
+        return Evaluate{[left, right]() {
+            std::any value = left();
+            return Interpreter::isTruthy(value) ? value : right();
+        }};
+    }
+    return Evaluate{[left, right]() {
+        std::any value = left();
+        return Interpreter::isTruthy(value) ? right() : value;
+    }};
+}
+
+std::any ClosureEngine::Compiler::visitMapExpr(MapExpr& expr) {
+    throw Unsupported{"uses maps"};
+}
+
+std::any ClosureEngine::Compiler::visitSetExpr(SetExpr& expr) {
+    throw Unsupported{"uses classes"};
+}
+
+std::any ClosureEngine::Compiler::visitSetIndexExpr(SetIndexExpr& expr) {
+    throw Unsupported{"uses arrays"};
+}
+
+std::any ClosureEngine::Compiler::visitSuperExpr(SuperExpr& expr) {
+    throw Unsupported{"uses classes"};
+}
+
+std::any ClosureEngine::Compiler::visitThisExpr(ThisExpr& expr) {
+    throw Unsupported{"uses classes"};
+}
+
+std::any ClosureEngine::Compiler::visitUnaryExpr(UnaryExpr& expr) {
+    Evaluate right = compile(expr.right);
+
+    if (expr.op.type == BANG) {
+        return Evaluate{[right]() -> std::any { return !Interpreter::isTruthy(right()); }};
+    }
+    return Evaluate{[right, op = expr.op]() -> std::any {
+        std::any value = right();
+        if (const double* number = std::any_cast<double>(&value)) {
+            return -*number;
+        }
+        throwError(op, "Operand must be a number.");
+    }};
+}
+
+std::any ClosureEngine::Compiler::visitVariableExpr(VariableExpr& expr) {
+    std::size_t index = expr.binding.index;
+    ClosureEngine* engine = &this->engine;
+
+    switch (expr.binding.kind) {
+        case VariableBinding::Kind::NUMBER:
+        case VariableBinding::Kind::LOCAL:
+            return Evaluate{[engine, index]() { return engine->stack[engine->base + index]; }};
+        case VariableBinding::Kind::BOXED:
+            return Evaluate{[engine, index]() {
+                return (*std::any_cast<Ref<Upvalue>>(&engine->stack[engine->base + index]))->value;
+            }};
+        case VariableBinding::Kind::UPVALUE:
+            return Evaluate{[engine, index]() { return engine->function->upvalues[index]->value; }};
+        case VariableBinding::Kind::GLOBAL:
+        default:
+            if (isBuiltin(expr.name.lexeme)) {
+                throw Unsupported{"calls builtins"};
+            }
+            return Evaluate{[cell = engine->globalCell(expr.name.lexeme), name = expr.name]() {
+                if (!cell->defined) {
+                    throwUndefined(name);
+                }
+                return cell->value;
+            }};
+    }
+}
+
+void ClosureEngine::Compiler::visitBlockStmt(BlockStmt& stmt) {
+    compiled = compileBlock(stmt.statements);
+}
+
+void ClosureEngine::Compiler::visitClassStmt(ClassStmt& stmt) {
+    throw Unsupported{"uses classes"};
+}
+
+void ClosureEngine::Compiler::visitExpressionStmt(ExpressionStmt& stmt) {
+    compiled = [expression = compile(stmt.expression)]() {
+        expression();
+        return false;
+    };
+}
+
+void ClosureEngine::Compiler::visitFunctionStmt(FunctionStmt& stmt) {
+    if (stmt.isGenerator) {
+        throw Unsupported{"uses generators"};
+    }
+    Compiler body{engine, static_cast<std::size_t>(stmt.frameSize)};
+    auto code = std::make_shared<CompiledFunction>();
+    code->name = stmt.name.lexeme;
+    code->arity = stmt.parameters.size();
+    for (std::size_t i = 0; i < stmt.parameters.size(); ++i) {
+        if (stmt.parameterBindings[i].kind == VariableBinding::Kind::BOXED) {
+            code->boxedParameters.push_back(i);
+        }
+    }
+    code->body = body.compileBlock(stmt.body);
+    code->frameExtent = body.extent();
+
+    std::shared_ptr<GlobalCell> cell;
+    if (stmt.binding.kind == VariableBinding::Kind::GLOBAL) {
+        cell = engine.globalCell(stmt.name.lexeme);
+    }
+
+    ClosureEngine* engine = &this->engine;
+    compiled = [engine, code, upvalues = stmt.upvalues, binding = stmt.binding, cell]() {
+        // A boxed name must exist before the upvalues are captured, so a local function can refer to itself.
+        Ref<Upvalue> self;
+        if (binding.kind == VariableBinding::Kind::BOXED) {
+            self = makeRef<Upvalue>(nullptr);
+            engine->stack[engine->base + binding.index] = self;
+        }
+
+        auto function = makeRef<Function>();
+        function->code = code;
+        function->upvalues.reserve(upvalues.size());
+        for (const FunctionStmt::UpvalueSource& source : upvalues) {
+            if (source.isLocal) {
+                function->upvalues.push_back(
+                    *std::any_cast<Ref<Upvalue>>(&engine->stack[engine->base + source.index]));
+            } else {
+                function->upvalues.push_back(engine->function->upvalues[source.index]);
+            }
+        }
+
+        if (self != nullptr) {
+            self->value = function;
+        } else if (cell != nullptr) {
+            cell->defined = true;
+            cell->value = function;
+        } else {
+            engine->stack[engine->base + binding.index] = function;
+        }
+        return false;
+    };
+}
+
+void ClosureEngine::Compiler::visitIfStmt(IfStmt& stmt) {
+    Evaluate condition = compile(stmt.condition);
+    Execute thenBranch = compile(stmt.thenBranch);
+
+    if (stmt.elseBranch == nullptr) {
+        compiled = [condition, thenBranch]() { return Interpreter::isTruthy(condition()) && thenBranch(); };
+        return;
+    }
+
+    Execute elseBranch = compile(stmt.elseBranch);
+    compiled = [condition, thenBranch, elseBranch]() {
+        return Interpreter::isTruthy(condition()) ? thenBranch() : elseBranch();
+    };
+}
+
+void ClosureEngine::Compiler::visitPrintStmt(PrintStmt& stmt) {
+    ClosureEngine* engine = &this->engine;
+    compiled = [engine, expression = compile(stmt.expression)]() {
+        std::any value = expression();
+        standardOutput().append(engine->stringify(value));
+        standardOutput().endLine();
+        return false;
+    };
+}
+
+void ClosureEngine::Compiler::visitReturnStmt(ReturnStmt& stmt) {
+    ClosureEngine* engine = &this->engine;
+
+    if (stmt.isTailCall) {
+        const CallExpr& call = static_cast<const CallExpr&>(*stmt.value);
+        compiled = [engine, site = compileCall(call), paren = call.paren]() {
+            std::any value = site.callee();
+            std::size_t argumentCount = site.arguments.size();
+            for (std::size_t i = 0; i < argumentCount; ++i) {
+                std::any argument = site.arguments[i]();
+                engine->stack[engine->base + site.argumentBase + i] = std::move(argument);
+            }
+
+            std::size_t argumentBase = engine->base + site.argumentBase;
+            engine->checkCallee(value, paren, argumentBase, argumentCount);
+
+            // The callee takes over this frame, see Interpreter::executeTailCall.
+            for (std::size_t i = 0; i < argumentCount; ++i) {
+                engine->stack[engine->base + i] = std::move(engine->stack[argumentBase + i]);
+            }
+            for (std::size_t i = engine->base + argumentCount; i < argumentBase + argumentCount; ++i) {
+                engine->stack[i].reset();
+            }
+
+            engine->tailCall = *std::any_cast<Ref<Function>>(&value);
+            return true;
+        };
+        return;
+    }
+
+    if (stmt.value == nullptr) {
+        compiled = [engine]() {
+            engine->returnValue = nullptr;
+            return true;
+        };
+        return;
+    }
+
+    compiled = [engine, value = compile(stmt.value)]() {
+        engine->returnValue = value();
+        return true;
+    };
+}
+
+void ClosureEngine::Compiler::visitWhileStmt(WhileStmt& stmt) {
+    compiled = [condition = compile(stmt.condition), body = compile(stmt.body)]() {
+        while (Interpreter::isTruthy(condition())) {
+            if (body()) {
+                return true;
+            }
+        }
+        return false;
+    };
+}
+
+void ClosureEngine::Compiler::visitVarStmt(VarStmt& stmt) {
+    Evaluate initializer = [] { return std::any{nullptr}; };
+    if (stmt.initializer != nullptr) {
+        initializer = compile(stmt.initializer);
+    }
+
+    std::size_t index = stmt.binding.index;
+    ClosureEngine* engine = &this->engine;
+    switch (stmt.binding.kind) {
+        case VariableBinding::Kind::NUMBER:
+        case VariableBinding::Kind::LOCAL:
+            compiled = [engine, initializer, index]() {
+                std::any value = initializer();
+                engine->stack[engine->base + index] = std::move(value);
+                return false;
+            };
+            break;
+        case VariableBinding::Kind::BOXED:
+            compiled = [engine, initializer, index]() {
+                auto cell = makeRef<Upvalue>(initializer());
+                engine->stack[engine->base + index] = std::move(cell);
+                return false;
+            };
+            break;
+        case VariableBinding::Kind::GLOBAL:
+        case VariableBinding::Kind::UPVALUE:
+            compiled = [initializer, cell = engine->globalCell(stmt.name.lexeme)]() {
+                cell->value = initializer();
+                cell->defined = true;
+                return false;
+            };
+            break;
+    }
+}
+
+void ClosureEngine::Compiler::visitYieldStmt(YieldStmt& stmt) {
+    throw Unsupported{"uses generators"};
+}
+
+// Marks a call frame as running, and clears and pops it however the call ends.
+class ClosureEngine::CallGuard {
+ public:
+    CallGuard(ClosureEngine& engine, std::size_t callBase)
+        : engine{engine}, base{engine.base}, function{engine.function}, end{callBase} {
+        engine.base = callBase;
+        ++engine.depth;
+    }
+
+    ~CallGuard() {
+        for (std::size_t i = engine.base; i < end; ++i) {
+            engine.stack[i].reset();
+        }
+        engine.base = base;
+        engine.function = function;
+        --engine.depth;
+    }
+
+    void extend(std::size_t size) {
+        end = std::max(end, engine.base + size);
+    }
+
+ private:
+    ClosureEngine& engine;
+    std::size_t base;
+    Function* function;
+    std::size_t end;
+};
+
+ClosureEngine::ClosureEngine() : maxCallDepth{Interpreter::DEFAULT_MAX_CALL_DEPTH} {}
+
+void ClosureEngine::setMaxCallDepth(std::size_t depth) {
+    maxCallDepth = depth;
+}
+
+bool ClosureEngine::interpret(const std::vector<std::shared_ptr<Stmt>>& statements, std::size_t frameSize) {
+    nativeStackLimit = ::nativeStackLimit(256 * 1024);
+
+    Compiler compiler{*this, frameSize};
+    Execute script;
+    try {
+        script = compiler.compileBlock(statements);
+    } catch (const Unsupported&) {
+        return false;
+    }
+    reserveStack(compiler.extent());
+
+    try {
+        script();
+    } catch (const RuntimeError& error) {
+        for (std::any& slot : stack) {
+            slot.reset();
+        }
+        Lox::runtimeError(error);
+    }
+    return true;
+}
+
+std::shared_ptr<ClosureEngine::GlobalCell> ClosureEngine::globalCell(const std::string& name) {
+    std::shared_ptr<GlobalCell>& cell = globals[name];
+    if (cell == nullptr) {
+        cell = std::make_shared<GlobalCell>();
+    }
+    return cell;
+}
+
+void ClosureEngine::reserveStack(std::size_t size) {
+    if (stack.size() < size) {
+        stack.resize(std::max(stack.size() * 2, size));
+    }
+}
+
+ClosureEngine::Function* ClosureEngine::checkCallee(std::any& callee, const Token& paren, std::size_t argumentBase,
+                                                    std::size_t argumentCount) {
+    Function* function = nullptr;
+    if (auto* pointer = std::any_cast<Ref<Function>>(&callee)) {
+        function = pointer->get();
+    }
+
+    if (function == nullptr || argumentCount != function->code->arity) {
+        for (std::size_t i = argumentBase; i < argumentBase + argumentCount; ++i) {
+            stack[i].reset();
+        }
+        if (function == nullptr) {
+            throwError(paren, "Can only call functions and classes.");
+        }
+        throw RuntimeError{paren, "Expected " + std::to_string(function->code->arity) + " arguments but got " +
+                                      std::to_string(argumentCount) + "."};
+    }
+
+    return function;
+}
+
+std::any ClosureEngine::call(Function* callee, std::size_t callBase, const Token& paren) {
+    char probe;
+    if (depth >= maxCallDepth || reinterpret_cast<std::uintptr_t>(&probe) < nativeStackLimit) {
+        for (std::size_t i = callBase; i < callBase + callee->code->arity; ++i) {
+            stack[i].reset();
+        }
+        throwError(paren, "Stack overflow.");
+    }
+
+    CallGuard guard{*this, callBase};
+    // Holds a tail-called function once nothing else may be keeping it alive.
+    Ref<Function> tailCallee;
+    while (true) {
+        const CompiledFunction& code = *callee->code;
+        reserveStack(callBase + code.frameExtent);
+        guard.extend(code.frameExtent);
+        for (std::size_t slot : code.boxedParameters) {
+            stack[callBase + slot] = makeRef<Upvalue>(std::move(stack[callBase + slot]));
+        }
+
+        function = callee;
+        if (!code.body()) {
+            return nullptr;
+        }
+        if (tailCall == nullptr) {
+            return std::move(returnValue);
+        }
+
+        tailCallee = std::move(tailCall);
+        callee = tailCallee.get();
+    }
+}
+
+std::string ClosureEngine::stringify(const std::any& object) {
+    if (auto* function = std::any_cast<Ref<Function>>(&object)) {
+        return "<fn " + (*function)->code->name + ">";
+    }
+    return Interpreter::stringify(object);
+}
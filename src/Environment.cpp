@@ -8,23 +8,34 @@ Environment::Environment() : enclosing{nullptr} {}
 
 Environment::Environment(std::shared_ptr<Environment> enclosing) : enclosing{std::move(enclosing)} {}
 
-std::any Environment::get(const Token& name) {
-    auto elem = values.find(name.lexeme);
-    if (elem != values.end()) {
+std::size_t Environment::slot(const std::string& name) {
+    auto elem = slots.find(name);
+    if (elem != slots.end()) {
         return elem->second;
     }
 
+    values.emplace_back();
+    slots.emplace(name, values.size() - 1);
+    return values.size() - 1;
+}
+
+std::any Environment::get(const Token& name) {
+    auto elem = slots.find(name.lexeme);
+    if (elem != slots.end() && values[elem->second].has_value()) {
+        return values[elem->second];
+    }
+
     if (enclosing != nullptr) {
         return enclosing->get(name);
     }
 
-    throw RuntimeError(name, "Undefined variable '" + name.lexeme + "'.");
+    undefined(name);
 }
 
 void Environment::assign(const Token& name, std::any value) {
-    auto elem = values.find(name.lexeme);
-    if (elem != values.end()) {
-        elem->second = std::move(value);
+    auto elem = slots.find(name.lexeme);
+    if (elem != slots.end() && values[elem->second].has_value()) {
+        values[elem->second] = std::move(value);
         return;
     }
 
@@ -33,33 +44,23 @@ void Environment::assign(const Token& name, std::any value) {
         return;
     }
 
-    throw RuntimeError(name, "Undefined variable '" + name.lexeme + "'.");
+    undefined(name);
 }
 
 void Environment::define(const std::string& name, std::any value) {
-    values[name] = std::move(value);
+    values[slot(name)] = std::move(value);
 }
 
-std::shared_ptr<Environment> Environment::ancestor(int distance) {
-    std::shared_ptr<Environment> environment = shared_from_this();
-    for (int i = 0; i < distance; ++i) {
-        environment = environment->enclosing;
-    }
-
-    return environment;
-}
-
-std::any Environment::getAt(int distance, const std::string& name) {
-    return ancestor(distance)->values[name];
-}
-
-void Environment::assignAt(int distance, const Token& name, std::any value) {
-    ancestor(distance)->values[name.lexeme] = std::move(value);
+// Out of line and cold, so the indexed accessors inline to a load and a test.
+__attribute__((noinline, cold)) void Environment::undefined(const Token& name) {
+    throw RuntimeError(name, "Undefined variable '" + name.lexeme + "'.");
 }
 
 void Environment::print_values() {
-    for (auto [key, value] : values) {
-        std::cout << "[" << key << "] ";
+    for (const auto& [key, slot] : slots) {
+        if (values[slot].has_value()) {
+            std::cout << "[" << key << "] ";
+        }
     }
     std::cout << "\n";
-}
\ No newline at end of file
+}
@@ -0,0 +1,354 @@
+#include "../include/EventLoop.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+
+#include "../include/Interpreter.h"
+#include "../include/LoxArray.h"
+#include "../include/LoxFiber.h"
+#include "../include/LoxFunction.h"
+#include "../include/LoxString.h"
+#include "../include/Output.h"
+#include "../include/RuntimeError.h"
+
+namespace {
+
+constexpr std::size_t CHUNK = 64 * 1024;
+
+// Whether value asks for a callback rather than for waiting, which nil does. A callback must take arity arguments.
+bool isCallback(const Token& paren, const std::any& value, int arity) {
+    if (value.type() == typeid(nullptr)) {
+        return false;
+    }
+    auto* function = std::any_cast<Ref<LoxFunction>>(&value);
+    if (function == nullptr || (*function)->arity() != arity) {
+        throw RuntimeError{paren, arity == 0 ? "Callback must be a function taking no arguments."
+                                             : "Callback must be a function taking 1 argument."};
+    }
+    return true;
+}
+
+double checkDelay(const Token& paren, const std::any& value) {
+    auto* milliseconds = std::any_cast<double>(&value);
+    if (milliseconds == nullptr || std::isnan(*milliseconds)) {
+        throw RuntimeError{paren, "Delay must be a number."};
+    }
+    return std::max(*milliseconds, 0.0);
+}
+
+const std::string& checkPath(const Token& paren, const std::any& value) {
+    auto* path = std::any_cast<Ref<LoxString>>(&value);
+    if (path == nullptr) {
+        throw RuntimeError{paren, "Path must be a string."};
+    }
+    return (*path)->str();
+}
+
+// For waiting outside a fiber, where there is no other work to overlap.
+std::string readBlocking(const Token& paren, const std::string& path) {
+    standardOutput().flush();
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw RuntimeError{paren, "Could not open '" + path + "'."};
+    }
+    std::string text;
+    char buffer[CHUNK];
+    ssize_t count;
+    while ((count = read(fd, buffer, sizeof buffer)) != 0) {
+        if (count < 0 && errno != EINTR) {
+            close(fd);
+            throw RuntimeError{paren, "Could not read '" + path + "'."};
+        }
+        text.append(buffer, std::max<ssize_t>(count, 0));
+    }
+    close(fd);
+    return text;
+}
+
+Ref<LoxArray> splitLines(const std::string& text) {
+    auto lines = makeRef<LoxArray>();
+    std::size_t start = 0;
+    for (std::size_t end; (end = text.find('\n', start)) != std::string::npos; start = end + 1) {
+        lines->push(makeRef<LoxString>(text.substr(start, end - start)));
+    }
+    if (start < text.size()) {
+        lines->push(makeRef<LoxString>(text.substr(start)));
+    }
+    return lines;
+}
+
+// Calls the function target with arguments, or wakes the fiber target with the first of them.
+void notify(Interpreter& interpreter, const std::any& target, std::vector<std::any> arguments, const Token& paren) {
+    if (const auto* fiber = std::any_cast<Ref<LoxFiber>>(&target)) {
+        interpreter.wake(**fiber, arguments.empty() ? std::any{nullptr} : std::move(arguments.front()), paren);
+    } else {
+        interpreter.executeFunction(**std::any_cast<Ref<LoxFunction>>(&target), arguments);
+    }
+}
+
+}  // namespace
+
+std::any setTimeout(Interpreter& interpreter, const Token& paren, std::any* arguments) {
+    isCallback(paren, arguments[0], 0);
+    interpreter.eventLoop().addTimer(checkDelay(paren, arguments[1]), arguments[0], paren);
+    return nullptr;
+}
+
+std::any sleepFor(Interpreter& interpreter, const Token& paren, std::any* arguments) {
+    double milliseconds = checkDelay(paren, arguments[0]);
+    LoxFiber* fiber = interpreter.currentFiber();
+    if (fiber == nullptr) {
+        standardOutput().flush();
+        int allowed = interpreter.budget().clampWait(-1);
+        if (allowed >= 0 && allowed < milliseconds) {
+            std::this_thread::sleep_for(std::chrono::milliseconds{allowed});
+            throw RuntimeError{paren, "Deadline exceeded."};
+        }
+        std::this_thread::sleep_for(std::chrono::duration<double, std::milli>{milliseconds});
+        return nullptr;
+    }
+    interpreter.eventLoop().addTimer(milliseconds, Ref<LoxFiber>{fiber}, paren);
+    return interpreter.waitForEvent();
+}
+
+template <bool LINES>
+std::any readInput(Interpreter& interpreter, const Token& paren, std::any* arguments) {
+    const std::string& path = checkPath(paren, arguments[0]);
+    LoxFiber* fiber = interpreter.currentFiber();
+    if (isCallback(paren, arguments[1], 1)) {
+        interpreter.eventLoop().addRead(path, LINES, arguments[1], paren);
+        return nullptr;
+    }
+    if (fiber == nullptr) {
+        std::string text = readBlocking(paren, path);
+        if (LINES) {
+            return splitLines(text);
+        }
+        return makeRef<LoxString>(std::move(text));
+    }
+    interpreter.eventLoop().addRead(path, LINES, Ref<LoxFiber>{fiber}, paren);
+    return interpreter.waitForEvent();
+}
+
+std::any readFile(Interpreter& interpreter, const Token& paren, std::any* arguments) {
+    return readInput<false>(interpreter, paren, arguments);
+}
+
+std::any readLines(Interpreter& interpreter, const Token& paren, std::any* arguments) {
+    return readInput<true>(interpreter, paren, arguments);
+}
+
+struct EventLoop::Read {
+    std::string path;
+    int fd;
+    bool lines;
+    // Whether poller reports when there is input; the rest are read a chunk per turn of the loop.
+    bool polled;
+    std::any target;
+    Token paren;
+    // Input not handed over yet: all of it for readFile, the unfinished last line for readLines.
+    std::string text;
+    // The lines so far, for a fiber waiting on readLines.
+    Ref<LoxArray> collected;
+};
+
+bool EventLoop::Later::operator()(const Timer& a, const Timer& b) const {
+    return a.deadline != b.deadline ? a.deadline > b.deadline : a.sequence > b.sequence;
+}
+
+EventLoop::EventLoop() : buffer(CHUNK) {
+#ifdef __linux__
+    poller = epoll_create1(EPOLL_CLOEXEC);
+#endif
+}
+
+EventLoop::~EventLoop() {
+    clear();
+    if (poller >= 0) {
+        close(poller);
+    }
+}
+
+void EventLoop::clear() {
+    // Closing a descriptor also takes it out of poller.
+    for (const auto& [id, read] : reads) {
+        close(read->fd);
+    }
+    reads.clear();
+    timers = {};
+}
+
+void EventLoop::addTimer(double milliseconds, std::any target, const Token& paren) {
+    auto delay = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>{milliseconds});
+    timers.push(Timer{Clock::now() + delay, timersSet++, std::move(target), paren});
+}
+
+void EventLoop::addRead(const std::string& path, bool lines, std::any target, const Token& paren) {
+    // Opening a FIFO without O_NONBLOCK would wait for a writer.
+    int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        throw RuntimeError{paren, "Could not open '" + path + "'."};
+    }
+
+    std::uint64_t id = readsStarted++;
+    struct stat status;
+    bool polled = fstat(fd, &status) == 0 && !S_ISREG(status.st_mode);
+#ifdef __linux__
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = id;
+    // epoll refuses some devices, such as /dev/null, which never block either.
+    polled = polled && epoll_ctl(poller, EPOLL_CTL_ADD, fd, &event) == 0;
+#endif
+    auto read = std::make_unique<Read>(Read{path, fd, lines, polled, std::move(target), paren, {}, nullptr});
+    if (lines && read->target.type() == typeid(Ref<LoxFiber>)) {
+        read->collected = makeRef<LoxArray>();
+    }
+    reads.emplace(id, std::move(read));
+}
+
+void EventLoop::run(Interpreter& interpreter) {
+    std::vector<std::uint64_t> ready;
+    while (!timers.empty() || !reads.empty()) {
+        ready.clear();
+        for (const auto& [id, read] : reads) {
+            if (!read->polled) {
+                ready.push_back(id);
+            }
+        }
+
+        int wait = interpreter.budget().clampWait(timeout(!ready.empty()));
+        // What has been printed so far should not wait along with the loop.
+        if (wait != 0) {
+            standardOutput().flush();
+        }
+#ifdef __linux__
+        epoll_event events[64];
+        int count = epoll_wait(poller, events, 64, wait);
+        for (int i = 0; i < count; ++i) {
+            ready.push_back(events[i].data.u64);
+        }
+#else
+        std::vector<pollfd> descriptors;
+        std::vector<std::uint64_t> ids;
+        for (const auto& [id, read] : reads) {
+            if (read->polled) {
+                descriptors.push_back(pollfd{read->fd, POLLIN, 0});
+                ids.push_back(id);
+            }
+        }
+        if (poll(descriptors.data(), descriptors.size(), wait) > 0) {
+            for (std::size_t i = 0; i < descriptors.size(); ++i) {
+                if (descriptors[i].revents != 0) {
+                    ready.push_back(ids[i]);
+                }
+            }
+        }
+#endif
+
+        if (interpreter.budget().pastDeadline()) {
+            // Reported where the script set the next timer, or else started the oldest read.
+            const Token& paren = timers.empty() ? reads.begin()->second->paren : timers.top().paren;
+            throw RuntimeError{paren, "Deadline exceeded."};
+        }
+        for (std::uint64_t id : ready) {
+            readChunk(interpreter, id);
+        }
+
+        // Timers set by the callbacks below wait for the next turn, even when already due.
+        Clock::time_point now = Clock::now();
+        while (!timers.empty() && timers.top().deadline <= now) {
+            Timer timer = timers.top();
+            timers.pop();
+            notify(interpreter, timer.target, {}, timer.paren);
+        }
+    }
+}
+
+// Milliseconds to wait for input: none while some read needs no waiting, else until the next timer is due, rounded
+// up so it is due on waking.
+int EventLoop::timeout(bool unpolled) const {
+    if (unpolled) {
+        return 0;
+    }
+    if (timers.empty()) {
+        return -1;
+    }
+    auto remaining = timers.top().deadline - Clock::now();
+    auto milliseconds = std::chrono::ceil<std::chrono::milliseconds>(remaining).count();
+    return static_cast<int>(std::clamp<decltype(milliseconds)>(milliseconds, 0, 60 * 60 * 1000));
+}
+
+void EventLoop::readChunk(Interpreter& interpreter, std::uint64_t id) {
+    auto entry = reads.find(id);
+    if (entry == reads.end()) {
+        return;
+    }
+    Read& read = *entry->second;
+
+    ssize_t count = ::read(read.fd, buffer.data(), buffer.size());
+    if (count < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return;
+        }
+        std::unique_ptr<Read> failed = std::move(entry->second);
+        reads.erase(entry);
+        close(failed->fd);
+        throw RuntimeError{failed->paren, "Could not read '" + failed->path + "'."};
+    }
+    if (count == 0) {
+        std::unique_ptr<Read> finished = std::move(entry->second);
+        reads.erase(entry);
+        finish(interpreter, std::move(finished));
+        return;
+    }
+
+    read.text.append(buffer.data(), count);
+    if (read.lines) {
+        deliverLines(interpreter, read);
+    }
+}
+
+// Hands over each complete line read so far, keeping the unfinished last one.
+void EventLoop::deliverLines(Interpreter& interpreter, Read& read) {
+    std::size_t start = 0;
+    for (std::size_t end; (end = read.text.find('\n', start)) != std::string::npos; start = end + 1) {
+        auto line = makeRef<LoxString>(read.text.substr(start, end - start));
+        if (read.collected != nullptr) {
+            read.collected->push(std::move(line));
+        } else {
+            notify(interpreter, read.target, {std::move(line)}, read.paren);
+        }
+    }
+    read.text.erase(0, start);
+}
+
+void EventLoop::finish(Interpreter& interpreter, std::unique_ptr<Read> read) {
+    close(read->fd);
+    if (!read->lines) {
+        notify(interpreter, read->target, {makeRef<LoxString>(std::move(read->text))}, read->paren);
+        return;
+    }
+
+    // A last line without a newline still counts, as it does for splitLines.
+    if (!read->text.empty()) {
+        read->text += '\n';
+        deliverLines(interpreter, *read);
+    }
+    if (read->collected != nullptr) {
+        notify(interpreter, read->target, {read->collected}, read->paren);
+    } else {
+        notify(interpreter, read->target, {nullptr}, read->paren);
+    }
+}
@@ -0,0 +1,364 @@
+#include "../include/Inliner.h"
+
+namespace {
+
+// Copies a function's returned expression for one call site, moving parameter references to that site's slots.
+class Copier : public ExprVisitor {
+ public:
+    Copier(const std::string &function, std::vector<int> slots) : function{function}, slots{std::move(slots)} {}
+
+    std::shared_ptr<Expr> copy(const std::shared_ptr<Expr> &expr) {
+        ++nodes;
+        return std::any_cast<std::shared_ptr<Expr>>(expr->accept(*this));
+    }
+
+    std::any visitArrayExpr(ArrayExpr& expr) override {
+        std::vector<std::shared_ptr<Expr>> elements;
+        for (const std::shared_ptr<Expr> &element : expr.elements) {
+            elements.push_back(copy(element));
+        }
+        return std::shared_ptr<Expr>{std::make_shared<ArrayExpr>(expr.bracket, elements)};
+    }
+
+    std::any visitAssignExpr(AssignExpr& expr) override {
+        auto copied = std::make_shared<AssignExpr>(expr.name, copy(expr.value));
+        copied->binding = rebind(expr.binding);
+        return std::shared_ptr<Expr>{copied};
+    }
+
+    std::any visitBinaryExpr(BinaryExpr& expr) override {
+        return std::shared_ptr<Expr>{std::make_shared<BinaryExpr>(copy(expr.left), expr.op, copy(expr.right))};
+    }
+
+    std::any visitCallExpr(CallExpr& expr) override {
+        auto callee = std::dynamic_pointer_cast<VariableExpr>(expr.callee);
+        if (callee != nullptr && callee->binding.kind == VariableBinding::Kind::GLOBAL &&
+            callee->name.lexeme == function) {
+            recursive = true;
+        }
+
+        std::vector<std::shared_ptr<Expr>> arguments;
+        for (const std::shared_ptr<Expr> &argument : expr.arguments) {
+            arguments.push_back(copy(argument));
+        }
+        auto copied = std::make_shared<CallExpr>(copy(expr.callee), expr.paren, arguments);
+        copied->property = dynamic_cast<GetExpr*>(copied->callee.get());
+        return std::shared_ptr<Expr>{copied};
+    }
+
+    std::any visitGetExpr(GetExpr& expr) override {
+        return std::shared_ptr<Expr>{std::make_shared<GetExpr>(copy(expr.object), expr.name)};
+    }
+
+    std::any visitGroupingExpr(GroupingExpr& expr) override {
+        return std::shared_ptr<Expr>{std::make_shared<GroupingExpr>(copy(expr.expression))};
+    }
+
+    std::any visitIndexExpr(IndexExpr& expr) override {
+        return std::shared_ptr<Expr>{std::make_shared<IndexExpr>(copy(expr.object), expr.bracket, copy(expr.index))};
+    }
+
+    std::any visitLiteralExpr(LiteralExpr& expr) override {
+        return std::shared_ptr<Expr>{std::make_shared<LiteralExpr>(expr.value)};
+    }
+
+    std::any visitLogicalExpr(LogicalExpr& expr) override {
+        return std::shared_ptr<Expr>{std::make_shared<LogicalExpr>(copy(expr.left), expr.op, copy(expr.right))};
+    }
+
+    std::any visitMapExpr(MapExpr& expr) override {
+        std::vector<std::shared_ptr<Expr>> keys;
+        std::vector<std::shared_ptr<Expr>> values;
+        for (std::size_t i = 0; i < expr.keys.size(); ++i) {
+            keys.push_back(copy(expr.keys[i]));
+            values.push_back(copy(expr.values[i]));
+        }
+        return std::shared_ptr<Expr>{std::make_shared<MapExpr>(expr.brace, keys, values)};
+    }
+
+    std::any visitSetExpr(SetExpr& expr) override {
+        return std::shared_ptr<Expr>{std::make_shared<SetExpr>(copy(expr.object), expr.name, copy(expr.value))};
+    }
+
+    std::any visitSetIndexExpr(SetIndexExpr& expr) override {
+        return std::shared_ptr<Expr>{
+            std::make_shared<SetIndexExpr>(copy(expr.object), expr.bracket, copy(expr.index), copy(expr.value))};
+    }
+
+    std::any visitSuperExpr(SuperExpr& expr) override {
+        auto copied = std::make_shared<SuperExpr>(expr.keyword, expr.method);
+        copied->binding = rebind(expr.binding);
+        copied->thisBinding = rebind(expr.thisBinding);
+        return std::shared_ptr<Expr>{copied};
+    }
+
+    std::any visitThisExpr(ThisExpr& expr) override {
+        auto copied = std::make_shared<ThisExpr>(expr.keyword);
+        copied->binding = rebind(expr.binding);
+        return std::shared_ptr<Expr>{copied};
+    }
+
+    std::any visitUnaryExpr(UnaryExpr& expr) override {
+        return std::shared_ptr<Expr>{std::make_shared<UnaryExpr>(expr.op, copy(expr.right))};
+    }
+
+    std::any visitVariableExpr(VariableExpr& expr) override {
+        auto copied = std::make_shared<VariableExpr>(expr.name);
+        copied->binding = rebind(expr.binding);
+        return std::shared_ptr<Expr>{copied};
+    }
+
+    int nodes = 0;
+    bool recursive = false;
+
+ private:
+    const std::string &function;
+    const std::vector<int> slots;
+
+    // A body that is a single return has no locals besides its parameters, and a top-level function no upvalues.
+    VariableBinding rebind(const VariableBinding &binding) {
+        if (binding.kind == VariableBinding::Kind::LOCAL && static_cast<std::size_t>(binding.index) < slots.size()) {
+            return VariableBinding{VariableBinding::Kind::LOCAL, slots[binding.index]};
+        }
+        return binding;
+    }
+};
+
+}  // namespace
+
+int Inliner::inlineCalls(const std::vector<std::shared_ptr<Stmt>>& statements, int frameSize) {
+    walk(statements);
+
+    for (const auto& [name, declarations] : globalFunctions) {
+        FunctionStmt* declaration = declarations.front();
+        if (declarations.size() != 1 || assignedGlobals.count(name) != 0 || declaration->body.size() != 1 ||
+            declaration->isGenerator) {
+            continue;
+        }
+        auto body = std::dynamic_pointer_cast<ReturnStmt>(declaration->body.front());
+        if (body == nullptr || body->value == nullptr) {
+            continue;
+        }
+
+        Copier measure{name, {}};
+        measure.copy(body->value);
+        if (measure.nodes <= BUDGET && !measure.recursive) {
+            candidates[name] = {declaration, body->value};
+        }
+    }
+
+    collecting = false;
+    scriptFrameSize = frameSize;
+    this->frameSize = &scriptFrameSize;
+    walk(statements);
+    return scriptFrameSize;
+}
+
+std::size_t Inliner::inlinedCalls() const {
+    return inlined;
+}
+
+void Inliner::inlineCall(CallExpr& call, FunctionStmt& declaration, const std::shared_ptr<Expr>& body) {
+    std::vector<int> slots;
+    auto site = std::make_unique<InlinedCall>();
+    site->declaration = &declaration;
+    for (std::size_t i = 0; i < declaration.parameters.size(); ++i) {
+        slots.push_back((*frameSize)++);
+        site->parameters.push_back(VariableBinding{VariableBinding::Kind::LOCAL, slots.back()});
+    }
+
+    site->body = Copier{declaration.name.lexeme, slots}.copy(body);
+    call.inlined = std::move(site);
+    ++inlined;
+}
+
+void Inliner::walk(const std::vector<std::shared_ptr<Stmt>>& statements) {
+    for (const std::shared_ptr<Stmt>& statement : statements) {
+        statement->accept(*this);
+    }
+}
+
+void Inliner::walk(const std::shared_ptr<Expr>& expr) {
+    expr->accept(*this);
+}
+
+void Inliner::visitBlockStmt(BlockStmt& stmt) {
+    walk(stmt.statements);
+}
+
+void Inliner::visitClassStmt(ClassStmt& stmt) {
+    if (collecting && stmt.binding.kind == VariableBinding::Kind::GLOBAL) {
+        assignedGlobals.insert(stmt.name.lexeme);
+    }
+    for (const std::shared_ptr<FunctionStmt>& method : stmt.methods) {
+        walkBody(*method);
+    }
+}
+
+void Inliner::visitExpressionStmt(ExpressionStmt& stmt) {
+    walk(stmt.expression);
+}
+
+void Inliner::visitFunctionStmt(FunctionStmt& stmt) {
+    if (collecting && stmt.binding.kind == VariableBinding::Kind::GLOBAL) {
+        globalFunctions[stmt.name.lexeme].push_back(&stmt);
+    }
+    walkBody(stmt);
+}
+
+// Calls inlined into a body take their parameter slots from that body's frame.
+void Inliner::walkBody(FunctionStmt& function) {
+    int* enclosing = frameSize;
+    frameSize = &function.frameSize;
+    walk(function.body);
+    frameSize = enclosing;
+}
+
+void Inliner::visitIfStmt(IfStmt& stmt) {
+    walk(stmt.condition);
+    stmt.thenBranch->accept(*this);
+    if (stmt.elseBranch != nullptr) {
+        stmt.elseBranch->accept(*this);
+    }
+}
+
+void Inliner::visitPrintStmt(PrintStmt& stmt) {
+    walk(stmt.expression);
+}
+
+void Inliner::visitReturnStmt(ReturnStmt& stmt) {
+    if (stmt.value == nullptr) {
+        return;
+    }
+
+    walk(stmt.value);
+    // An inlined call needs no frame to hand over.
+    if (stmt.isTailCall && static_cast<CallExpr&>(*stmt.value).inlined != nullptr) {
+        stmt.isTailCall = false;
+    }
+}
+
+void Inliner::visitWhileStmt(WhileStmt& stmt) {
+    walk(stmt.condition);
+    stmt.body->accept(*this);
+}
+
+void Inliner::visitVarStmt(VarStmt& stmt) {
+    if (collecting && stmt.binding.kind == VariableBinding::Kind::GLOBAL) {
+        assignedGlobals.insert(stmt.name.lexeme);
+    }
+    if (stmt.initializer != nullptr) {
+        walk(stmt.initializer);
+    }
+}
+
+void Inliner::visitYieldStmt(YieldStmt& stmt) {
+    if (stmt.value != nullptr) {
+        walk(stmt.value);
+    }
+}
+
+std::any Inliner::visitArrayExpr(ArrayExpr& expr) {
+    for (const std::shared_ptr<Expr>& element : expr.elements) {
+        walk(element);
+    }
+    return {};
+}
+
+std::any Inliner::visitAssignExpr(AssignExpr& expr) {
+    if (collecting && expr.binding.kind == VariableBinding::Kind::GLOBAL) {
+        assignedGlobals.insert(expr.name.lexeme);
+    }
+    walk(expr.value);
+    return {};
+}
+
+std::any Inliner::visitBinaryExpr(BinaryExpr& expr) {
+    walk(expr.left);
+    walk(expr.right);
+    return {};
+}
+
+std::any Inliner::visitCallExpr(CallExpr& expr) {
+    walk(expr.callee);
+    for (const std::shared_ptr<Expr>& argument : expr.arguments) {
+        walk(argument);
+    }
+    if (collecting) {
+        return {};
+    }
+
+    auto callee = std::dynamic_pointer_cast<VariableExpr>(expr.callee);
+    if (callee == nullptr || callee->binding.kind != VariableBinding::Kind::GLOBAL) {
+        return {};
+    }
+    auto candidate = candidates.find(callee->name.lexeme);
+    if (candidate != candidates.end() && candidate->second.first->parameters.size() == expr.arguments.size()) {
+        inlineCall(expr, *candidate->second.first, candidate->second.second);
+    }
+    return {};
+}
+
+std::any Inliner::visitGetExpr(GetExpr& expr) {
+    walk(expr.object);
+    return {};
+}
+
+std::any Inliner::visitGroupingExpr(GroupingExpr& expr) {
+    walk(expr.expression);
+    return {};
+}
+
+std::any Inliner::visitIndexExpr(IndexExpr& expr) {
+    walk(expr.object);
+    walk(expr.index);
+    return {};
+}
+
+std::any Inliner::visitLiteralExpr(LiteralExpr& expr) {
+    return {};
+}
+
+std::any Inliner::visitLogicalExpr(LogicalExpr& expr) {
+    walk(expr.left);
+    walk(expr.right);
+    return {};
+}
+
+std::any Inliner::visitMapExpr(MapExpr& expr) {
+    for (std::size_t i = 0; i < expr.keys.size(); ++i) {
+        walk(expr.keys[i]);
+        walk(expr.values[i]);
+    }
+    return {};
+}
+
+std::any Inliner::visitSetExpr(SetExpr& expr) {
+    walk(expr.object);
+    walk(expr.value);
+    return {};
+}
+
+std::any Inliner::visitSetIndexExpr(SetIndexExpr& expr) {
+    walk(expr.object);
+    walk(expr.index);
+    walk(expr.value);
+    return {};
+}
+
+std::any Inliner::visitSuperExpr(SuperExpr& expr) {
+    return {};
+}
+
+std::any Inliner::visitThisExpr(ThisExpr& expr) {
+    return {};
+}
+
+std::any Inliner::visitUnaryExpr(UnaryExpr& expr) {
+    walk(expr.right);
+    return {};
+}
+
+std::any Inliner::visitVariableExpr(VariableExpr& expr) {
+    return {};
+}
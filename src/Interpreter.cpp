@@ -1,157 +1,1006 @@
+#include <algorithm>
+#include <cmath>
+#include <exception>
 #include <iostream>
+#include <limits>
+#include <new>
+#include <utility>
 
+#include "../include/Builtins.h"
 #include "../include/Environment.h"
+#include "../include/Inliner.h"
 #include "../include/Interpreter.h"
 #include "../include/Lox.h"
+#include "../include/LoxArray.h"
 #include "../include/LoxCallable.h"
+#include "../include/LoxClass.h"
+#include "../include/LoxFiber.h"
+#include "../include/LoxFile.h"
 #include "../include/LoxFunction.h"
-#include "../include/LoxReturn.h"
+#include "../include/LoxMap.h"
+#include "../include/LoxString.h"
+#include "../include/NativeStack.h"
+#include "../include/Output.h"
+#include "../include/PurityAnalysis.h"
 #include "../include/RuntimeError.h"
+#include "../include/TypeInference.h"
+#include "../include/Upvalue.h"
+
+// Errors are built out of line: the message temporaries would otherwise enlarge the native frames of the recursive
+// visitors, and every nested Lox call stacks several of those frames.
+[[noreturn]] __attribute__((noinline, cold)) static void throwError(const Token& token, const char* message) {
+    throw RuntimeError{token, message};
+}
+
+__attribute__((noinline, cold)) void Interpreter::throwArityError(const Token& paren, std::size_t expected,
+                                                                  std::size_t got) {
+    throw RuntimeError{paren, "Expected " + std::to_string(expected) + " arguments but got " + std::to_string(got) +
+                                  "."};
+}
+
+[[noreturn]] __attribute__((noinline, cold)) static void throwUndefinedProperty(const Token& name) {
+    throw RuntimeError{name, "Undefined property '" + name.lexeme + "'."};
+}
+
+// Takes the left operand by value: a temporary string nothing else refers to is then appended to in place.
+__attribute__((noinline)) static std::any concatenate(std::any left, const std::any& right) {
+    return LoxString::concatenate(std::move(*std::any_cast<Ref<LoxString>>(&left)),
+                                  *std::any_cast<Ref<LoxString>>(&right));
+}
 
 Interpreter::Interpreter() {
-    globals->define("clock", std::shared_ptr<Clock>{});
+    for (const Ref<LoxNative>& native : builtins()) {
+        globals->define(native->name, native);
+    }
 }
 
 void Interpreter::interpret(const std::vector<std::shared_ptr<Stmt>>& statements) {
+    Inliner inliner;
+    reserveScriptFrame(inliner.inlineCalls(statements, frame.size));
+    inlinedCalls += inliner.inlinedCalls();
+
+    TypeInference inference;
+    inference.infer(statements);
+    typeStats.numberVariables += inference.stats().numberVariables;
+    typeStats.numberExpressions += inference.stats().numberExpressions;
+    typeStats.speculatedFunctions += inference.stats().speculatedFunctions;
+    typeStats.countedLoops += inference.stats().countedLoops;
+
+    // parallelMap and parallelReduce take only pure functions, so purity is proven even without memoization.
+    PurityAnalysis purity;
+    for (const std::shared_ptr<FunctionStmt>& declaration : purity.analyze(statements, memoizePure)) {
+        if (memoizePure) {
+            // Machine code would make the recursive calls without going through the table.
+            declaration->jitRejected = true;
+            memoized.push_back(declaration);
+        }
+    }
+
+    updateNativeStackLimit();
+    limits.start();
+    safepointsLeft = 0;
+    CallFrame script = frame;
     try {
         for (const std::shared_ptr<Stmt>& statement : statements) {
             execute(statement);
         }
-    } catch (RuntimeError error) {
+        events.run(*this);
+    } catch (const RuntimeError& error) {
+        frame = script;
+        tailMemoKeys.clear();
+        // The error ends the script, along with whatever it was still waiting for.
+        events.clear();
         Lox::runtimeError(error);
     }
 }
 
-std::any Interpreter::evaluate(std::shared_ptr<Expr> expr) {
+std::any Interpreter::evaluate(const std::shared_ptr<Expr>& expr) {
     return expr->accept(*this);
 }
 
-void Interpreter::execute(std::shared_ptr<Stmt> stmt) {
+void Interpreter::execute(const std::shared_ptr<Stmt>& stmt) {
     stmt->accept(*this);
 }
 
-void Interpreter::resolve(std::shared_ptr<Expr> expr, int depth) {
-    locals[expr] = depth;
+void Interpreter::executeStatements(const std::vector<std::shared_ptr<Stmt>>& statements) {
+    for (const std::shared_ptr<Stmt>& statement : statements) {
+        execute(statement);
+        if (returning) {
+            return;
+        }
+    }
+}
+
+void Interpreter::reserveScriptFrame(int size) {
+    frame.size = std::max(frame.size, static_cast<std::size_t>(size));
+    if (stack.size() < frame.base + frame.size) {
+        stack.resize(frame.base + frame.size);
+        numbers.resize(stack.size());
+    }
 }
 
-void Interpreter::executeBlock(const std::vector<std::shared_ptr<Stmt>>& statements, std::shared_ptr<Environment> environment) {
-    std::shared_ptr<Environment> previous = this->environment;
-    try {
-        this->environment = environment;
-        for (const std::shared_ptr<Stmt>& statement : statements) {
-            execute(statement);
+void Interpreter::setMaxCallDepth(std::size_t depth) {
+    maxCallDepth = depth;
+    jit.setMaxCallDepth(depth);
+}
+
+std::size_t Interpreter::callDepthLimit() const {
+    return maxCallDepth;
+}
+
+void Interpreter::compileNow(FunctionStmt& declaration) {
+    if (jitEnabled && declaration.jitCode == nullptr && !declaration.jitRejected) {
+        jit.compile(declaration);
+    }
+}
+
+void Interpreter::setJitEnabled(bool enabled) {
+    jitRequested = enabled && LOX_JIT_SUPPORTED;
+    jitEnabled = jitRequested && !limits.limited();
+}
+
+void Interpreter::setFuel(std::uint64_t fuel) {
+    limits.setFuel(fuel);
+    setJitEnabled(jitRequested);
+}
+
+void Interpreter::setTimeLimit(std::chrono::milliseconds limit) {
+    limits.setTimeLimit(limit);
+    setJitEnabled(jitRequested);
+}
+
+Budget& Interpreter::budget() {
+    return limits;
+}
+
+void Interpreter::setMemoizePure(bool enabled) {
+    memoizePure = enabled;
+}
+
+void Interpreter::setCollectStats(bool collect) {
+    collectingStats = collect;
+}
+
+static const char* specializationName(BinarySpecialization specialization) {
+    switch (specialization) {
+        case BinarySpecialization::UNINITIALIZED:
+            return "uninitialized";
+        case BinarySpecialization::NUMBER_ADD:
+            return "number add";
+        case BinarySpecialization::NUMBER_SUBTRACT:
+            return "number subtract";
+        case BinarySpecialization::NUMBER_MULTIPLY:
+            return "number multiply";
+        case BinarySpecialization::NUMBER_DIVIDE:
+            return "number divide";
+        case BinarySpecialization::NUMBER_GREATER:
+            return "number greater";
+        case BinarySpecialization::NUMBER_GREATER_EQUAL:
+            return "number greater-equal";
+        case BinarySpecialization::NUMBER_LESS:
+            return "number less";
+        case BinarySpecialization::NUMBER_LESS_EQUAL:
+            return "number less-equal";
+        case BinarySpecialization::NUMBER_EQUAL:
+            return "number equal";
+        case BinarySpecialization::NUMBER_NOT_EQUAL:
+            return "number not-equal";
+        case BinarySpecialization::STRING_CONCAT:
+            return "string concat";
+        case BinarySpecialization::GENERIC:
+            return "generic";
+    }
+    return "unknown";
+}
+
+static const char* specializationName(ConditionSpecialization specialization) {
+    switch (specialization) {
+        case ConditionSpecialization::UNINITIALIZED:
+            return "uninitialized";
+        case ConditionSpecialization::BOOLEAN:
+            return "boolean";
+        case ConditionSpecialization::GENERIC:
+            return "generic";
+    }
+    return "unknown";
+}
+
+static void printFeedback(std::ostream& out, int line, const std::string& node, const char* specialization,
+                          const SpecializationStats& stats) {
+    out << "[line " << line << "] " << node << " -> " << specialization << ": " << stats.hits << " hits, "
+        << stats.misses << " misses\n";
+}
+
+void Interpreter::printStats(std::ostream& out) {
+    out << "-- node specialization --\n";
+    for (const std::shared_ptr<BinaryExpr>& expr : binaryFeedback) {
+        printFeedback(out, expr->op.line, "'" + expr->op.lexeme + "'", specializationName(expr->specialization),
+                      expr->stats);
+    }
+    for (const std::shared_ptr<IfStmt>& stmt : ifFeedback) {
+        printFeedback(out, stmt->keyword.line, "if condition", specializationName(stmt->specialization), stmt->stats);
+    }
+    for (const std::shared_ptr<WhileStmt>& stmt : whileFeedback) {
+        printFeedback(out, stmt->keyword.line, stmt->keyword.lexeme + " condition",
+                      specializationName(stmt->specialization), stmt->stats);
+    }
+    if (!getFeedback.empty() || !setFeedback.empty()) {
+        out << "-- property caches --\n";
+    }
+    for (const std::shared_ptr<GetExpr>& expr : getFeedback) {
+        printFeedback(out, expr->name.line, "get '" + expr->name.lexeme + "'",
+                      expr->cache.slot >= 0 ? "field" : "method", expr->cache.stats);
+    }
+    for (const std::shared_ptr<SetExpr>& expr : setFeedback) {
+        printFeedback(out, expr->name.line, "set '" + expr->name.lexeme + "'",
+                      expr->cache.transition != nullptr ? "add field" : "field", expr->cache.stats);
+    }
+    out << "-- inlining --\n";
+    out << "call sites inlined: " << inlinedCalls << " (" << inlineGuardFailures << " guard failures)\n";
+    out << "-- type inference --\n";
+    out << "number variables: " << typeStats.numberVariables << ", number expressions: "
+        << typeStats.numberExpressions << "\n";
+    out << "functions with number parameters: " << typeStats.speculatedFunctions << " (" << typeStats.invalidations
+        << " invalidated)\n";
+    out << "counted loops: " << typeStats.countedLoops << "\n";
+    if (memoizePure) {
+        out << "-- memoization --\n";
+        for (const std::shared_ptr<FunctionStmt>& declaration : memoized) {
+            const MemoTable& memo = *declaration->memo;
+            std::uint64_t lookups = memo.hits + memo.misses;
+            out << "[line " << declaration->name.line << "] " << declaration->name.lexeme << ": " << memo.hits
+                << " hits, " << memo.misses << " misses (" << (lookups == 0 ? 0 : 100 * memo.hits / lookups)
+                << "% hit rate), " << memo.results.size() << " entries, " << memo.clears << " clears, "
+                << memo.bypassed << " bypassed\n";
         }
-    } catch (...) {
-        this->environment = previous;
-        throw;
     }
+    if (jitEnabled) {
+        jit.printStats(out);
+    }
+}
+
+void Interpreter::updateNativeStackLimit() {
+    // Leave room for evaluating deeply nested expressions in the last frame and for unwinding the error.
+    nativeStackLimit = ::nativeStackLimit(NATIVE_STACK_MARGIN);
+}
+
+void Interpreter::checkCallDepth(const Token& paren) {
+    char probe;
+    if (frames.size() >= maxCallDepth || reinterpret_cast<std::uintptr_t>(&probe) < nativeStackLimit) {
+        throwError(paren, "Stack overflow.");
+    }
+}
+
+// Loop iterations and calls pass through here; without limits the first draw is for more than any run can use.
+inline void Interpreter::safepoint(const Token& token) {
+    if (--safepointsLeft < 0) {
+        drawBudget(token);
+    }
+}
+
+void Interpreter::drawBudget(const Token& token) {
+    const char* error = nullptr;
+    safepointsLeft = limits.draw(error) - 1;
+    if (error != nullptr) {
+        throwError(token, error);
+    }
+}
+
+Interpreter::FrameGuard::FrameGuard(Interpreter& interpreter, CallFrame callee) : interpreter{interpreter} {
+    interpreter.frames.push_back(interpreter.frame);
+    interpreter.frame = callee;
+}
+
+Interpreter::FrameGuard::~FrameGuard() {
+    // Slots are cleared on the way out so a finished call does not keep its values alive.
+    CallFrame& callee = interpreter.frame;
+    for (std::size_t i = callee.base; i < callee.base + callee.size; ++i) {
+        interpreter.stack[i].reset();
+    }
+    interpreter.frame = interpreter.frames.back();
+    interpreter.frames.pop_back();
+}
 
-    this->environment = previous;
+void Interpreter::reserveStack(std::size_t size) {
+    if (stack.size() < size) {
+        stack.resize(std::max(stack.size() * 2, size));
+        numbers.resize(stack.size());
+    }
 }
 
-void Interpreter::visitBlockStmt(std::shared_ptr<BlockStmt> stmt) {
-    executeBlock(stmt->statements, std::make_shared<Environment>(environment));
+std::size_t Interpreter::evaluateArguments(const std::vector<std::shared_ptr<Expr>>& arguments) {
+    std::size_t size = frame.size;
+    for (const std::shared_ptr<Expr>& argument : arguments) {
+        std::any value = evaluate(argument);
+        // Counting evaluated arguments as part of this frame keeps calls made by the later ones above them.
+        reserveStack(frame.base + frame.size + 1);
+        stack[frame.base + frame.size++] = std::move(value);
+    }
+    frame.size = size;
+    return frame.base + frame.size;
 }
 
-void Interpreter::visitExpressionStmt(std::shared_ptr<ExpressionStmt> stmt) {
-    evaluate(stmt->expression);
+LoxFunction* Interpreter::checkCallee(std::any& callee, const Token& paren, std::size_t argumentCount) {
+    LoxFunction* function = nullptr;
+    if (callee.type() == typeid(Ref<LoxFunction>)) {
+        function = std::any_cast<Ref<LoxFunction>>(&callee)->get();
+    }
+
+    if (function == nullptr || argumentCount != static_cast<std::size_t>(function->arity())) {
+        discardArguments(argumentCount);
+        if (function == nullptr) {
+            throwError(paren, "Can only call functions and classes.");
+        }
+        throwArityError(paren, function->arity(), argumentCount);
+    }
+
+    return function;
 }
 
-void Interpreter::visitFunctionStmt(std::shared_ptr<FunctionStmt> stmt) {
-    auto function = std::make_shared<LoxFunction>(stmt, environment);
-    environment->define(stmt->name.lexeme, function);
+void Interpreter::checkArity(std::size_t arity, const Token& paren, std::size_t argumentCount) {
+    if (argumentCount != arity) {
+        discardArguments(argumentCount);
+        throwArityError(paren, arity, argumentCount);
+    }
 }
 
-void Interpreter::visitIfStmt(std::shared_ptr<IfStmt> stmt) {
-    if (isTruthy(evaluate(stmt->condition))) {
-        execute(stmt->thenBranch);
-    } else if (stmt->elseBranch != nullptr) {
-        execute(stmt->elseBranch);
+// Passes nil for the optional arguments a native's call leaves out, and returns the native's full arity.
+__attribute__((noinline)) std::size_t Interpreter::fillOptionalArguments(LoxNative& native, const Token& paren,
+                                                                         std::size_t argumentCount) {
+    if (argumentCount > native.arity || argumentCount + native.optional < native.arity) {
+        discardArguments(argumentCount);
+        if (native.optional == 0) {
+            throwArityError(paren, native.arity, argumentCount);
+        }
+        throw RuntimeError{paren, "Expected " + std::to_string(native.arity - native.optional) + " to " +
+                                      std::to_string(native.arity) + " arguments but got " +
+                                      std::to_string(argumentCount) + "."};
+    }
+
+    std::size_t base = frame.base + frame.size;
+    reserveStack(base + native.arity);
+    for (std::size_t i = base + argumentCount; i < base + native.arity; ++i) {
+        stack[i] = nullptr;
     }
+    return native.arity;
 }
 
-void Interpreter::visitPrintStmt(std::shared_ptr<PrintStmt> stmt) {
-    std::any value = evaluate(stmt->expression);
-    std::cout << stringify(value) << "\n";
+// Clears the evaluated arguments of a call that fails before it starts.
+void Interpreter::discardArguments(std::size_t argumentCount) {
+    std::size_t base = frame.base + frame.size;
+    for (std::size_t i = base; i < base + argumentCount; ++i) {
+        stack[i].reset();
+    }
 }
 
-void Interpreter::visitReturnStmt(std::shared_ptr<ReturnStmt> stmt) {
+void Interpreter::bindParameters(LoxFunction& function, std::size_t base) {
+    FunctionStmt& declaration = *function.declaration;
+    if (function.receiver != nullptr) {
+        stack[base + declaration.parameters.size()] = function.receiver;
+    }
+
+    for (std::size_t i : declaration.typeProofs.parameters) {
+        if (stack[base + i].type() != typeid(double)) {
+            invalidateTypeProofs(declaration, base);
+            break;
+        }
+    }
+
+    // A method's receiver is boxed like a parameter when a closure captures 'this'.
+    for (std::size_t i = 0; i < declaration.parameterBindings.size(); ++i) {
+        switch (declaration.parameterBindings[i].kind) {
+            case VariableBinding::Kind::BOXED:
+                stack[base + i] = makeRef<Upvalue>(std::move(stack[base + i]));
+                break;
+            case VariableBinding::Kind::NUMBER:
+                numbers[base + i] = *std::any_cast<double>(&stack[base + i]);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// Some call passed a non-number where TypeInference assumed a number, so the function runs without its proofs from
+// now on. Frames already running it keep going generically once their NUMBER locals are back in the stack; the frame
+// at enteringBase is just starting and has none yet.
+__attribute__((noinline, cold)) void Interpreter::invalidateTypeProofs(FunctionStmt& declaration,
+                                                                       std::size_t enteringBase) {
+    TypeProofs& proofs = declaration.typeProofs;
+    auto release = [&](const CallFrame& running, std::vector<std::any>& values, std::vector<double>& doubles,
+                       std::size_t entering) {
+        if (running.function == nullptr || running.function->declaration.get() != &declaration ||
+            running.base == entering) {
+            return;
+        }
+        for (int slot : proofs.slots) {
+            values[running.base + slot] = doubles[running.base + slot];
+        }
+    };
+    release(frame, stack, numbers, enteringBase);
+    for (const CallFrame& running : frames) {
+        release(running, stack, numbers, enteringBase);
+    }
+    // Frames of suspended fibers, and of whatever resumed the running ones, are parked in the fibers.
+    for (LoxFiber* fiber = fibers; fiber != nullptr; fiber = fiber->next) {
+        release(fiber->frame, fiber->stack, fiber->numbers, std::numeric_limits<std::size_t>::max());
+        for (const CallFrame& running : fiber->frames) {
+            release(running, fiber->stack, fiber->numbers, std::numeric_limits<std::size_t>::max());
+        }
+    }
+
+    for (VariableBinding* binding : proofs.bindings) {
+        binding->kind = VariableBinding::Kind::LOCAL;
+    }
+    for (bool* flag : proofs.flags) {
+        *flag = false;
+    }
+    proofs = TypeProofs{};
+    ++typeStats.invalidations;
+}
+
+std::any Interpreter::executeFunction(LoxFunction& function, std::vector<std::any>& arguments) {
+    std::size_t base = frame.base + frame.size;
+    reserveStack(base + arguments.size());
+    for (std::size_t i = 0; i < arguments.size(); ++i) {
+        stack[base + i] = std::move(arguments[i]);
+    }
+    if (function.declaration->isGenerator) {
+        return startGenerator(&function, function.declaration->name, arguments.size());
+    }
+    if (function.declaration->memo != nullptr) {
+        return callMemoized(&function);
+    }
+    return executeCall(&function);
+}
+
+// Kept out of line so the machine-code path adds nothing to the native frame of interpreted calls.
+__attribute__((noinline)) bool Interpreter::runCompiled(FunctionStmt& declaration, std::any& result) {
+    if (declaration.jitCode == nullptr &&
+        (++declaration.callCount < Jit::HOT_THRESHOLD || !jit.compile(declaration))) {
+        return false;
+    }
+
+    std::size_t base = frame.base + frame.size;
+    if (!jit.run(declaration, &stack[base], frames.size(), nativeStackLimit, result)) {
+        return false;
+    }
+    for (std::size_t i = base; i < base + declaration.parameters.size(); ++i) {
+        stack[i].reset();
+    }
+    return true;
+}
+
+std::any Interpreter::executeCall(LoxFunction* function) {
+    if (jitEnabled && !function->declaration->jitRejected) {
+        std::any result;
+        if (runCompiled(*function->declaration, result)) {
+            return result;
+        }
+    }
+
+    CallFrame callee{function, frame.base + frame.size, static_cast<std::size_t>(function->declaration->frameSize)};
+    reserveStack(callee.base + callee.size);
+    bindParameters(*function, callee.base);
+
+    FrameGuard guard{*this, callee};
+    std::size_t pendingMemos = tailMemoKeys.size();
+    // Holds a tail-called function once nothing else may be keeping it alive.
+    Ref<LoxFunction> tailCallee;
+    while (true) {
+        executeStatements(function->declaration->body);
+        if (tailCall == nullptr) {
+            break;
+        }
+
+        // visitReturnStmt already moved the arguments into this frame's parameter slots.
+        tailCallee = std::move(tailCall);
+        function = tailCallee.get();
+        frame.function = function;
+        frame.size = function->declaration->frameSize;
+        reserveStack(frame.base + frame.size);
+        bindParameters(*function, frame.base);
+        returning = false;
+    }
+
+    if (tailMemoKeys.size() > pendingMemos) {
+        storeTailMemo(pendingMemos);
+    }
+    FunctionStmt& declaration = *function->declaration;
+    if (declaration.isInitializer) {
+        returning = false;
+        return lookUpVariable(declaration.name, declaration.parameterBindings.back());
+    }
+    if (!returning) {
+        return nullptr;
+    }
+
+    returning = false;
+    return std::move(returnValue);
+}
+
+void Interpreter::visitBlockStmt(BlockStmt& stmt) {
+    executeStatements(stmt.statements);
+}
+
+void Interpreter::visitExpressionStmt(ExpressionStmt& stmt) {
+    evaluate(stmt.expression);
+}
+
+void Interpreter::visitFunctionStmt(FunctionStmt& stmt) {
+    // A boxed name must exist before the upvalues are captured, so a local function can refer to itself.
+    Ref<Upvalue> self;
+    if (stmt.binding.kind == VariableBinding::Kind::BOXED) {
+        self = makeRef<Upvalue>(nullptr);
+        stack[frame.base + stmt.binding.index] = self;
+    }
+
+    Ref<LoxFunction> function = makeClosure(stmt);
+    if (self != nullptr) {
+        self->value = function;
+    } else {
+        define(stmt.name, stmt.binding, function);
+    }
+}
+
+Ref<LoxFunction> Interpreter::makeClosure(FunctionStmt& declaration) {
+    auto function = makeRef<LoxFunction>(declaration.shared_from_this());
+    function->upvalues.reserve(declaration.upvalues.size());
+    for (const FunctionStmt::UpvalueSource& source : declaration.upvalues) {
+        if (source.isLocal) {
+            function->upvalues.push_back(*std::any_cast<Ref<Upvalue>>(&stack[frame.base + source.index]));
+        } else {
+            function->upvalues.push_back(frame.function->upvalues[source.index]);
+        }
+    }
+    return function;
+}
+
+void Interpreter::visitClassStmt(ClassStmt& stmt) {
+    Ref<LoxClass> superclass;
+    if (stmt.superclass != nullptr) {
+        std::any value = evaluate(stmt.superclass);
+        auto* klass = std::any_cast<Ref<LoxClass>>(&value);
+        if (klass == nullptr) {
+            throwError(stmt.superclass->name, "Superclass must be a class.");
+        }
+        superclass = *klass;
+        // Defined before the methods are made, since those capture it.
+        define(stmt.superclass->name, stmt.superBinding, superclass);
+    }
+
+    // As for functions, a boxed name must exist before the methods capture it.
+    Ref<Upvalue> self;
+    if (stmt.binding.kind == VariableBinding::Kind::BOXED) {
+        self = makeRef<Upvalue>(nullptr);
+        stack[frame.base + stmt.binding.index] = self;
+    }
+
+    std::unordered_map<std::string, Ref<LoxFunction>> methods;
+    for (const std::shared_ptr<FunctionStmt>& method : stmt.methods) {
+        methods[method->name.lexeme] = makeClosure(*method);
+    }
+
+    auto klass = makeRef<LoxClass>(stmt.name.lexeme, std::move(superclass), std::move(methods));
+    if (self != nullptr) {
+        self->value = klass;
+    } else {
+        define(stmt.name, stmt.binding, klass);
+    }
+}
+
+void Interpreter::visitIfStmt(IfStmt& stmt) {
+    if (collectingStats && !stmt.numberCondition && stmt.specialization == ConditionSpecialization::UNINITIALIZED) {
+        ifFeedback.push_back(stmt.shared_from_this());
+    }
+
+    if (stmt.numberCondition ? compareNumbers(static_cast<BinaryExpr&>(*stmt.condition))
+                              : testCondition(stmt.condition, stmt.specialization, stmt.stats)) {
+        execute(stmt.thenBranch);
+    } else if (stmt.elseBranch != nullptr) {
+        execute(stmt.elseBranch);
+    }
+}
+
+void Interpreter::visitPrintStmt(PrintStmt& stmt) {
+    std::any value = evaluate(stmt.expression);
+    Output& output = standardOutput();
+    if (const auto* number = std::any_cast<double>(&value)) {
+        output.appendNumber(*number);
+    } else if (const auto* string = std::any_cast<Ref<LoxString>>(&value)) {
+        output.append((*string)->view());
+    } else {
+        output.append(stringify(value));
+    }
+    output.endLine();
+}
+
+void Interpreter::visitReturnStmt(ReturnStmt& stmt) {
+    if (stmt.isTailCall) {
+        executeTailCall(static_cast<CallExpr&>(*stmt.value));
+        return;
+    }
+
     std::any value = nullptr;
-    if (stmt->value != nullptr) {
-        value = evaluate(stmt->value);
+    if (stmt.value != nullptr) {
+        value = evaluate(stmt.value);
     }
 
-    throw LoxReturn{value};
+    returnValue = std::move(value);
+    returning = true;
 }
 
-void Interpreter::visitVarStmt(std::shared_ptr<VarStmt> stmt) {
+void Interpreter::executeTailCall(CallExpr& call) {
+    std::any callee = evaluate(call.callee);
+    std::size_t argumentBase = evaluateArguments(call.arguments);
+    if (const Ref<LoxClass>* klass = std::any_cast<Ref<LoxClass>>(&callee)) {
+        // Constructing needs the instance after the initializer returns, so it does not take over this frame.
+        returnValue = construct(*klass, call.paren, call.arguments.size());
+        returning = true;
+        return;
+    }
+    if (const Ref<LoxNative>* native = std::any_cast<Ref<LoxNative>>(&callee)) {
+        returnValue = callNative(**native, call.paren, call.arguments.size());
+        returning = true;
+        return;
+    }
+    LoxFunction* function = checkCallee(callee, call.paren, call.arguments.size());
+    if (function->declaration->isGenerator) {
+        returnValue = startGenerator(function, call.paren, call.arguments.size());
+        returning = true;
+        return;
+    }
+    safepoint(call.paren);
+    // Machine code returns before anything else runs, so calling it nests no deeper than taking over the frame.
+    FunctionStmt& declaration = *function->declaration;
+    if ((declaration.memo != nullptr && lookUpTailMemo(function)) ||
+        (jitEnabled && !declaration.jitRejected && runCompiled(declaration, returnValue))) {
+        returning = true;
+        return;
+    }
+
+    // The running function is finished once its return value is being computed, so the callee takes over its frame
+    // instead of nesting a new one. Moving upwards is safe because the arguments sit above the slots they move to.
+    std::size_t argumentCount = call.arguments.size();
+    for (std::size_t i = 0; i < argumentCount; ++i) {
+        stack[frame.base + i] = std::move(stack[argumentBase + i]);
+    }
+    for (std::size_t i = frame.base + argumentCount; i < argumentBase + argumentCount; ++i) {
+        stack[i].reset();
+    }
+
+    tailCall = *std::any_cast<Ref<LoxFunction>>(&callee);
+    returning = true;
+}
+
+// A generator's call only parks its arguments in a new fiber, as the first slots of the fiber's frame stack. The body
+// runs when the fiber is resumed.
+std::any Interpreter::startGenerator(LoxFunction* function, const Token& paren, std::size_t argumentCount) {
+    Ref<LoxFiber> fiber;
+    try {
+        fiber = makeRef<LoxFiber>(*this, Ref<LoxFunction>{function});
+    } catch (const std::bad_alloc&) {
+        discardArguments(argumentCount);
+        throwError(paren, "Out of memory for fibers.");
+    }
+
+    std::size_t base = frame.base + frame.size;
+    fiber->stack.resize(argumentCount);
+    fiber->numbers.resize(argumentCount);
+    for (std::size_t i = 0; i < argumentCount; ++i) {
+        fiber->stack[i] = std::move(stack[base + i]);
+        stack[base + i].reset();
+    }
+    fiber->nativeStackLimit = fiber->stackBottom() + NATIVE_STACK_MARGIN;
+    return fiber;
+}
+
+std::any Interpreter::resume(LoxFiber& fiber, const Token& paren) {
+    if (fiber.state == LoxFiber::State::DONE) {
+        return nullptr;
+    }
+    if (fiber.state == LoxFiber::State::RUNNING) {
+        throwError(paren, "Fiber is already running.");
+    }
+    if (fiber.state == LoxFiber::State::WAITING) {
+        throwError(paren, "Fiber is waiting for an event.");
+    }
+
+    LoxFiber* resumer = runningFiber;
+    runningFiber = &fiber;
+    fiber.state = LoxFiber::State::RUNNING;
+    switchFrames(fiber);
+    fiber.resume();
+    switchFrames(fiber);
+    runningFiber = resumer;
+
+    if (fiber.state == LoxFiber::State::RUNNING) {
+        fiber.state = LoxFiber::State::SUSPENDED;
+    }
+    if (fiber.error != nullptr) {
+        std::rethrow_exception(std::exchange(fiber.error, nullptr));
+    }
+    return std::move(fiber.value);
+}
+
+// Swaps the running frame stack with the one parked in fiber. The vectors swap their buffers, so pointers into the
+// parked stack, such as a native's arguments, stay valid.
+void Interpreter::switchFrames(LoxFiber& fiber) {
+    stack.swap(fiber.stack);
+    numbers.swap(fiber.numbers);
+    std::swap(frame, fiber.frame);
+    frames.swap(fiber.frames);
+    std::swap(nativeStackLimit, fiber.nativeStackLimit);
+}
+
+// Runs on the fiber's stack, with its frame stack switched in and the arguments in its first slots.
+void Interpreter::runFiber(LoxFiber& fiber) {
+    try {
+        fiber.value = executeCall(fiber.function.get());
+    } catch (...) {
+        fiber.error = std::current_exception();
+    }
+    fiber.state = LoxFiber::State::DONE;
+}
+
+LoxFiber* Interpreter::currentFiber() const {
+    return runningFiber;
+}
+
+EventLoop& Interpreter::eventLoop() {
+    return events;
+}
+
+// Suspends the running fiber until the event loop wakes it, and returns what it is woken with. Whoever resumed the
+// fiber carries on meanwhile, as if it had yielded nil.
+std::any Interpreter::waitForEvent() {
+    LoxFiber& fiber = *runningFiber;
+    fiber.state = LoxFiber::State::WAITING;
+    fiber.value = nullptr;
+    fiber.suspend();
+    return std::exchange(fiber.value, nullptr);
+}
+
+void Interpreter::wake(LoxFiber& fiber, std::any value, const Token& paren) {
+    fiber.state = LoxFiber::State::SUSPENDED;
+    fiber.value = std::move(value);
+    resume(fiber, paren);
+}
+
+void Interpreter::visitYieldStmt(YieldStmt& stmt) {
     std::any value = nullptr;
-    if (stmt->initializer != nullptr) {
-        value = evaluate(stmt->initializer);
+    if (stmt.value != nullptr) {
+        value = evaluate(stmt.value);
     }
 
-    environment->define(stmt->name.lexeme, std::move(value));
+    // The Resolver only allows yield directly in a generator's body, which only ever runs in its own fiber.
+    LoxFiber& fiber = *runningFiber;
+    fiber.value = std::move(value);
+    fiber.suspend();
 }
 
-void Interpreter::visitWhileStmt(std::shared_ptr<WhileStmt> stmt) {
-    while (isTruthy(evaluate(stmt->condition))) {
-        execute(stmt->body);
+void Interpreter::visitVarStmt(VarStmt& stmt) {
+    if (stmt.binding.kind == VariableBinding::Kind::NUMBER) {
+        numbers[frame.base + stmt.binding.index] = evaluateNumber(stmt.initializer);
+        return;
     }
+
+    std::any value = nullptr;
+    if (stmt.initializer != nullptr) {
+        value = evaluate(stmt.initializer);
+    }
+
+    define(stmt.name, stmt.binding, std::move(value));
 }
 
-std::any Interpreter::visitAssignExpr(std::shared_ptr<AssignExpr> expr) {
-    std::any value = evaluate(expr->value);
+void Interpreter::visitWhileStmt(WhileStmt& stmt) {
+    if (collectingStats && !stmt.numberCondition && stmt.specialization == ConditionSpecialization::UNINITIALIZED) {
+        whileFeedback.push_back(stmt.shared_from_this());
+    }
+    if (stmt.numberCondition && stmt.counted != nullptr && runCountedLoop(stmt)) {
+        return;
+    }
 
-    auto element = locals.find(expr);
-    if (element != locals.end()) {
-        int distance = element->second;
-        environment->assignAt(distance, expr->name, value);
-    } else {
-        globals->assign(expr->name, value);
+    while (stmt.numberCondition ? compareNumbers(static_cast<BinaryExpr&>(*stmt.condition))
+                                 : testCondition(stmt.condition, stmt.specialization, stmt.stats)) {
+        execute(stmt.body);
+        if (returning) {
+            return;
+        }
+        safepoint(stmt.keyword);
+    }
+}
+
+std::any Interpreter::visitAssignExpr(AssignExpr& expr) {
+    if (expr.isNumber) {
+        return visitAssignNumber(expr);
     }
 
+    std::any value = evaluate(expr.value);
+    assignVariable(expr.name, expr.binding, value);
     return value;
 }
 
-std::any Interpreter::visitBinaryExpr(std::shared_ptr<BinaryExpr> expr) {
-    std::any left = evaluate(expr->left);
-    std::any right = evaluate(expr->right);
+std::any Interpreter::visitBinaryExpr(BinaryExpr& expr) {
+    if (expr.numberOperands) {
+        return evaluateNumberOperands(expr);
+    }
+
+    std::any left = evaluate(expr.left);
+    std::any right = evaluate(expr.right);
 
-    switch (expr->op.type) {
+    // any_cast on a pointer compares the stored type's manager directly, so each guard is a single compare.
+    const double* a = std::any_cast<double>(&left);
+    const double* b = std::any_cast<double>(&right);
+    bool numbers = a != nullptr && b != nullptr;
+
+    switch (expr.specialization) {
+        case BinarySpecialization::NUMBER_ADD:
+            if (numbers) {
+                ++expr.stats.hits;
+                return *a + *b;
+            }
+            break;
+        case BinarySpecialization::NUMBER_SUBTRACT:
+            if (numbers) {
+                ++expr.stats.hits;
+                return *a - *b;
+            }
+            break;
+        case BinarySpecialization::NUMBER_MULTIPLY:
+            if (numbers) {
+                ++expr.stats.hits;
+                return *a * *b;
+            }
+            break;
+        case BinarySpecialization::NUMBER_DIVIDE:
+            if (numbers) {
+                ++expr.stats.hits;
+                return *a / *b;
+            }
+            break;
+        case BinarySpecialization::NUMBER_GREATER:
+            if (numbers) {
+                ++expr.stats.hits;
+                return *a > *b;
+            }
+            break;
+        case BinarySpecialization::NUMBER_GREATER_EQUAL:
+            if (numbers) {
+                ++expr.stats.hits;
+                return *a >= *b;
+            }
+            break;
+        case BinarySpecialization::NUMBER_LESS:
+            if (numbers) {
+                ++expr.stats.hits;
+                return *a < *b;
+            }
+            break;
+        case BinarySpecialization::NUMBER_LESS_EQUAL:
+            if (numbers) {
+                ++expr.stats.hits;
+                return *a <= *b;
+            }
+            break;
+        case BinarySpecialization::NUMBER_EQUAL:
+            if (numbers) {
+                ++expr.stats.hits;
+                return *a == *b;
+            }
+            break;
+        case BinarySpecialization::NUMBER_NOT_EQUAL:
+            if (numbers) {
+                ++expr.stats.hits;
+                return *a != *b;
+            }
+            break;
+        case BinarySpecialization::STRING_CONCAT:
+            if (std::any_cast<Ref<LoxString>>(&left) != nullptr && std::any_cast<Ref<LoxString>>(&right) != nullptr) {
+                ++expr.stats.hits;
+                return concatenate(std::move(left), right);
+            }
+            break;
+        case BinarySpecialization::UNINITIALIZED:
+            // This first evaluation still runs the generic code, which also reports any type error.
+            specialize(expr, left, right);
+            ++expr.stats.misses;
+            return binaryOperation(expr.op, left, right);
+        case BinarySpecialization::GENERIC:
+            break;
+    }
+
+    // A failed guard lands here too; the node then stays generic instead of flipping between variants.
+    expr.specialization = BinarySpecialization::GENERIC;
+    ++expr.stats.misses;
+    return binaryOperation(expr.op, left, right);
+}
+
+void Interpreter::specialize(BinaryExpr& expr, const std::any& left, const std::any& right) {
+    if (collectingStats) {
+        binaryFeedback.push_back(expr.shared_from_this());
+    }
+
+    BinarySpecialization specialization = BinarySpecialization::GENERIC;
+    if (left.type() == typeid(double) && right.type() == typeid(double)) {
+        switch (expr.op.type) {
+            case PLUS:
+                specialization = BinarySpecialization::NUMBER_ADD;
+                break;
+            case MINUS:
+                specialization = BinarySpecialization::NUMBER_SUBTRACT;
+                break;
+            case STAR:
+                specialization = BinarySpecialization::NUMBER_MULTIPLY;
+                break;
+            case SLASH:
+                specialization = BinarySpecialization::NUMBER_DIVIDE;
+                break;
+            case GREATER:
+                specialization = BinarySpecialization::NUMBER_GREATER;
+                break;
+            case GREATER_EQUAL:
+                specialization = BinarySpecialization::NUMBER_GREATER_EQUAL;
+                break;
+            case LESS:
+                specialization = BinarySpecialization::NUMBER_LESS;
+                break;
+            case LESS_EQUAL:
+                specialization = BinarySpecialization::NUMBER_LESS_EQUAL;
+                break;
+            case EQUAL_EQUAL:
+                specialization = BinarySpecialization::NUMBER_EQUAL;
+                break;
+            case BANG_EQUAL:
+                specialization = BinarySpecialization::NUMBER_NOT_EQUAL;
+                break;
+            default:
+                break;
+        }
+    } else if (expr.op.type == PLUS && left.type() == typeid(Ref<LoxString>) &&
+               right.type() == typeid(Ref<LoxString>)) {
+        specialization = BinarySpecialization::STRING_CONCAT;
+    }
+
+    expr.specialization = specialization;
+}
+
+std::any Interpreter::binaryOperation(const Token& op, const std::any& left, const std::any& right) {
+    switch (op.type) {
         case BANG_EQUAL:
             return !isEqual(left, right);
         case EQUAL_EQUAL:
             return isEqual(left, right);
         case GREATER:
-            checkNumberOperands(expr->op, left, right);
+            checkNumberOperands(op, left, right);
             return std::any_cast<double>(left) > std::any_cast<double>(right);
         case GREATER_EQUAL:
-            checkNumberOperands(expr->op, left, right);
+            checkNumberOperands(op, left, right);
             return std::any_cast<double>(left) >= std::any_cast<double>(right);
         case LESS:
-            checkNumberOperands(expr->op, left, right);
+            checkNumberOperands(op, left, right);
             return std::any_cast<double>(left) < std::any_cast<double>(right);
         case LESS_EQUAL:
-            checkNumberOperands(expr->op, left, right);
+            checkNumberOperands(op, left, right);
             return std::any_cast<double>(left) <= std::any_cast<double>(right);
         case MINUS:
-            checkNumberOperands(expr->op, left, right);
+            checkNumberOperands(op, left, right);
             return std::any_cast<double>(left) - std::any_cast<double>(right);
         case PLUS:
             if (left.type() == typeid(double) && right.type() == typeid(double)) {
                 return std::any_cast<double>(left) + std::any_cast<double>(right);
             }
 
-            if (left.type() == typeid(std::string) && right.type() == typeid(std::string)) {
-                return std::any_cast<std::string>(left) + std::any_cast<std::string>(right);
+            if (left.type() == typeid(Ref<LoxString>) && right.type() == typeid(Ref<LoxString>)) {
+                return concatenate(left, right);
             }
 
-            throw RuntimeError{expr->op, "Operands must be two numbers or two strings."};
+            throwError(op, "Operands must be two numbers or two strings.");
         case SLASH:
-            checkNumberOperands(expr->op, left, right);
+            checkNumberOperands(op, left, right);
             return std::any_cast<double>(left) / std::any_cast<double>(right);
         case STAR:
-            checkNumberOperands(expr->op, left, right);
+            checkNumberOperands(op, left, right);
             return std::any_cast<double>(left) * std::any_cast<double>(right);
         default:
             return {};
@@ -161,42 +1010,428 @@ std::any Interpreter::visitBinaryExpr(std::shared_ptr<BinaryExpr> expr) {
     return {};
 }
 
-std::any Interpreter::visitCallExpr(std::shared_ptr<CallExpr> expr) {
-    std::any callee = evaluate(expr->callee);
+std::any Interpreter::visitCallExpr(CallExpr& expr) {
+    if (expr.inlined != nullptr) {
+        if (holdsFunction(*expr.inlined->declaration)) {
+            return evaluateInlined(expr);
+        }
+        ++inlineGuardFailures;
+    }
+
+    if (expr.property != nullptr) {
+        return invoke(expr, *expr.property);
+    }
+
+    std::any callee = evaluate(expr.callee);
+    return callValue(callee, expr);
+}
+
+std::any Interpreter::callValue(std::any& callee, CallExpr& expr) {
+    evaluateArguments(expr.arguments);
+    if (const Ref<LoxClass>* klass = std::any_cast<Ref<LoxClass>>(&callee)) {
+        return construct(*klass, expr.paren, expr.arguments.size());
+    }
+    if (const Ref<LoxNative>* native = std::any_cast<Ref<LoxNative>>(&callee)) {
+        return callNative(**native, expr.paren, expr.arguments.size());
+    }
+
+    // callee keeps the function alive for the duration of the call.
+    LoxFunction* function = checkCallee(callee, expr.paren, expr.arguments.size());
+    if (function->declaration->isGenerator) {
+        return startGenerator(function, expr.paren, expr.arguments.size());
+    }
+    checkCallDepth(expr.paren);
+    safepoint(expr.paren);
+    if (function->declaration->memo != nullptr) {
+        return callMemoized(function);
+    }
+    return executeCall(function);
+}
+
+std::any Interpreter::callNative(LoxNative& native, const Token& paren, std::size_t argumentCount) {
+    if (argumentCount != native.arity) {
+        argumentCount = fillOptionalArguments(native, paren, argumentCount);
+    }
+    std::any result;
+    try {
+        result = native.body(*this, paren, &stack[frame.base + frame.size]);
+    } catch (const RuntimeError&) {
+        discardArguments(argumentCount);
+        throw;
+    }
+    discardArguments(argumentCount);
+    return result;
+}
+
+std::any Interpreter::construct(const Ref<LoxClass>& klass, const Token& paren, std::size_t argumentCount) {
+    auto instance = makeRef<LoxInstance>(klass);
+    if (klass->initializer == nullptr) {
+        checkArity(0, paren, argumentCount);
+        return instance;
+    }
+    callMethod(klass->initializer, instance, paren, argumentCount);
+    return instance;
+}
+
+// Calls a property. A method runs with the instance as its receiver straight away instead of through a bound copy.
+std::any Interpreter::invoke(CallExpr& call, GetExpr& property) {
+    std::any object = evaluate(property.object);
+    auto* instance = std::any_cast<Ref<LoxInstance>>(&object);
+    if (instance == nullptr) {
+        throwError(property.name, "Only instances have properties.");
+    }
+
+    std::any* field = nullptr;
+    LoxFunction* method = findProperty(property, **instance, field);
+    if (method == nullptr) {
+        std::any callee = *field;
+        return callValue(callee, call);
+    }
+
+    evaluateArguments(call.arguments);
+    // The receiver keeps the class and so the method alive, whatever happens to this site's cache meanwhile.
+    return callMethod(method, std::move(object), call.paren, call.arguments.size());
+}
+
+// The arguments are in place above this frame; the receiver goes in the slot after them, where the method's 'this'
+// is.
+std::any Interpreter::callMethod(LoxFunction* method, std::any receiver, const Token& paren,
+                                 std::size_t argumentCount) {
+    checkArity(method->arity(), paren, argumentCount);
+    checkCallDepth(paren);
+    safepoint(paren);
+    std::size_t base = frame.base + frame.size;
+    reserveStack(base + argumentCount + 1);
+    stack[base + argumentCount] = std::move(receiver);
+    return executeCall(method);
+}
+
+// Appends an encoding of each argument to key, or returns false if one is not a number, string or boolean. Numbers
+// are compared by their bits, which keeps 0 and -0 apart.
+static bool memoKey(const std::any* arguments, std::size_t count, std::string& key) {
+    for (std::size_t i = 0; i < count; ++i) {
+        if (const double* number = std::any_cast<double>(&arguments[i])) {
+            key += 'n';
+            key.append(reinterpret_cast<const char*>(number), sizeof(double));
+        } else if (const bool* boolean = std::any_cast<bool>(&arguments[i])) {
+            key += *boolean ? 't' : 'f';
+        } else if (const Ref<LoxString>* string = std::any_cast<Ref<LoxString>>(&arguments[i])) {
+            std::size_t length = (*string)->length();
+            key += 's';
+            key.append(reinterpret_cast<const char*>(&length), sizeof(length));
+            key += (*string)->view();
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Out of line like runCompiled, so the key does not enlarge the native frame of every call.
+__attribute__((noinline)) std::any Interpreter::callMemoized(LoxFunction* function) {
+    MemoTable& memo = *function->declaration->memo;
+    std::size_t base = frame.base + frame.size;
+    std::size_t arity = function->declaration->parameters.size();
+    std::string key;
+    if (!holdsDependencies(memo) || !memoKey(&stack[base], arity, key)) {
+        ++memo.bypassed;
+        return executeCall(function);
+    }
+
+    auto elem = memo.results.find(key);
+    if (elem != memo.results.end()) {
+        ++memo.hits;
+        for (std::size_t i = base; i < base + arity; ++i) {
+            stack[i].reset();
+        }
+        return elem->second;
+    }
+
+    ++memo.misses;
+    std::any result = executeCall(function);
+    storeMemo(memo, std::move(key), result);
+    return result;
+}
+
+// A memoized function called in tail position takes over the caller's frame, so its result is only known once that
+// frame returns. A hit becomes the return value at once; on a miss the key waits in tailMemoKeys until executeCall
+// stores the frame's result under it.
+__attribute__((noinline)) bool Interpreter::lookUpTailMemo(LoxFunction* function) {
+    MemoTable& memo = *function->declaration->memo;
+    std::size_t base = frame.base + frame.size;
+    std::size_t arity = function->declaration->parameters.size();
+    std::string key;
+    if (!holdsDependencies(memo) || !memoKey(&stack[base], arity, key)) {
+        ++memo.bypassed;
+        return false;
+    }
+
+    auto elem = memo.results.find(key);
+    if (elem != memo.results.end()) {
+        ++memo.hits;
+        for (std::size_t i = base; i < base + arity; ++i) {
+            stack[i].reset();
+        }
+        returnValue = elem->second;
+        return true;
+    }
+    ++memo.misses;
+    tailMemoKeys.push_back(PendingMemo{&memo, std::move(key)});
+    return false;
+}
+
+__attribute__((noinline)) void Interpreter::storeTailMemo(std::size_t first) {
+    const std::any result = returning ? returnValue : std::any{nullptr};
+    for (std::size_t i = first; i < tailMemoKeys.size(); ++i) {
+        storeMemo(*tailMemoKeys[i].memo, std::move(tailMemoKeys[i].key), result);
+    }
+    tailMemoKeys.resize(first);
+}
+
+void Interpreter::storeMemo(MemoTable& memo, std::string key, const std::any& result) {
+    if (memo.results.size() >= MemoTable::CAPACITY) {
+        memo.results.clear();
+        ++memo.clears;
+    }
+    memo.results.emplace(std::move(key), result);
+}
+
+bool Interpreter::holdsDependencies(MemoTable& memo) {
+    for (const FunctionStmt* dependency : memo.dependencies) {
+        if (!holdsFunction(*dependency)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The global a function was declared as may have been reassigned since, for instance by a later line at the prompt.
+bool Interpreter::holdsFunction(const FunctionStmt& declaration) {
+    auto* function = std::any_cast<Ref<LoxFunction>>(&globals->values[declaration.binding.index]);
+    return function != nullptr && (*function)->declaration.get() == &declaration;
+}
+
+std::any Interpreter::evaluateInlined(CallExpr& call) {
+    // Charged like the call it replaces.
+    safepoint(call.paren);
+    InlinedCall& inlined = *call.inlined;
+    for (std::size_t i = 0; i < call.arguments.size(); ++i) {
+        const VariableBinding& parameter = inlined.parameters[i];
+        if (parameter.kind == VariableBinding::Kind::NUMBER) {
+            numbers[frame.base + parameter.index] = evaluateNumber(call.arguments[i]);
+        } else {
+            stack[frame.base + parameter.index] = evaluate(call.arguments[i]);
+        }
+    }
+    return evaluate(inlined.body);
+}
+
+std::any Interpreter::visitGetExpr(GetExpr& expr) {
+    std::any object = evaluate(expr.object);
+    auto* instance = std::any_cast<Ref<LoxInstance>>(&object);
+    if (instance == nullptr) {
+        throwError(expr.name, "Only instances have properties.");
+    }
+
+    std::any* field = nullptr;
+    LoxFunction* method = findProperty(expr, **instance, field);
+    if (method == nullptr) {
+        return *field;
+    }
+    return method->bind(*instance);
+}
+
+// Returns the method the property names, or nullptr with field pointing at the instance's field.
+LoxFunction* Interpreter::findProperty(GetExpr& expr, LoxInstance& instance, std::any*& field) {
+    PropertyCache& cache = expr.cache;
+    if (instance.shape.get() == cache.shape.get()) {
+        ++cache.stats.hits;
+    } else {
+        refillCache(expr, instance);
+    }
+
+    if (cache.slot >= 0) {
+        field = &instance.fields[cache.slot];
+        return nullptr;
+    }
+    return cache.method.get();
+}
+
+__attribute__((noinline)) void Interpreter::refillCache(GetExpr& expr, LoxInstance& instance) {
+    PropertyCache& cache = expr.cache;
+    int slot = instance.shape->find(expr.name.lexeme);
+    LoxFunction* method = slot < 0 ? instance.klass->findMethod(expr.name.lexeme) : nullptr;
+    if (slot < 0 && method == nullptr) {
+        throwUndefinedProperty(expr.name);
+    }
+
+    if (collectingStats && cache.shape == nullptr) {
+        getFeedback.push_back(expr.shared_from_this());
+    }
+    cache.shape = instance.shape;
+    cache.slot = slot;
+    cache.method = Ref<LoxFunction>{method};
+    ++cache.stats.misses;
+}
+
+std::any Interpreter::visitSetExpr(SetExpr& expr) {
+    std::any object = evaluate(expr.object);
+    auto* instance = std::any_cast<Ref<LoxInstance>>(&object);
+    if (instance == nullptr) {
+        throwError(expr.name, "Only instances have fields.");
+    }
+    std::any value = evaluate(expr.value);
+
+    // Checked only now, as evaluating the value may have given the instance new fields.
+    LoxInstance& target = **instance;
+    PropertyCache& cache = expr.cache;
+    if (target.shape.get() == cache.shape.get()) {
+        ++cache.stats.hits;
+    } else {
+        refillCache(expr, target);
+    }
+
+    if (cache.transition != nullptr) {
+        target.shape = cache.transition;
+        target.fields.push_back(value);
+    } else {
+        target.fields[cache.slot] = value;
+    }
+    return value;
+}
+
+__attribute__((noinline)) void Interpreter::refillCache(SetExpr& expr, LoxInstance& instance) {
+    PropertyCache& cache = expr.cache;
+    if (collectingStats && cache.shape == nullptr) {
+        setFeedback.push_back(expr.shared_from_this());
+    }
+
+    cache.shape = instance.shape;
+    cache.slot = instance.shape->find(expr.name.lexeme);
+    if (cache.slot >= 0) {
+        cache.transition = nullptr;
+    } else {
+        cache.slot = static_cast<int>(instance.fields.size());
+        cache.transition = instance.shape->transition(expr.name.lexeme);
+    }
+    ++cache.stats.misses;
+}
+
+std::any Interpreter::visitArrayExpr(ArrayExpr& expr) {
+    auto array = makeRef<LoxArray>();
+    array->numbers.reserve(expr.elements.size());
+    for (const std::shared_ptr<Expr>& element : expr.elements) {
+        array->push(evaluate(element));
+    }
+    return array;
+}
+
+std::any Interpreter::visitIndexExpr(IndexExpr& expr) {
+    std::any object = evaluate(expr.object);
+    auto* array = std::any_cast<Ref<LoxArray>>(&object);
+    if (array == nullptr) {
+        auto* map = std::any_cast<Ref<LoxMap>>(&object);
+        if (map == nullptr) {
+            throwError(expr.bracket, "Only arrays and maps can be indexed.");
+        }
+        std::any* value = (*map)->get(evaluateKey(expr.index, expr.bracket));
+        return value == nullptr ? nullptr : *value;
+    }
+    double index = evaluateIndex(expr.index, expr.bracket);
+    if (index >= (*array)->size()) {
+        throwError(expr.bracket, "Array index out of bounds.");
+    }
+    return (*array)->get(static_cast<std::size_t>(index));
+}
+
+std::any Interpreter::visitSetIndexExpr(SetIndexExpr& expr) {
+    std::any object = evaluate(expr.object);
+    auto* array = std::any_cast<Ref<LoxArray>>(&object);
+    if (array == nullptr) {
+        auto* map = std::any_cast<Ref<LoxMap>>(&object);
+        if (map == nullptr) {
+            throwError(expr.bracket, "Only arrays and maps can be indexed.");
+        }
+        std::any key = evaluateKey(expr.index, expr.bracket);
+        std::any value = evaluate(expr.value);
+        (*map)->set(key, value);
+        return value;
+    }
+    double index = evaluateIndex(expr.index, expr.bracket);
+    std::any value = evaluate(expr.value);
+    // Checked only now, as evaluating the value may have resized the array.
+    if (index >= (*array)->size()) {
+        throwError(expr.bracket, "Array index out of bounds.");
+    }
+    (*array)->set(static_cast<std::size_t>(index), value);
+    return value;
+}
 
-    std::vector<std::any> arguments;
-    for (const std::shared_ptr<Expr>& argument : expr->arguments) {
-        arguments.push_back(evaluate(argument));
+std::any Interpreter::visitMapExpr(MapExpr& expr) {
+    auto map = makeRef<LoxMap>();
+    for (std::size_t i = 0; i < expr.keys.size(); ++i) {
+        std::any key = evaluateKey(expr.keys[i], expr.brace);
+        map->set(key, evaluate(expr.values[i]));
     }
+    return map;
+}
 
-    std::shared_ptr<LoxCallable> function;
+std::any Interpreter::evaluateKey(const std::shared_ptr<Expr>& key, const Token& token) {
+    std::any value = evaluate(key);
+    if (!LoxMap::isKey(value)) {
+        throwError(token, "Map keys must be nil, booleans, numbers or strings.");
+    }
+    return value;
+}
 
-    if (callee.type() == typeid(std::shared_ptr<LoxFunction>)) {
-        function = std::any_cast<std::shared_ptr<LoxFunction>>(callee);
+// Returns the index as a whole number that is not negative, still to be checked against the array's size.
+double Interpreter::evaluateIndex(const std::shared_ptr<Expr>& index, const Token& bracket) {
+    double number;
+    if (index->isNumber) {
+        number = evaluateNumber(index);
     } else {
-        throw RuntimeError{expr->paren, "Can only call functions and classes."};
+        std::any value = evaluate(index);
+        const double* boxed = std::any_cast<double>(&value);
+        if (boxed == nullptr) {
+            throwError(bracket, "Array index must be a number.");
+        }
+        number = *boxed;
+    }
+    if (number != std::floor(number)) {
+        throwError(bracket, "Array index must be a whole number.");
+    }
+    if (number < 0) {
+        throwError(bracket, "Array index out of bounds.");
     }
+    return number;
+}
 
-    if (arguments.size() != function->arity()) {
-        throw RuntimeError{expr->paren, "Expected " + std::to_string(function->arity()) + " arguments but got " +
-                                            std::to_string(arguments.size()) + "."};
+std::any Interpreter::visitSuperExpr(SuperExpr& expr) {
+    std::any superclass = lookUpVariable(expr.keyword, expr.binding);
+    std::any receiver = lookUpVariable(expr.keyword, expr.thisBinding);
+    LoxFunction* method = (*std::any_cast<Ref<LoxClass>>(&superclass))->findMethod(expr.method.lexeme);
+    if (method == nullptr) {
+        throwUndefinedProperty(expr.method);
     }
+    return method->bind(*std::any_cast<Ref<LoxInstance>>(&receiver));
+}
 
-    return function->call(*this, std::move(arguments));
+std::any Interpreter::visitThisExpr(ThisExpr& expr) {
+    return lookUpVariable(expr.keyword, expr.binding);
 }
 
-std::any Interpreter::visitGroupingExpr(std::shared_ptr<GroupingExpr> expr) {
-    return evaluate(expr->expression);
+std::any Interpreter::visitGroupingExpr(GroupingExpr& expr) {
+    return evaluate(expr.expression);
 }
 
-std::any Interpreter::visitLiteralExpr(std::shared_ptr<LiteralExpr> expr) {
-    return expr->value;
+std::any Interpreter::visitLiteralExpr(LiteralExpr& expr) {
+    return expr.value;
 }
 
-std::any Interpreter::visitLogicalExpr(std::shared_ptr<LogicalExpr> expr) {
-    std::any left = evaluate(expr->left);
+std::any Interpreter::visitLogicalExpr(LogicalExpr& expr) {
+    std::any left = evaluate(expr.left);
 
-    if (expr->op.type == OR) {
+    if (expr.op.type == OR) {
         if (isTruthy(left)) {
             return left;
         }
@@ -206,17 +1441,23 @@ std::any Interpreter::visitLogicalExpr(std::shared_ptr<LogicalExpr> expr) {
         }
     }
 
-    return evaluate(expr->right);
+    return evaluate(expr.right);
 }
 
-std::any Interpreter::visitUnaryExpr(std::shared_ptr<UnaryExpr> expr) {
-    std::any right = evaluate(expr->right);
+std::any Interpreter::visitUnaryExpr(UnaryExpr& expr) {
+    if (expr.isNumber && expr.right->isNumber) {
+        return -evaluateNumber(expr.right);
+    }
 
-    switch (expr->op.type) {
+    return unaryOperation(expr.op, evaluate(expr.right));
+}
+
+std::any Interpreter::unaryOperation(const Token& op, const std::any& right) {
+    switch (op.type) {
         case BANG:
             return !isTruthy(right);
         case MINUS:
-            checkNumberOperand(expr->op, right);
+            checkNumberOperand(op, right);
             return -std::any_cast<double>(right);
         default:
             return std::any{};
@@ -226,17 +1467,183 @@ std::any Interpreter::visitUnaryExpr(std::shared_ptr<UnaryExpr> expr) {
     return {};
 }
 
-std::any Interpreter::visitVariableExpr(std::shared_ptr<VariableExpr> expr) {
-    return lookUpVariable(expr->name, expr);
+std::any Interpreter::visitVariableExpr(VariableExpr& expr) {
+    return lookUpVariable(expr.name, expr.binding);
+}
+
+// Expressions proven to be numbers are evaluated here on raw doubles. A node whose proofs were undone while it was
+// already being evaluated falls back to its generic visitor, whose result is still a number.
+double Interpreter::evaluateNumber(const std::shared_ptr<Expr>& expr) {
+    return expr->acceptNumber(*this);
 }
 
-std::any Interpreter::lookUpVariable(const Token& name, std::shared_ptr<Expr> expr) {
-    auto elem = locals.find(expr);
-    if (elem != locals.end()) {
-        int distance = elem->second;
-        return environment->getAt(distance, name.lexeme);
+double Interpreter::visitAssignNumber(AssignExpr& expr) {
+    double value = evaluateNumber(expr.value);
+    if (expr.binding.kind == VariableBinding::Kind::NUMBER) {
+        numbers[frame.base + expr.binding.index] = value;
     } else {
-        return globals->get(name);
+        assignVariable(expr.name, expr.binding, value);
+    }
+    return value;
+}
+
+double Interpreter::visitBinaryNumber(BinaryExpr& expr) {
+    if (!expr.numberOperands) {
+        std::any value = expr.accept(*this);
+        return *std::any_cast<double>(&value);
+    }
+
+    double a = evaluateNumber(expr.left);
+    double b = evaluateNumber(expr.right);
+    switch (expr.op.type) {
+        case PLUS:
+            return a + b;
+        case MINUS:
+            return a - b;
+        case STAR:
+            return a * b;
+        case SLASH:
+        default:
+            return a / b;
+    }
+}
+
+double Interpreter::visitGroupingNumber(GroupingExpr& expr) {
+    return evaluateNumber(expr.expression);
+}
+
+double Interpreter::visitLiteralNumber(LiteralExpr& expr) {
+    return expr.number;
+}
+
+double Interpreter::visitUnaryNumber(UnaryExpr& expr) {
+    if (!expr.right->isNumber) {
+        std::any value = expr.accept(*this);
+        return *std::any_cast<double>(&value);
+    }
+    return -evaluateNumber(expr.right);
+}
+
+double Interpreter::visitVariableNumber(VariableExpr& expr) {
+    if (expr.binding.kind == VariableBinding::Kind::NUMBER) {
+        return numbers[frame.base + expr.binding.index];
+    }
+    std::any value = lookUpVariable(expr.name, expr.binding);
+    return *std::any_cast<double>(&value);
+}
+
+std::any Interpreter::evaluateNumberOperands(BinaryExpr& expr) {
+    switch (expr.op.type) {
+        case PLUS:
+        case MINUS:
+        case STAR:
+        case SLASH:
+            return visitBinaryNumber(expr);
+        default:
+            return compareNumbers(expr);
+    }
+}
+
+static bool compare(TokenType op, double a, double b) {
+    switch (op) {
+        case GREATER:
+            return a > b;
+        case GREATER_EQUAL:
+            return a >= b;
+        case LESS:
+            return a < b;
+        case LESS_EQUAL:
+            return a <= b;
+        case EQUAL_EQUAL:
+            return a == b;
+        case BANG_EQUAL:
+        default:
+            return a != b;
+    }
+}
+
+bool Interpreter::compareNumbers(BinaryExpr& expr) {
+    double a = evaluateNumber(expr.left);
+    double b = evaluateNumber(expr.right);
+    return compare(expr.op.type, a, b);
+}
+
+// Returns false if the loop's proofs were undone by a call in its body, in which case the generic loop carries on
+// from the condition.
+bool Interpreter::runCountedLoop(WhileStmt& stmt) {
+    CountedLoop& loop = *stmt.counted;
+    auto& condition = static_cast<BinaryExpr&>(*stmt.condition);
+    std::size_t counter = frame.base + loop.slot;
+    while (true) {
+        double count = numbers[counter];
+        if (!compare(condition.op.type, count, evaluateNumber(condition.right))) {
+            return true;
+        }
+        execute(loop.body);
+        if (returning) {
+            return true;
+        }
+        safepoint(stmt.keyword);
+        if (!stmt.numberCondition) {
+            execute(loop.increment);
+            return false;
+        }
+        numbers[counter] += loop.step;
+    }
+}
+
+void Interpreter::define(const Token& name, const VariableBinding& binding, std::any value) {
+    switch (binding.kind) {
+        case VariableBinding::Kind::GLOBAL:
+            globals->define(binding.index, std::move(value));
+            break;
+        case VariableBinding::Kind::LOCAL:
+            stack[frame.base + binding.index] = std::move(value);
+            break;
+        case VariableBinding::Kind::BOXED:
+            stack[frame.base + binding.index] = makeRef<Upvalue>(std::move(value));
+            break;
+        case VariableBinding::Kind::NUMBER:
+            numbers[frame.base + binding.index] = *std::any_cast<double>(&value);
+            break;
+        case VariableBinding::Kind::UPVALUE:
+            break;
+    }
+}
+
+std::any Interpreter::lookUpVariable(const Token& name, const VariableBinding& binding) {
+    switch (binding.kind) {
+        case VariableBinding::Kind::LOCAL:
+            return stack[frame.base + binding.index];
+        case VariableBinding::Kind::BOXED:
+            return (*std::any_cast<Ref<Upvalue>>(&stack[frame.base + binding.index]))->value;
+        case VariableBinding::Kind::UPVALUE:
+            return frame.function->upvalues[binding.index]->value;
+        case VariableBinding::Kind::NUMBER:
+            return numbers[frame.base + binding.index];
+        case VariableBinding::Kind::GLOBAL:
+        default:
+            return globals->get(name, binding.index);
+    }
+}
+
+void Interpreter::assignVariable(const Token& name, const VariableBinding& binding, std::any value) {
+    switch (binding.kind) {
+        case VariableBinding::Kind::LOCAL:
+            stack[frame.base + binding.index] = std::move(value);
+            break;
+        case VariableBinding::Kind::BOXED:
+            (*std::any_cast<Ref<Upvalue>>(&stack[frame.base + binding.index]))->value = std::move(value);
+            break;
+        case VariableBinding::Kind::UPVALUE:
+            frame.function->upvalues[binding.index]->value = std::move(value);
+            break;
+        case VariableBinding::Kind::NUMBER:
+            numbers[frame.base + binding.index] = *std::any_cast<double>(&value);
+            break;
+        case VariableBinding::Kind::GLOBAL:
+            globals->assign(name, binding.index, std::move(value));
+            break;
     }
 }
 
@@ -244,7 +1651,7 @@ void Interpreter::checkNumberOperand(const Token& op, const std::any& operand) {
     if (operand.type() == typeid(double)) {
         return;
     }
-    throw RuntimeError{op, "Operand must be a number."};
+    throwError(op, "Operand must be a number.");
 }
 
 void Interpreter::checkNumberOperands(const Token& op, const std::any& left, const std::any& right) {
@@ -252,7 +1659,26 @@ void Interpreter::checkNumberOperands(const Token& op, const std::any& left, con
         return;
     }
 
-    throw RuntimeError{op, "Operands must be numbers."};
+    throwError(op, "Operands must be numbers.");
+}
+
+bool Interpreter::testCondition(const std::shared_ptr<Expr>& condition, ConditionSpecialization& specialization,
+                                SpecializationStats& stats) {
+    std::any value = evaluate(condition);
+
+    if (specialization == ConditionSpecialization::BOOLEAN) {
+        if (const bool* test = std::any_cast<bool>(&value)) {
+            ++stats.hits;
+            return *test;
+        }
+        specialization = ConditionSpecialization::GENERIC;
+    } else if (specialization == ConditionSpecialization::UNINITIALIZED) {
+        specialization =
+            value.type() == typeid(bool) ? ConditionSpecialization::BOOLEAN : ConditionSpecialization::GENERIC;
+    }
+
+    ++stats.misses;
+    return isTruthy(value);
 }
 
 bool Interpreter::isTruthy(const std::any& object) {
@@ -273,12 +1699,35 @@ bool Interpreter::isEqual(const std::any& a, const std::any& b) {
         return false;
     }
 
-    if (a.type() == typeid(std::string) && b.type() == typeid(std::string)) {
-        return std::any_cast<std::string>(a) == std::any_cast<std::string>(b);
+    if (a.type() == typeid(Ref<LoxString>) && b.type() == typeid(Ref<LoxString>)) {
+        const Ref<LoxString>& s = *std::any_cast<Ref<LoxString>>(&a);
+        const Ref<LoxString>& t = *std::any_cast<Ref<LoxString>>(&b);
+        return s.get() == t.get() || (s->length() == t->length() && s->view() == t->view());
     }
     if (a.type() == typeid(double) && b.type() == typeid(double)) {
         return std::any_cast<double>(a) == std::any_cast<double>(b);
     }
+    if (a.type() == typeid(Ref<LoxInstance>) && b.type() == typeid(Ref<LoxInstance>)) {
+        return std::any_cast<Ref<LoxInstance>>(&a)->get() == std::any_cast<Ref<LoxInstance>>(&b)->get();
+    }
+    if (a.type() == typeid(Ref<LoxClass>) && b.type() == typeid(Ref<LoxClass>)) {
+        return std::any_cast<Ref<LoxClass>>(&a)->get() == std::any_cast<Ref<LoxClass>>(&b)->get();
+    }
+    if (a.type() == typeid(Ref<LoxArray>) && b.type() == typeid(Ref<LoxArray>)) {
+        return std::any_cast<Ref<LoxArray>>(&a)->get() == std::any_cast<Ref<LoxArray>>(&b)->get();
+    }
+    if (a.type() == typeid(Ref<LoxMap>) && b.type() == typeid(Ref<LoxMap>)) {
+        return std::any_cast<Ref<LoxMap>>(&a)->get() == std::any_cast<Ref<LoxMap>>(&b)->get();
+    }
+    if (a.type() == typeid(Ref<LoxNative>) && b.type() == typeid(Ref<LoxNative>)) {
+        return std::any_cast<Ref<LoxNative>>(&a)->get() == std::any_cast<Ref<LoxNative>>(&b)->get();
+    }
+    if (a.type() == typeid(Ref<LoxFiber>) && b.type() == typeid(Ref<LoxFiber>)) {
+        return std::any_cast<Ref<LoxFiber>>(&a)->get() == std::any_cast<Ref<LoxFiber>>(&b)->get();
+    }
+    if (a.type() == typeid(Ref<LoxFile>) && b.type() == typeid(Ref<LoxFile>)) {
+        return std::any_cast<Ref<LoxFile>>(&a)->get() == std::any_cast<Ref<LoxFile>>(&b)->get();
+    }
     if (a.type() == typeid(bool) && b.type() == typeid(bool)) {
         return std::any_cast<bool>(a) == std::any_cast<bool>(b);
     }
@@ -286,27 +1735,76 @@ bool Interpreter::isEqual(const std::any& a, const std::any& b) {
     return false;
 }
 
+// Prints arrays and maps with their elements. enclosing holds the ones being printed around value, so one that
+// contains itself prints as [...] or {...} there.
+static std::string stringifyNested(const std::any& value, std::vector<const RefCounted*>& enclosing) {
+    const auto* array = std::any_cast<Ref<LoxArray>>(&value);
+    const auto* map = std::any_cast<Ref<LoxMap>>(&value);
+    if (array == nullptr && map == nullptr) {
+        return Interpreter::stringify(value);
+    }
+    const RefCounted* object = array != nullptr ? static_cast<const RefCounted*>(array->get()) : map->get();
+    if (std::find(enclosing.begin(), enclosing.end(), object) != enclosing.end()) {
+        return array != nullptr ? "[...]" : "{...}";
+    }
+
+    enclosing.push_back(object);
+    std::string text;
+    if (array != nullptr) {
+        for (std::size_t i = 0; i < (*array)->size(); ++i) {
+            text += (i > 0 ? ", " : "") + stringifyNested((*array)->get(i), enclosing);
+        }
+        text = "[" + text + "]";
+    } else {
+        for (const LoxMap::Entry& entry : (*map)->entries()) {
+            if (entry.key.has_value()) {
+                text += (text.empty() ? "" : ", ") + stringifyNested(entry.key, enclosing) + ": " +
+                        stringifyNested(entry.value, enclosing);
+            }
+        }
+        text = "{" + text + "}";
+    }
+    enclosing.pop_back();
+    return text;
+}
+
 std::string Interpreter::stringify(const std::any& object) {
     if (object.type() == typeid(nullptr)) {
         return "nil";
     }
 
     if (object.type() == typeid(double)) {
-        std::string text = std::to_string(std::any_cast<double>(object));
-        if (text[text.length() - 2] == '.' && text[text.length() - 1] == '0') {
-            text = text.substr(0, text.length() - 2);
-        }
-        return text;
+        char text[NUMBER_TEXT_SIZE];
+        return std::string(text, formatNumber(std::any_cast<double>(object), text));
     }
 
-    if (object.type() == typeid(std::string)) {
-        return std::any_cast<std::string>(object);
+    if (object.type() == typeid(Ref<LoxString>)) {
+        return std::any_cast<const Ref<LoxString>&>(object)->str();
     }
     if (object.type() == typeid(bool)) {
         return std::any_cast<bool>(object) ? "true" : "false";
     }
-    if (object.type() == typeid(std::shared_ptr<LoxFunction>)) {
-        return std::any_cast<std::shared_ptr<LoxFunction>>(object)->toString();
+    if (object.type() == typeid(Ref<LoxFunction>)) {
+        return std::any_cast<Ref<LoxFunction>>(object)->toString();
+    }
+    if (object.type() == typeid(Ref<LoxInstance>)) {
+        return std::any_cast<const Ref<LoxInstance>&>(object)->toString();
+    }
+    if (object.type() == typeid(Ref<LoxClass>)) {
+        return std::any_cast<const Ref<LoxClass>&>(object)->toString();
+    }
+    if (object.type() == typeid(Ref<LoxArray>) || object.type() == typeid(Ref<LoxMap>)) {
+        std::vector<const RefCounted*> enclosing;
+        return stringifyNested(object, enclosing);
+    }
+    if (object.type() == typeid(Ref<LoxNative>)) {
+        return std::any_cast<const Ref<LoxNative>&>(object)->toString();
+    }
+    if (object.type() == typeid(Ref<LoxFiber>)) {
+        return std::any_cast<const Ref<LoxFiber>&>(object)->toString();
+    }
+    if (object.type() == typeid(Ref<LoxFile>)) {
+        return std::any_cast<const Ref<LoxFile>&>(object)->toString();
     }
 
     return "Error in stringify: object type not recognized.";
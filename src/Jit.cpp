@@ -0,0 +1,756 @@
+#include "../include/Jit.h"
+
+#include <cstring>
+
+#if LOX_JIT_SUPPORTED
+#include <sys/mman.h>
+#endif
+
+#include "../include/LoxFunction.h"
+
+// A global a call site or variable read refers to, by its slot in the globals.
+struct JitSite {
+    std::size_t global;
+    std::size_t arity;
+};
+
+JitFunction::~JitFunction() {
+#if LOX_JIT_SUPPORTED
+    if (memory != nullptr) {
+        munmap(memory, size);
+    }
+#endif
+}
+
+namespace {
+
+struct Unsupported {
+    const char *reason;
+};
+
+// Locals the compiled code keeps in its own frame; NUMBER locals are the visitor's unboxed form of the same thing.
+bool isFrameSlot(const VariableBinding &binding) {
+    return binding.kind == VariableBinding::Kind::LOCAL || binding.kind == VariableBinding::Kind::NUMBER;
+}
+
+// SSE opcodes for the arithmetic templates, all encoded as F2 0F <opcode>.
+constexpr std::uint8_t ADDSD = 0x58;
+constexpr std::uint8_t MULSD = 0x59;
+constexpr std::uint8_t SUBSD = 0x5C;
+constexpr std::uint8_t DIVSD = 0x5E;
+
+// Condition codes of the two-byte Jcc rel32 encoding, 0F 8<code>.
+constexpr std::uint8_t BELOW = 0x2;
+constexpr std::uint8_t ABOVE_EQUAL = 0x3;
+constexpr std::uint8_t EQUAL = 0x4;
+constexpr std::uint8_t NOT_EQUAL = 0x5;
+constexpr std::uint8_t BELOW_EQUAL = 0x6;
+constexpr std::uint8_t ABOVE = 0x7;
+constexpr std::uint8_t PARITY = 0xA;
+
+// Emits a fixed machine-code template per node. Expressions leave their value in xmm0; locals live in the native
+// frame at rbp-24-8*slot, with scratch slots for pending operands and call arguments above the locals. rbx holds the
+// Jit and r12 the result pointer. Every helper call returns a status that, when non-zero, bails the whole call out.
+class CodeGenerator : public ExprVisitor, public StmtVisitor {
+ public:
+    CodeGenerator(FunctionStmt &declaration, JitFunction &function)
+        : declaration{declaration}, function{function}, frameSize{declaration.frameSize} {}
+
+    std::vector<std::uint8_t> generate();
+
+    std::any visitArrayExpr(ArrayExpr &expr) override;
+    std::any visitAssignExpr(AssignExpr &expr) override;
+    std::any visitBinaryExpr(BinaryExpr &expr) override;
+    std::any visitCallExpr(CallExpr &expr) override;
+    std::any visitGetExpr(GetExpr &expr) override;
+    std::any visitGroupingExpr(GroupingExpr &expr) override;
+    std::any visitIndexExpr(IndexExpr &expr) override;
+    std::any visitLiteralExpr(LiteralExpr &expr) override;
+    std::any visitLogicalExpr(LogicalExpr &expr) override;
+    std::any visitMapExpr(MapExpr &expr) override;
+    std::any visitSetExpr(SetExpr &expr) override;
+    std::any visitSetIndexExpr(SetIndexExpr &expr) override;
+    std::any visitSuperExpr(SuperExpr &expr) override;
+    std::any visitThisExpr(ThisExpr &expr) override;
+    std::any visitUnaryExpr(UnaryExpr &expr) override;
+    std::any visitVariableExpr(VariableExpr &expr) override;
+    void visitBlockStmt(BlockStmt &stmt) override;
+    void visitClassStmt(ClassStmt &stmt) override;
+    void visitExpressionStmt(ExpressionStmt &stmt) override;
+    void visitFunctionStmt(FunctionStmt &stmt) override;
+    void visitIfStmt(IfStmt &stmt) override;
+    void visitPrintStmt(PrintStmt &stmt) override;
+    void visitReturnStmt(ReturnStmt &stmt) override;
+    void visitWhileStmt(WhileStmt &stmt) override;
+    void visitVarStmt(VarStmt &stmt) override;
+    void visitYieldStmt(YieldStmt &stmt) override;
+
+ private:
+    struct Label {
+        std::ptrdiff_t position = -1;
+        std::vector<std::size_t> uses;
+    };
+
+    void emit(std::initializer_list<std::uint8_t> bytes);
+    void emit32(std::uint32_t value);
+    void emit64(std::uint64_t value);
+    static std::int32_t slotOffset(int slot);
+
+    int newLabel();
+    void bind(int label);
+    void jump(int label);
+    void jumpIf(std::uint8_t condition, int label);
+
+    void loadSlot(int xmm, int slot);
+    void storeSlot(int slot, int xmm);
+    void loadConstant(int xmm, double value);
+    void loadOperand(int xmm, const std::shared_ptr<Expr> &operand);
+    bool isSimpleOperand(const std::shared_ptr<Expr> &operand);
+    void callHelper(const void *helper);
+    JitSite *site(const VariableBinding &global, std::size_t arity);
+    int pushTemporaries(int count);
+    void popTemporaries(int count);
+
+    void generate(const std::shared_ptr<Expr> &expr);
+    void generate(const std::shared_ptr<Stmt> &stmt);
+    void branch(const std::shared_ptr<Expr> &condition, bool when, int label);
+    void compare(const BinaryExpr &expr, bool when, int label);
+
+    FunctionStmt &declaration;
+    JitFunction &function;
+    const int frameSize;
+    int temporaries = 0;
+    int maxTemporaries = 0;
+    std::vector<std::uint8_t> code;
+    std::vector<Label> labels;
+    int bailLabel = 0;
+    int exitLabel = 0;
+};
+
+void CodeGenerator::emit(std::initializer_list<std::uint8_t> bytes) {
+    code.insert(code.end(), bytes);
+}
+
+void CodeGenerator::emit32(std::uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        code.push_back(static_cast<std::uint8_t>(value >> (8 * i)));
+    }
+}
+
+void CodeGenerator::emit64(std::uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+        code.push_back(static_cast<std::uint8_t>(value >> (8 * i)));
+    }
+}
+
+std::int32_t CodeGenerator::slotOffset(int slot) {
+    return -24 - 8 * slot;
+}
+
+int CodeGenerator::newLabel() {
+    labels.emplace_back();
+    return labels.size() - 1;
+}
+
+void CodeGenerator::bind(int label) {
+    labels[label].position = code.size();
+}
+
+void CodeGenerator::jump(int label) {
+    emit({0xE9});
+    labels[label].uses.push_back(code.size());
+    emit32(0);
+}
+
+void CodeGenerator::jumpIf(std::uint8_t condition, int label) {
+    emit({0x0F, static_cast<std::uint8_t>(0x80 | condition)});
+    labels[label].uses.push_back(code.size());
+    emit32(0);
+}
+
+void CodeGenerator::loadSlot(int xmm, int slot) {
+    // movsd xmm, [rbp + disp32]
+    emit({0xF2, 0x0F, 0x10, static_cast<std::uint8_t>(0x85 | xmm << 3)});
+    emit32(slotOffset(slot));
+}
+
+void CodeGenerator::storeSlot(int slot, int xmm) {
+    // movsd [rbp + disp32], xmm
+    emit({0xF2, 0x0F, 0x11, static_cast<std::uint8_t>(0x85 | xmm << 3)});
+    emit32(slotOffset(slot));
+}
+
+void CodeGenerator::loadConstant(int xmm, double value) {
+    std::uint64_t bits;
+    std::memcpy(&bits, &value, sizeof bits);
+    // mov rax, imm64; movq xmm, rax
+    emit({0x48, 0xB8});
+    emit64(bits);
+    emit({0x66, 0x48, 0x0F, 0x6E, static_cast<std::uint8_t>(0xC0 | xmm << 3)});
+}
+
+bool CodeGenerator::isSimpleOperand(const std::shared_ptr<Expr> &operand) {
+    if (auto literal = std::dynamic_pointer_cast<LiteralExpr>(operand)) {
+        return literal->value.type() == typeid(double);
+    }
+    if (auto variable = std::dynamic_pointer_cast<VariableExpr>(operand)) {
+        return isFrameSlot(variable->binding);
+    }
+    return false;
+}
+
+// Literals and locals go straight into a register instead of round-tripping through a scratch slot.
+void CodeGenerator::loadOperand(int xmm, const std::shared_ptr<Expr> &operand) {
+    if (auto literal = std::dynamic_pointer_cast<LiteralExpr>(operand)) {
+        loadConstant(xmm, std::any_cast<double>(literal->value));
+    } else {
+        loadSlot(xmm, std::static_pointer_cast<VariableExpr>(operand)->binding.index);
+    }
+}
+
+void CodeGenerator::callHelper(const void *helper) {
+    // mov rdi, rbx; mov rax, imm64; call rax; test eax, eax; jnz bail
+    emit({0x48, 0x89, 0xDF});
+    emit({0x48, 0xB8});
+    emit64(reinterpret_cast<std::uint64_t>(helper));
+    emit({0xFF, 0xD0, 0x85, 0xC0});
+    jumpIf(NOT_EQUAL, bailLabel);
+}
+
+JitSite *CodeGenerator::site(const VariableBinding &global, std::size_t arity) {
+    function.sites.push_back(std::make_unique<JitSite>(JitSite{static_cast<std::size_t>(global.index), arity}));
+    JitSite *site = function.sites.back().get();
+    // mov rsi, imm64
+    emit({0x48, 0xBE});
+    emit64(reinterpret_cast<std::uint64_t>(site));
+    return site;
+}
+
+int CodeGenerator::pushTemporaries(int count) {
+    int first = frameSize + temporaries;
+    temporaries += count;
+    maxTemporaries = std::max(maxTemporaries, temporaries);
+    return first;
+}
+
+void CodeGenerator::popTemporaries(int count) {
+    temporaries -= count;
+}
+
+void CodeGenerator::generate(const std::shared_ptr<Expr> &expr) {
+    expr->accept(*this);
+}
+
+void CodeGenerator::generate(const std::shared_ptr<Stmt> &stmt) {
+    stmt->accept(*this);
+}
+
+std::vector<std::uint8_t> CodeGenerator::generate() {
+    for (const VariableBinding &binding : declaration.parameterBindings) {
+        if (!isFrameSlot(binding)) {
+            throw Unsupported{"captures a parameter"};
+        }
+    }
+
+    bailLabel = newLabel();
+    exitLabel = newLabel();
+
+    // push rbp; mov rbp, rsp; push rbx; push r12; sub rsp, imm32 (patched below)
+    emit({0x55, 0x48, 0x89, 0xE5, 0x53, 0x41, 0x54, 0x48, 0x81, 0xEC});
+    std::size_t frameBytes = code.size();
+    emit32(0);
+    // mov rbx, rdx; mov r12, rsi
+    emit({0x48, 0x89, 0xD3, 0x49, 0x89, 0xF4});
+
+    for (std::size_t i = 0; i < declaration.parameters.size(); ++i) {
+        // movsd xmm0, [rdi + disp32]
+        emit({0xF2, 0x0F, 0x10, 0x87});
+        emit32(8 * i);
+        storeSlot(declaration.parameterBindings[i].index, 0);
+    }
+
+    for (const std::shared_ptr<Stmt> &statement : declaration.body) {
+        generate(statement);
+    }
+
+    // Falling off the end returns nil, which only the interpreter can produce.
+    bind(bailLabel);
+    emit({0xB8});
+    emit32(1);
+    bind(exitLabel);
+    // lea rsp, [rbp - 16]; pop r12; pop rbx; pop rbp; ret
+    emit({0x48, 0x8D, 0x65, 0xF0, 0x41, 0x5C, 0x5B, 0x5D, 0xC3});
+
+    std::uint32_t size = 8 * (frameSize + maxTemporaries);
+    size = (size + 15) & ~15u;
+    std::memcpy(&code[frameBytes], &size, sizeof size);
+
+    for (const Label &label : labels) {
+        for (std::size_t use : label.uses) {
+            std::int32_t offset = label.position - (use + 4);
+            std::memcpy(&code[use], &offset, sizeof offset);
+        }
+    }
+    return code;
+}
+
+std::any CodeGenerator::visitArrayExpr(ArrayExpr &expr) {
+    throw Unsupported{"uses an array"};
+}
+
+std::any CodeGenerator::visitAssignExpr(AssignExpr &expr) {
+    if (!isFrameSlot(expr.binding)) {
+        throw Unsupported{"assigns a non-local variable"};
+    }
+    generate(expr.value);
+    storeSlot(expr.binding.index, 0);
+    return {};
+}
+
+std::any CodeGenerator::visitBinaryExpr(BinaryExpr &expr) {
+    std::uint8_t opcode;
+    switch (expr.op.type) {
+        case PLUS:
+            opcode = ADDSD;
+            break;
+        case MINUS:
+            opcode = SUBSD;
+            break;
+        case STAR:
+            opcode = MULSD;
+            break;
+        case SLASH:
+            opcode = DIVSD;
+            break;
+        default:
+            throw Unsupported{"uses a comparison as a value"};
+    }
+
+    if (isSimpleOperand(expr.right)) {
+        generate(expr.left);
+        loadOperand(1, expr.right);
+    } else {
+        generate(expr.left);
+        int left = pushTemporaries(1);
+        storeSlot(left, 0);
+        generate(expr.right);
+        // movapd xmm1, xmm0
+        emit({0x66, 0x0F, 0x28, 0xC8});
+        loadSlot(0, left);
+        popTemporaries(1);
+    }
+
+    // <op>sd xmm0, xmm1
+    emit({0xF2, 0x0F, opcode, 0xC1});
+    return {};
+}
+
+std::any CodeGenerator::visitCallExpr(CallExpr &expr) {
+    auto callee = std::dynamic_pointer_cast<VariableExpr>(expr.callee);
+    if (callee == nullptr || callee->binding.kind != VariableBinding::Kind::GLOBAL) {
+        throw Unsupported{"calls something other than a global function"};
+    }
+
+    // Arguments are stored downwards from the last one, so they end up in ascending addresses; the result follows.
+    int count = expr.arguments.size();
+    int first = pushTemporaries(count + 1);
+    int result = first + count;
+    for (int i = 0; i < count; ++i) {
+        generate(expr.arguments[i]);
+        storeSlot(first + count - 1 - i, 0);
+    }
+
+    site(callee->binding, count);
+    // lea rdx, [rbp + arguments]; lea rcx, [rbp + result]
+    emit({0x48, 0x8D, 0x95});
+    emit32(slotOffset(count > 0 ? first + count - 1 : result));
+    emit({0x48, 0x8D, 0x8D});
+    emit32(slotOffset(result));
+    callHelper(reinterpret_cast<const void *>(&Jit::callGlobal));
+    loadSlot(0, result);
+    popTemporaries(count + 1);
+    return {};
+}
+
+std::any CodeGenerator::visitGetExpr(GetExpr &expr) {
+    throw Unsupported{"uses a property"};
+}
+
+std::any CodeGenerator::visitGroupingExpr(GroupingExpr &expr) {
+    generate(expr.expression);
+    return {};
+}
+
+std::any CodeGenerator::visitIndexExpr(IndexExpr &expr) {
+    throw Unsupported{"uses an array"};
+}
+
+std::any CodeGenerator::visitLiteralExpr(LiteralExpr &expr) {
+    if (expr.value.type() != typeid(double)) {
+        throw Unsupported{"uses a literal that is not a number"};
+    }
+    loadConstant(0, std::any_cast<double>(expr.value));
+    return {};
+}
+
+std::any CodeGenerator::visitLogicalExpr(LogicalExpr &expr) {
+    throw Unsupported{"uses a logical operator as a value"};
+}
+
+std::any CodeGenerator::visitMapExpr(MapExpr &expr) {
+    throw Unsupported{"uses a map"};
+}
+
+std::any CodeGenerator::visitSetExpr(SetExpr &expr) {
+    throw Unsupported{"uses a property"};
+}
+
+std::any CodeGenerator::visitSetIndexExpr(SetIndexExpr &expr) {
+    throw Unsupported{"uses an array"};
+}
+
+std::any CodeGenerator::visitSuperExpr(SuperExpr &expr) {
+    throw Unsupported{"uses 'super'"};
+}
+
+std::any CodeGenerator::visitThisExpr(ThisExpr &expr) {
+    throw Unsupported{"uses 'this'"};
+}
+
+std::any CodeGenerator::visitUnaryExpr(UnaryExpr &expr) {
+    if (expr.op.type != MINUS) {
+        throw Unsupported{"uses '!' as a value"};
+    }
+    generate(expr.right);
+    // Flip the sign bit: mov rax, imm64; movq xmm1, rax; xorpd xmm0, xmm1
+    emit({0x48, 0xB8});
+    emit64(0x8000000000000000ull);
+    emit({0x66, 0x48, 0x0F, 0x6E, 0xC8, 0x66, 0x0F, 0x57, 0xC1});
+    return {};
+}
+
+std::any CodeGenerator::visitVariableExpr(VariableExpr &expr) {
+    switch (expr.binding.kind) {
+        case VariableBinding::Kind::LOCAL:
+        case VariableBinding::Kind::NUMBER:
+            loadSlot(0, expr.binding.index);
+            break;
+        case VariableBinding::Kind::GLOBAL: {
+            int result = pushTemporaries(1);
+            site(expr.binding, 0);
+            // lea rdx, [rbp + result]
+            emit({0x48, 0x8D, 0x95});
+            emit32(slotOffset(result));
+            callHelper(reinterpret_cast<const void *>(&Jit::loadGlobal));
+            loadSlot(0, result);
+            popTemporaries(1);
+            break;
+        }
+        default:
+            throw Unsupported{"uses a captured variable"};
+    }
+    return {};
+}
+
+void CodeGenerator::visitBlockStmt(BlockStmt &stmt) {
+    for (const std::shared_ptr<Stmt> &statement : stmt.statements) {
+        generate(statement);
+    }
+}
+
+void CodeGenerator::visitClassStmt(ClassStmt &stmt) {
+    throw Unsupported{"declares a class"};
+}
+
+void CodeGenerator::visitExpressionStmt(ExpressionStmt &stmt) {
+    generate(stmt.expression);
+}
+
+void CodeGenerator::visitFunctionStmt(FunctionStmt &stmt) {
+    throw Unsupported{"declares a function"};
+}
+
+void CodeGenerator::visitIfStmt(IfStmt &stmt) {
+    int elseBranch = newLabel();
+    int end = newLabel();
+    branch(stmt.condition, false, elseBranch);
+    generate(stmt.thenBranch);
+    if (stmt.elseBranch != nullptr) {
+        jump(end);
+    }
+    bind(elseBranch);
+    if (stmt.elseBranch != nullptr) {
+        generate(stmt.elseBranch);
+    }
+    bind(end);
+}
+
+void CodeGenerator::visitPrintStmt(PrintStmt &stmt) {
+    throw Unsupported{"prints"};
+}
+
+void CodeGenerator::visitReturnStmt(ReturnStmt &stmt) {
+    if (stmt.value == nullptr) {
+        throw Unsupported{"returns nil"};
+    }
+    generate(stmt.value);
+    // movsd [r12], xmm0; xor eax, eax
+    emit({0xF2, 0x41, 0x0F, 0x11, 0x04, 0x24, 0x31, 0xC0});
+    jump(exitLabel);
+}
+
+void CodeGenerator::visitWhileStmt(WhileStmt &stmt) {
+    int top = newLabel();
+    int end = newLabel();
+    bind(top);
+    branch(stmt.condition, false, end);
+    generate(stmt.body);
+    jump(top);
+    bind(end);
+}
+
+void CodeGenerator::visitVarStmt(VarStmt &stmt) {
+    if (!isFrameSlot(stmt.binding)) {
+        throw Unsupported{"declares a captured variable"};
+    }
+    if (stmt.initializer == nullptr) {
+        throw Unsupported{"declares a variable without a value"};
+    }
+    generate(stmt.initializer);
+    storeSlot(stmt.binding.index, 0);
+}
+
+void CodeGenerator::visitYieldStmt(YieldStmt &stmt) {
+    throw Unsupported{"yields"};
+}
+
+// Jumps to label when the condition's truthiness equals when. Comparisons branch on the flags directly; any other
+// expression in the subset is a number, which is always truthy.
+void CodeGenerator::branch(const std::shared_ptr<Expr> &condition, bool when, int label) {
+    if (auto grouping = std::dynamic_pointer_cast<GroupingExpr>(condition)) {
+        branch(grouping->expression, when, label);
+    } else if (auto literal = std::dynamic_pointer_cast<LiteralExpr>(condition)) {
+        bool truthy = literal->value.type() == typeid(bool) ? std::any_cast<bool>(literal->value)
+                                                            : literal->value.type() != typeid(nullptr);
+        if (truthy == when) {
+            jump(label);
+        }
+    } else if (auto unary = std::dynamic_pointer_cast<UnaryExpr>(condition); unary && unary->op.type == BANG) {
+        branch(unary->right, !when, label);
+    } else if (auto logical = std::dynamic_pointer_cast<LogicalExpr>(condition)) {
+        // Short-circuiting: the left operand alone decides the result when it is true for 'or' and false for 'and'.
+        bool decides = logical->op.type == OR;
+        if (decides == when) {
+            branch(logical->left, when, label);
+            branch(logical->right, when, label);
+        } else {
+            int skip = newLabel();
+            branch(logical->left, decides, skip);
+            branch(logical->right, when, label);
+            bind(skip);
+        }
+    } else if (auto binary = std::dynamic_pointer_cast<BinaryExpr>(condition);
+               binary && binary->op.type != PLUS && binary->op.type != MINUS && binary->op.type != STAR &&
+               binary->op.type != SLASH) {
+        compare(*binary, when, label);
+    } else {
+        generate(condition);
+        if (when) {
+            jump(label);
+        }
+    }
+}
+
+void CodeGenerator::compare(const BinaryExpr &expr, bool when, int label) {
+    generate(expr.left);
+    if (isSimpleOperand(expr.right)) {
+        loadOperand(1, expr.right);
+    } else {
+        int left = pushTemporaries(1);
+        storeSlot(left, 0);
+        generate(expr.right);
+        emit({0x66, 0x0F, 0x28, 0xC8});
+        loadSlot(0, left);
+        popTemporaries(1);
+    }
+
+    // ucomisd sets CF, ZF and PF for unordered operands, so 'above' style conditions are false on NaN as in C++.
+    const std::uint8_t ucomisdLeftRight[] = {0x66, 0x0F, 0x2E, 0xC1};
+    const std::uint8_t ucomisdRightLeft[] = {0x66, 0x0F, 0x2E, 0xC8};
+    switch (expr.op.type) {
+        case LESS:
+        case LESS_EQUAL:
+            code.insert(code.end(), std::begin(ucomisdRightLeft), std::end(ucomisdRightLeft));
+            break;
+        default:
+            code.insert(code.end(), std::begin(ucomisdLeftRight), std::end(ucomisdLeftRight));
+            break;
+    }
+
+    bool equal = expr.op.type == EQUAL_EQUAL;
+    switch (expr.op.type) {
+        case LESS:
+        case GREATER:
+            jumpIf(when ? ABOVE : BELOW_EQUAL, label);
+            break;
+        case LESS_EQUAL:
+        case GREATER_EQUAL:
+            jumpIf(when ? ABOVE_EQUAL : BELOW, label);
+            break;
+        case EQUAL_EQUAL:
+        case BANG_EQUAL:
+            if (when == equal) {
+                int skip = newLabel();
+                jumpIf(PARITY, skip);
+                jumpIf(EQUAL, label);
+                bind(skip);
+            } else {
+                jumpIf(PARITY, label);
+                jumpIf(NOT_EQUAL, label);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+}  // namespace
+
+Jit::Jit(std::shared_ptr<Environment> globals, std::size_t maxCallDepth, bool readOnly)
+    : globals{std::move(globals)}, maxCallDepth{maxCallDepth}, readOnly{readOnly} {}
+
+void Jit::setMaxCallDepth(std::size_t depth) {
+    maxCallDepth = depth;
+}
+
+bool Jit::compile(FunctionStmt &declaration) {
+    auto function = std::make_shared<JitFunction>();
+    function->name = declaration.name.lexeme;
+    function->line = declaration.name.line;
+
+    const char *reason = "unsupported platform";
+#if LOX_JIT_SUPPORTED
+    try {
+        if (!declaration.upvalues.empty()) {
+            throw Unsupported{"captures variables"};
+        }
+        if (declaration.isMethod) {
+            throw Unsupported{"is a method"};
+        }
+        if (declaration.isGenerator) {
+            throw Unsupported{"is a generator"};
+        }
+
+        std::vector<std::uint8_t> code = CodeGenerator{declaration, *function}.generate();
+        // Written while writable, then flipped to executable so the mapping is never both.
+        void *memory = mmap(nullptr, code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            throw Unsupported{"out of executable memory"};
+        }
+        function->memory = memory;
+        function->size = code.size();
+        std::memcpy(memory, code.data(), code.size());
+        if (mprotect(memory, code.size(), PROT_READ | PROT_EXEC) != 0) {
+            throw Unsupported{"out of executable memory"};
+        }
+        function->entry = reinterpret_cast<JitFunction::Entry>(memory);
+
+        declaration.jitCode = function;
+        compiled.push_back(function);
+        return true;
+    } catch (const Unsupported &unsupported) {
+        reason = unsupported.reason;
+    }
+#endif
+
+    declaration.jitRejected = true;
+    rejected.push_back(Rejection{function->name, function->line, reason});
+    return false;
+}
+
+bool Jit::run(FunctionStmt &declaration, const std::any *values, std::size_t depth, std::uintptr_t stackLimit,
+              std::any &result) {
+    JitFunction &function = *declaration.jitCode;
+    if (!readOnly) {
+        ++function.entries;
+    }
+
+    std::size_t count = declaration.parameters.size();
+    arguments.resize(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        const double *number = std::any_cast<double>(&values[i]);
+        if (number == nullptr) {
+            if (!readOnly) {
+                ++function.guardFailures;
+            }
+            return false;
+        }
+        arguments[i] = *number;
+    }
+
+    this->depth = depth;
+    this->stackLimit = stackLimit;
+    double value;
+    if (function.entry(arguments.data(), &value, this) != 0) {
+        if (readOnly) {
+            return false;
+        }
+        // The code ran into something it cannot handle and will keep doing so; compiled keeps it alive for the stats.
+        ++function.bailouts;
+        declaration.jitCode.reset();
+        declaration.jitRejected = true;
+        return false;
+    }
+
+    result = value;
+    return true;
+}
+
+int Jit::callGlobal(Jit *jit, JitSite *site, const double *arguments, double *result) {
+    auto *callee = std::any_cast<Ref<LoxFunction>>(&jit->globals->values[site->global]);
+    if (callee == nullptr) {
+        return 1;
+    }
+    FunctionStmt &declaration = *(*callee)->declaration;
+    if (declaration.parameters.size() != site->arity) {
+        return 1;
+    }
+    if (declaration.jitCode == nullptr && (declaration.jitRejected || jit->readOnly || !jit->compile(declaration))) {
+        return 1;
+    }
+
+    char probe;
+    if (jit->depth >= jit->maxCallDepth || reinterpret_cast<std::uintptr_t>(&probe) < jit->stackLimit) {
+        return 1;
+    }
+
+    JitFunction &function = *declaration.jitCode;
+    if (!jit->readOnly) {
+        ++function.nativeCalls;
+    }
+    ++jit->depth;
+    int status = function.entry(arguments, result, jit);
+    --jit->depth;
+    return status;
+}
+
+int Jit::loadGlobal(Jit *jit, JitSite *site, double *result) {
+    const double *number = std::any_cast<double>(&jit->globals->values[site->global]);
+    if (number == nullptr) {
+        return 1;
+    }
+    *result = *number;
+    return 0;
+}
+
+void Jit::printStats(std::ostream &out) {
+    out << "-- jit --\n";
+    for (const std::shared_ptr<JitFunction> &function : compiled) {
+        out << "[line " << function->line << "] " << function->name << ": " << function->size << " bytes, "
+            << function->entries << " entries, " << function->nativeCalls << " native calls, "
+            << function->guardFailures << " guard failures, " << function->bailouts << " bailouts\n";
+    }
+    for (const Rejection &rejection : rejected) {
+        out << "[line " << rejection.line << "] " << rejection.name << ": not compiled, " << rejection.reason << "\n";
+    }
+}
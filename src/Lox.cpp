@@ -1,28 +1,158 @@
 #include "../include/Lox.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <thread>
 
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/resource.h>
+#endif
+
+#include "../include/Output.h"
+#include "../include/Parallel.h"
 #include "../include/Parser.h"
 #include "../include/Resolver.h"
 #include "../include/Scanner.h"
+#include "../include/Server.h"
 #include "../include/Token.h"
 
 bool Lox::hadError = false;
 bool Lox::hadRuntimeError = false;
+bool Lox::showStats = false;
+Lox::Engine Lox::engine = Lox::Engine::VISITOR;
+bool Lox::visitorRan = false;
+bool Lox::bytecodeRan = false;
 Interpreter interpreter{};
+ClosureEngine closureEngine{};
+VM vm{};
+
+static void usage() {
+    std::cout << "Usage: lox [--engine visitor|closure|bytecode] [--jit|--no-jit] [--memoize-pure] [--max-depth N] [--threads N] [--fuel N] [--deadline MS] [--stats] [--serve PATH [--workers N] | --connect PATH] [script]\n";
+    exit(64);
+}
+
+// Lox calls recurse on the native stack, so clox runs on a thread whose stack has room for as many calls as the depth
+// limit allows. The stack is only reserved: its pages are committed as recursion reaches them. The thread ends the
+// process with body's status itself, so the runtime's globals are destroyed on its stack too, and dropping what a
+// script left in them has the same room. If the thread cannot be started, body runs on the main thread, and the native
+// stack check reports overflows earlier.
+[[noreturn]] static void runWithStackFor(std::size_t depth, const std::function<int()>& body) {
+    // More than any engine's frames for one Lox call take, with room for the expressions nested in it.
+    constexpr std::size_t BYTES_PER_CALL = 2048;
+    constexpr std::size_t MINIMUM_STACK = 8 << 20;
+
+    std::size_t stackSize = std::min(depth, SIZE_MAX / BYTES_PER_CALL) * BYTES_PER_CALL;
+
+    pthread_attr_t attributes;
+    pthread_t thread;
+    bool started = pthread_attr_init(&attributes) == 0 &&
+                   pthread_attr_setstacksize(&attributes, std::max(MINIMUM_STACK, stackSize)) == 0 &&
+                   pthread_create(
+                       &thread, &attributes,
+                       [](void* body) -> void* { std::exit((*static_cast<const std::function<int()>*>(body))()); },
+                       const_cast<std::function<int()>*>(&body)) == 0;
+    pthread_attr_destroy(&attributes);
+    if (!started) {
+        std::exit(body());
+    }
+    // Never returns: the thread exits the process.
+    pthread_join(thread, nullptr);
+    std::abort();
+}
 
 int main(int argc, char* argv[]) {
-    if (argc > 2) {
-        std::cout << "Usage: lox [script]\n";
-        exit(64);
-    } else if (argc == 2) {
-        Lox::runFile(argv[1]);
-    } else {
-        Lox::runPrompt();
+    const char* servePath = nullptr;
+    const char* connectPath = nullptr;
+    unsigned workers = 0;
+    int arg = 1;
+    for (; arg < argc && std::strncmp(argv[arg], "--", 2) == 0; ++arg) {
+        std::string option = argv[arg];
+        if (option == "--engine" && arg + 1 < argc) {
+            std::string name = argv[++arg];
+            if (name == "visitor") {
+                Lox::engine = Lox::Engine::VISITOR;
+            } else if (name == "closure") {
+                Lox::engine = Lox::Engine::CLOSURE;
+            } else if (name == "bytecode") {
+                Lox::engine = Lox::Engine::BYTECODE;
+            } else {
+                usage();
+            }
+        } else if (option == "--max-depth" && arg + 1 < argc) {
+            char* end;
+            unsigned long depth = std::strtoul(argv[++arg], &end, 10);
+            if (*end != '\0' || depth == 0) {
+                usage();
+            }
+            interpreter.setMaxCallDepth(depth);
+            closureEngine.setMaxCallDepth(depth);
+            vm.setMaxCallDepth(depth);
+        } else if (option == "--threads" && arg + 1 < argc) {
+            char* end;
+            unsigned long threads = std::strtoul(argv[++arg], &end, 10);
+            if (*end != '\0' || threads == 0) {
+                usage();
+            }
+            setParallelThreads(threads);
+        } else if (option == "--fuel" && arg + 1 < argc) {
+            char* end;
+            unsigned long long fuel = std::strtoull(argv[++arg], &end, 10);
+            if (*end != '\0' || fuel == 0) {
+                usage();
+            }
+            interpreter.setFuel(fuel);
+        } else if (option == "--deadline" && arg + 1 < argc) {
+            char* end;
+            unsigned long milliseconds = std::strtoul(argv[++arg], &end, 10);
+            if (*end != '\0' || milliseconds == 0) {
+                usage();
+            }
+            interpreter.setTimeLimit(std::chrono::milliseconds{milliseconds});
+        } else if (option == "--serve" && arg + 1 < argc) {
+            servePath = argv[++arg];
+        } else if (option == "--connect" && arg + 1 < argc) {
+            connectPath = argv[++arg];
+        } else if (option == "--workers" && arg + 1 < argc) {
+            char* end;
+            unsigned long count = std::strtoul(argv[++arg], &end, 10);
+            if (*end != '\0' || count == 0) {
+                usage();
+            }
+            workers = count;
+        } else if (option == "--jit" || option == "--no-jit") {
+            interpreter.setJitEnabled(option == "--jit");
+        } else if (option == "--memoize-pure") {
+            interpreter.setMemoizePure(true);
+        } else if (option == "--stats") {
+            Lox::showStats = true;
+            interpreter.setCollectStats(true);
+        } else {
+            usage();
+        }
+    }
+
+    if (argc - arg > 1 || (servePath != nullptr && (connectPath != nullptr || argc - arg == 1))) {
+        usage();
+    } else if (connectPath != nullptr) {
+        return runRemote(connectPath, argc - arg == 1 ? argv[arg] : nullptr);
     }
 
-    return 0;
+    runWithStackFor(interpreter.callDepthLimit(), [&] {
+        if (servePath != nullptr) {
+            serve(servePath, workers != 0 ? workers : std::max(1u, std::thread::hardware_concurrency()));
+        } else if (argc - arg == 1) {
+            Lox::runFile(argv[arg]);
+        } else {
+            Lox::runPrompt();
+        }
+        return 0;
+    });
 }
 
 void Lox::runFile(const std::string& path) {
@@ -44,6 +174,8 @@ void Lox::runFile(const std::string& path) {
 
     run(source);
 
+    printStats();
+
     if (hadError) {
         exit(65);
     }
@@ -54,7 +186,8 @@ void Lox::runFile(const std::string& path) {
 
 void Lox::runPrompt() {
     while (true) {
-        std::cout << "> ";
+        standardOutput().append("> ");
+        standardOutput().flush();
         std::string line;
         std::getline(std::cin, line);
         if (line.length() == 0) {
@@ -63,27 +196,72 @@ void Lox::runPrompt() {
         run(line);
         hadError = false;
     }
+
+    printStats();
 }
 
 void Lox::run(const std::string& source) {
+    Program program;
+    if (compile(source, program)) {
+        execute(program);
+    }
+}
+
+bool Lox::compile(const std::string& source, Program& program) {
     Scanner scanner{source};
     std::vector<Token> tokens = scanner.scanTokens();
 
     Parser parser{tokens};
-    std::vector<std::shared_ptr<Stmt>> statements = parser.parse();
+    program.statements = parser.parse();
 
     if (hadError) {
-        return;
+        return false;
     }
 
     Resolver resolver{interpreter};
-    resolver.resolve(statements);
+    resolver.resolve(program.statements);
+    program.frameSize = resolver.scriptFrameSize();
+    return !hadError;
+}
 
-    if (hadError) {
-        return;
+void Lox::execute(const Program& program) {
+    // The closure engine and the VM decline programs they cannot compile; those run on the tree-walker instead, as do
+    // all programs under --fuel or --deadline, which only it enforces.
+    if (!interpreter.budget().limited()) {
+        if (engine == Engine::CLOSURE && closureEngine.interpret(program.statements, program.frameSize)) {
+            return;
+        }
+        if (engine == Engine::BYTECODE && vm.interpret(program.statements, program.frameSize)) {
+            bytecodeRan = true;
+            return;
+        }
     }
+    visitorRan = true;
+    interpreter.interpret(program.statements);
+}
+
+Environment& Lox::globals() {
+    return *interpreter.globals;
+}
 
-    interpreter.interpret(statements);
+void Lox::printStats() {
+    if (!showStats) {
+        return;
+    }
+    // The statistics follow what the program printed.
+    standardOutput().flush();
+    if (visitorRan) {
+        interpreter.printStats(std::cerr);
+    }
+    if (bytecodeRan) {
+        vm.printStats(std::cerr);
+    }
+#ifdef __linux__
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        std::cerr << "-- memory --\npeak resident set: " << usage.ru_maxrss << " KB\n";
+    }
+#endif
 }
 
 void Lox::error(int line, const std::string& message) {
@@ -91,7 +269,8 @@ void Lox::error(int line, const std::string& message) {
 }
 
 void Lox::report(int line, const std::string& where, const std::string& message) {
-    std::cout << "[line " << line << "] Error" << where << ": " << message << "\n";
+    standardOutput().append("[line " + std::to_string(line) + "] Error" + where + ": " + message);
+    standardOutput().endLine();
     hadError = true;
 }
 
@@ -104,6 +283,7 @@ void Lox::error(Token token, const std::string& message) {
 }
 
 void Lox::runtimeError(RuntimeError error) {
+    standardOutput().flush();
     std::cerr << error.what() << "\n[line " << error.token.line << "]";
     hadRuntimeError = true;
 }
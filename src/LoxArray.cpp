@@ -0,0 +1,62 @@
+#include "../include/LoxArray.h"
+
+std::size_t LoxArray::size() const {
+    return generic ? values.size() : numbers.size();
+}
+
+std::any LoxArray::get(std::size_t index) const {
+    if (generic) {
+        return values[index];
+    }
+    return numbers[index];
+}
+
+void LoxArray::set(std::size_t index, std::any value) {
+    if (!generic) {
+        if (const double* number = std::any_cast<double>(&value)) {
+            numbers[index] = *number;
+            return;
+        }
+        promote();
+    }
+    values[index] = std::move(value);
+}
+
+void LoxArray::push(std::any value) {
+    if (!generic) {
+        if (const double* number = std::any_cast<double>(&value)) {
+            numbers.push_back(*number);
+            return;
+        }
+        promote();
+    }
+    values.push_back(std::move(value));
+}
+
+bool LoxArray::unbox() {
+    if (!generic) {
+        return true;
+    }
+    for (const std::any& value : values) {
+        if (value.type() != typeid(double)) {
+            return false;
+        }
+    }
+
+    numbers.reserve(values.size());
+    for (const std::any& value : values) {
+        numbers.push_back(*std::any_cast<double>(&value));
+    }
+    values = {};
+    generic = false;
+    return true;
+}
+
+void LoxArray::promote() {
+    values.reserve(numbers.size() + 1);
+    for (double number : numbers) {
+        values.emplace_back(number);
+    }
+    numbers = {};
+    generic = true;
+}
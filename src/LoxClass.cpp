@@ -0,0 +1,54 @@
+#include "../include/LoxClass.h"
+
+int Shape::find(const std::string& name) const {
+    auto elem = slots.find(name);
+    return elem == slots.end() ? -1 : static_cast<int>(elem->second);
+}
+
+const Ref<Shape>& Shape::transition(const std::string& name) {
+    Ref<Shape>& next = transitions[name];
+    if (next == nullptr) {
+        next = makeRef<Shape>();
+        next->slots = slots;
+        next->slots.emplace(name, static_cast<std::uint32_t>(slots.size()));
+    }
+    return next;
+}
+
+static std::unordered_map<std::string, Ref<LoxFunction>> inherit(
+    const Ref<LoxClass>& superclass, std::unordered_map<std::string, Ref<LoxFunction>> methods) {
+    if (superclass != nullptr) {
+        // emplace keeps the subclass's own method where it overrides one.
+        for (const auto& [name, method] : superclass->methods) {
+            methods.emplace(name, method);
+        }
+    }
+    return methods;
+}
+
+LoxClass::LoxClass(std::string name, Ref<LoxClass> superclass,
+                   std::unordered_map<std::string, Ref<LoxFunction>> methods)
+    : name{std::move(name)},
+      superclass{std::move(superclass)},
+      methods{inherit(this->superclass, std::move(methods))},
+      initializer{findMethod("init")},
+      root{makeRef<Shape>()} {}
+
+LoxFunction* LoxClass::findMethod(const std::string& name) const {
+    auto elem = methods.find(name);
+    return elem == methods.end() ? nullptr : elem->second.get();
+}
+
+int LoxClass::arity() const {
+    return initializer == nullptr ? 0 : initializer->arity();
+}
+
+std::string LoxClass::toString() const {
+    return name;
+}
+
+LoxInstance::LoxInstance(Ref<LoxClass> klass) : klass{std::move(klass)}, shape{this->klass->root} {}
+
+std::string LoxInstance::toString() const {
+    return klass->name + " instance";
+}
@@ -0,0 +1,213 @@
+#include "../include/LoxFiber.h"
+
+#include <new>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../include/Stmt.h"
+
+#if defined(__x86_64__) && defined(__ELF__)
+#define LOX_FIBER_ASM 1
+#else
+#define LOX_FIBER_ASM 0
+#include <ucontext.h>
+#endif
+
+namespace {
+
+// As much as a main thread usually gets, reserved up front but only backed by memory as it is touched, so most
+// fibers cost a few pages.
+constexpr std::size_t STACK_SIZE = 8 << 20;
+// Stacks of destroyed fibers kept for new ones, which saves the system calls in pipelines that make a fiber per item.
+constexpr std::size_t SPARE_STACKS = 16;
+
+std::size_t pageSize() {
+    static const std::size_t size = sysconf(_SC_PAGESIZE);
+    return size;
+}
+
+// Never destroyed, since fibers held by globals may be destroyed after it would be.
+std::vector<void*>& spareStacks() {
+    static auto* stacks = new std::vector<void*>;
+    return *stacks;
+}
+
+void* allocateStack() {
+    std::vector<void*>& spare = spareStacks();
+    if (!spare.empty()) {
+        void* stack = spare.back();
+        spare.pop_back();
+        return stack;
+    }
+
+    void* stack = mmap(nullptr, STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (stack == MAP_FAILED) {
+        throw std::bad_alloc{};
+    }
+    // A guard page at the low end makes an overflow fault instead of overwriting whatever is mapped below.
+    if (mprotect(stack, pageSize(), PROT_NONE) != 0) {
+        munmap(stack, STACK_SIZE);
+        throw std::bad_alloc{};
+    }
+    return stack;
+}
+
+void releaseStack(void* stack) {
+    std::vector<void*>& spare = spareStacks();
+    if (spare.size() < SPARE_STACKS) {
+        spare.push_back(stack);
+    } else {
+        munmap(stack, STACK_SIZE);
+    }
+}
+
+}  // namespace
+
+// Runs on the fiber's own stack. Interpreter::runFiber catches everything, since an exception must not unwind past
+// the bottom of this stack.
+void LoxFiber::start(LoxFiber* fiber) {
+    fiber->interpreter.runFiber(*fiber);
+    fiber->suspend();
+}
+
+#if LOX_FIBER_ASM
+
+// Pushes the callee-saved registers, stores the stack pointer in *from, then pops the registers saved at to and
+// returns to whatever called the switch that saved them.
+extern "C" void loxSwitchStack(void** from, void* to);
+// Where a new fiber's first switch returns to, with the fiber in rbx and LoxFiber::start in r12.
+extern "C" void loxStartFiber();
+
+asm(R"(
+    .text
+    .globl loxSwitchStack
+    .hidden loxSwitchStack
+    .type loxSwitchStack, @function
+loxSwitchStack:
+    pushq %rbp
+    pushq %rbx
+    pushq %r12
+    pushq %r13
+    pushq %r14
+    pushq %r15
+    movq %rsp, (%rdi)
+    movq %rsi, %rsp
+    popq %r15
+    popq %r14
+    popq %r13
+    popq %r12
+    popq %rbx
+    popq %rbp
+    ret
+    .size loxSwitchStack, .-loxSwitchStack
+
+    .globl loxStartFiber
+    .hidden loxStartFiber
+    .type loxStartFiber, @function
+loxStartFiber:
+    .cfi_startproc
+    .cfi_undefined rip
+    movq %rbx, %rdi
+    callq *%r12
+    ud2
+    .cfi_endproc
+    .size loxStartFiber, .-loxStartFiber
+)");
+
+struct LoxFiber::Context {
+    void* fiber;
+    void* resumer = nullptr;
+};
+
+LoxFiber::LoxFiber(Interpreter& interpreter, Ref<LoxFunction> function)
+    : interpreter{interpreter}, function{std::move(function)}, nativeStack{allocateStack()} {
+    // What loxSwitchStack pops: r15, r14, r13, r12, rbx and rbp, then the return address. The top stays 16-byte
+    // aligned, so loxStartFiber calls start with the alignment the ABI requires.
+    auto* top = reinterpret_cast<void**>(static_cast<char*>(nativeStack) + STACK_SIZE);
+    void** saved = top - 7;
+    saved[0] = nullptr;
+    saved[1] = nullptr;
+    saved[2] = nullptr;
+    saved[3] = reinterpret_cast<void*>(&start);
+    saved[4] = this;
+    saved[5] = nullptr;
+    saved[6] = reinterpret_cast<void*>(&loxStartFiber);
+    context.reset(new Context{saved});
+
+    next = interpreter.fibers;
+    if (next != nullptr) {
+        next->previous = this;
+    }
+    interpreter.fibers = this;
+}
+
+void LoxFiber::resume() {
+    loxSwitchStack(&context->resumer, context->fiber);
+}
+
+void LoxFiber::suspend() {
+    loxSwitchStack(&context->fiber, context->resumer);
+}
+
+#else
+
+struct LoxFiber::Context {
+    ucontext_t fiber;
+    ucontext_t resumer;
+};
+
+LoxFiber::LoxFiber(Interpreter& interpreter, Ref<LoxFunction> function)
+    : interpreter{interpreter}, function{std::move(function)}, nativeStack{allocateStack()} {
+    context.reset(new Context);
+    getcontext(&context->fiber);
+    context->fiber.uc_stack.ss_sp = static_cast<char*>(nativeStack) + pageSize();
+    context->fiber.uc_stack.ss_size = STACK_SIZE - pageSize();
+    context->fiber.uc_link = nullptr;
+    // makecontext passes only int arguments, so the fiber's address goes in two halves.
+    void (*entry)(unsigned, unsigned) = [](unsigned high, unsigned low) {
+        start(reinterpret_cast<LoxFiber*>(static_cast<std::uintptr_t>(static_cast<std::uint64_t>(high) << 32 | low)));
+    };
+    auto address = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(this));
+    makecontext(&context->fiber, reinterpret_cast<void (*)()>(entry), 2, static_cast<unsigned>(address >> 32),
+                static_cast<unsigned>(address));
+
+    next = interpreter.fibers;
+    if (next != nullptr) {
+        next->previous = this;
+    }
+    interpreter.fibers = this;
+}
+
+void LoxFiber::resume() {
+    swapcontext(&context->resumer, &context->fiber);
+}
+
+void LoxFiber::suspend() {
+    swapcontext(&context->fiber, &context->resumer);
+}
+
+#endif
+
+// A fiber abandoned at a yield has nothing on its native stack that needs destroying: yield is a statement directly
+// in the generator's body, so only the interpreter's visitors are below it, holding no objects. A waiting fiber is
+// held by the event loop, so it is only destroyed when the loop is cleared, leaking what its native frames hold.
+LoxFiber::~LoxFiber() {
+    if (previous != nullptr) {
+        previous->next = next;
+    } else {
+        interpreter.fibers = next;
+    }
+    if (next != nullptr) {
+        next->previous = previous;
+    }
+    releaseStack(nativeStack);
+}
+
+std::uintptr_t LoxFiber::stackBottom() const {
+    return reinterpret_cast<std::uintptr_t>(nativeStack) + pageSize();
+}
+
+std::string LoxFiber::toString() const {
+    return "<fiber " + function->declaration->name.lexeme + ">";
+}
@@ -0,0 +1,175 @@
+#include "../include/LoxFile.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../include/LoxArray.h"
+#include "../include/RuntimeError.h"
+
+namespace {
+
+// How far reading gets past the last release before the pages behind it are released, so a file many times the size
+// of memory streams through without the read part staying resident.
+constexpr std::size_t RELEASE_STEP = 64 << 20;
+
+LoxFile& checkFile(const Token& paren, const std::any& argument) {
+    auto* file = std::any_cast<Ref<LoxFile>>(&argument);
+    if (file == nullptr) {
+        throw RuntimeError{paren, "Argument must be a file."};
+    }
+    return **file;
+}
+
+Ref<LoxString>& checkString(const Token& paren, std::any& argument, const char* message) {
+    auto* string = std::any_cast<Ref<LoxString>>(&argument);
+    if (string == nullptr) {
+        throw RuntimeError{paren, message};
+    }
+    return *string;
+}
+
+std::any stringOrNil(Ref<LoxString> string) {
+    if (string == nullptr) {
+        return nullptr;
+    }
+    return string;
+}
+
+}  // namespace
+
+Ref<MappedFile> MappedFile::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    Ref<MappedFile> file{new MappedFile};
+    struct stat status;
+    if (fstat(fd, &status) == 0 && S_ISREG(status.st_mode) && status.st_size > 0) {
+        void* data = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, status.st_size, MADV_SEQUENTIAL);
+            file->data = static_cast<const char*>(data);
+            file->size = status.st_size;
+            file->mapped = true;
+            close(fd);
+            return file;
+        }
+    }
+
+    char buffer[64 * 1024];
+    ssize_t count;
+    while ((count = read(fd, buffer, sizeof buffer)) != 0) {
+        if (count < 0 && errno != EINTR) {
+            close(fd);
+            return nullptr;
+        }
+        file->copy.append(buffer, std::max<ssize_t>(count, 0));
+    }
+    close(fd);
+    file->data = file->copy.data();
+    file->size = file->copy.size();
+    return file;
+}
+
+MappedFile::~MappedFile() {
+    if (mapped) {
+        munmap(const_cast<char*>(data), size);
+    }
+}
+
+void MappedFile::release(std::size_t offset) {
+    if (mapped) {
+        std::size_t pages = offset - offset % sysconf(_SC_PAGESIZE);
+        madvise(const_cast<char*>(data), pages, MADV_DONTNEED);
+    }
+}
+
+LoxFile::LoxFile(std::string path, Ref<MappedFile> mapping) : path{std::move(path)}, mapping{std::move(mapping)} {}
+
+Ref<LoxString> LoxFile::readLine(std::string_view text) {
+    const char* data = mapping->data;
+    std::size_t size = mapping->size;
+    if (position >= size) {
+        return nullptr;
+    }
+
+    const char* start = data + position;
+    if (!text.empty()) {
+        std::string_view rest{start, size - position};
+        std::size_t found = rest.find(text);
+        if (found == std::string_view::npos) {
+            position = size;
+            return nullptr;
+        }
+        std::size_t newline = found == 0 ? std::string_view::npos : rest.rfind('\n', found - 1);
+        if (newline != std::string_view::npos) {
+            start += newline + 1;
+        }
+    }
+    auto* end = static_cast<const char*>(std::memchr(start, '\n', data + size - start));
+    if (end == nullptr) {
+        end = data + size;
+    }
+    position = end - data + 1;
+    if (position - released >= RELEASE_STEP) {
+        mapping->release(position);
+        released = position;
+    }
+    return makeRef<LoxString>(mapping, std::string_view(start, end - start));
+}
+
+Ref<LoxString> LoxFile::readAll() {
+    std::size_t start = std::min(position, mapping->size);
+    position = mapping->size;
+    return makeRef<LoxString>(mapping, std::string_view(mapping->data + start, mapping->size - start));
+}
+
+std::string LoxFile::toString() const {
+    return "<file " + path + ">";
+}
+
+std::any openFile(Interpreter& interpreter, const Token& paren, std::any* arguments) {
+    const std::string& path = checkString(paren, arguments[0], "Path must be a string.")->str();
+    Ref<MappedFile> mapping = MappedFile::open(path);
+    if (mapping == nullptr) {
+        throw RuntimeError{paren, "Could not open '" + path + "'."};
+    }
+    return makeRef<LoxFile>(path, std::move(mapping));
+}
+
+std::any readLine(Interpreter& interpreter, const Token& paren, std::any* arguments) {
+    LoxFile& file = checkFile(paren, arguments[0]);
+    if (arguments[1].type() == typeid(nullptr)) {
+        return stringOrNil(file.readLine({}));
+    }
+    return stringOrNil(file.readLine(checkString(paren, arguments[1], "Text to find must be a string.")->view()));
+}
+
+std::any readAll(Interpreter& interpreter, const Token& paren, std::any* arguments) {
+    return checkFile(paren, arguments[0]).readAll();
+}
+
+std::any split(Interpreter& interpreter, const Token& paren, std::any* arguments) {
+    Ref<LoxString>& string = checkString(paren, arguments[0], "Can only split a string.");
+    std::string_view separator = checkString(paren, arguments[1], "Separator must be a non-empty string.")->view();
+    if (separator.empty()) {
+        throw RuntimeError{paren, "Separator must be a non-empty string."};
+    }
+
+    std::string_view text = string->view();
+    auto fields = makeRef<LoxArray>();
+    std::size_t start = 0;
+    for (std::size_t end; (end = text.find(separator, start)) != std::string_view::npos;
+         start = end + separator.size()) {
+        fields->push(string->substring(start, end - start));
+    }
+    fields->push(string->substring(start, text.size() - start));
+    return fields;
+}
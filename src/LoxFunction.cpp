@@ -1,12 +1,21 @@
 #include "../include/LoxFunction.h"
 
-#include "../include/Environment.h"
 #include "../include/Interpreter.h"
-#include "../include/LoxReturn.h"
+#include "../include/LoxClass.h"
 #include "../include/Stmt.h"
+#include "../include/Upvalue.h"
 
-LoxFunction::LoxFunction(std::shared_ptr<FunctionStmt> declaration, std::shared_ptr<Environment> closure)
-    : declaration(std::move(declaration)), closure(std::move(closure)) {
+LoxFunction::LoxFunction(std::shared_ptr<FunctionStmt> declaration) : declaration(std::move(declaration)) {
+}
+
+// Out of line, where LoxInstance is complete.
+LoxFunction::~LoxFunction() = default;
+
+Ref<LoxFunction> LoxFunction::bind(Ref<LoxInstance> instance) const {
+    auto bound = makeRef<LoxFunction>(declaration);
+    bound->upvalues = upvalues;
+    bound->receiver = std::move(instance);
+    return bound;
 }
 
 int LoxFunction::arity() {
@@ -14,18 +23,7 @@ int LoxFunction::arity() {
 }
 
 std::any LoxFunction::call(Interpreter& interpreter, std::vector<std::any> arguments) {
-    auto environment = std::make_shared<Environment>(closure);
-    for (int i = 0; i < declaration->parameters.size(); ++i) {
-        environment->define(declaration->parameters[i].lexeme, arguments[i]);
-    }
-
-    try {
-        interpreter.executeBlock(declaration->body, environment);
-    } catch (LoxReturn returnValue) {
-        return returnValue.value;
-    }
-
-    return nullptr;
+    return interpreter.executeFunction(*this, arguments);
 }
 
 std::string LoxFunction::toString() {
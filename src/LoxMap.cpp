@@ -0,0 +1,231 @@
+#include "../include/LoxMap.h"
+
+#include <cstring>
+
+#include "../include/LoxString.h"
+
+namespace {
+
+constexpr std::uint8_t EMPTY = 0x80;
+constexpr std::uint8_t DELETED = 0xFE;
+constexpr std::uint64_t LSBS = 0x0101010101010101;
+constexpr std::uint64_t MSBS = 0x8080808080808080;
+constexpr std::size_t NOT_FOUND = SIZE_MAX;
+
+// The control bytes of a group as one word, the first slot's in the lowest byte, so all 8 are tested with a few
+// integer operations. Each match function returns the high bit of the bytes that match.
+std::uint64_t loadGroup(const std::uint8_t* control) {
+    std::uint64_t group;
+    std::memcpy(&group, control, sizeof group);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    group = __builtin_bswap64(group);
+#endif
+    return group;
+}
+
+// May also report the byte after a match if it holds the hash bits with the lowest one flipped; the slot is full
+// either way, and the keys are compared next.
+std::uint64_t matchHash(std::uint64_t group, std::uint8_t bits) {
+    std::uint64_t difference = group ^ (LSBS * bits);
+    return (difference - LSBS) & ~difference & MSBS;
+}
+
+std::uint64_t matchEmpty(std::uint64_t group) {
+    return group & ~(group << 6) & MSBS;
+}
+
+std::uint64_t matchEmptyOrDeleted(std::uint64_t group) {
+    return group & ~(group << 7) & MSBS;
+}
+
+std::size_t firstMatch(std::uint64_t match) {
+    return __builtin_ctzll(match) / 8;
+}
+
+// Spreads every input bit over the whole hash, as the table takes the group from its high bits and the control
+// byte from its low ones.
+std::uint64_t mix(std::uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccd;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53;
+    x ^= x >> 33;
+    return x;
+}
+
+// -0 is 0 as a key, so the two have to hash alike; NaNs are left as they are, each only finding its own bits.
+std::uint64_t numberBits(double number) {
+    if (number == 0) {
+        number = 0;
+    }
+    std::uint64_t bits;
+    std::memcpy(&bits, &number, sizeof bits);
+    return bits;
+}
+
+std::uint64_t hashKey(const std::any& key) {
+    if (const double* number = std::any_cast<double>(&key)) {
+        return mix(numberBits(*number));
+    }
+    if (const Ref<LoxString>* string = std::any_cast<Ref<LoxString>>(&key)) {
+        return mix((*string)->hash());
+    }
+    if (const bool* boolean = std::any_cast<bool>(&key)) {
+        return mix(*boolean ? 2 : 1);
+    }
+    return mix(0);
+}
+
+bool sameKey(const std::any& a, const std::any& b) {
+    if (a.type() != b.type()) {
+        return false;
+    }
+    if (const double* number = std::any_cast<double>(&a)) {
+        return numberBits(*number) == numberBits(*std::any_cast<double>(&b));
+    }
+    if (const Ref<LoxString>* string = std::any_cast<Ref<LoxString>>(&a)) {
+        const Ref<LoxString>& other = *std::any_cast<Ref<LoxString>>(&b);
+        return string->get() == other.get() ||
+               ((*string)->length() == other->length() && (*string)->view() == other->view());
+    }
+    if (const bool* boolean = std::any_cast<bool>(&a)) {
+        return *boolean == *std::any_cast<bool>(&b);
+    }
+    return true;
+}
+
+}  // namespace
+
+bool LoxMap::isKey(const std::any& key) {
+    return std::any_cast<double>(&key) != nullptr || std::any_cast<Ref<LoxString>>(&key) != nullptr ||
+           std::any_cast<bool>(&key) != nullptr || std::any_cast<std::nullptr_t>(&key) != nullptr;
+}
+
+std::size_t LoxMap::size() const {
+    return live;
+}
+
+std::any* LoxMap::get(const std::any& key) {
+    Slot slot = find(key, hashKey(key));
+    return slot.group == nullptr ? nullptr : &items[slot.group->indices[slot.offset]].value;
+}
+
+void LoxMap::set(const std::any& key, std::any value) {
+    std::uint64_t hash = hashKey(key);
+    Slot slot = find(key, hash);
+    if (slot.group != nullptr) {
+        items[slot.group->indices[slot.offset]].value = std::move(value);
+        return;
+    }
+
+    // At most 7/8 of the slots are in use, so a probe soon reaches a group with an empty one.
+    if ((used + 1) * 8 > groups.size() * GROUP * 7) {
+        rebuild();
+    }
+    // Stored as 0 if it is -0, so the key iterated is the same whichever of the two was set first.
+    const double* number = std::any_cast<double>(&key);
+    items.push_back(Entry{number != nullptr && *number == 0 ? std::any{0.0} : key, std::move(value), hash});
+    insert(static_cast<std::uint32_t>(items.size() - 1), hash);
+    ++live;
+}
+
+bool LoxMap::remove(const std::any& key) {
+    Slot slot = find(key, hashKey(key));
+    if (slot.group == nullptr) {
+        return false;
+    }
+
+    Entry& entry = items[slot.group->indices[slot.offset]];
+    entry.key.reset();
+    entry.value.reset();
+    // Probes for other keys may have passed this slot, so it cannot become EMPTY.
+    slot.group->control[slot.offset] = DELETED;
+    --live;
+    // Compacted once removed entries outnumber the live ones, so neither iterating nor the memory used grows with
+    // the number of removals.
+    if (items.size() > 2 * live + GROUP) {
+        rebuild();
+    }
+    return true;
+}
+
+const std::vector<LoxMap::Entry>& LoxMap::entries() const {
+    return items;
+}
+
+std::size_t LoxMap::memoryUsage() const {
+    return items.capacity() * sizeof(Entry) + groups.capacity() * sizeof(Group);
+}
+
+// Probes group by group: the group the hash's high bits pick, then ones 1, 2, 3... groups further on, which visits
+// every group of a table with a power of two of them.
+LoxMap::Slot LoxMap::find(const std::any& key, std::uint64_t hash) {
+    if (groups.empty()) {
+        return Slot{nullptr, 0};
+    }
+
+    std::size_t mask = groups.size() - 1;
+    std::size_t index = (hash >> 7) & mask;
+    auto bits = static_cast<std::uint8_t>(hash & 0x7F);
+    for (std::size_t step = 1;; ++step) {
+        Group& group = groups[index];
+        std::uint64_t control = loadGroup(group.control);
+        for (std::uint64_t match = matchHash(control, bits); match != 0; match &= match - 1) {
+            std::size_t offset = firstMatch(match);
+            const Entry& entry = items[group.indices[offset]];
+            if (entry.hash == hash && sameKey(entry.key, key)) {
+                return Slot{&group, offset};
+            }
+        }
+        if (matchEmpty(control) != 0) {
+            return Slot{nullptr, 0};
+        }
+        index = (index + step) & mask;
+    }
+}
+
+void LoxMap::insert(std::uint32_t entry, std::uint64_t hash) {
+    std::size_t mask = groups.size() - 1;
+    std::size_t index = (hash >> 7) & mask;
+    for (std::size_t step = 1;; ++step) {
+        Group& group = groups[index];
+        std::uint64_t free = matchEmptyOrDeleted(loadGroup(group.control));
+        if (free != 0) {
+            std::size_t offset = firstMatch(free);
+            if (group.control[offset] == EMPTY) {
+                ++used;
+            }
+            group.control[offset] = static_cast<std::uint8_t>(hash & 0x7F);
+            group.indices[offset] = entry;
+            return;
+        }
+        index = (index + step) & mask;
+    }
+}
+
+// Drops the removed entries and rehashes the rest into a table at most 7/16 full.
+void LoxMap::rebuild() {
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < items.size(); ++i) {
+        if (items[i].key.has_value()) {
+            if (kept != i) {
+                items[kept] = std::move(items[i]);
+            }
+            ++kept;
+        }
+    }
+    items.erase(items.begin() + kept, items.end());
+
+    std::size_t count = 1;
+    while (count * GROUP * 7 < (live + 1) * 16) {
+        count *= 2;
+    }
+    Group empty;
+    std::memset(empty.control, EMPTY, sizeof empty.control);
+    std::memset(empty.indices, 0, sizeof empty.indices);
+    groups.assign(count, empty);
+    used = 0;
+    for (std::size_t i = 0; i < items.size(); ++i) {
+        insert(static_cast<std::uint32_t>(i), items[i].hash);
+    }
+}
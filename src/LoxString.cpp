@@ -0,0 +1,118 @@
+#include "../include/LoxString.h"
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include "../include/LoxFile.h"
+
+LoxString::LoxString(std::string chars) : chars{std::move(chars)}, size{this->chars.size()} {}
+
+LoxString::LoxString(Ref<MappedFile> file, std::string_view text)
+    : file{std::move(file)}, slice{text.data()}, size{text.size()} {}
+
+LoxString::LoxString(Ref<LoxString> left, Ref<LoxString> right)
+    : left{std::move(left)}, right{std::move(right)}, size{this->left->size + this->right->size} {}
+
+LoxString::~LoxString() {
+    releaseChildren();
+}
+
+Ref<LoxString> LoxString::concatenate(Ref<LoxString> left, const Ref<LoxString>& right) {
+    std::size_t size = left->size + right->size;
+    if (left.unique() && left->left == nullptr && left->file == nullptr && right->left == nullptr) {
+        left->chars += right->view();
+        left->size = size;
+        left->hashCode = 0;
+        return left;
+    }
+    if (size <= SHORT) {
+        // Both operands are flat: only longer strings are ever ropes.
+        std::string text;
+        text.reserve(size);
+        text += left->view();
+        text += right->view();
+        return makeRef<LoxString>(std::move(text));
+    }
+    return Ref<LoxString>{new LoxString{std::move(left), right}};
+}
+
+const std::string& LoxString::str() {
+    if (left != nullptr) {
+        flatten();
+    }
+    if (file != nullptr) {
+        chars.assign(slice, size);
+        file = nullptr;
+    }
+    return chars;
+}
+
+std::string_view LoxString::view() {
+    if (left != nullptr) {
+        flatten();
+    }
+    if (file != nullptr) {
+        return {slice, size};
+    }
+    return chars;
+}
+
+Ref<LoxString> LoxString::substring(std::size_t start, std::size_t length) {
+    std::string_view text = view().substr(start, length);
+    if (file != nullptr) {
+        return makeRef<LoxString>(file, text);
+    }
+    return makeRef<LoxString>(std::string{text});
+}
+
+std::size_t LoxString::length() const {
+    return size;
+}
+
+std::uint64_t LoxString::hash() {
+    if (hashCode == 0) {
+        // Only 0 means not computed yet, so a string hashing to it takes 1 instead.
+        hashCode = std::max<std::uint64_t>(std::hash<std::string_view>{}(view()), 1);
+    }
+    return hashCode;
+}
+
+void LoxString::flatten() {
+    std::string text;
+    text.reserve(size);
+    // Walked with an explicit stack: appending in a loop builds a rope as deep as the loop ran.
+    std::vector<LoxString*> pending{right.get(), left.get()};
+    while (!pending.empty()) {
+        LoxString* node = pending.back();
+        pending.pop_back();
+        if (node->left == nullptr) {
+            text += node->view();
+        } else {
+            pending.push_back(node->right.get());
+            pending.push_back(node->left.get());
+        }
+    }
+
+    chars = std::move(text);
+    releaseChildren();
+}
+
+// Releases a rope's children without recursing into their destructors, for the same reason.
+void LoxString::releaseChildren() {
+    if (left == nullptr) {
+        return;
+    }
+
+    std::vector<Ref<LoxString>> pending;
+    pending.push_back(std::move(left));
+    pending.push_back(std::move(right));
+    while (!pending.empty()) {
+        Ref<LoxString> node = std::move(pending.back());
+        pending.pop_back();
+        if (node.unique() && node->left != nullptr) {
+            pending.push_back(std::move(node->left));
+            pending.push_back(std::move(node->right));
+        }
+    }
+}
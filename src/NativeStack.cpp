@@ -0,0 +1,23 @@
+#include "../include/NativeStack.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#endif
+
+std::uintptr_t nativeStackLimit(std::size_t margin) {
+    std::uintptr_t limit = 0;
+#ifdef __linux__
+    pthread_attr_t attributes;
+    if (pthread_getattr_np(pthread_self(), &attributes) != 0) {
+        return 0;
+    }
+
+    void* address;
+    std::size_t size;
+    if (pthread_attr_getstack(&attributes, &address, &size) == 0 && size > 2 * margin) {
+        limit = reinterpret_cast<std::uintptr_t>(address) + margin;
+    }
+    pthread_attr_destroy(&attributes);
+#endif
+    return limit;
+}
@@ -0,0 +1,97 @@
+#include "../include/Output.h"
+
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+
+#include <unistd.h>
+
+char* formatNumber(double number, char* out) {
+#if __cpp_lib_to_chars >= 201611L
+    return std::to_chars(out, out + NUMBER_TEXT_SIZE, number, std::chars_format::fixed, 6).ptr;
+#else
+    return out + std::snprintf(out, NUMBER_TEXT_SIZE, "%f", number);
+#endif
+}
+
+Output::Output(int fd) : fd{fd}, lineBuffered{isatty(fd) == 1} {}
+
+Output::~Output() {
+    flush();
+}
+
+void Output::writeTo(int fd) {
+    flush();
+    this->fd = fd;
+    lineBuffered = isatty(fd) == 1;
+    memory = nullptr;
+}
+
+void Output::captureIn(std::string& memory) {
+    flush();
+    this->memory = &memory;
+    lineBuffered = false;
+}
+
+void Output::flushEachLine() {
+    lineBuffered = true;
+}
+
+void Output::appendNumber(double number) {
+    if (CAPACITY - used < NUMBER_TEXT_SIZE) {
+        flush();
+    }
+    used = formatNumber(number, buffer + used) - buffer;
+}
+
+void Output::endLine() {
+    append("\n");
+    if (lineBuffered) {
+        flush();
+    }
+}
+
+void Output::flush() {
+    write(buffer, used);
+    used = 0;
+}
+
+// Text that does not fit goes out straight after what is buffered, without being copied.
+void Output::appendLong(std::string_view text) {
+    flush();
+    if (text.size() < CAPACITY) {
+        append(text);
+    } else {
+        write(text.data(), text.size());
+    }
+}
+
+void Output::write(const char* data, std::size_t size) {
+    if (memory != nullptr) {
+        memory->append(data, size);
+        return;
+    }
+    // Output that cannot be written, say to a closed pipe, is dropped, like std::cout drops it.
+    while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return;
+        }
+        data += written;
+        size -= written;
+    }
+}
+
+Output& standardOutput() {
+    // Never destroyed, so printing still works in the destructors of other statics, and flushed by exit however the
+    // program ends.
+    static Output* output = [] {
+        std::atexit([] { standardOutput().flush(); });
+        return new Output{STDOUT_FILENO};
+    }();
+    return *output;
+}
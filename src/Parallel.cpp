@@ -0,0 +1,720 @@
+#include "../include/Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "../include/Environment.h"
+#include "../include/Interpreter.h"
+#include "../include/LoxArray.h"
+#include "../include/LoxFunction.h"
+#include "../include/NativeStack.h"
+#include "../include/RuntimeError.h"
+#include "../include/Stmt.h"
+
+namespace {
+
+unsigned requestedThreads = 0;
+
+// A fixed set of threads that sleep until run hands them the tasks of one call.
+class Pool {
+ public:
+    explicit Pool(unsigned size) {
+        for (unsigned i = 1; i < size; ++i) {
+            threads.emplace_back([this] { work(); });
+        }
+    }
+
+    ~Pool() {
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+
+    // Threads taking part in a call, the calling one included.
+    std::size_t size() const {
+        return threads.size() + 1;
+    }
+
+    // Runs task(0) to task(count - 1) on the pool and the calling thread, and returns once every one has finished.
+    // task must not throw.
+    void run(std::size_t count, const std::function<void(std::size_t)>& task) {
+        if (threads.empty() || count <= 1) {
+            for (std::size_t i = 0; i < count; ++i) {
+                task(i);
+            }
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            this->task = &task;
+            this->count = count;
+            next = 0;
+            busy = threads.size();
+            ++generation;
+        }
+        wake.notify_all();
+        drain();
+
+        std::unique_lock<std::mutex> lock{mutex};
+        done.wait(lock, [this] { return busy == 0; });
+        this->task = nullptr;
+    }
+
+ private:
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    bool stopping = false;
+    // Counts the calls to run, so a thread can tell a new one from the one it finished.
+    std::uint64_t generation = 0;
+    const std::function<void(std::size_t)>* task = nullptr;
+    std::size_t count = 0;
+    std::atomic<std::size_t> next{0};
+    // Pool threads still working on the current call.
+    std::size_t busy = 0;
+
+    void drain() {
+        for (std::size_t i = next++; i < count; i = next++) {
+            (*task)(i);
+        }
+    }
+
+    void work() {
+        std::uint64_t finished = 0;
+        std::unique_lock<std::mutex> lock{mutex};
+        while (true) {
+            wake.wait(lock, [&] { return stopping || generation != finished; });
+            if (stopping) {
+                return;
+            }
+            finished = generation;
+            lock.unlock();
+            drain();
+            lock.lock();
+            if (--busy == 0) {
+                done.notify_one();
+            }
+        }
+    }
+};
+
+Pool& pool() {
+    static Pool pool{requestedThreads != 0 ? requestedThreads : std::max(1u, std::thread::hardware_concurrency())};
+    return pool;
+}
+
+// A runtime error raised on a worker. It keeps a pointer to the AST's token rather than a copy, whose literal may
+// hold a reference-counted string.
+struct Failure {
+    const Token* token;
+    std::string message;
+};
+
+// What the workers of one call share, and only read.
+struct Plan {
+    // The function each call in the functions run reaches.
+    std::unordered_map<const CallExpr*, FunctionStmt*> callees;
+    // For machine code reading globals.
+    std::shared_ptr<Environment> globals;
+    std::size_t maxDepth;
+    // The run's, which workers draw on as the interpreter does.
+    Budget* budget;
+};
+
+// The declaration of value if it is a function PurityAnalysis proved pure that captures nothing.
+FunctionStmt* pureFunction(const std::any* value) {
+    auto* function = value == nullptr ? nullptr : std::any_cast<Ref<LoxFunction>>(value);
+    if (function == nullptr || !(*function)->declaration->isPure || !(*function)->upvalues.empty() ||
+        (*function)->receiver != nullptr) {
+        return nullptr;
+    }
+    return (*function)->declaration.get();
+}
+
+// Makes sure, on the calling thread, that a function and the functions it calls only use what a Worker can run,
+// and plans the call. Purity keeps the globals from changing under the workers.
+class Checker : public ExprVisitor, public StmtVisitor {
+ public:
+    explicit Checker(Interpreter& interpreter) : interpreter{interpreter} {
+        plan.globals = interpreter.globals;
+        plan.maxDepth = interpreter.callDepthLimit();
+        plan.budget = &interpreter.budget();
+    }
+
+    FunctionStmt& check(const Token& paren, const std::any& value, std::size_t arity) {
+        if (std::any_cast<Ref<LoxFunction>>(&value) == nullptr) {
+            throw RuntimeError{paren, "First argument must be a function."};
+        }
+        FunctionStmt* function = pureFunction(&value);
+        if (function == nullptr) {
+            throw RuntimeError{paren, "Function must be pure."};
+        }
+        if (function->parameters.size() != arity) {
+            throw RuntimeError{paren,
+                               arity == 1 ? "Function must take 1 argument." : "Function must take 2 arguments."};
+        }
+        walk(*function);
+        if (!supported) {
+            throw RuntimeError{paren, "Function must compute only with nil, booleans and numbers."};
+        }
+
+        // Workers cannot compile, and every function they run is hot from the start.
+        for (FunctionStmt* reached : checked) {
+            interpreter.compileNow(*reached);
+        }
+        return *function;
+    }
+
+    Plan plan;
+
+    std::any visitArrayExpr(ArrayExpr& expr) override {
+        supported = false;
+        return {};
+    }
+
+    std::any visitAssignExpr(AssignExpr& expr) override {
+        checkBinding(expr.binding);
+        walk(expr.value);
+        return {};
+    }
+
+    std::any visitBinaryExpr(BinaryExpr& expr) override {
+        walk(expr.left);
+        walk(expr.right);
+        return {};
+    }
+
+    // Only a global naming a pure function may be called, and only directly.
+    std::any visitCallExpr(CallExpr& expr) override {
+        auto* callee = dynamic_cast<VariableExpr*>(expr.callee.get());
+        FunctionStmt* function = nullptr;
+        if (callee != nullptr && callee->binding.kind == VariableBinding::Kind::GLOBAL) {
+            function = pureFunction(interpreter.globals->find(callee->binding.index));
+        }
+        if (function == nullptr) {
+            supported = false;
+            return {};
+        }
+
+        plan.callees[&expr] = function;
+        for (const std::shared_ptr<Expr>& argument : expr.arguments) {
+            walk(argument);
+        }
+        walk(*function);
+        return {};
+    }
+
+    std::any visitGetExpr(GetExpr& expr) override {
+        supported = false;
+        return {};
+    }
+
+    std::any visitGroupingExpr(GroupingExpr& expr) override {
+        walk(expr.expression);
+        return {};
+    }
+
+    std::any visitIndexExpr(IndexExpr& expr) override {
+        supported = false;
+        return {};
+    }
+
+    // String literals are the one kind of constant a Worker cannot copy.
+    std::any visitLiteralExpr(LiteralExpr& expr) override {
+        if (expr.value.type() != typeid(double) && expr.value.type() != typeid(bool) &&
+            expr.value.type() != typeid(nullptr)) {
+            supported = false;
+        }
+        return {};
+    }
+
+    std::any visitLogicalExpr(LogicalExpr& expr) override {
+        walk(expr.left);
+        walk(expr.right);
+        return {};
+    }
+
+    std::any visitMapExpr(MapExpr& expr) override {
+        supported = false;
+        return {};
+    }
+
+    std::any visitSetExpr(SetExpr& expr) override {
+        supported = false;
+        return {};
+    }
+
+    std::any visitSetIndexExpr(SetIndexExpr& expr) override {
+        supported = false;
+        return {};
+    }
+
+    std::any visitSuperExpr(SuperExpr& expr) override {
+        supported = false;
+        return {};
+    }
+
+    std::any visitThisExpr(ThisExpr& expr) override {
+        supported = false;
+        return {};
+    }
+
+    std::any visitUnaryExpr(UnaryExpr& expr) override {
+        walk(expr.right);
+        return {};
+    }
+
+    std::any visitVariableExpr(VariableExpr& expr) override {
+        checkBinding(expr.binding);
+        return {};
+    }
+
+    void visitBlockStmt(BlockStmt& stmt) override {
+        walk(stmt.statements);
+    }
+
+    void visitClassStmt(ClassStmt& stmt) override {
+        supported = false;
+    }
+
+    void visitExpressionStmt(ExpressionStmt& stmt) override {
+        walk(stmt.expression);
+    }
+
+    void visitFunctionStmt(FunctionStmt& stmt) override {
+        supported = false;
+    }
+
+    void visitIfStmt(IfStmt& stmt) override {
+        walk(stmt.condition);
+        stmt.thenBranch->accept(*this);
+        if (stmt.elseBranch != nullptr) {
+            stmt.elseBranch->accept(*this);
+        }
+    }
+
+    void visitPrintStmt(PrintStmt& stmt) override {
+        supported = false;
+    }
+
+    void visitReturnStmt(ReturnStmt& stmt) override {
+        if (stmt.value != nullptr) {
+            walk(stmt.value);
+        }
+    }
+
+    void visitWhileStmt(WhileStmt& stmt) override {
+        walk(stmt.condition);
+        stmt.body->accept(*this);
+    }
+
+    void visitVarStmt(VarStmt& stmt) override {
+        checkBinding(stmt.binding);
+        if (stmt.initializer != nullptr) {
+            walk(stmt.initializer);
+        }
+    }
+
+    void visitYieldStmt(YieldStmt& stmt) override {
+        supported = false;
+    }
+
+ private:
+    Interpreter& interpreter;
+    std::unordered_set<FunctionStmt*> checked;
+    bool supported = true;
+
+    void walk(FunctionStmt& function) {
+        if (checked.insert(&function).second) {
+            for (const VariableBinding& binding : function.parameterBindings) {
+                checkBinding(binding);
+            }
+            walk(function.body);
+        }
+    }
+
+    void walk(const std::vector<std::shared_ptr<Stmt>>& statements) {
+        for (const std::shared_ptr<Stmt>& statement : statements) {
+            statement->accept(*this);
+        }
+    }
+
+    void walk(const std::shared_ptr<Expr>& expr) {
+        if (supported) {
+            expr->accept(*this);
+        }
+    }
+
+    // A Worker keeps every variable in its frame, so none may be global or captured.
+    void checkBinding(const VariableBinding& binding) {
+        if (binding.kind != VariableBinding::Kind::LOCAL && binding.kind != VariableBinding::Kind::NUMBER) {
+            supported = false;
+        }
+    }
+};
+
+// Evaluates functions a Checker accepted, reading the AST but writing nothing outside itself. Values are std::any
+// as in the interpreter, but only ever nil, booleans and numbers, which are copied without touching shared state.
+// Operators and arity checks go through the interpreter's own helpers, whose errors are turned into Failures: the
+// tokens those copy are operators and parentheses, which hold no literal.
+// Functions the JIT compiled run as machine code, through a Jit of the worker's own.
+class Worker : public ExprVisitor, public StmtVisitor {
+ public:
+    explicit Worker(const Plan& plan) : plan{plan}, jit{plan.globals, plan.maxDepth, true} {
+        // Margin for the frames that report the overflow.
+        thread_local std::uintptr_t limit = nativeStackLimit(64 * 1024);
+        stackLimit = limit;
+    }
+
+    std::any call(FunctionStmt& function, const Token& paren, const std::any* arguments, std::size_t count) {
+        std::size_t argumentBase = top;
+        reserve(argumentBase + count);
+        std::copy(arguments, arguments + count, stack.begin() + argumentBase);
+        return invoke(function, paren, argumentBase, count);
+    }
+
+    std::any visitArrayExpr(ArrayExpr& expr) override {
+        return {};
+    }
+
+    std::any visitAssignExpr(AssignExpr& expr) override {
+        std::any value = evaluate(expr.value);
+        stack[base + expr.binding.index] = value;
+        return value;
+    }
+
+    std::any visitBinaryExpr(BinaryExpr& expr) override {
+        std::any left = evaluate(expr.left);
+        std::any right = evaluate(expr.right);
+        try {
+            return Interpreter::binaryOperation(expr.op, left, right);
+        } catch (const RuntimeError& error) {
+            fail(expr.op, error.what());
+        }
+    }
+
+    std::any visitCallExpr(CallExpr& expr) override {
+        std::size_t argumentBase = top;
+        std::size_t count = expr.arguments.size();
+        top += count;
+        reserve(top);
+        for (std::size_t i = 0; i < count; ++i) {
+            // Evaluated before indexing: a nested call may grow the stack.
+            std::any argument = evaluate(expr.arguments[i]);
+            stack[argumentBase + i] = std::move(argument);
+        }
+        std::any result = invoke(*plan.callees.at(&expr), expr.paren, argumentBase, count);
+        top = argumentBase;
+        return result;
+    }
+
+    std::any visitGetExpr(GetExpr& expr) override {
+        return {};
+    }
+
+    std::any visitGroupingExpr(GroupingExpr& expr) override {
+        return evaluate(expr.expression);
+    }
+
+    std::any visitIndexExpr(IndexExpr& expr) override {
+        return {};
+    }
+
+    std::any visitLiteralExpr(LiteralExpr& expr) override {
+        return expr.value;
+    }
+
+    std::any visitLogicalExpr(LogicalExpr& expr) override {
+        std::any left = evaluate(expr.left);
+        if (expr.op.type == OR ? Interpreter::isTruthy(left) : !Interpreter::isTruthy(left)) {
+            return left;
+        }
+        return evaluate(expr.right);
+    }
+
+    std::any visitMapExpr(MapExpr& expr) override {
+        return {};
+    }
+
+    std::any visitSetExpr(SetExpr& expr) override {
+        return {};
+    }
+
+    std::any visitSetIndexExpr(SetIndexExpr& expr) override {
+        return {};
+    }
+
+    std::any visitSuperExpr(SuperExpr& expr) override {
+        return {};
+    }
+
+    std::any visitThisExpr(ThisExpr& expr) override {
+        return {};
+    }
+
+    std::any visitUnaryExpr(UnaryExpr& expr) override {
+        std::any right = evaluate(expr.right);
+        try {
+            return Interpreter::unaryOperation(expr.op, right);
+        } catch (const RuntimeError& error) {
+            fail(expr.op, error.what());
+        }
+    }
+
+    std::any visitVariableExpr(VariableExpr& expr) override {
+        return stack[base + expr.binding.index];
+    }
+
+    void visitBlockStmt(BlockStmt& stmt) override {
+        execute(stmt.statements);
+    }
+
+    void visitClassStmt(ClassStmt& stmt) override {}
+
+    void visitExpressionStmt(ExpressionStmt& stmt) override {
+        evaluate(stmt.expression);
+    }
+
+    void visitFunctionStmt(FunctionStmt& stmt) override {}
+
+    void visitIfStmt(IfStmt& stmt) override {
+        if (Interpreter::isTruthy(evaluate(stmt.condition))) {
+            stmt.thenBranch->accept(*this);
+        } else if (stmt.elseBranch != nullptr) {
+            stmt.elseBranch->accept(*this);
+        }
+    }
+
+    void visitPrintStmt(PrintStmt& stmt) override {}
+
+    void visitReturnStmt(ReturnStmt& stmt) override {
+        returnValue = stmt.value == nullptr ? std::any{nullptr} : evaluate(stmt.value);
+        returning = true;
+    }
+
+    void visitWhileStmt(WhileStmt& stmt) override {
+        while (!returning && Interpreter::isTruthy(evaluate(stmt.condition))) {
+            stmt.body->accept(*this);
+            safepoint(stmt.keyword);
+        }
+    }
+
+    void visitVarStmt(VarStmt& stmt) override {
+        std::any value = stmt.initializer == nullptr ? std::any{nullptr} : evaluate(stmt.initializer);
+        stack[base + stmt.binding.index] = std::move(value);
+    }
+
+    void visitYieldStmt(YieldStmt& stmt) override {}
+
+ private:
+    const Plan& plan;
+    Jit jit;
+    std::uintptr_t stackLimit = 0;
+    std::size_t depth = 0;
+    std::int64_t safepointsLeft = 0;
+    // The running function's frame is stack[base, top); calls put their arguments from top on.
+    std::vector<std::any> stack;
+    std::size_t base = 0;
+    std::size_t top = 0;
+    bool returning = false;
+    std::any returnValue;
+
+    [[noreturn]] static void fail(const Token& token, std::string message) {
+        throw Failure{&token, std::move(message)};
+    }
+
+    void safepoint(const Token& token) {
+        if (--safepointsLeft < 0) {
+            const char* error = nullptr;
+            safepointsLeft = plan.budget->draw(error) - 1;
+            if (error != nullptr) {
+                fail(token, error);
+            }
+        }
+    }
+
+    std::any evaluate(const std::shared_ptr<Expr>& expr) {
+        return expr->accept(*this);
+    }
+
+    void execute(const std::vector<std::shared_ptr<Stmt>>& statements) {
+        for (const std::shared_ptr<Stmt>& statement : statements) {
+            statement->accept(*this);
+            if (returning) {
+                return;
+            }
+        }
+    }
+
+    void reserve(std::size_t size) {
+        if (stack.size() < size) {
+            stack.resize(std::max(size, 2 * stack.size()));
+        }
+    }
+
+    // The parameters take the slots the arguments were evaluated into.
+    std::any invoke(FunctionStmt& function, const Token& paren, std::size_t argumentBase, std::size_t count) {
+        if (count != function.parameters.size()) {
+            try {
+                Interpreter::throwArityError(paren, function.parameters.size(), count);
+            } catch (const RuntimeError& error) {
+                fail(paren, error.what());
+            }
+        }
+        char probe;
+        if (depth >= plan.maxDepth || reinterpret_cast<std::uintptr_t>(&probe) < stackLimit) {
+            fail(paren, "Stack overflow.");
+        }
+        safepoint(paren);
+        std::any result;
+        if (function.jitCode != nullptr && jit.run(function, &stack[argumentBase], depth, stackLimit, result)) {
+            return result;
+        }
+
+        std::size_t callerBase = base;
+        std::size_t callerTop = top;
+        base = argumentBase;
+        top = base + std::max(count, static_cast<std::size_t>(function.frameSize));
+        reserve(top);
+        ++depth;
+        execute(function.body);
+        --depth;
+        base = callerBase;
+        top = callerTop;
+
+        if (!returning) {
+            return nullptr;
+        }
+        returning = false;
+        return std::move(returnValue);
+    }
+};
+
+std::vector<double>& checkNumbers(const Token& paren, std::any& argument) {
+    auto* array = std::any_cast<Ref<LoxArray>>(&argument);
+    if (array == nullptr) {
+        throw RuntimeError{paren, "Second argument must be an array."};
+    }
+    if (!(*array)->unbox()) {
+        throw RuntimeError{paren, "Array elements must be numbers."};
+    }
+    return (*array)->numbers;
+}
+
+// A few chunks per thread, so threads that finish early take over the rest. Only parallelMap sizes its chunks by the
+// pool, since its results do not depend on how the elements are grouped.
+std::size_t mapChunkSize(std::size_t count) {
+    std::size_t chunks = 8 * pool().size();
+    return std::max<std::size_t>(1, (count + chunks - 1) / chunks);
+}
+
+// parallelReduce groups the elements into runs of this many whatever the number of threads, so a function that is
+// not associative still gives the same result on every machine.
+constexpr std::size_t REDUCE_CHUNK_SIZE = 1024;
+
+using ChunkBody = std::function<void(Worker& worker, std::size_t chunk, std::size_t begin, std::size_t end)>;
+
+// Runs body over [0, count) split into chunks of chunkSize elements, the last one shorter, each on a Worker of its
+// own. A failure stops the chunks after it, and the earliest chunk's failure is raised, so the error is the one the
+// first failing element gives.
+void runChunks(const Plan& plan, std::size_t count, std::size_t chunkSize, const ChunkBody& body) {
+    std::size_t chunks = (count + chunkSize - 1) / chunkSize;
+    std::vector<std::unique_ptr<Failure>> failures(chunks);
+    std::atomic<std::size_t> firstFailure{chunks};
+    pool().run(chunks, [&](std::size_t chunk) {
+        if (chunk > firstFailure.load(std::memory_order_relaxed)) {
+            return;
+        }
+        try {
+            Worker worker{plan};
+            body(worker, chunk, chunk * chunkSize, std::min(count, (chunk + 1) * chunkSize));
+        } catch (Failure& failure) {
+            failures[chunk] = std::make_unique<Failure>(std::move(failure));
+            std::size_t first = firstFailure.load();
+            while (chunk < first && !firstFailure.compare_exchange_weak(first, chunk)) {
+            }
+        }
+    });
+
+    if (firstFailure < chunks) {
+        const Failure& failure = *failures[firstFailure];
+        throw RuntimeError{*failure.token, failure.message};
+    }
+}
+
+}  // namespace
+
+std::any parallelMap(Interpreter& interpreter, const Token& paren, std::any* arguments) {
+    Checker checker{interpreter};
+    FunctionStmt& function = checker.check(paren, arguments[0], 1);
+    const std::vector<double>& elements = checkNumbers(paren, arguments[1]);
+
+    std::vector<std::any> results(elements.size());
+    runChunks(checker.plan, elements.size(), mapChunkSize(elements.size()),
+              [&](Worker& worker, std::size_t chunk, std::size_t begin, std::size_t end) {
+                  for (std::size_t i = begin; i < end; ++i) {
+                      std::any element = elements[i];
+                      results[i] = worker.call(function, paren, &element, 1);
+                  }
+              });
+
+    auto mapped = makeRef<LoxArray>();
+    mapped->numbers.reserve(results.size());
+    for (std::any& result : results) {
+        mapped->push(std::move(result));
+    }
+    return mapped;
+}
+
+std::any parallelReduce(Interpreter& interpreter, const Token& paren, std::any* arguments) {
+    Checker checker{interpreter};
+    FunctionStmt& function = checker.check(paren, arguments[0], 2);
+    const std::vector<double>& elements = checkNumbers(paren, arguments[1]);
+    const std::any& init = arguments[2];
+    if (init.type() != typeid(double) && init.type() != typeid(bool) && init.type() != typeid(nullptr)) {
+        throw RuntimeError{paren, "Initial value must be nil, a boolean or a number."};
+    }
+
+    std::vector<std::any> partials((elements.size() + REDUCE_CHUNK_SIZE - 1) / REDUCE_CHUNK_SIZE);
+    runChunks(checker.plan, elements.size(), REDUCE_CHUNK_SIZE,
+              [&](Worker& worker, std::size_t chunk, std::size_t begin, std::size_t end) {
+                  std::any pair[2] = {elements[begin], nullptr};
+                  for (std::size_t i = begin + 1; i < end; ++i) {
+                      pair[1] = elements[i];
+                      pair[0] = worker.call(function, paren, pair, 2);
+                  }
+                  partials[chunk] = std::move(pair[0]);
+              });
+
+    std::any result;
+    runChunks(checker.plan, 1, 1,
+              [&](Worker& worker, std::size_t chunk, std::size_t begin, std::size_t end) {
+                  std::any pair[2] = {init, nullptr};
+                  for (std::any& partial : partials) {
+                      pair[1] = std::move(partial);
+                      pair[0] = worker.call(function, paren, pair, 2);
+                  }
+                  result = std::move(pair[0]);
+              });
+    return result;
+}
+
+void setParallelThreads(unsigned threads) {
+    requestedThreads = threads;
+}
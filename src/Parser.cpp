@@ -5,6 +5,7 @@
 
 #include "../include/Expr.h"
 #include "../include/Lox.h"
+#include "../include/LoxString.h"
 #include "../include/Token.h"
 
 Parser::Parser(const std::vector<Token>& tokens) : tokens{tokens} {
@@ -25,20 +26,45 @@ std::shared_ptr<Expr> Parser::expression() {
 
 std::shared_ptr<Stmt> Parser::declaration() {
     try {
+        if (match({CLASS})) {
+            return classDeclaration();
+        }
         if (match({FUN})) {
-            return function("function");
+            bool isGenerator = match({STAR});
+            std::shared_ptr<FunctionStmt> declaration = function(isGenerator ? "generator" : "function");
+            declaration->isGenerator = isGenerator;
+            return declaration;
         }
         if (match({VAR})) {
             return varDeclaration();
         }
 
         return statement();
-    } catch (ParserError error) {
+    } catch (const ParserError& error) {
         synchronize();
         return nullptr;
     }
 }
 
+std::shared_ptr<Stmt> Parser::classDeclaration() {
+    Token name = consume(IDENTIFIER, "Expect class name.");
+
+    std::shared_ptr<VariableExpr> superclass = nullptr;
+    if (match({LESS})) {
+        consume(IDENTIFIER, "Expect superclass name.");
+        superclass = std::make_shared<VariableExpr>(previous());
+    }
+
+    consume(LEFT_BRACE, "Expect '{' before class body.");
+    std::vector<std::shared_ptr<FunctionStmt>> methods;
+    while (!check(RIGHT_BRACE) && !isAtEnd()) {
+        methods.push_back(function("method"));
+    }
+    consume(RIGHT_BRACE, "Expect '}' after class body.");
+
+    return std::make_shared<ClassStmt>(std::move(name), superclass, std::move(methods));
+}
+
 std::shared_ptr<Stmt> Parser::statement() {
     if (match({FOR})) {
         return forStatement();
@@ -55,6 +81,9 @@ std::shared_ptr<Stmt> Parser::statement() {
     if (match({WHILE})) {
         return whileStatement();
     }
+    if (match({YIELD})) {
+        return yieldStatement();
+    }
     if (match({LEFT_BRACE})) {
         return std::make_shared<BlockStmt>(block());
     }
@@ -63,6 +92,7 @@ std::shared_ptr<Stmt> Parser::statement() {
 }
 
 std::shared_ptr<Stmt> Parser::forStatement() {
+    Token keyword = previous();
     consume(LEFT_PAREN, "Expect '(' after 'for'.");
 
     std::shared_ptr<Stmt> initializer;
@@ -95,7 +125,7 @@ std::shared_ptr<Stmt> Parser::forStatement() {
     if (condition == nullptr) {
         condition = std::make_shared<LiteralExpr>(true);
     }
-    body = std::make_shared<WhileStmt>(condition, body);
+    body = std::make_shared<WhileStmt>(std::move(keyword), condition, body);
 
     if (initializer != nullptr) {
         body = std::make_shared<BlockStmt>(std::vector<std::shared_ptr<Stmt>>{initializer, body});
@@ -105,6 +135,7 @@ std::shared_ptr<Stmt> Parser::forStatement() {
 }
 
 std::shared_ptr<Stmt> Parser::ifStatement() {
+    Token keyword = previous();
     consume(LEFT_PAREN, "Expect '(' after 'if'.");
     std::shared_ptr<Expr> condition = expression();
     consume(RIGHT_PAREN, "Expect ')' after if condition.");
@@ -115,7 +146,7 @@ std::shared_ptr<Stmt> Parser::ifStatement() {
         elseBranch = statement();
     }
 
-    return std::make_shared<IfStmt>(condition, thenBranch, elseBranch);
+    return std::make_shared<IfStmt>(std::move(keyword), condition, thenBranch, elseBranch);
 }
 
 std::shared_ptr<Stmt> Parser::printStatement() {
@@ -135,6 +166,17 @@ std::shared_ptr<Stmt> Parser::returnStatement() {
     return std::make_shared<ReturnStmt>(keyword, value);
 }
 
+std::shared_ptr<Stmt> Parser::yieldStatement() {
+    Token keyword = previous();
+    std::shared_ptr<Expr> value = nullptr;
+    if (!check(SEMICOLON)) {
+        value = expression();
+    }
+
+    consume(SEMICOLON, "Expect ';' after yield value.");
+    return std::make_shared<YieldStmt>(keyword, value);
+}
+
 std::shared_ptr<Stmt> Parser::varDeclaration() {
     Token name = consume(IDENTIFIER, "Expect variable name.");
 
@@ -148,12 +190,13 @@ std::shared_ptr<Stmt> Parser::varDeclaration() {
 }
 
 std::shared_ptr<Stmt> Parser::whileStatement() {
+    Token keyword = previous();
     consume(LEFT_PAREN, "Expect '(' after 'while'.");
     std::shared_ptr<Expr> condition = expression();
     consume(RIGHT_PAREN, "Expect ')' after condition.");
     std::shared_ptr<Stmt> body = statement();
 
-    return std::make_shared<WhileStmt>(condition, body);
+    return std::make_shared<WhileStmt>(std::move(keyword), condition, body);
 }
 
 std::shared_ptr<Stmt> Parser::expressionStatement() {
@@ -204,6 +247,12 @@ std::shared_ptr<Expr> Parser::assignment() {
             Token name = e->name;
             return std::make_shared<AssignExpr>(std::move(name), value);
         }
+        if (GetExpr* e = dynamic_cast<GetExpr*>(expr.get())) {
+            return std::make_shared<SetExpr>(e->object, e->name, value);
+        }
+        if (IndexExpr* e = dynamic_cast<IndexExpr*>(expr.get())) {
+            return std::make_shared<SetIndexExpr>(e->object, e->bracket, e->index, value);
+        }
 
         error(std::move(equals), "Invalid assignment target.");
     }
@@ -315,6 +364,14 @@ std::shared_ptr<Expr> Parser::call() {
     while (true) {
         if (match({LEFT_PAREN})) {
             expr = finishCall(expr);
+        } else if (match({DOT})) {
+            Token name = consume(IDENTIFIER, "Expect property name after '.'.");
+            expr = std::make_shared<GetExpr>(expr, std::move(name));
+        } else if (match({LEFT_BRACKET})) {
+            Token bracket = previous();
+            std::shared_ptr<Expr> index = expression();
+            consume(RIGHT_BRACKET, "Expect ']' after index.");
+            expr = std::make_shared<IndexExpr>(expr, std::move(bracket), index);
         } else {
             break;
         }
@@ -334,9 +391,22 @@ std::shared_ptr<Expr> Parser::primary() {
         return std::make_shared<LiteralExpr>(nullptr);
     }
 
-    if (match({NUMBER, STRING})) {
+    if (match({NUMBER})) {
         return std::make_shared<LiteralExpr>(previous().literal);
     }
+    if (match({STRING})) {
+        return std::make_shared<LiteralExpr>(makeRef<LoxString>(std::any_cast<std::string>(previous().literal)));
+    }
+
+    if (match({SUPER})) {
+        Token keyword = previous();
+        consume(DOT, "Expect '.' after 'super'.");
+        Token method = consume(IDENTIFIER, "Expect superclass method name.");
+        return std::make_shared<SuperExpr>(std::move(keyword), std::move(method));
+    }
+    if (match({THIS})) {
+        return std::make_shared<ThisExpr>(previous());
+    }
 
     if (match({IDENTIFIER})) {
         return std::make_shared<VariableExpr>(previous());
@@ -348,6 +418,34 @@ std::shared_ptr<Expr> Parser::primary() {
         return std::make_shared<GroupingExpr>(expr);
     }
 
+    if (match({LEFT_BRACKET})) {
+        Token bracket = previous();
+        std::vector<std::shared_ptr<Expr>> elements;
+        if (!check(RIGHT_BRACKET)) {
+            do {
+                elements.push_back(expression());
+            } while (match({COMMA}));
+        }
+        consume(RIGHT_BRACKET, "Expect ']' after array elements.");
+        return std::make_shared<ArrayExpr>(std::move(bracket), std::move(elements));
+    }
+
+    // Only reached where an expression is expected; a statement starting with '{' is a block.
+    if (match({LEFT_BRACE})) {
+        Token brace = previous();
+        std::vector<std::shared_ptr<Expr>> keys;
+        std::vector<std::shared_ptr<Expr>> values;
+        if (!check(RIGHT_BRACE)) {
+            do {
+                keys.push_back(expression());
+                consume(COLON, "Expect ':' after map key.");
+                values.push_back(expression());
+            } while (match({COMMA}));
+        }
+        consume(RIGHT_BRACE, "Expect '}' after map entries.");
+        return std::make_shared<MapExpr>(std::move(brace), std::move(keys), std::move(values));
+    }
+
     throw error(peek(), "Expect expression.");
 }
 
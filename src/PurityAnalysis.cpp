@@ -0,0 +1,286 @@
+#include "../include/PurityAnalysis.h"
+
+std::vector<std::shared_ptr<FunctionStmt>> PurityAnalysis::analyze(
+    const std::vector<std::shared_ptr<Stmt>>& statements, bool memoize) {
+    walk(statements);
+    collecting = false;
+
+    for (const auto& [name, declarations] : globalFunctions) {
+        // A generator returns a new fiber from every call.
+        if (declarations.size() == 1 && assignedGlobals.count(name) == 0 && !declarations.front()->isGenerator) {
+            candidates[name] = declarations.front();
+        }
+    }
+
+    // Dropping a function makes its callers impure in turn, so repeat until nothing changes.
+    bool changed;
+    do {
+        changed = false;
+        for (auto candidate = candidates.begin(); candidate != candidates.end();) {
+            if (isPure(candidate->first, *candidate->second)) {
+                ++candidate;
+            } else {
+                candidate = candidates.erase(candidate);
+                changed = true;
+            }
+        }
+    } while (changed);
+
+    std::vector<std::shared_ptr<FunctionStmt>> pure;
+    for (const auto& [name, declaration] : candidates) {
+        declaration->isPure = true;
+        pure.push_back(declaration);
+        if (!memoize) {
+            continue;
+        }
+
+        std::set<std::string> dependencies{name};
+        collectDependencies(name, dependencies);
+
+        declaration->memo = std::make_unique<MemoTable>();
+        for (const std::string& dependency : dependencies) {
+            declaration->memo->dependencies.push_back(candidates[dependency].get());
+        }
+    }
+    return pure;
+}
+
+bool PurityAnalysis::isPure(const std::string& name, FunctionStmt& declaration) {
+    impure = false;
+    named = &references[name];
+    named->clear();
+    walk(declaration.body);
+    named = nullptr;
+    return !impure;
+}
+
+// The results of a function depend on every function it can reach, not only those it calls directly.
+void PurityAnalysis::collectDependencies(const std::string& name, std::set<std::string>& dependencies) {
+    for (const std::string& reference : references[name]) {
+        if (dependencies.insert(reference).second) {
+            collectDependencies(reference, dependencies);
+        }
+    }
+}
+
+void PurityAnalysis::walk(const std::vector<std::shared_ptr<Stmt>>& statements) {
+    for (const std::shared_ptr<Stmt>& statement : statements) {
+        statement->accept(*this);
+    }
+}
+
+void PurityAnalysis::walk(const std::shared_ptr<Expr>& expr) {
+    expr->accept(*this);
+}
+
+void PurityAnalysis::visitBlockStmt(BlockStmt& stmt) {
+    walk(stmt.statements);
+}
+
+void PurityAnalysis::visitClassStmt(ClassStmt& stmt) {
+    if (collecting) {
+        if (stmt.binding.kind == VariableBinding::Kind::GLOBAL) {
+            assignedGlobals.insert(stmt.name.lexeme);
+        }
+        for (const std::shared_ptr<FunctionStmt>& method : stmt.methods) {
+            walk(method->body);
+        }
+        return;
+    }
+
+    impure = true;
+}
+
+void PurityAnalysis::visitExpressionStmt(ExpressionStmt& stmt) {
+    walk(stmt.expression);
+}
+
+void PurityAnalysis::visitFunctionStmt(FunctionStmt& stmt) {
+    if (collecting) {
+        if (stmt.binding.kind == VariableBinding::Kind::GLOBAL) {
+            globalFunctions[stmt.name.lexeme].push_back(stmt.shared_from_this());
+        }
+        walk(stmt.body);
+        return;
+    }
+
+    // A closure would make the result a new object on every call.
+    impure = true;
+}
+
+void PurityAnalysis::visitIfStmt(IfStmt& stmt) {
+    walk(stmt.condition);
+    stmt.thenBranch->accept(*this);
+    if (stmt.elseBranch != nullptr) {
+        stmt.elseBranch->accept(*this);
+    }
+}
+
+void PurityAnalysis::visitPrintStmt(PrintStmt& stmt) {
+    walk(stmt.expression);
+    if (!collecting) {
+        impure = true;
+    }
+}
+
+void PurityAnalysis::visitReturnStmt(ReturnStmt& stmt) {
+    if (stmt.value != nullptr) {
+        walk(stmt.value);
+    }
+}
+
+void PurityAnalysis::visitWhileStmt(WhileStmt& stmt) {
+    walk(stmt.condition);
+    stmt.body->accept(*this);
+}
+
+void PurityAnalysis::visitVarStmt(VarStmt& stmt) {
+    if (collecting && stmt.binding.kind == VariableBinding::Kind::GLOBAL) {
+        assignedGlobals.insert(stmt.name.lexeme);
+    }
+    if (stmt.initializer != nullptr) {
+        walk(stmt.initializer);
+    }
+}
+
+void PurityAnalysis::visitYieldStmt(YieldStmt& stmt) {
+    if (stmt.value != nullptr) {
+        walk(stmt.value);
+    }
+    if (!collecting) {
+        impure = true;
+    }
+}
+
+// Every call must return a new array, which a remembered result would not be.
+std::any PurityAnalysis::visitArrayExpr(ArrayExpr& expr) {
+    for (const std::shared_ptr<Expr>& element : expr.elements) {
+        walk(element);
+    }
+    if (!collecting) {
+        impure = true;
+    }
+    return {};
+}
+
+std::any PurityAnalysis::visitAssignExpr(AssignExpr& expr) {
+    bool outer = expr.binding.kind == VariableBinding::Kind::GLOBAL ||
+                 expr.binding.kind == VariableBinding::Kind::UPVALUE;
+    if (collecting && expr.binding.kind == VariableBinding::Kind::GLOBAL) {
+        assignedGlobals.insert(expr.name.lexeme);
+    } else if (!collecting && outer) {
+        impure = true;
+    }
+    walk(expr.value);
+    return {};
+}
+
+std::any PurityAnalysis::visitBinaryExpr(BinaryExpr& expr) {
+    walk(expr.left);
+    walk(expr.right);
+    return {};
+}
+
+std::any PurityAnalysis::visitCallExpr(CallExpr& expr) {
+    // An inlined copy does what the call does, so the callee alone decides.
+    walk(expr.callee);
+    for (const std::shared_ptr<Expr>& argument : expr.arguments) {
+        walk(argument);
+    }
+
+    auto callee = std::dynamic_pointer_cast<VariableExpr>(expr.callee);
+    if (!collecting && (callee == nullptr || callee->binding.kind != VariableBinding::Kind::GLOBAL)) {
+        impure = true;
+    }
+    return {};
+}
+
+// Fields can change between calls, and instances are never arguments a result is memoized for.
+std::any PurityAnalysis::visitGetExpr(GetExpr& expr) {
+    walk(expr.object);
+    if (!collecting) {
+        impure = true;
+    }
+    return {};
+}
+
+std::any PurityAnalysis::visitGroupingExpr(GroupingExpr& expr) {
+    walk(expr.expression);
+    return {};
+}
+
+// Arrays are never arguments a result is memoized for, and a pure function cannot create one.
+std::any PurityAnalysis::visitIndexExpr(IndexExpr& expr) {
+    walk(expr.object);
+    walk(expr.index);
+    return {};
+}
+
+std::any PurityAnalysis::visitLiteralExpr(LiteralExpr& expr) {
+    return {};
+}
+
+std::any PurityAnalysis::visitLogicalExpr(LogicalExpr& expr) {
+    walk(expr.left);
+    walk(expr.right);
+    return {};
+}
+
+// Like an array literal, every call must return a new map.
+std::any PurityAnalysis::visitMapExpr(MapExpr& expr) {
+    for (std::size_t i = 0; i < expr.keys.size(); ++i) {
+        walk(expr.keys[i]);
+        walk(expr.values[i]);
+    }
+    if (!collecting) {
+        impure = true;
+    }
+    return {};
+}
+
+std::any PurityAnalysis::visitSetExpr(SetExpr& expr) {
+    walk(expr.object);
+    walk(expr.value);
+    if (!collecting) {
+        impure = true;
+    }
+    return {};
+}
+
+std::any PurityAnalysis::visitSetIndexExpr(SetIndexExpr& expr) {
+    walk(expr.object);
+    walk(expr.index);
+    walk(expr.value);
+    if (!collecting) {
+        impure = true;
+    }
+    return {};
+}
+
+// Only found in methods, which are never candidates.
+std::any PurityAnalysis::visitSuperExpr(SuperExpr& expr) {
+    return {};
+}
+
+std::any PurityAnalysis::visitThisExpr(ThisExpr& expr) {
+    return {};
+}
+
+std::any PurityAnalysis::visitUnaryExpr(UnaryExpr& expr) {
+    walk(expr.right);
+    return {};
+}
+
+std::any PurityAnalysis::visitVariableExpr(VariableExpr& expr) {
+    if (collecting || expr.binding.kind != VariableBinding::Kind::GLOBAL) {
+        return {};
+    }
+
+    // Any other global may change between calls.
+    if (candidates.count(expr.name.lexeme) == 0) {
+        impure = true;
+    } else {
+        named->insert(expr.name.lexeme);
+    }
+    return {};
+}
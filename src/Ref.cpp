@@ -0,0 +1,59 @@
+#include "../include/Ref.h"
+
+#include <cstdlib>
+
+namespace {
+
+struct Deletion {
+    void* object;
+    void (*destroy)(void*);
+};
+
+// Plain data rather than a std::vector: thread_local objects are destroyed before the statics of the thread that
+// calls exit, whose destructors still release objects through here.
+struct Deletions {
+    Deletion* items;
+    std::size_t size;
+    std::size_t capacity;
+    bool running;
+};
+
+// Past this many, the queue's memory is given back once it drains, as deleting a large array can queue an entry per
+// element.
+constexpr std::size_t KEPT_CAPACITY = 1024;
+
+thread_local Deletions deletions{};
+
+void push(Deletion deletion) {
+    if (deletions.size == deletions.capacity) {
+        std::size_t capacity = deletions.capacity == 0 ? 64 : 2 * deletions.capacity;
+        auto* items = static_cast<Deletion*>(std::realloc(deletions.items, capacity * sizeof(Deletion)));
+        if (items == nullptr) {
+            std::abort();
+        }
+        deletions.items = items;
+        deletions.capacity = capacity;
+    }
+    deletions.items[deletions.size++] = deletion;
+}
+
+}  // namespace
+
+void deleteRefCounted(void* object, void (*destroy)(void*)) {
+    if (deletions.running) {
+        push(Deletion{object, destroy});
+        return;
+    }
+
+    deletions.running = true;
+    destroy(object);
+    while (deletions.size > 0) {
+        Deletion next = deletions.items[--deletions.size];
+        next.destroy(next.object);
+    }
+    if (deletions.capacity > KEPT_CAPACITY) {
+        std::free(deletions.items);
+        deletions = Deletions{};
+    }
+    deletions.running = false;
+}
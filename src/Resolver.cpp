@@ -1,10 +1,13 @@
 #include "../include/Resolver.h"
 
+#include <algorithm>
 #include <iostream>
 
 #include "../include/Lox.h"
 
-Resolver::Resolver(Interpreter& interpreter) : interpreter{interpreter} {}
+Resolver::Resolver(Interpreter& interpreter) : interpreter{interpreter} {
+    functions.push_back(FunctionScope{nullptr});
+}
 
 void Resolver::resolve(const std::vector<std::shared_ptr<Stmt>>& statements) {
     for (const std::shared_ptr<Stmt>& statement : statements) {
@@ -12,170 +15,373 @@ void Resolver::resolve(const std::vector<std::shared_ptr<Stmt>>& statements) {
     }
 }
 
-void Resolver::visitBlockStmt(std::shared_ptr<BlockStmt> stmt) {
+int Resolver::scriptFrameSize() const {
+    return functions.front().frameSize;
+}
+
+void Resolver::visitBlockStmt(BlockStmt& stmt) {
     beginScope();
-    resolve(stmt->statements);
+    resolve(stmt.statements);
     endScope();
 }
 
-void Resolver::visitExpressionStmt(std::shared_ptr<ExpressionStmt> stmt) {
-    resolve(stmt->expression);
+void Resolver::visitClassStmt(ClassStmt& stmt) {
+    ClassType enclosingClass = currentClass;
+    currentClass = ClassType::CLASS;
+
+    declare(stmt.name, stmt.binding);
+    define(stmt.name);
+
+    if (stmt.superclass != nullptr) {
+        if (stmt.superclass->name.lexeme == stmt.name.lexeme) {
+            Lox::error(stmt.superclass->name, "A class can't inherit from itself.");
+        }
+        currentClass = ClassType::SUBCLASS;
+        resolve(stmt.superclass);
+
+        // A scope of its own, even at top level, so methods capture the superclass like any enclosing local.
+        beginScope();
+        Token super{SUPER, "super", nullptr, stmt.name.line};
+        declare(super, stmt.superBinding);
+        define(super);
+    }
+
+    for (const std::shared_ptr<FunctionStmt>& method : stmt.methods) {
+        method->isMethod = true;
+        method->isInitializer = method->name.lexeme == "init";
+        resolveFunction(*method, method->isInitializer ? FunctionType::INITIALIZER : FunctionType::METHOD);
+    }
+
+    if (stmt.superclass != nullptr) {
+        endScope();
+    }
+    currentClass = enclosingClass;
+}
+
+void Resolver::visitExpressionStmt(ExpressionStmt& stmt) {
+    resolve(stmt.expression);
 }
 
-void Resolver::visitFunctionStmt(std::shared_ptr<FunctionStmt> stmt) {
-    declare(stmt->name);
-    define(stmt->name);
+void Resolver::visitFunctionStmt(FunctionStmt& stmt) {
+    declare(stmt.name, stmt.binding);
+    define(stmt.name);
 
     // resolveFunction(stmt);
-    resolveFunction(stmt, FunctionType::FUNCTION);
+    resolveFunction(stmt, stmt.isGenerator ? FunctionType::GENERATOR : FunctionType::FUNCTION);
 }
 
-void Resolver::visitIfStmt(std::shared_ptr<IfStmt> stmt) {
-    resolve(stmt->condition);
-    resolve(stmt->thenBranch);
-    if (stmt->elseBranch != nullptr) {
-        resolve(stmt->elseBranch);
+void Resolver::visitIfStmt(IfStmt& stmt) {
+    resolve(stmt.condition);
+    resolve(stmt.thenBranch);
+    if (stmt.elseBranch != nullptr) {
+        resolve(stmt.elseBranch);
     }
 }
 
-void Resolver::visitPrintStmt(std::shared_ptr<PrintStmt> stmt) {
-    resolve(stmt->expression);
+void Resolver::visitPrintStmt(PrintStmt& stmt) {
+    resolve(stmt.expression);
 }
 
-void Resolver::visitReturnStmt(std::shared_ptr<ReturnStmt> stmt) {
+void Resolver::visitReturnStmt(ReturnStmt& stmt) {
     if (currentFunction == FunctionType::NONE) {
-        Lox::error(stmt->keyword, "Can't return from top-level code.");
+        Lox::error(stmt.keyword, "Can't return from top-level code.");
     }
 
-    if (stmt->value != nullptr) {
-        resolve(stmt->value);
+    if (stmt.value != nullptr) {
+        if (currentFunction == FunctionType::INITIALIZER) {
+            Lox::error(stmt.keyword, "Can't return a value from an initializer.");
+        }
+        resolve(stmt.value);
     }
+
+    stmt.isTailCall = currentFunction != FunctionType::NONE && dynamic_cast<CallExpr*>(stmt.value.get()) != nullptr;
 }
 
-void Resolver::visitVarStmt(std::shared_ptr<VarStmt> stmt) {
-    declare(stmt->name);
-    if (stmt->initializer != nullptr) {
-        resolve(stmt->initializer);
+void Resolver::visitVarStmt(VarStmt& stmt) {
+    declare(stmt.name, stmt.binding);
+    if (stmt.initializer != nullptr) {
+        resolve(stmt.initializer);
     }
-    define(stmt->name);
+    define(stmt.name);
 }
 
-void Resolver::visitWhileStmt(std::shared_ptr<WhileStmt> stmt) {
-    resolve(stmt->condition);
-    resolve(stmt->body);
+void Resolver::visitWhileStmt(WhileStmt& stmt) {
+    resolve(stmt.condition);
+    resolve(stmt.body);
 }
 
-std::any Resolver::visitAssignExpr(std::shared_ptr<AssignExpr> expr) {
-    resolve(expr->value);
-    resolveLocal(expr, expr->name);
+void Resolver::visitYieldStmt(YieldStmt& stmt) {
+    if (currentFunction != FunctionType::GENERATOR) {
+        Lox::error(stmt.keyword, "Can't yield outside a generator.");
+    }
+    if (stmt.value != nullptr) {
+        resolve(stmt.value);
+    }
+}
+
+std::any Resolver::visitArrayExpr(ArrayExpr& expr) {
+    for (const std::shared_ptr<Expr>& element : expr.elements) {
+        resolve(element);
+    }
     return {};
 }
 
-std::any Resolver::visitBinaryExpr(std::shared_ptr<BinaryExpr> expr) {
-    resolve(expr->left);
-    resolve(expr->right);
+std::any Resolver::visitAssignExpr(AssignExpr& expr) {
+    resolve(expr.value);
+    resolveLocal(expr.binding, expr.name);
     return {};
 }
 
-std::any Resolver::visitCallExpr(std::shared_ptr<CallExpr> expr) {
-    resolve(expr->callee);
+std::any Resolver::visitBinaryExpr(BinaryExpr& expr) {
+    resolve(expr.left);
+    resolve(expr.right);
+    return {};
+}
+
+std::any Resolver::visitCallExpr(CallExpr& expr) {
+    resolve(expr.callee);
+    expr.property = dynamic_cast<GetExpr*>(expr.callee.get());
 
-    for (const std::shared_ptr<Expr>& argument : expr->arguments) {
+    for (const std::shared_ptr<Expr>& argument : expr.arguments) {
         resolve(argument);
     }
 
     return {};
 }
 
-std::any Resolver::visitGroupingExpr(std::shared_ptr<GroupingExpr> expr) {
-    resolve(expr->expression);
+std::any Resolver::visitGetExpr(GetExpr& expr) {
+    resolve(expr.object);
+    return {};
+}
+
+std::any Resolver::visitGroupingExpr(GroupingExpr& expr) {
+    resolve(expr.expression);
+    return {};
+}
+
+std::any Resolver::visitIndexExpr(IndexExpr& expr) {
+    resolve(expr.object);
+    resolve(expr.index);
+    return {};
+}
+
+std::any Resolver::visitLiteralExpr(LiteralExpr& expr) {
+    return {};
+}
+
+std::any Resolver::visitLogicalExpr(LogicalExpr& expr) {
+    resolve(expr.left);
+    resolve(expr.right);
+    return {};
+}
+
+std::any Resolver::visitMapExpr(MapExpr& expr) {
+    for (std::size_t i = 0; i < expr.keys.size(); ++i) {
+        resolve(expr.keys[i]);
+        resolve(expr.values[i]);
+    }
+    return {};
+}
+
+std::any Resolver::visitSetExpr(SetExpr& expr) {
+    resolve(expr.value);
+    resolve(expr.object);
+    return {};
+}
+
+std::any Resolver::visitSetIndexExpr(SetIndexExpr& expr) {
+    resolve(expr.object);
+    resolve(expr.index);
+    resolve(expr.value);
     return {};
 }
 
-std::any Resolver::visitLiteralExpr(std::shared_ptr<LiteralExpr> expr) {
+std::any Resolver::visitSuperExpr(SuperExpr& expr) {
+    if (currentClass == ClassType::NONE) {
+        Lox::error(expr.keyword, "Can't use 'super' outside of a class.");
+    } else if (currentClass != ClassType::SUBCLASS) {
+        Lox::error(expr.keyword, "Can't use 'super' in a class with no superclass.");
+    } else {
+        resolveLocal(expr.binding, expr.keyword);
+        resolveLocal(expr.thisBinding, Token{THIS, "this", nullptr, expr.keyword.line});
+    }
     return {};
 }
 
-std::any Resolver::visitLogicalExpr(std::shared_ptr<LogicalExpr> expr) {
-    resolve(expr->left);
-    resolve(expr->right);
+std::any Resolver::visitThisExpr(ThisExpr& expr) {
+    if (currentClass == ClassType::NONE) {
+        Lox::error(expr.keyword, "Can't use 'this' outside of a class.");
+        return {};
+    }
+
+    resolveLocal(expr.binding, expr.keyword);
     return {};
 }
 
-std::any Resolver::visitUnaryExpr(std::shared_ptr<UnaryExpr> expr) {
-    resolve(expr->right);
+std::any Resolver::visitUnaryExpr(UnaryExpr& expr) {
+    resolve(expr.right);
     return {};
 }
 
-std::any Resolver::visitVariableExpr(std::shared_ptr<VariableExpr> expr) {
+std::any Resolver::visitVariableExpr(VariableExpr& expr) {
+    std::vector<std::map<std::string, Local>>& scopes = functions.back().scopes;
     if (!scopes.empty()) {
         auto& scope = scopes.back();
-        auto elem = scope.find(expr->name.lexeme);
-        if (elem != scope.end() && elem->second == false) {
-            Lox::error(expr->name, "Can't read local variable in its own initializer.");
+        auto elem = scope.find(expr.name.lexeme);
+        if (elem != scope.end() && elem->second.defined == false) {
+            Lox::error(expr.name, "Can't read local variable in its own initializer.");
         }
     }
 
-    resolveLocal(expr, expr->name);
+    resolveLocal(expr.binding, expr.name);
     return {};
 }
 
-void Resolver::resolve(std::shared_ptr<Stmt> stmt) {
+void Resolver::resolve(const std::shared_ptr<Stmt>& stmt) {
     stmt->accept(*this);
 }
 
-void Resolver::resolve(std::shared_ptr<Expr> expr) {
+void Resolver::resolve(const std::shared_ptr<Expr>& expr) {
     expr->accept(*this);
 }
 
 // void resolveFunction(std::shared_ptr<Function> function) {
-void Resolver::resolveFunction(std::shared_ptr<FunctionStmt> function, FunctionType type) {
+void Resolver::resolveFunction(FunctionStmt& function, FunctionType type) {
     FunctionType enclosingFunction = currentFunction;
     currentFunction = type;
+    function.upvalues.clear();
+    functions.push_back(FunctionScope{&function});
 
     beginScope();
-    for (const Token& param : function->parameters) {
-        declare(param);
-        define(param);
+    std::size_t parameterCount = function.parameters.size();
+    if (type == FunctionType::METHOD || type == FunctionType::INITIALIZER) {
+        // Sized before any declaration, since the scope keeps pointers to these bindings.
+        function.parameterBindings.resize(parameterCount + 1);
+    }
+    for (std::size_t i = 0; i < parameterCount; ++i) {
+        declare(function.parameters[i], function.parameterBindings[i]);
+        define(function.parameters[i]);
     }
-    resolve(function->body);
+    if (function.parameterBindings.size() > parameterCount) {
+        Token self{THIS, "this", nullptr, function.name.line};
+        declare(self, function.parameterBindings[parameterCount]);
+        define(self);
+    }
+    resolve(function.body);
     endScope();
+
+    function.frameSize = functions.back().frameSize;
+    functions.pop_back();
     currentFunction = enclosingFunction;
 }
 
 void Resolver::beginScope() {
-    scopes.push_back(std::map<std::string, bool>{});
+    functions.back().scopes.push_back(std::map<std::string, Local>{});
 }
 
 void Resolver::endScope() {
-    scopes.pop_back();
+    FunctionScope& function = functions.back();
+    std::map<std::string, Local>& scope = function.scopes.back();
+
+    // Every use of a local is known once its scope closes, so this is where captured locals become boxed.
+    for (auto& [name, local] : scope) {
+        if (local.captured) {
+            for (VariableBinding* binding : local.bindings) {
+                binding->kind = VariableBinding::Kind::BOXED;
+            }
+        }
+    }
+
+    function.slotCount -= scope.size();
+    function.scopes.pop_back();
+
+    if (function.declaration == nullptr && function.scopes.empty()) {
+        interpreter.reserveScriptFrame(function.frameSize);
+    }
 }
 
-void Resolver::declare(const Token& name) {
-    if (scopes.empty()) {
+void Resolver::declare(const Token& name, VariableBinding& binding) {
+    FunctionScope& function = functions.back();
+    if (function.scopes.empty()) {
+        binding = globalBinding(name);
         return;
     }
 
-    std::map<std::string, bool>& scope = scopes.back();
+    std::map<std::string, Local>& scope = function.scopes.back();
     if (scope.find(name.lexeme) != scope.end()) {
         Lox::error(name, "Already a variable with this name in this scope.");
     }
 
-    scope[name.lexeme] = false;
+    int slot = function.slotCount++;
+    function.frameSize = std::max(function.frameSize, function.slotCount);
+    binding = VariableBinding{VariableBinding::Kind::LOCAL, slot};
+    scope[name.lexeme] = Local{false, slot, false, {&binding}};
+}
+
+VariableBinding Resolver::globalBinding(const Token& name) {
+    return VariableBinding{VariableBinding::Kind::GLOBAL, static_cast<int>(interpreter.globals->slot(name.lexeme))};
 }
 
 void Resolver::define(const Token& name) {
+    std::vector<std::map<std::string, Local>>& scopes = functions.back().scopes;
     if (scopes.empty()) {
         return;
     }
-    scopes.back()[name.lexeme] = true;
+    scopes.back()[name.lexeme].defined = true;
 }
 
-void Resolver::resolveLocal(std::shared_ptr<Expr> expr, const Token& name) {
-    for (int i = scopes.size() - 1; i >= 0; --i) {
-        if (scopes[i].find(name.lexeme) != scopes[i].end()) {
-            interpreter.resolve(expr, scopes.size() - 1 - i);
-            return;
+void Resolver::resolveLocal(VariableBinding& binding, const Token& name) {
+    Local* local = findLocal(functions.back(), name);
+    if (local != nullptr) {
+        binding = VariableBinding{VariableBinding::Kind::LOCAL, local->slot};
+        local->bindings.push_back(&binding);
+        return;
+    }
+
+    int upvalue = resolveUpvalue(functions.size() - 1, name);
+    if (upvalue != -1) {
+        binding = VariableBinding{VariableBinding::Kind::UPVALUE, upvalue};
+    } else {
+        binding = globalBinding(name);
+    }
+}
+
+int Resolver::resolveUpvalue(std::size_t function, const Token& name) {
+    if (function == 0) {
+        return -1;
+    }
+
+    Local* local = findLocal(functions[function - 1], name);
+    if (local != nullptr) {
+        local->captured = true;
+        return addUpvalue(functions[function], true, local->slot);
+    }
+
+    int upvalue = resolveUpvalue(function - 1, name);
+    if (upvalue == -1) {
+        return -1;
+    }
+    return addUpvalue(functions[function], false, upvalue);
+}
+
+int Resolver::addUpvalue(FunctionScope& function, bool isLocal, int index) {
+    std::vector<FunctionStmt::UpvalueSource>& upvalues = function.declaration->upvalues;
+    for (std::size_t i = 0; i < upvalues.size(); ++i) {
+        if (upvalues[i].isLocal == isLocal && upvalues[i].index == index) {
+            return i;
         }
     }
-}
\ No newline at end of file
+
+    upvalues.push_back(FunctionStmt::UpvalueSource{isLocal, index});
+    return upvalues.size() - 1;
+}
+
+Resolver::Local* Resolver::findLocal(FunctionScope& function, const Token& name) {
+    for (auto scope = function.scopes.rbegin(); scope != function.scopes.rend(); ++scope) {
+        auto elem = scope->find(name.lexeme);
+        if (elem != scope->end()) {
+            return &elem->second;
+        }
+    }
+    return nullptr;
+}
@@ -6,7 +6,7 @@
 const std::map<std::string, TokenType> Scanner::keywords = {
     {"and", AND},   {"class", CLASS}, {"else", ELSE}, {"false", FALSE}, {"fun", FUN},       {"for", FOR},
     {"if", IF},     {"nil", NIL},     {"or", OR},     {"print", PRINT}, {"return", RETURN}, {"super", SUPER},
-    {"this", THIS}, {"true", TRUE},   {"var", VAR},   {"while", WHILE},
+    {"this", THIS}, {"true", TRUE},   {"var", VAR},   {"while", WHILE}, {"yield", YIELD},
 };
 
 Scanner::Scanner(const std::string &source) : source(source) {}
@@ -49,6 +49,15 @@ void Scanner::scanToken() {
         case '}':
             addToken(RIGHT_BRACE);
             break;
+        case '[':
+            addToken(LEFT_BRACKET);
+            break;
+        case ']':
+            addToken(RIGHT_BRACKET);
+            break;
+        case ':':
+            addToken(COLON);
+            break;
         case ',':
             addToken(COMMA);
             break;
@@ -91,11 +100,6 @@ void Scanner::scanToken() {
         case '"':
             string();
             break;
-        case 'o':
-            if (match('r')) {
-                addToken(OR);
-            }
-            break;
         default:
             if (isDigit(c)) {
                 number();
@@ -180,7 +184,7 @@ void Scanner::identifier() {
 }
 
 bool Scanner::isAtEnd() {
-    return current >= source.length();
+    return static_cast<std::size_t>(current) >= source.length();
 }
 
 char Scanner::advance() {
@@ -213,7 +217,7 @@ char Scanner::peek() {
 }
 
 char Scanner::peekNext() {
-    if (current + 1 >= source.length()) {
+    if (static_cast<std::size_t>(current) + 1 >= source.length()) {
         return '\0';
     }
     return source[current + 1];
@@ -0,0 +1,445 @@
+#include "../include/Server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../include/Lox.h"
+#include "../include/Output.h"
+
+namespace {
+
+// The exit statuses of clox itself, which the reply ends with.
+constexpr int USAGE_ERROR = 64;
+constexpr int COMPILE_ERROR = 65;
+constexpr int RUNTIME_ERROR = 70;
+constexpr int IO_ERROR = 74;
+
+using Clock = std::chrono::steady_clock;
+
+constexpr std::size_t HEADER_LIMIT = 64 * 1024;
+// How long a client may take to send the request line. Other clients are served meanwhile.
+constexpr std::chrono::seconds HEADER_TIMEOUT{5};
+// Connections accepted but not yet running a script. Past this many, further clients wait in the listen backlog.
+constexpr std::size_t WAITING_LIMIT = 256;
+// Files kept compiled. A file not among them replaces the one run least recently.
+constexpr std::size_t CACHE_LIMIT = 64;
+
+// A file as it was when last compiled, along with what compiling it reported.
+struct CachedProgram {
+    ino_t inode;
+    off_t size;
+    std::int64_t modified;
+    bool compiled;
+    std::string errors;
+    Program program;
+    // The globals the program was resolved against, so that the slots of files no longer cached are not kept.
+    Environment globals;
+    // The value of runs when it was last asked for.
+    std::uint64_t lastRun;
+};
+
+std::map<std::string, CachedProgram> cache;
+// The globals before any script is resolved. Each file is resolved against its own copy of them.
+Environment natives;
+std::uint64_t runs = 0;
+
+// A connection whose request line is still arriving, or, in ready, has arrived and waits for a process to run it.
+struct Request {
+    int connection;
+    // The request line and whatever came after it in the same reads.
+    std::string received;
+    Clock::time_point deadline;
+};
+
+std::vector<Request> arriving;
+std::deque<Request> ready;
+
+// Written to by the SIGCHLD handler, so that the server wakes up from poll to reap the process and start another.
+int childExits[2];
+
+bool writeAll(int fd, const char* data, std::size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+void sendTrailer(int connection, int status) {
+    std::string trailer = '\0' + std::to_string(status);
+    writeAll(connection, trailer.data(), trailer.size());
+}
+
+// For requests the server turns down itself.
+void refuse(int connection, const std::string& message, int status) {
+    writeAll(connection, message.data(), message.size());
+    sendTrailer(connection, status);
+}
+
+bool socketAddress(const std::string& path, sockaddr_un& address) {
+    address = sockaddr_un{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof address.sun_path) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    path.copy(address.sun_path, path.size());
+    return true;
+}
+
+std::int64_t modificationTime(const struct stat& status) {
+#ifdef __APPLE__
+    return status.st_mtimespec.tv_sec * 1000000000LL + status.st_mtimespec.tv_nsec;
+#else
+    return status.st_mtim.tv_sec * 1000000000LL + status.st_mtim.tv_nsec;
+#endif
+}
+
+void setBlocking(int fd, bool blocking) {
+    int flags = fcntl(fd, F_GETFL);
+    fcntl(fd, F_SETFL, blocking ? flags & ~O_NONBLOCK : flags | O_NONBLOCK);
+}
+
+void onChildExit(int) {
+    int saved = errno;
+    char byte = 0;
+    // The pipe is non-blocking: if it is full, the server has a wakeup pending already.
+    [[maybe_unused]] ssize_t written = write(childExits[1], &byte, 1);
+    errno = saved;
+}
+
+// Reads what the client has sent of the request line so far, from a non-blocking connection. Returns false if the
+// client hung up or sent too long a line.
+bool readHeader(Request& request) {
+    char buffer[4096];
+    while (request.received.find('\n') == std::string::npos) {
+        ssize_t count = read(request.connection, buffer, sizeof buffer);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+        }
+        if (count <= 0 || request.received.size() + count > HEADER_LIMIT) {
+            return false;
+        }
+        request.received.append(buffer, count);
+    }
+    return true;
+}
+
+// Compiles path unless the cache holds it as it is now. Errors are reported to the client as well as returned.
+CachedProgram* lookUp(int connection, const std::string& path) {
+    struct stat status;
+    std::ifstream file{path};
+    if (stat(path.c_str(), &status) != 0 || !file) {
+        refuse(connection, "Failed to open file " + path + ": " + std::strerror(errno) + "\n", IO_ERROR);
+        return nullptr;
+    }
+
+    auto cached = cache.find(path);
+    if (cached != cache.end() && cached->second.inode == status.st_ino && cached->second.size == status.st_size &&
+        cached->second.modified == modificationTime(status)) {
+        cached->second.lastRun = ++runs;
+        return &cached->second;
+    }
+    if (cached == cache.end() && cache.size() >= CACHE_LIMIT) {
+        cache.erase(std::min_element(cache.begin(), cache.end(), [](const auto& a, const auto& b) {
+            return a.second.lastRun < b.second.lastRun;
+        }));
+    }
+
+    std::stringstream source;
+    source << file.rdbuf();
+    CachedProgram& entry = cache[path];
+    entry = CachedProgram{status.st_ino, status.st_size, modificationTime(status), false, {}, {}, {}, ++runs};
+    // The errors are printed to the client by each run of the file, so they are collected here.
+    standardOutput().captureIn(entry.errors);
+    entry.compiled = Lox::compile(source.str(), entry.program);
+    standardOutput().writeTo(STDOUT_FILENO);
+    entry.globals = std::move(Lox::globals());
+    Lox::globals() = natives;
+    Lox::hadError = false;
+    return &entry;
+}
+
+// Runs in the forked process, with the script's output going to the client.
+[[noreturn]] void finish(int connection, int status) {
+    standardOutput().flush();
+    sendTrailer(connection, status);
+    _exit(status);
+}
+
+[[noreturn]] void runRequest(int connection, const CachedProgram* cached, std::string source) {
+    std::signal(SIGPIPE, SIG_DFL);
+    std::signal(SIGCHLD, SIG_DFL);
+    // Otherwise the other clients would not see their connections closed until this process exits.
+    for (const Request& request : arriving) {
+        close(request.connection);
+    }
+    for (const Request& request : ready) {
+        close(request.connection);
+    }
+    close(childExits[0]);
+    close(childExits[1]);
+    int nothing = open("/dev/null", O_RDONLY);
+    dup2(nothing, STDIN_FILENO);
+    dup2(connection, STDOUT_FILENO);
+    dup2(connection, STDERR_FILENO);
+    standardOutput().writeTo(STDOUT_FILENO);
+    // The client shows each line as the script prints it, not when the buffer fills or the script ends.
+    standardOutput().flushEachLine();
+
+    Program compiled;
+    const Program* program = &compiled;
+    if (cached != nullptr) {
+        standardOutput().append(cached->errors);
+        if (!cached->compiled) {
+            finish(connection, COMPILE_ERROR);
+        }
+        program = &cached->program;
+        Lox::globals() = cached->globals;
+    } else {
+        char buffer[64 * 1024];
+        ssize_t count;
+        while ((count = read(connection, buffer, sizeof buffer)) != 0) {
+            if (count < 0 && errno != EINTR) {
+                finish(connection, IO_ERROR);
+            }
+            source.append(buffer, std::max<ssize_t>(count, 0));
+        }
+        if (!Lox::compile(source, compiled)) {
+            finish(connection, COMPILE_ERROR);
+        }
+    }
+
+    Lox::execute(*program);
+    finish(connection, Lox::hadRuntimeError ? RUNTIME_ERROR : 0);
+}
+
+// Returns whether a process was started for the request, which has its request line.
+bool handle(int listener, const Request& request) {
+    int connection = request.connection;
+    std::size_t newline = request.received.find('\n');
+    std::string header = request.received.substr(0, newline);
+    const CachedProgram* cached = nullptr;
+    if (header.compare(0, 5, "FILE ") == 0 && header.size() > 6 && header[5] == '/') {
+        cached = lookUp(connection, header.substr(5));
+        if (cached == nullptr) {
+            return false;
+        }
+    } else if (header != "SOURCE") {
+        refuse(connection, "Bad request.\n", USAGE_ERROR);
+        return false;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        refuse(connection, std::string{"Could not start a process: "} + std::strerror(errno) + "\n", RUNTIME_ERROR);
+        return false;
+    }
+    if (pid == 0) {
+        close(listener);
+        runRequest(connection, cached, request.received.substr(newline + 1));
+    }
+    return true;
+}
+
+}  // namespace
+
+void serve(const std::string& path, unsigned workers) {
+    // A client that hangs up early must not take the server down with it.
+    std::signal(SIGPIPE, SIG_IGN);
+    natives = Lox::globals();
+
+    sockaddr_un address;
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct stat status;
+    if (lstat(path.c_str(), &status) == 0 && S_ISSOCK(status.st_mode)) {
+        // Left behind by a server that was killed.
+        unlink(path.c_str());
+    }
+    if (listener < 0 || !socketAddress(path, address) ||
+        bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof address) != 0 ||
+        listen(listener, SOMAXCONN) != 0) {
+        std::cerr << "Failed to listen on " << path << ": " << std::strerror(errno) << "\n";
+        std::exit(IO_ERROR);
+    }
+    fcntl(listener, F_SETFD, FD_CLOEXEC);
+    setBlocking(listener, false);
+
+    if (pipe(childExits) != 0) {
+        std::cerr << "Failed to create a pipe: " << std::strerror(errno) << "\n";
+        std::exit(IO_ERROR);
+    }
+    for (int fd : childExits) {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        setBlocking(fd, false);
+    }
+    struct sigaction action{};
+    action.sa_handler = onChildExit;
+    action.sa_flags = SA_NOCLDSTOP;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGCHLD, &action, nullptr);
+
+    unsigned running = 0;
+    std::vector<pollfd> polled;
+    while (true) {
+        // Drained before reaping, so an exit after the reaping still leaves a byte to wake poll.
+        char drained[64];
+        while (read(childExits[0], drained, sizeof drained) > 0) {
+        }
+        while (running > 0 && waitpid(-1, nullptr, WNOHANG) > 0) {
+            --running;
+        }
+        while (running < workers && !ready.empty()) {
+            Request request = std::move(ready.front());
+            ready.pop_front();
+            if (handle(listener, request)) {
+                ++running;
+            }
+            close(request.connection);
+        }
+
+        // Turns away the clients that took too long to send the request line, and waits no longer than the next one
+        // may take.
+        Clock::time_point now = Clock::now();
+        int wait = -1;
+        for (Request& request : arriving) {
+            if (request.deadline <= now) {
+                refuse(request.connection, "Bad request.\n", USAGE_ERROR);
+                close(request.connection);
+                request.connection = -1;
+                continue;
+            }
+            auto left = std::chrono::ceil<std::chrono::milliseconds>(request.deadline - now).count();
+            wait = wait < 0 ? static_cast<int>(left) : std::min(wait, static_cast<int>(left));
+        }
+        arriving.erase(std::remove_if(arriving.begin(), arriving.end(),
+                                      [](const Request& request) { return request.connection < 0; }),
+                       arriving.end());
+
+        polled.clear();
+        polled.push_back(pollfd{childExits[0], POLLIN, 0});
+        polled.push_back(pollfd{arriving.size() + ready.size() < WAITING_LIMIT ? listener : -1, POLLIN, 0});
+        for (const Request& request : arriving) {
+            polled.push_back(pollfd{request.connection, POLLIN, 0});
+        }
+        if (poll(polled.data(), polled.size(), wait) <= 0) {
+            continue;
+        }
+
+        for (std::size_t i = 0; i < arriving.size(); ++i) {
+            Request& request = arriving[i];
+            if (polled[i + 2].revents == 0) {
+                continue;
+            }
+            if (!readHeader(request)) {
+                refuse(request.connection, "Bad request.\n", USAGE_ERROR);
+                close(request.connection);
+            } else if (request.received.find('\n') != std::string::npos) {
+                // The script's process reads the rest of the source, and writes its output, blocking.
+                setBlocking(request.connection, true);
+                ready.push_back(std::move(request));
+            } else {
+                continue;
+            }
+            request.connection = -1;
+        }
+        arriving.erase(std::remove_if(arriving.begin(), arriving.end(),
+                                      [](const Request& request) { return request.connection < 0; }),
+                       arriving.end());
+
+        if (polled[1].revents != 0) {
+            int connection = accept(listener, nullptr, nullptr);
+            if (connection >= 0) {
+                fcntl(connection, F_SETFD, FD_CLOEXEC);
+                setBlocking(connection, false);
+                arriving.push_back(Request{connection, {}, Clock::now() + HEADER_TIMEOUT});
+            }
+        }
+    }
+}
+
+int runRemote(const std::string& path, const char* script) {
+    std::string request;
+    if (script != nullptr) {
+        char* absolute = realpath(script, nullptr);
+        if (absolute == nullptr) {
+            std::cerr << "Failed to open file " << script << ": " << std::strerror(errno) << "\n";
+            return IO_ERROR;
+        }
+        request = "FILE " + std::string{absolute} + "\n";
+        std::free(absolute);
+    } else {
+        std::stringstream source;
+        source << std::cin.rdbuf();
+        request = "SOURCE\n" + source.str();
+    }
+
+    sockaddr_un address;
+    int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connection < 0 || !socketAddress(path, address) ||
+        connect(connection, reinterpret_cast<sockaddr*>(&address), sizeof address) != 0) {
+        std::cerr << "Failed to connect to " << path << ": " << std::strerror(errno) << "\n";
+        return IO_ERROR;
+    }
+    std::signal(SIGPIPE, SIG_IGN);
+    writeAll(connection, request.data(), request.size());
+    shutdown(connection, SHUT_WR);
+
+    // Everything from the last NUL on may be the trailer, so it is held back until more output or the end shows
+    // whether it is.
+    std::string pending;
+    char buffer[64 * 1024];
+    ssize_t count;
+    while ((count = read(connection, buffer, sizeof buffer)) != 0) {
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        pending.append(buffer, count);
+        std::size_t last = pending.rfind('\0');
+        std::size_t ready = last == std::string::npos ? pending.size() : last;
+        standardOutput().append(std::string_view{pending}.substr(0, ready));
+        standardOutput().flush();
+        pending.erase(0, ready);
+    }
+    close(connection);
+
+    if (pending.size() < 2 || pending[0] != '\0' ||
+        pending.find_first_not_of("0123456789", 1) != std::string::npos) {
+        standardOutput().append(pending);
+        standardOutput().flush();
+        std::cerr << "Lost the connection to the server.\n";
+        return RUNTIME_ERROR;
+    }
+    return std::stoi(pending.substr(1));
+}
@@ -13,6 +13,12 @@ std::string tokenTypeToString(TokenType type) {
             return "LEFT_BRACE";
         case RIGHT_BRACE:
             return "RIGHT_BRACE";
+        case LEFT_BRACKET:
+            return "LEFT_BRACKET";
+        case RIGHT_BRACKET:
+            return "RIGHT_BRACKET";
+        case COLON:
+            return "COLON";
         case COMMA:
             return "COMMA";
         case DOT:
@@ -84,6 +90,8 @@ std::string tokenTypeToString(TokenType type) {
             return "VAR";
         case WHILE:
             return "WHILE";
+        case YIELD:
+            return "YIELD";
         case END_OF_FILE:
             return "END_OF_FILE";
 
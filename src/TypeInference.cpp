@@ -0,0 +1,451 @@
+#include "../include/TypeInference.h"
+
+static bool isComparison(TokenType type) {
+    switch (type) {
+        case GREATER:
+        case GREATER_EQUAL:
+        case LESS:
+        case LESS_EQUAL:
+        case EQUAL_EQUAL:
+        case BANG_EQUAL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void TypeInference::infer(const std::vector<std::shared_ptr<Stmt>>& statements) {
+    pass = Pass::COLLECT;
+    walk(statements);
+
+    for (const auto& [name, declarations] : globalFunctions) {
+        if (declarations.size() == 1 && unknownGlobals.count(name) == 0) {
+            FunctionStmt* declaration = declarations.front();
+            knownFunctions[name] = declaration;
+            numberParameters[declaration] = std::vector<bool>(declaration->parameters.size(), true);
+        }
+    }
+
+    // A demoted parameter can make the arguments of further calls non-numbers, so repeat until nothing changes.
+    do {
+        parametersDemoted = false;
+        infer(statements, nullptr, Pass::ANALYZE);
+        for (const std::shared_ptr<FunctionStmt>& declaration : functions) {
+            infer(declaration->body, declaration.get(), Pass::ANALYZE);
+        }
+    } while (parametersDemoted);
+
+    infer(statements, nullptr, Pass::ANNOTATE);
+    for (const std::shared_ptr<FunctionStmt>& declaration : functions) {
+        infer(declaration->body, declaration.get(), Pass::ANNOTATE);
+    }
+}
+
+const TypeInferenceStats& TypeInference::stats() const {
+    return inferenceStats;
+}
+
+void TypeInference::infer(const std::vector<std::shared_ptr<Stmt>>& statements, FunctionStmt* declaration,
+                          Pass last) {
+    demoted.clear();
+    if (declaration != nullptr) {
+        auto known = numberParameters.find(declaration);
+        for (std::size_t i = 0; i < declaration->parameters.size(); ++i) {
+            const VariableBinding& binding = declaration->parameterBindings[i];
+            if (binding.kind != VariableBinding::Kind::LOCAL || known == numberParameters.end() ||
+                !known->second[i]) {
+                demote(binding.index);
+            }
+        }
+        if (declaration->isMethod) {
+            // The receiver.
+            demote(declaration->parameters.size());
+        }
+    }
+
+    pass = Pass::ANALYZE;
+    do {
+        changed = false;
+        walk(statements);
+    } while (changed);
+
+    if (last != Pass::ANNOTATE) {
+        return;
+    }
+
+    pass = Pass::ANNOTATE;
+    proofs = declaration != nullptr ? &declaration->typeProofs : nullptr;
+    if (declaration != nullptr) {
+        for (std::size_t i = 0; i < declaration->parameters.size(); ++i) {
+            VariableBinding& binding = declaration->parameterBindings[i];
+            if (binding.kind == VariableBinding::Kind::LOCAL && isNumberSlot(binding.index)) {
+                proofs->parameters.push_back(i);
+                declare(binding);
+            }
+        }
+        if (!proofs->parameters.empty()) {
+            ++inferenceStats.speculatedFunctions;
+        }
+    }
+    walk(statements);
+    proofs = nullptr;
+}
+
+void TypeInference::walk(const std::vector<std::shared_ptr<Stmt>>& statements) {
+    for (const std::shared_ptr<Stmt>& statement : statements) {
+        statement->accept(*this);
+    }
+}
+
+bool TypeInference::isNumber(const std::shared_ptr<Expr>& expr) {
+    return std::any_cast<bool>(expr->accept(*this));
+}
+
+bool TypeInference::isNumberSlot(std::size_t slot) const {
+    return slot >= demoted.size() || !demoted[slot];
+}
+
+void TypeInference::demote(std::size_t slot) {
+    if (slot >= demoted.size()) {
+        demoted.resize(slot + 1, false);
+    }
+    if (!demoted[slot]) {
+        demoted[slot] = true;
+        changed = true;
+    }
+}
+
+bool TypeInference::isNumberLocal(const VariableBinding& binding) const {
+    return (binding.kind == VariableBinding::Kind::LOCAL || binding.kind == VariableBinding::Kind::NUMBER) &&
+           isNumberSlot(binding.index);
+}
+
+void TypeInference::store(VariableBinding& binding, bool number) {
+    if (pass == Pass::ANALYZE && binding.kind != VariableBinding::Kind::GLOBAL &&
+        binding.kind != VariableBinding::Kind::UPVALUE && (binding.kind == VariableBinding::Kind::BOXED || !number)) {
+        demote(binding.index);
+    }
+}
+
+void TypeInference::declare(VariableBinding& binding) {
+    if (isNumberLocal(binding)) {
+        convert(binding);
+        if (proofs != nullptr) {
+            proofs->slots.push_back(binding.index);
+        }
+        ++inferenceStats.numberVariables;
+    }
+}
+
+void TypeInference::convert(VariableBinding& binding) {
+    binding.kind = VariableBinding::Kind::NUMBER;
+    if (proofs != nullptr) {
+        proofs->bindings.push_back(&binding);
+    }
+}
+
+bool TypeInference::annotate(Expr& expr, bool number) {
+    if (pass == Pass::ANNOTATE && number) {
+        ++inferenceStats.numberExpressions;
+        annotate(expr.isNumber);
+    }
+    return number;
+}
+
+void TypeInference::annotate(bool& flag) {
+    flag = true;
+    if (proofs != nullptr) {
+        proofs->flags.push_back(&flag);
+    }
+}
+
+void TypeInference::visitBlockStmt(BlockStmt& stmt) {
+    walk(stmt.statements);
+}
+
+void TypeInference::visitClassStmt(ClassStmt& stmt) {
+    if (stmt.superclass != nullptr) {
+        isNumber(stmt.superclass);
+    }
+    if (pass == Pass::COLLECT) {
+        if (stmt.binding.kind == VariableBinding::Kind::GLOBAL) {
+            unknownGlobals.insert(stmt.name.lexeme);
+        }
+        for (const std::shared_ptr<FunctionStmt>& method : stmt.methods) {
+            functions.push_back(method);
+            walk(method->body);
+        }
+        return;
+    }
+
+    // As with functions, the methods are analyzed on their own.
+    store(stmt.binding, false);
+    if (stmt.superclass != nullptr) {
+        store(stmt.superBinding, false);
+    }
+}
+
+void TypeInference::visitExpressionStmt(ExpressionStmt& stmt) {
+    isNumber(stmt.expression);
+}
+
+void TypeInference::visitFunctionStmt(FunctionStmt& stmt) {
+    if (pass == Pass::COLLECT) {
+        functions.push_back(stmt.shared_from_this());
+        if (stmt.binding.kind == VariableBinding::Kind::GLOBAL) {
+            globalFunctions[stmt.name.lexeme].push_back(&stmt);
+        }
+        walk(stmt.body);
+        return;
+    }
+
+    // The body is analyzed on its own; here the function is only a value stored into a variable.
+    store(stmt.binding, false);
+}
+
+void TypeInference::visitIfStmt(IfStmt& stmt) {
+    isNumber(stmt.condition);
+    if (pass == Pass::ANNOTATE) {
+        auto condition = std::dynamic_pointer_cast<BinaryExpr>(stmt.condition);
+        if (condition != nullptr && condition->numberOperands && isComparison(condition->op.type)) {
+            annotate(stmt.numberCondition);
+        }
+    }
+
+    stmt.thenBranch->accept(*this);
+    if (stmt.elseBranch != nullptr) {
+        stmt.elseBranch->accept(*this);
+    }
+}
+
+void TypeInference::visitPrintStmt(PrintStmt& stmt) {
+    isNumber(stmt.expression);
+}
+
+void TypeInference::visitReturnStmt(ReturnStmt& stmt) {
+    if (stmt.value != nullptr) {
+        isNumber(stmt.value);
+    }
+}
+
+void TypeInference::visitWhileStmt(WhileStmt& stmt) {
+    isNumber(stmt.condition);
+    if (pass == Pass::ANNOTATE) {
+        auto condition = std::dynamic_pointer_cast<BinaryExpr>(stmt.condition);
+        if (condition != nullptr && condition->numberOperands && isComparison(condition->op.type)) {
+            annotate(stmt.numberCondition);
+        }
+    }
+
+    stmt.body->accept(*this);
+    if (pass == Pass::ANNOTATE && stmt.numberCondition) {
+        findCountedLoop(stmt);
+    }
+}
+
+// Matches the shape a for loop desugars to: while (i < n) { body; i = i + step; }, with i a NUMBER local.
+void TypeInference::findCountedLoop(WhileStmt& stmt) {
+    auto counter = std::dynamic_pointer_cast<VariableExpr>(static_cast<BinaryExpr&>(*stmt.condition).left);
+    auto block = std::dynamic_pointer_cast<BlockStmt>(stmt.body);
+    if (counter == nullptr || counter->binding.kind != VariableBinding::Kind::NUMBER || block == nullptr ||
+        block->statements.size() != 2) {
+        return;
+    }
+    int slot = counter->binding.index;
+
+    auto increment = std::dynamic_pointer_cast<ExpressionStmt>(block->statements[1]);
+    auto assign = increment != nullptr ? std::dynamic_pointer_cast<AssignExpr>(increment->expression) : nullptr;
+    if (assign == nullptr || assign->binding.kind != VariableBinding::Kind::NUMBER || assign->binding.index != slot) {
+        return;
+    }
+    auto value = std::dynamic_pointer_cast<BinaryExpr>(assign->value);
+    if (value == nullptr || (value->op.type != PLUS && value->op.type != MINUS)) {
+        return;
+    }
+    auto self = std::dynamic_pointer_cast<VariableExpr>(value->left);
+    auto step = std::dynamic_pointer_cast<LiteralExpr>(value->right);
+    if (self == nullptr || self->binding.kind != VariableBinding::Kind::NUMBER || self->binding.index != slot ||
+        step == nullptr || step->value.type() != typeid(double)) {
+        return;
+    }
+
+    double amount = std::any_cast<double>(step->value);
+    stmt.counted = std::make_unique<CountedLoop>(
+        CountedLoop{slot, value->op.type == PLUS ? amount : -amount, block->statements[0], increment});
+    ++inferenceStats.countedLoops;
+}
+
+void TypeInference::visitVarStmt(VarStmt& stmt) {
+    bool number = stmt.initializer != nullptr && isNumber(stmt.initializer);
+
+    if (pass == Pass::COLLECT && stmt.binding.kind == VariableBinding::Kind::GLOBAL) {
+        unknownGlobals.insert(stmt.name.lexeme);
+    } else if (pass == Pass::ANNOTATE) {
+        declare(stmt.binding);
+    }
+    store(stmt.binding, number);
+}
+
+void TypeInference::visitYieldStmt(YieldStmt& stmt) {
+    if (stmt.value != nullptr) {
+        isNumber(stmt.value);
+    }
+}
+
+std::any TypeInference::visitArrayExpr(ArrayExpr& expr) {
+    for (const std::shared_ptr<Expr>& element : expr.elements) {
+        isNumber(element);
+    }
+    return false;
+}
+
+std::any TypeInference::visitAssignExpr(AssignExpr& expr) {
+    bool number = isNumber(expr.value);
+
+    if (pass == Pass::COLLECT && expr.binding.kind == VariableBinding::Kind::GLOBAL) {
+        unknownGlobals.insert(expr.name.lexeme);
+    } else if (pass == Pass::ANNOTATE && isNumberLocal(expr.binding)) {
+        convert(expr.binding);
+    }
+    store(expr.binding, number);
+
+    // The assignment evaluates to the value assigned, whatever the variable's own type.
+    return annotate(expr, number);
+}
+
+std::any TypeInference::visitBinaryExpr(BinaryExpr& expr) {
+    bool left = isNumber(expr.left);
+    bool right = isNumber(expr.right);
+
+    if (pass == Pass::ANNOTATE && left && right) {
+        annotate(expr.numberOperands);
+    }
+
+    switch (expr.op.type) {
+        case MINUS:
+        case STAR:
+        case SLASH:
+            // These either produce a number or raise an error.
+            return annotate(expr, true);
+        case PLUS:
+            return annotate(expr, left && right);
+        default:
+            return false;
+    }
+}
+
+std::any TypeInference::visitCallExpr(CallExpr& expr) {
+    auto callee = std::dynamic_pointer_cast<VariableExpr>(expr.callee);
+    bool global = callee != nullptr && callee->binding.kind == VariableBinding::Kind::GLOBAL;
+    if (!global) {
+        isNumber(expr.callee);
+    }
+
+    std::vector<bool> arguments;
+    for (const std::shared_ptr<Expr>& argument : expr.arguments) {
+        arguments.push_back(isNumber(argument));
+    }
+
+    if (expr.inlined != nullptr) {
+        // Evaluating the inlined copy stores each argument into a parameter slot of this frame.
+        for (std::size_t i = 0; i < arguments.size(); ++i) {
+            VariableBinding& parameter = expr.inlined->parameters[i];
+            if (pass == Pass::ANNOTATE) {
+                declare(parameter);
+            }
+            store(parameter, arguments[i]);
+        }
+        isNumber(expr.inlined->body);
+    }
+
+    if (pass != Pass::ANALYZE || !global) {
+        return false;
+    }
+    auto known = knownFunctions.find(callee->name.lexeme);
+    if (known == knownFunctions.end() || known->second->parameters.size() != arguments.size()) {
+        // A call with the wrong number of arguments fails before the function runs.
+        return false;
+    }
+
+    std::vector<bool>& parameters = numberParameters[known->second];
+    for (std::size_t i = 0; i < arguments.size(); ++i) {
+        if (parameters[i] && !arguments[i]) {
+            parameters[i] = false;
+            parametersDemoted = true;
+        }
+    }
+    return false;
+}
+
+std::any TypeInference::visitGetExpr(GetExpr& expr) {
+    isNumber(expr.object);
+    return false;
+}
+
+std::any TypeInference::visitGroupingExpr(GroupingExpr& expr) {
+    return annotate(expr, isNumber(expr.expression));
+}
+
+// An element can be anything, even of an array that only held numbers so far.
+std::any TypeInference::visitIndexExpr(IndexExpr& expr) {
+    isNumber(expr.object);
+    isNumber(expr.index);
+    return false;
+}
+
+std::any TypeInference::visitLiteralExpr(LiteralExpr& expr) {
+    return annotate(expr, expr.value.type() == typeid(double));
+}
+
+std::any TypeInference::visitLogicalExpr(LogicalExpr& expr) {
+    isNumber(expr.left);
+    isNumber(expr.right);
+    return false;
+}
+
+std::any TypeInference::visitMapExpr(MapExpr& expr) {
+    for (std::size_t i = 0; i < expr.keys.size(); ++i) {
+        isNumber(expr.keys[i]);
+        isNumber(expr.values[i]);
+    }
+    return false;
+}
+
+std::any TypeInference::visitSetExpr(SetExpr& expr) {
+    isNumber(expr.object);
+    isNumber(expr.value);
+    return false;
+}
+
+std::any TypeInference::visitSetIndexExpr(SetIndexExpr& expr) {
+    isNumber(expr.object);
+    isNumber(expr.index);
+    isNumber(expr.value);
+    return false;
+}
+
+std::any TypeInference::visitSuperExpr(SuperExpr& expr) {
+    return false;
+}
+
+std::any TypeInference::visitThisExpr(ThisExpr& expr) {
+    return false;
+}
+
+std::any TypeInference::visitUnaryExpr(UnaryExpr& expr) {
+    isNumber(expr.right);
+    return annotate(expr, expr.op.type == MINUS);
+}
+
+std::any TypeInference::visitVariableExpr(VariableExpr& expr) {
+    if (pass == Pass::COLLECT && expr.binding.kind == VariableBinding::Kind::GLOBAL) {
+        // A function read as a value may be called from anywhere.
+        unknownGlobals.insert(expr.name.lexeme);
+    }
+
+    bool number = pass != Pass::COLLECT && isNumberLocal(expr.binding);
+    if (pass == Pass::ANNOTATE && number) {
+        convert(expr.binding);
+    }
+    return annotate(expr, number);
+}
@@ -0,0 +1,53 @@
+#include "../include/Upvalue.h"
+
+#include <new>
+
+namespace {
+
+// Cells are freed back to the heap past this many on the list, so a burst of closures does not stay allocated.
+constexpr std::size_t FREE_LIMIT = 4096;
+
+// Reuses a free cell's storage for the link to the next.
+struct FreeCell {
+    FreeCell* next;
+};
+
+static_assert(sizeof(FreeCell) <= sizeof(Upvalue));
+
+struct FreeList {
+    FreeCell* first = nullptr;
+    std::size_t size = 0;
+
+    // Cells freed after the thread's list is gone, by objects that outlive it, go straight back to the heap.
+    ~FreeList() {
+        while (first != nullptr) {
+            FreeCell* next = first->next;
+            ::operator delete(first);
+            first = next;
+        }
+        size = FREE_LIMIT;
+    }
+};
+
+thread_local FreeList freeCells;
+
+}  // namespace
+
+void* Upvalue::operator new(std::size_t size) {
+    if (freeCells.first == nullptr) {
+        return ::operator new(size);
+    }
+    FreeCell* cell = freeCells.first;
+    freeCells.first = cell->next;
+    --freeCells.size;
+    return cell;
+}
+
+void Upvalue::operator delete(void* cell) {
+    if (freeCells.size == FREE_LIMIT) {
+        ::operator delete(cell);
+        return;
+    }
+    freeCells.first = new (cell) FreeCell{freeCells.first};
+    ++freeCells.size;
+}
@@ -0,0 +1,450 @@
+#include "../include/VM.h"
+
+#include <iostream>
+
+#include "../include/BytecodeCompiler.h"
+#include "../include/Interpreter.h"
+#include "../include/Lox.h"
+#include "../include/Output.h"
+#include "../include/RuntimeError.h"
+
+[[noreturn]] __attribute__((noinline, cold)) static void throwError(int line, const std::string& message) {
+    throw RuntimeError{Token{NIL, "", nullptr, line}, message};
+}
+
+// Both tags in a single compare.
+static inline bool bothNumbers(const Value& a, const Value& b) {
+    constexpr unsigned number = static_cast<unsigned>(Value::Type::NUMBER);
+    return (static_cast<unsigned>(a.type) << 8 | static_cast<unsigned>(b.type)) == (number << 8 | number);
+}
+
+static inline void setNumber(Value& value, double number) {
+    if (value.object != nullptr) {
+        value.object = nullptr;
+    }
+    value.type = Value::Type::NUMBER;
+    value.number = number;
+}
+
+static inline void setBool(Value& value, bool boolean) {
+    if (value.object != nullptr) {
+        value.object = nullptr;
+    }
+    value.type = Value::Type::BOOL;
+    value.boolean = boolean;
+}
+
+__attribute__((noinline)) static Value binary(OpCode op, const Value& x, const Value& y, int line) {
+    switch (op) {
+        case OpCode::EQUAL:
+            return Value{x.equals(y)};
+        case OpCode::NOT_EQUAL:
+            return Value{!x.equals(y)};
+        case OpCode::ADD:
+            if (bothNumbers(x, y)) {
+                return Value{x.number + y.number};
+            }
+            if (x.type == Value::Type::STRING && y.type == Value::Type::STRING) {
+                return Value::string(LoxString::concatenate(x.asText(), y.asText()));
+            }
+            throwError(line, "Operands must be two numbers or two strings.");
+        default:
+            break;
+    }
+
+    if (!bothNumbers(x, y)) {
+        throwError(line, "Operands must be numbers.");
+    }
+    switch (op) {
+        case OpCode::SUBTRACT:
+            return Value{x.number - y.number};
+        case OpCode::MULTIPLY:
+            return Value{x.number * y.number};
+        case OpCode::DIVIDE:
+            return Value{x.number / y.number};
+        case OpCode::GREATER:
+            return Value{x.number > y.number};
+        case OpCode::GREATER_EQUAL:
+            return Value{x.number >= y.number};
+        case OpCode::LESS:
+            return Value{x.number < y.number};
+        case OpCode::LESS_EQUAL:
+        default:
+            return Value{x.number <= y.number};
+    }
+}
+
+// Rewrites a generic binary instruction into the variant for the operand types of its first execution.
+static void quicken(Instruction& instruction, const Value& x, const Value& y) {
+    if (instruction.flags & Instruction::GENERIC) {
+        return;
+    }
+
+    if (bothNumbers(x, y)) {
+        int variant = instruction.flags & Instruction::CONSTANT ? NUMBER_CONSTANT_VARIANT : NUMBER_VARIANT;
+        instruction.op = static_cast<OpCode>(static_cast<int>(instruction.op) + variant);
+    } else if (instruction.op == OpCode::ADD && x.type == Value::Type::STRING && y.type == Value::Type::STRING) {
+        instruction.op = OpCode::ADD_STRING;
+    } else {
+        instruction.flags |= Instruction::GENERIC;
+    }
+}
+
+// A quickened instruction whose guard failed goes back to the generic form for good.
+static void deoptimize(Instruction& instruction, OpCode generic) {
+    instruction.op = generic;
+    instruction.flags |= Instruction::GENERIC;
+}
+
+VM::VM() : maxCallDepth{Interpreter::DEFAULT_MAX_CALL_DEPTH} {}
+
+void VM::setMaxCallDepth(std::size_t depth) {
+    maxCallDepth = depth;
+}
+
+std::uint16_t VM::globalSlot(const std::string& name) {
+    auto elem = globalSlots.find(name);
+    if (elem != globalSlots.end()) {
+        return elem->second;
+    }
+
+    if (globals.size() > UINT16_MAX) {
+        throw Unsupported{"too many globals for bytecode"};
+    }
+    std::uint16_t slot = globals.size();
+    globals.push_back(Value{Value::Type::UNDEFINED, nullptr});
+    globalNames.push_back(name);
+    globalSlots.emplace(name, slot);
+    return slot;
+}
+
+bool VM::interpret(const std::vector<std::shared_ptr<Stmt>>& statements, std::size_t frameSize) {
+    auto script = std::make_shared<Proto>();
+    script->name = "script";
+    try {
+        BytecodeCompiler{*this, script, frameSize}.compile(statements);
+    } catch (const Unsupported&) {
+        return false;
+    }
+    collectPrototypes(script);
+
+    auto closure = makeRef<ClosureObj>(script);
+    reserveStack(script->registers);
+    frames.push_back(CallFrame{closure.get(), script->code.data(), 0, 0, closure});
+    try {
+        run();
+    } catch (const RuntimeError& error) {
+        frames.clear();
+        for (Value& value : stack) {
+            value = Value{};
+        }
+        Lox::runtimeError(error);
+    }
+    return true;
+}
+
+void VM::collectPrototypes(const std::shared_ptr<Proto>& proto) {
+    prototypes.push_back(proto);
+    for (const std::shared_ptr<Proto>& nested : proto->prototypes) {
+        collectPrototypes(nested);
+    }
+}
+
+void VM::reserveStack(std::size_t size) {
+    if (stack.size() < size) {
+        stack.resize(std::max(stack.size() * 2, size));
+    }
+}
+
+void VM::run() {
+    CallFrame* frame = &frames.back();
+    ClosureObj* closure = frame->closure;
+    Instruction* code = closure->proto->code.data();
+    Instruction* ip = frame->ip;
+    const Value* constants = closure->proto->constants.data();
+    Value* registers = &stack[frame->base];
+
+    auto line = [&]() { return closure->proto->lines[ip - 1 - code]; };
+
+    // Makes function the running code of frame, whose arguments are already in place.
+    auto enter = [&](ClosureObj* function) {
+        Proto& proto = *function->proto;
+        reserveStack(frame->base + proto.registers);
+        registers = &stack[frame->base];
+        for (std::uint16_t slot : proto.boxedParameters) {
+            registers[slot] = Value{Value::Type::CELL, makeRef<CellObj>(std::move(registers[slot]))};
+        }
+        closure = function;
+        code = proto.code.data();
+        ip = code;
+        constants = proto.constants.data();
+        ++calls;
+    };
+
+    auto checkCallee = [&](const Value& callee, std::size_t argumentCount) {
+        if (callee.type != Value::Type::FUNCTION) {
+            throwError(line(), "Can only call functions and classes.");
+        }
+        auto* function = static_cast<ClosureObj*>(callee.object.get());
+        if (argumentCount != function->proto->arity) {
+            throwError(line(), "Expected " + std::to_string(function->proto->arity) + " arguments but got " +
+                                   std::to_string(argumentCount) + ".");
+        }
+        return function;
+    };
+
+    while (true) {
+        Instruction& instruction = *ip++;
+        ++dispatched;
+
+        switch (instruction.op) {
+            case OpCode::MOVE:
+                registers[instruction.a] = registers[instruction.b];
+                break;
+            case OpCode::LOAD_CONSTANT:
+                registers[instruction.a] = constants[instruction.b];
+                break;
+            case OpCode::GET_GLOBAL: {
+                const Value& global = globals[instruction.b];
+                if (global.type == Value::Type::UNDEFINED) {
+                    throwError(line(), "Undefined variable '" + globalNames[instruction.b] + "'.");
+                }
+                registers[instruction.a] = global;
+                break;
+            }
+            case OpCode::DEFINE_GLOBAL:
+                globals[instruction.b] = registers[instruction.a];
+                break;
+            case OpCode::SET_GLOBAL:
+                if (globals[instruction.b].type == Value::Type::UNDEFINED) {
+                    throwError(line(), "Undefined variable '" + globalNames[instruction.b] + "'.");
+                }
+                globals[instruction.b] = registers[instruction.a];
+                break;
+            case OpCode::BOX:
+                registers[instruction.a] =
+                    Value{Value::Type::CELL, makeRef<CellObj>(std::move(registers[instruction.a]))};
+                break;
+            case OpCode::GET_CELL: {
+                Value value = static_cast<CellObj*>(registers[instruction.b].object.get())->value;
+                registers[instruction.a] = std::move(value);
+                break;
+            }
+            case OpCode::SET_CELL:
+                static_cast<CellObj*>(registers[instruction.a].object.get())->value = registers[instruction.b];
+                break;
+            case OpCode::GET_UPVALUE:
+                registers[instruction.a] = closure->upvalues[instruction.b]->value;
+                break;
+            case OpCode::SET_UPVALUE:
+                closure->upvalues[instruction.b]->value = registers[instruction.a];
+                break;
+
+            case OpCode::ADD:
+            case OpCode::SUBTRACT:
+            case OpCode::MULTIPLY:
+            case OpCode::DIVIDE:
+            case OpCode::GREATER:
+            case OpCode::GREATER_EQUAL:
+            case OpCode::LESS:
+            case OpCode::LESS_EQUAL:
+            case OpCode::EQUAL:
+            case OpCode::NOT_EQUAL: {
+                OpCode op = instruction.op;
+                const Value& x = registers[instruction.b];
+                const Value& y =
+                    instruction.flags & Instruction::CONSTANT ? constants[instruction.c] : registers[instruction.c];
+                quicken(instruction, x, y);
+                Value result = binary(op, x, y, line());
+                registers[instruction.a] = std::move(result);
+                break;
+            }
+
+#define NUMBER_OPERATION(NAME, OPERATOR, SET)                                                   \
+    case OpCode::NAME##_NUMBER: {                                                               \
+        const Value& x = registers[instruction.b];                                              \
+        const Value& y = registers[instruction.c];                                              \
+        if (bothNumbers(x, y)) {                                                                \
+            SET(registers[instruction.a], x.number OPERATOR y.number);                          \
+        } else {                                                                                \
+            deoptimize(instruction, OpCode::NAME);                                              \
+            --ip;                                                                               \
+        }                                                                                       \
+        break;                                                                                  \
+    }                                                                                           \
+    case OpCode::NAME##_NUMBER_CONSTANT: {                                                      \
+        /* The constant was a number when this was quickened, and constants never change. */    \
+        const Value& x = registers[instruction.b];                                              \
+        if (x.isNumber()) {                                                                     \
+            SET(registers[instruction.a], x.number OPERATOR constants[instruction.c].number);   \
+        } else {                                                                                \
+            deoptimize(instruction, OpCode::NAME);                                              \
+            --ip;                                                                               \
+        }                                                                                       \
+        break;                                                                                  \
+    }
+
+                NUMBER_OPERATION(ADD, +, setNumber)
+                NUMBER_OPERATION(SUBTRACT, -, setNumber)
+                NUMBER_OPERATION(MULTIPLY, *, setNumber)
+                NUMBER_OPERATION(DIVIDE, /, setNumber)
+                NUMBER_OPERATION(GREATER, >, setBool)
+                NUMBER_OPERATION(GREATER_EQUAL, >=, setBool)
+                NUMBER_OPERATION(LESS, <, setBool)
+                NUMBER_OPERATION(LESS_EQUAL, <=, setBool)
+                NUMBER_OPERATION(EQUAL, ==, setBool)
+                NUMBER_OPERATION(NOT_EQUAL, !=, setBool)
+#undef NUMBER_OPERATION
+
+            case OpCode::ADD_STRING: {
+                const Value& x = registers[instruction.b];
+                const Value& y =
+                    instruction.flags & Instruction::CONSTANT ? constants[instruction.c] : registers[instruction.c];
+                if (x.type == Value::Type::STRING && y.type == Value::Type::STRING) {
+                    Ref<LoxString> tail = y.asText();
+                    if (instruction.a == instruction.b && x.object.unique()) {
+                        // Nothing else holds the string object, so s = s + t can reuse it.
+                        Ref<LoxString>& text = static_cast<StringObj*>(x.object.get())->text;
+                        text = LoxString::concatenate(std::move(text), tail);
+                    } else {
+                        registers[instruction.a] = Value::string(LoxString::concatenate(x.asText(), tail));
+                    }
+                } else {
+                    deoptimize(instruction, OpCode::ADD);
+                    --ip;
+                }
+                break;
+            }
+
+            case OpCode::NEGATE: {
+                const Value& value = registers[instruction.b];
+                if (!value.isNumber()) {
+                    throwError(line(), "Operand must be a number.");
+                }
+                setNumber(registers[instruction.a], -value.number);
+                break;
+            }
+            case OpCode::NOT:
+                setBool(registers[instruction.a], !registers[instruction.b].isTruthy());
+                break;
+            case OpCode::JUMP:
+                ip = code + instruction.target();
+                break;
+            case OpCode::JUMP_IF_FALSE:
+                if (!registers[instruction.a].isTruthy()) {
+                    ip = code + instruction.target();
+                }
+                break;
+            case OpCode::JUMP_IF_TRUE:
+                if (registers[instruction.a].isTruthy()) {
+                    ip = code + instruction.target();
+                }
+                break;
+
+            case OpCode::CALL: {
+                ClosureObj* function = checkCallee(registers[instruction.b], instruction.c);
+                if (frames.size() >= maxCallDepth) {
+                    throwError(line(), "Stack overflow.");
+                }
+
+                frame->ip = ip;
+                std::size_t base = frame->base + instruction.b + 1;
+                frames.push_back(CallFrame{function, nullptr, base, instruction.a, nullptr});
+                frame = &frames.back();
+                enter(function);
+                break;
+            }
+            case OpCode::TAIL_CALL: {
+                ClosureObj* function = checkCallee(registers[instruction.b], instruction.c);
+                Ref<ClosureObj> hold =
+                    staticRefCast<ClosureObj>(registers[instruction.b].object);
+
+                // The callee takes over this frame; its arguments move down into the parameter registers.
+                std::size_t count = instruction.c;
+                for (std::size_t i = 0; i < count; ++i) {
+                    registers[i] = std::move(registers[instruction.b + 1 + i]);
+                }
+                for (std::size_t i = count; i < closure->proto->registers; ++i) {
+                    registers[i] = Value{};
+                }
+
+                frame->hold = std::move(hold);
+                frame->closure = function;
+                enter(function);
+                break;
+            }
+            case OpCode::RETURN:
+            case OpCode::RETURN_NIL: {
+                Value result;
+                if (instruction.op == OpCode::RETURN) {
+                    result = std::move(registers[instruction.a]);
+                }
+                for (std::size_t i = 0; i < closure->proto->registers; ++i) {
+                    if (registers[i].object != nullptr) {
+                        registers[i].object = nullptr;
+                    }
+                }
+
+                std::uint16_t dest = frame->dest;
+                frames.pop_back();
+                if (frames.empty()) {
+                    return;
+                }
+
+                frame = &frames.back();
+                closure = frame->closure;
+                code = closure->proto->code.data();
+                ip = frame->ip;
+                constants = closure->proto->constants.data();
+                registers = &stack[frame->base];
+                registers[dest] = std::move(result);
+                break;
+            }
+            case OpCode::CLOSURE: {
+                auto function = makeRef<ClosureObj>(closure->proto->prototypes[instruction.b]);
+                function->upvalues.reserve(function->proto->upvalues.size());
+                for (const FunctionStmt::UpvalueSource& source : function->proto->upvalues) {
+                    if (source.isLocal) {
+                        function->upvalues.push_back(staticRefCast<CellObj>(registers[source.index].object));
+                    } else {
+                        function->upvalues.push_back(closure->upvalues[source.index]);
+                    }
+                }
+                registers[instruction.a] = Value{Value::Type::FUNCTION, std::move(function)};
+                break;
+            }
+            case OpCode::PRINT:
+                standardOutput().append(registers[instruction.a].toString());
+                standardOutput().endLine();
+                break;
+        }
+    }
+}
+
+void VM::printStats(std::ostream& out) {
+    std::size_t number = 0;
+    std::size_t string = 0;
+    std::size_t generic = 0;
+    std::size_t unexecuted = 0;
+    for (const std::shared_ptr<Proto>& proto : prototypes) {
+        for (const Instruction& instruction : proto->code) {
+            if (instruction.op >= OpCode::ADD_NUMBER && instruction.op <= OpCode::NOT_EQUAL_NUMBER_CONSTANT) {
+                ++number;
+            } else if (instruction.op == OpCode::ADD_STRING) {
+                ++string;
+            } else if (instruction.op >= OpCode::ADD && instruction.op <= OpCode::NOT_EQUAL) {
+                ++(instruction.flags & Instruction::GENERIC ? generic : unexecuted);
+            }
+        }
+    }
+
+    out << "-- bytecode --\n";
+    out << "instructions dispatched: " << dispatched << "\n";
+    out << "calls: " << calls;
+    if (calls > 0) {
+        out << " (" << dispatched / calls << " instructions per call)";
+    }
+    out << "\n";
+    out << "binary instructions: " << number << " number, " << string << " string, " << generic << " generic, "
+        << unexecuted << " not run\n";
+}
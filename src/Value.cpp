@@ -0,0 +1,43 @@
+#include "../include/Value.h"
+
+#include "../include/Bytecode.h"
+#include "../include/Output.h"
+
+bool Value::equals(const Value& other) const {
+    if (type != other.type) {
+        return false;
+    }
+
+    switch (type) {
+        case Type::NIL:
+            return true;
+        case Type::BOOL:
+            return boolean == other.boolean;
+        case Type::NUMBER:
+            return number == other.number;
+        case Type::STRING:
+            return asString() == other.asString();
+        default:
+            // Like Interpreter::isEqual, functions never compare equal, not even to themselves.
+            return false;
+    }
+}
+
+std::string Value::toString() const {
+    switch (type) {
+        case Type::NIL:
+            return "nil";
+        case Type::BOOL:
+            return boolean ? "true" : "false";
+        case Type::NUMBER: {
+            char text[NUMBER_TEXT_SIZE];
+            return std::string(text, formatNumber(number, text));
+        }
+        case Type::STRING:
+            return asString();
+        case Type::FUNCTION:
+            return "<fn " + static_cast<ClosureObj*>(object.get())->proto->name + ">";
+        default:
+            return "Error in stringify: object type not recognized.";
+    }
+}
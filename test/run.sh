@@ -0,0 +1,91 @@
+#!/bin/sh
+# Runs every test script under each engine and checks what it prints: test/run.sh [path/to/clox]
+#
+# A script gives the standard output it expects as `// expect: text` comments, one per line printed. A script that
+# ends in a runtime error marks the line reporting it with `// expect runtime error: message`; the message and that
+# line go to standard error, and clox exits with 70. `// flags: options` adds options to every run. A script with
+# `// stdin` is typed into the prompt instead, a line at a time with no empty ones, and its "> " prompts are not
+# compared.
+#
+# Scripts without flags or stdin also run through a server started with --serve, sent as a file, twice, and as
+# source; their output and errors come back together. Scripts run from this directory, so they can name the files
+# next to them.
+LOX=${1:-./clox}
+LOX=$(cd "$(dirname "$LOX")" && pwd)/$(basename "$LOX")
+MODES=${MODES:-"default --no-jit --memoize-pure --engine=closure --engine=bytecode"}
+WORK=$(mktemp -d)
+SERVER=
+trap 'test -n "$SERVER" && kill "$SERVER"; rm -rf "$WORK"' EXIT
+
+cd "$(dirname "$0")" || exit 1
+failures=0
+runs=0
+
+fail() {
+    echo "FAIL $1 ($2)"
+    diff "$WORK/expected" "$WORK/actual" | sed 's/^/    /'
+    failures=$((failures + 1))
+}
+
+# Writes the expected output of $1 to $WORK/expected.out, its expected errors to $WORK/expected.err and its expected
+# exit status to $WORK/expected.status.
+expectations() {
+    sed -n 's|.*// expect: ||p' "$1" > "$WORK/expected.out"
+    awk '/\/\/ expect runtime error: / {
+        sub(/.*\/\/ expect runtime error: /, "")
+        printf "%s\n[line %d]", $0, NR
+        error = 1
+    }
+    END { exit !error }' "$1" > "$WORK/expected.err"
+    if [ $? -eq 0 ]; then echo 70; else echo 0; fi > "$WORK/expected.status"
+}
+
+check() {
+    runs=$((runs + 1))
+    cat "$WORK/expected.out" "$WORK/expected.err" > "$WORK/expected"
+    printf "\nexit %s\n" "$(cat "$WORK/expected.status")" >> "$WORK/expected"
+    cat "$WORK/actual.out" "$WORK/actual.err" > "$WORK/actual"
+    printf "\nexit %s\n" "$3" >> "$WORK/actual"
+    cmp -s "$WORK/expected" "$WORK/actual" || fail "$1" "$2"
+}
+
+for script in *.lox; do
+    expectations "$script"
+    flags=$(sed -n 's|^// flags: ||p' "$script")
+    for mode in $MODES; do
+        [ "$mode" = default ] && option= || option=$(echo "$mode" | tr = ' ')
+        if grep -q '^// stdin$' "$script"; then
+            # shellcheck disable=SC2086
+            "$LOX" $option $flags < "$script" > "$WORK/raw.out" 2> "$WORK/actual.err"
+            status=$?
+            sed 's/^\(> \)*//' "$WORK/raw.out" | grep -v '^$' > "$WORK/actual.out"
+        else
+            # shellcheck disable=SC2086
+            "$LOX" $option $flags "$script" > "$WORK/actual.out" 2> "$WORK/actual.err"
+            status=$?
+        fi
+        check "$script" "$mode" "$status"
+    done
+done
+
+"$LOX" --serve "$WORK/socket" --workers 2 &
+SERVER=$!
+while [ ! -S "$WORK/socket" ]; do sleep 0.1; done
+for script in *.lox; do
+    grep -q '^// flags: \|^// stdin$' "$script" && continue
+    expectations "$script"
+    # The file twice, compiling it and then finding it cached, and then its source.
+    for request in file cached source; do
+        if [ "$request" = source ]; then
+            "$LOX" --connect "$WORK/socket" < "$script" > "$WORK/actual.out" 2>&1
+        else
+            "$LOX" --connect "$WORK/socket" "$script" > "$WORK/actual.out" 2>&1
+        fi
+        status=$?
+        : > "$WORK/actual.err"
+        check "$script" "--serve, $request" "$status"
+    done
+done
+
+echo "$runs runs, $failures failed"
+[ "$failures" -eq 0 ]